@@ -19,11 +19,15 @@
 #ifndef CONSOLEVIEW_H_
 #define CONSOLEVIEW_H_
 
+#include <stdio.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include <string>
 
 #include <doclone/Clone.h>
+#include <doclone/Job.h>
+#include <doclone/Stats.h>
 
 /**
  * \enum dcConsoleFunction
@@ -43,6 +47,16 @@
  * 	Server in multicast mode
  * \var CONSOLE_RECEIVE
  * 	Cliente in multicast mode
+ * \var CONSOLE_VERIFY
+ * 	Verify a restored device
+ * \var CONSOLE_LOCAL_CLONE
+ * 	Clone a device to other ones
+ * \var CONSOLE_DUPLICATE
+ * 	Restore an image in many devices at once
+ * \var CONSOLE_SERVE
+ * 	Serve the images of a directory
+ * \var CONSOLE_COLLECT
+ * 	Receive the images of many senders
  */
 enum dcConsoleFunction {
 	CONSOLE_NONE,
@@ -51,7 +65,36 @@ enum dcConsoleFunction {
 	CONSOLE_LINK_SEND,
 	CONSOLE_LINK_RECEIVE,
 	CONSOLE_SEND,
-	CONSOLE_RECEIVE
+	CONSOLE_RECEIVE,
+	CONSOLE_VERIFY,
+	CONSOLE_LOCAL_CLONE,
+	CONSOLE_DUPLICATE,
+	CONSOLE_SERVE,
+	CONSOLE_COLLECT
+};
+
+/**
+ * \var STATS_INTERVAL
+ *
+ * Seconds between the lines written by --stats
+ */
+const unsigned int STATS_INTERVAL = 1;
+
+/**
+ * \struct dcStatsEmitter
+ * \brief State of the thread that writes the stats of the job
+ */
+struct dcStatsEmitter {
+	/// File the lines are written to
+	FILE *file;
+	/// Job whose stats are written
+	Doclone::Job *job;
+	/// Set to stop the thread
+	bool stop;
+	/// Protects stop
+	pthread_mutex_t mutex;
+	/// Signals stop
+	pthread_cond_t cond;
 };
 
 /**
@@ -83,6 +126,9 @@ private:
 	void version() const;
 	void usage (FILE * stream, int code, const char * cmd) const;
 
+	static void *statsThread(void *arg);
+	static void writeStats(FILE *file, const Doclone::dcStats &stats);
+
 	/// Total amount of bytes to be transferred (for calculate the percentage)
 	uint64_t _totalSize;
 
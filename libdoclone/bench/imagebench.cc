@@ -0,0 +1,777 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the paths of the images without block devices: synthetic trees
+ * are created into images and restored with Image::readDirectoryData() and
+ * Image::writeDirectoryData(), which go through the same code as the
+ * partitions of a device, and a file standing for a loop device is copied
+ * with DataTransfer::copyData(), like the raw copies of the partitions. The
+ * images are also relayed with Image::relayImage(), like in the local
+ * fan-out of an image to many devices.
+ *
+ * Every restored tree, the tree of every relayed image and the copied file
+ * are compared with their source, byte for byte, and a case with
+ * differences fails.
+ *
+ * The trees are:
+ * - small: many small files in many directories
+ * - large: a few big files
+ * - links: files with several hard links each
+ * - sparse: big files with only some data regions
+ *
+ * Every case runs in its own process, so the peak RSS is the one of the case.
+ * The results are written as JSON, and compared with the ones of a previous
+ * run: a case is a regression if it is slower, or uses more memory, than
+ * the tolerance allows.
+ *
+ * The trees are written just before reading them, so most of the reads hit
+ * the page cache. Raise the scale for data sets that don't fit in it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <doclone/DataTransfer.h>
+#include <doclone/Image.h>
+#include <doclone/exception/Exception.h>
+
+/// Size of the blocks of data the files are made of
+static const size_t BLOCK_SIZE = 65536;
+
+/// Bytes of a MiB
+static const uint64_t MIB = 1048576;
+
+/**
+ * A tree written by the benchmark
+ */
+struct dcBenchTree {
+	/// Name of the tree, and of its cases
+	const char *name;
+	/// Bytes of the data of the files
+	uint64_t bytes;
+	/// Number of entries of the tree
+	uint64_t files;
+};
+
+/**
+ * The result of a case
+ */
+struct dcBenchResult {
+	std::string name;
+	uint64_t bytes;
+	uint64_t files;
+	double seconds;
+	long peakRss;
+};
+
+/// Data of the files: half random and half zeros, so it compresses like a system
+static char blockData[BLOCK_SIZE];
+
+/**
+ * Fills blockData
+ */
+static void initBlockData() {
+	uint64_t x = 88172645463325252ULL;
+
+	for(size_t i = 0; i < BLOCK_SIZE; i += 8) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+
+		if((i / 4096) % 2 == 0) {
+			memcpy(blockData + i, &x, 8);
+		}
+	}
+}
+
+/**
+ * Seconds of the monotonic clock
+ */
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes a file of the given size at the given offset of blockData, or
+ * only its data regions when the file is sparse
+ */
+static void writeFile(const std::string &path, uint64_t size,
+		uint64_t regionSize = 0, uint64_t regionStep = 0) {
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		perror(path.c_str());
+		exit(1);
+	}
+
+	uint64_t offset = 0;
+	while(offset < size) {
+		uint64_t end = regionStep > 0
+				? offset + regionSize : size;
+		if(end > size) {
+			end = size;
+		}
+
+		while(offset < end) {
+			size_t len = end - offset < BLOCK_SIZE ? end - offset : BLOCK_SIZE;
+			if(pwrite(fd, blockData, len, offset)
+					!= static_cast<ssize_t>(len)) {
+				perror(path.c_str());
+				exit(1);
+			}
+			offset += len;
+		}
+
+		if(regionStep > 0) {
+			offset += regionStep - regionSize;
+		}
+	}
+
+	if(ftruncate(fd, size) < 0) {
+		perror(path.c_str());
+		exit(1);
+	}
+
+	close(fd);
+}
+
+/**
+ * Creates a directory, or exits
+ */
+static void makeDir(const std::string &path) {
+	if(mkdir(path.c_str(), 0755) < 0) {
+		perror(path.c_str());
+		exit(1);
+	}
+}
+
+/**
+ * Writes the tree of the given name under root
+ */
+static dcBenchTree writeTree(const char *name, const std::string &root,
+		unsigned int scale) {
+	dcBenchTree tree = {name, 0, 0};
+	makeDir(root);
+
+	if(!strcmp(name, "small")) {
+		// 20000 files of 4 KiB, in 200 directories
+		for(unsigned int d = 0; d < 200 * scale; d++) {
+			char dir[32];
+			snprintf(dir, sizeof(dir), "/d%u", d);
+			makeDir(root + dir);
+			tree.files++;
+
+			for(unsigned int f = 0; f < 100; f++) {
+				char file[32];
+				snprintf(file, sizeof(file), "/f%u", f);
+				writeFile(root + dir + file, 4096);
+				tree.bytes += 4096;
+				tree.files++;
+			}
+		}
+	} else if(!strcmp(name, "large")) {
+		// 4 files of 64 MiB
+		for(unsigned int f = 0; f < 4; f++) {
+			char file[32];
+			snprintf(file, sizeof(file), "/f%u", f);
+			writeFile(root + file, 64 * MIB * scale);
+			tree.bytes += 64 * MIB * scale;
+			tree.files++;
+		}
+	} else if(!strcmp(name, "links")) {
+		// 2000 files of 16 KiB, with 3 more hard links each
+		for(unsigned int f = 0; f < 2000 * scale; f++) {
+			char file[32];
+			snprintf(file, sizeof(file), "/f%u", f);
+			writeFile(root + file, 16384);
+			tree.bytes += 16384;
+			tree.files++;
+
+			for(unsigned int l = 1; l < 4; l++) {
+				char link[32];
+				snprintf(link, sizeof(link), "/f%u.%u", f, l);
+				if(::link((root + file).c_str(), (root + link).c_str()) < 0) {
+					perror(link);
+					exit(1);
+				}
+				tree.files++;
+			}
+		}
+	} else if(!strcmp(name, "sparse")) {
+		// 16 files of 64 MiB, with 1 MiB of data every 16 MiB
+		for(unsigned int f = 0; f < 16; f++) {
+			char file[32];
+			snprintf(file, sizeof(file), "/f%u", f);
+			writeFile(root + file, 64 * MIB * scale, MIB, 16 * MIB);
+			tree.bytes += 64 * MIB * scale;
+			tree.files++;
+		}
+	}
+
+	return tree;
+}
+
+/**
+ * Removes an entry of a tree, for nftw()
+ */
+static int removeEntry(const char *path, const struct stat *,
+		int, struct FTW *) {
+	return remove(path);
+}
+
+/**
+ * Removes a tree
+ */
+static void removeTree(const std::string &root) {
+	nftw(root.c_str(), removeEntry, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+/// Root of the tree being compared with its copy, for compareEntry()
+static std::string compareSource;
+/// Root of the copy being compared, for compareEntry()
+static std::string compareCopy;
+/// Number of entries that differ from their copy
+static uint64_t compareErrors;
+
+/**
+ * Reads a whole buffer from a file, or less at its end
+ */
+static ssize_t readAll(int fd, char *buf, size_t len) {
+	size_t done = 0;
+
+	while(done < len) {
+		ssize_t nread = read(fd, buf + done, len - done);
+		if(nread < 0) {
+			return -1;
+		} else if(nread == 0) {
+			break;
+		}
+
+		done += nread;
+	}
+
+	return done;
+}
+
+/**
+ * Whether two files have the same data
+ */
+static bool sameData(const std::string &path, const std::string &copy) {
+	int fd = open(path.c_str(), O_RDONLY);
+	int copyFd = open(copy.c_str(), O_RDONLY);
+
+	static char buf[BLOCK_SIZE * 16];
+	static char copyBuf[BLOCK_SIZE * 16];
+	bool same = fd >= 0 && copyFd >= 0;
+	while(same) {
+		ssize_t nread = readAll(fd, buf, sizeof(buf));
+		ssize_t copyRead = readAll(copyFd, copyBuf, sizeof(copyBuf));
+
+		same = nread >= 0 && nread == copyRead
+				&& memcmp(buf, copyBuf, nread) == 0;
+		if(nread <= 0) {
+			break;
+		}
+	}
+
+	if(fd >= 0) {
+		close(fd);
+	}
+
+	if(copyFd >= 0) {
+		close(copyFd);
+	}
+
+	return same;
+}
+
+/**
+ * Compares an entry of a tree with the one of its copy, for nftw()
+ */
+static int compareEntry(const char *path, const struct stat *sb,
+		int type, struct FTW *) {
+	std::string copy = compareCopy + (path + compareSource.length());
+
+	struct stat copyStat;
+	if(lstat(copy.c_str(), &copyStat) < 0
+			|| (sb->st_mode & S_IFMT) != (copyStat.st_mode & S_IFMT)) {
+		fprintf(stderr, "imagebench: %s is not restored\n", copy.c_str());
+		compareErrors++;
+		return 0;
+	}
+
+	if(type != FTW_F || !S_ISREG(sb->st_mode)) {
+		return 0;
+	}
+
+	if(sb->st_size != copyStat.st_size || sb->st_nlink != copyStat.st_nlink
+			|| !sameData(path, copy)) {
+		fprintf(stderr, "imagebench: %s differs from %s\n", copy.c_str(),
+				path);
+		compareErrors++;
+	}
+
+	return 0;
+}
+
+/**
+ * Compares a tree, or a file, with its copy
+ *
+ * \return The number of entries that differ
+ */
+static uint64_t compareTree(const std::string &src, const std::string &copy) {
+	compareSource = src;
+	compareCopy = copy;
+	compareErrors = 0;
+
+	if(nftw(src.c_str(), compareEntry, 64, FTW_PHYS) != 0) {
+		compareErrors++;
+	}
+
+	return compareErrors;
+}
+
+/**
+ * Creates an image of the tree in src
+ */
+static void runCreate(const std::string &src, const std::string &image) {
+	int fd = open(image.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	Doclone::DataTransfer *trns = Doclone::DataTransfer::getInstance();
+	trns->initLocalRead();
+	trns->initLocalWrite();
+
+	Doclone::Image img;
+	img.initDiskReadArchive();
+	img.initFdWriteArchive(fd);
+	img.readDirectoryData(src);
+	img.freeWriteArchive();
+	img.freeReadArchive();
+
+	fsync(fd);
+	close(fd);
+}
+
+/**
+ * Restores the image of a tree in dst
+ */
+static void runRestore(const std::string &image, const std::string &dst) {
+	int fd = open(image.c_str(), O_RDONLY);
+	makeDir(dst);
+
+	Doclone::DataTransfer *trns = Doclone::DataTransfer::getInstance();
+	trns->initLocalRead();
+	trns->initLocalWrite();
+
+	Doclone::Image img;
+	img.initFdReadArchive(fd);
+	img.initDiskWriteArchive();
+	img.writeDirectoryData(dst);
+	img.freeWriteArchive();
+	img.freeReadArchive();
+
+	sync();
+	close(fd);
+}
+
+/**
+ * Relays an image to another one, like to each device of a local fan-out
+ */
+static void runRelay(const std::string &image, const std::string &relayed) {
+	int fdin = open(image.c_str(), O_RDONLY);
+	int fdout = open(relayed.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	Doclone::DataTransfer *trns = Doclone::DataTransfer::getInstance();
+	trns->initLocalRead();
+	trns->initLocalWrite();
+
+	std::vector<int> fds(1, fdout);
+
+	Doclone::Image img;
+	img.initFdReadArchive(fdin);
+	img.initRawWriteArchive(fds);
+	img.relayImage();
+	img.freeWriteArchive();
+	img.freeReadArchive();
+
+	fsync(fdout);
+	close(fdout);
+	close(fdin);
+}
+
+/**
+ * Copies a file standing for a loop device, like a raw copy of a partition
+ */
+static void runTransfer(const std::string &src, const std::string &dst) {
+	int fdin = open(src.c_str(), O_RDONLY);
+	int fdout = open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	Doclone::DataTransfer *trns = Doclone::DataTransfer::getInstance();
+	trns->initLocalRead();
+	trns->initLocalWrite();
+	trns->copyData(fdin, fdout);
+
+	fsync(fdout);
+	close(fdout);
+	close(fdin);
+}
+
+/**
+ * Restores an image in a child process, out of the cases
+ */
+static bool restoreImage(const std::string &image, const std::string &dst) {
+	pid_t pid = fork();
+	if(pid < 0) {
+		perror("imagebench: fork");
+		return false;
+	}
+
+	if(pid == 0) {
+		try {
+			runRestore(image, dst);
+		} catch(const Doclone::Exception &ex) {
+			_exit(1);
+		}
+		_exit(0);
+	}
+
+	int status;
+	return waitpid(pid, &status, 0) == pid && WIFEXITED(status)
+			&& WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Runs a case in a child process
+ *
+ * \param kind
+ * 		create, restore, relay or transfer
+ * \param original
+ * 		The tree, or file, that dst must be a copy of, if any. The image
+ * 		relayed is restored to compare its tree
+ */
+static bool runCase(const std::string &kind, const std::string &name,
+		const std::string &src, const std::string &dst, uint64_t bytes,
+		uint64_t files, std::vector<dcBenchResult> &results,
+		const std::string &original = "") {
+	sync();
+
+	int fds[2];
+	if(pipe(fds) < 0) {
+		perror("imagebench: pipe");
+		return false;
+	}
+
+	pid_t pid = fork();
+	if(pid < 0) {
+		perror("imagebench: fork");
+		return false;
+	}
+
+	if(pid == 0) {
+		close(fds[0]);
+
+		double seconds = now();
+		try {
+			if(kind == "create") {
+				runCreate(src, dst);
+			} else if(kind == "restore") {
+				runRestore(src, dst);
+			} else if(kind == "relay") {
+				runRelay(src, dst);
+			} else {
+				runTransfer(src, dst);
+			}
+		} catch(const Doclone::Exception &ex) {
+			_exit(1);
+		}
+		seconds = now() - seconds;
+
+		ssize_t written = write(fds[1], &seconds, sizeof(seconds));
+		_exit(written == sizeof(seconds) ? 0 : 1);
+	}
+
+	close(fds[1]);
+
+	double seconds = 0;
+	ssize_t nread = read(fds[0], &seconds, sizeof(seconds));
+	close(fds[0]);
+
+	int status;
+	struct rusage usage;
+	if(wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status)
+			|| WEXITSTATUS(status) != 0 || nread != sizeof(seconds)) {
+		fprintf(stderr, "imagebench: %s-%s failed\n", kind.c_str(),
+				name.c_str());
+		return false;
+	}
+
+	// The copies are checked out of the time measured
+	if(!original.empty()) {
+		std::string copy = kind == "relay" ? dst + ".restored" : dst;
+		bool same = (copy == dst || restoreImage(dst, copy))
+				&& compareTree(original, copy) == 0;
+
+		if(copy != dst) {
+			removeTree(copy);
+		}
+
+		if(!same) {
+			fprintf(stderr, "imagebench: %s-%s gave a wrong copy\n",
+					kind.c_str(), name.c_str());
+			return false;
+		}
+	}
+
+	dcBenchResult result;
+	result.name = kind + "-" + name;
+	result.bytes = bytes;
+	result.files = files;
+	result.seconds = seconds;
+	result.peakRss = usage.ru_maxrss;
+	results.push_back(result);
+
+	printf("%-16s %9.1f MiB/s %10.0f files/s %8ld KiB peak RSS\n",
+			result.name.c_str(), bytes / MIB / seconds, files / seconds,
+			result.peakRss);
+	fflush(stdout);
+
+	return true;
+}
+
+/**
+ * Writes the results as JSON, one case per line
+ */
+static bool writeResults(const char *path, unsigned int scale,
+		const std::vector<dcBenchResult> &results) {
+	FILE *file = strcmp(path, "-") ? fopen(path, "w") : stdout;
+	if(file == 0) {
+		perror(path);
+		return false;
+	}
+
+	fprintf(file, "{\"scale\": %u, \"results\": [\n", scale);
+	for(size_t i = 0; i < results.size(); i++) {
+		const dcBenchResult &r = results[i];
+		fprintf(file, "{\"case\": \"%s\", \"bytes\": %llu, \"files\": %llu, "
+				"\"seconds\": %.3f, \"mib_s\": %.1f, \"files_s\": %.0f, "
+				"\"peak_rss_kib\": %ld}%s\n", r.name.c_str(),
+				static_cast<unsigned long long>(r.bytes),
+				static_cast<unsigned long long>(r.files), r.seconds,
+				r.bytes / MIB / r.seconds, r.files / r.seconds, r.peakRss,
+				i + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "]}\n");
+
+	if(file != stdout) {
+		fclose(file);
+	}
+
+	return true;
+}
+
+/**
+ * Gets the number after a key of a line of the results
+ */
+static double getNumber(const char *line, const char *key) {
+	const char *value = strstr(line, key);
+
+	return value != 0 ? atof(value + strlen(key)) : 0;
+}
+
+/**
+ * Compares the results with the ones of a file written by writeResults()
+ *
+ * \return The number of regressions
+ */
+static int compareResults(const char *path, unsigned int scale,
+		unsigned int tolerance, const std::vector<dcBenchResult> &results) {
+	FILE *file = fopen(path, "r");
+	if(file == 0) {
+		perror(path);
+		return -1;
+	}
+
+	// Throughput and peak RSS of each case of the baseline
+	std::map<std::string, std::pair<double, double> > baseline;
+	char line[1024];
+	while(fgets(line, sizeof(line), file) != 0) {
+		if(getNumber(line, "\"scale\": ") != 0
+				&& getNumber(line, "\"scale\": ") != scale) {
+			fprintf(stderr, "imagebench: %s has another scale\n", path);
+		}
+
+		const char *name = strstr(line, "\"case\": \"");
+		if(name == 0) {
+			continue;
+		}
+
+		name += strlen("\"case\": \"");
+		std::string key(name, strcspn(name, "\""));
+		baseline[key] = std::make_pair(getNumber(line, "\"mib_s\": "),
+				getNumber(line, "\"peak_rss_kib\": "));
+	}
+	fclose(file);
+
+	printf("\n%-16s %14s %14s\n", "Against", "throughput", "peak RSS");
+
+	int regressions = 0;
+	for(size_t i = 0; i < results.size(); i++) {
+		const dcBenchResult &r = results[i];
+		std::map<std::string, std::pair<double, double> >::const_iterator it =
+				baseline.find(r.name);
+		if(it == baseline.end() || it->second.first <= 0
+				|| it->second.second <= 0) {
+			printf("%-16s %14s %14s\n", r.name.c_str(), "new", "new");
+			continue;
+		}
+
+		double speed = (r.bytes / MIB / r.seconds) / it->second.first - 1;
+		double memory = r.peakRss / it->second.second - 1;
+		bool regressed = speed * 100 < -static_cast<double>(tolerance)
+				|| memory * 100 > tolerance;
+
+		printf("%-16s %+13.1f%% %+13.1f%%%s\n", r.name.c_str(), speed * 100,
+				memory * 100, regressed ? "  REGRESSION" : "");
+		if(regressed) {
+			regressions++;
+		}
+	}
+
+	return regressions;
+}
+
+static void usage(const char *cmd) {
+	fprintf(stderr, "Usage: %s [ -d DIR ] [ -s SCALE ] [ -o FILE ]"
+			" [ -b FILE ] [ -t PERCENT ]\n"
+			"\t-d\tDirectory the trees are written in, /tmp by default\n"
+			"\t-s\tMultiplies the size of the trees, 1 by default\n"
+			"\t-o\tWrites the results in FILE as JSON, - for the standard\n"
+			"\t\toutput\n"
+			"\t-b\tCompares the results with the ones of FILE\n"
+			"\t-t\tTolerance of the comparison, 10%% by default\n", cmd);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	const char *dir = "/tmp";
+	const char *output = 0;
+	const char *baseline = 0;
+	unsigned int scale = 1;
+	unsigned int tolerance = 10;
+
+	int option;
+	while((option = getopt(argc, argv, "d:s:o:b:t:")) != -1) {
+		switch(option) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 's':
+			scale = atoi(optarg);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'b':
+			baseline = optarg;
+			break;
+		case 't':
+			tolerance = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if(scale == 0) {
+		usage(argv[0]);
+	}
+
+	std::string work = std::string(dir) + "/imagebench-XXXXXX";
+	std::vector<char> workPath(work.begin(), work.end());
+	workPath.push_back('\0');
+	if(mkdtemp(&workPath[0]) == 0) {
+		perror("imagebench: work directory");
+		return 1;
+	}
+	work = &workPath[0];
+
+	initBlockData();
+
+	std::vector<dcBenchResult> results;
+	bool ok = true;
+
+	const char *trees[] = {"small", "large", "links", "sparse"};
+	for(size_t i = 0; i < sizeof(trees) / sizeof(trees[0]); i++) {
+		std::string src = work + "/" + trees[i];
+		std::string image = work + "/" + trees[i] + ".img";
+		std::string dst = work + "/" + trees[i] + ".restored";
+
+		dcBenchTree tree = writeTree(trees[i], src, scale);
+
+		ok = runCase("create", tree.name, src, image, tree.bytes, tree.files,
+				results) && ok;
+		ok = runCase("restore", tree.name, image, dst, tree.bytes, tree.files,
+				results, src) && ok;
+		ok = runCase("relay", tree.name, image, image + ".relayed", tree.bytes,
+				tree.files, results, src) && ok;
+
+		removeTree(src);
+		removeTree(dst);
+		remove(image.c_str());
+		remove((image + ".relayed").c_str());
+	}
+
+	// A file standing for a loop device, copied raw
+	std::string loop = work + "/loop";
+	uint64_t loopSize = 256 * MIB * scale;
+	writeFile(loop, loopSize);
+	ok = runCase("transfer", "loop", loop, loop + ".copy", loopSize, 1,
+			results, loop) && ok;
+
+	remove((loop + ".copy").c_str());
+	remove(loop.c_str());
+	rmdir(work.c_str());
+
+	if(output != 0 && !writeResults(output, scale, results)) {
+		ok = false;
+	}
+
+	if(baseline != 0 && compareResults(baseline, scale, tolerance,
+			results) != 0) {
+		ok = false;
+	}
+
+	return ok ? 0 : 1;
+}
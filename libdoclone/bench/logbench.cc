@@ -0,0 +1,190 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the cost of the traces in the loops of the library: the calls of
+ * Logger with their priority disabled, compared with formatting the message
+ * first as the logger did before, and the copy loop of DataTransfer, which
+ * traces every buffer.
+ *
+ * Built without -DDEBUG_LOOP, loopDebug() costs nothing. The calls whose
+ * priority is enabled aren't measured, so the log of the library isn't
+ * filled with them; the copy loop writes them as usual.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <string>
+
+#include <log4cpp/Category.hh>
+
+#include <doclone/Logger.h>
+#include <doclone/DataTransfer.h>
+#include <doclone/exception/Exception.h>
+
+/// Calls measured for each kind of trace
+static const unsigned int CALLS = 10000000;
+
+/**
+ * Seconds of the monotonic clock
+ */
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * A trace as the logger wrote it before: formatted, then discarded by
+ * log4cpp if its priority is disabled
+ */
+static void formattedTrace(log4cpp::Category *cat, const std::string &msg,
+		...) {
+	char tmpStr[1024];
+
+	va_list vl;
+	va_start(vl, msg);
+	vsnprintf (tmpStr, sizeof(tmpStr), msg.c_str(), vl);
+	va_end (vl);
+
+	std::string str = tmpStr;
+	cat->log(Doclone::LOOP_DEBUG, str);
+}
+
+/**
+ * Prints the time of each call of a kind of trace
+ */
+static void printCalls(const char *name, double seconds) {
+	printf("%-24s %8.2f ns/call\n", name, seconds * 1e9 / CALLS);
+}
+
+/**
+ * Measures the calls of each kind of trace, with the arguments of the ones of
+ * DataTransfer::readBytes()
+ */
+static void runCalls() {
+	Doclone::Logger *log = Doclone::Logger::getInstance();
+	log4cpp::Category *cat = &log4cpp::Category::getInstance("libdoclone");
+	volatile int fd = 3;
+
+	double start;
+
+	if(!log->isEnabled(Doclone::LOOP_DEBUG)) {
+		start = now();
+		for(unsigned int i = 0; i < CALLS; i++) {
+			log->loopDebug("DataTransfer::readBytes(fd=>%d, nbytes=>%d) start",
+					fd, i);
+		}
+		printCalls("loopDebug (disabled)", now() - start);
+	}
+
+	if(!log->isEnabled(log4cpp::Priority::DEBUG)) {
+		start = now();
+		for(unsigned int i = 0; i < CALLS; i++) {
+			log->debug("DataTransfer::readBytes(fd=>%d, nbytes=>%d) start",
+					fd, i);
+		}
+		printCalls("debug (disabled)", now() - start);
+	}
+
+	if(!log->isEnabled(Doclone::LOOP_DEBUG)) {
+		start = now();
+		for(unsigned int i = 0; i < CALLS; i++) {
+			formattedTrace(cat,
+					"DataTransfer::readBytes(fd=>%d, nbytes=>%d) start", fd, i);
+		}
+		printCalls("formatted, discarded", now() - start);
+	}
+}
+
+/**
+ * Copies a sparse file to /dev/null with DataTransfer::copyData()
+ */
+static int runCopy(uint64_t mib) {
+	char path[] = "/tmp/logbench-XXXXXX";
+	int fdin = mkstemp(path);
+	if(fdin < 0 || ftruncate(fdin, mib * 1048576) < 0) {
+		perror("logbench: temporary file");
+		return -1;
+	}
+	unlink(path);
+
+	int fdout = open("/dev/null", O_WRONLY);
+	if(fdout < 0) {
+		perror("logbench: /dev/null");
+		return -1;
+	}
+
+	Doclone::DataTransfer *trns = Doclone::DataTransfer::getInstance();
+	trns->initLocalRead();
+	trns->initLocalWrite();
+
+	double start = now();
+
+	try {
+		trns->copyData(fdin, fdout);
+	} catch(const Doclone::Exception &ex) {
+		fprintf(stderr, "logbench: the copy failed\n");
+		return -1;
+	}
+
+	double seconds = now() - start;
+
+	printf("%-24s %8.1f MiB/s\n", "copyData", mib / seconds);
+
+	close(fdout);
+	close(fdin);
+
+	return 0;
+}
+
+static void usage(const char *cmd) {
+	fprintf(stderr, "Usage: %s [ -s MIB ]\n"
+			"\t-s\tData copied by copyData(), 4096 MiB by default\n", cmd);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	uint64_t mib = 4096;
+
+	int option;
+	while((option = getopt(argc, argv, "s:")) != -1) {
+		switch(option) {
+		case 's':
+			mib = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if(mib == 0) {
+		usage(argv[0]);
+	}
+
+	runCalls();
+
+	return runCopy(mib) < 0 ? 1 : 0;
+}
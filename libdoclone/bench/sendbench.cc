@@ -0,0 +1,223 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the send path of the server over loopback: a sparse file is sent
+ * to many receivers with DataTransfer::copyData(), first copying the data to
+ * the kernel and then with the zero-copy sends. The receivers run in this
+ * process and discard the data.
+ *
+ * On loopback the kernel copies the zero-copy sends anyway, so this measures
+ * their cost in syscalls and notifications. The copies are saved on a real
+ * NIC.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <vector>
+
+#include <doclone/DataTransfer.h>
+#include <doclone/exception/Exception.h>
+
+/// Size of the buffer of the receivers
+static const size_t RECV_BUFFER_SIZE = 1048576;
+
+/**
+ * Receives from a connection until it is closed
+ */
+static void *receiverThread(void *arg) {
+	int fd = *static_cast<int *>(arg);
+	char *buf = static_cast<char *>(malloc(RECV_BUFFER_SIZE));
+
+	while(recv(fd, buf, RECV_BUFFER_SIZE, 0) > 0) {
+	}
+
+	free(buf);
+	close(fd);
+
+	return 0;
+}
+
+/**
+ * Seconds of a clock
+ */
+static double now(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Sends the file to the given number of receivers and prints the results
+ */
+static int runBench(int fdin, uint64_t size, unsigned int receivers,
+		bool zeroCopy) {
+	int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addrSize = sizeof(addr);
+
+	if(listenFd < 0
+			|| bind(listenFd, reinterpret_cast<sockaddr *>(&addr),
+					sizeof(addr)) < 0
+			|| listen(listenFd, receivers) < 0
+			|| getsockname(listenFd, reinterpret_cast<sockaddr *>(&addr),
+					&addrSize) < 0) {
+		perror("sendbench: listen");
+		return -1;
+	}
+
+	std::vector<int> inFds(receivers);
+	std::vector<int> outFds;
+	std::vector<pthread_t> threads(receivers);
+
+	for(unsigned int i = 0; i < receivers; i++) {
+		inFds[i] = socket(AF_INET, SOCK_STREAM, 0);
+		if(connect(inFds[i], reinterpret_cast<sockaddr *>(&addr),
+				sizeof(addr)) < 0) {
+			perror("sendbench: connect");
+			return -1;
+		}
+
+		outFds.push_back(accept(listenFd, 0, 0));
+		pthread_create(&threads[i], 0, receiverThread, &inFds[i]);
+	}
+
+	close(listenFd);
+
+	Doclone::DataTransfer *trns = Doclone::DataTransfer::getInstance();
+	trns->initLocalRead();
+	trns->initSocketWrite();
+
+	if(zeroCopy) {
+		for(unsigned int i = 0; i < receivers; i++) {
+			if(!trns->enableZeroCopy(outFds[i])) {
+				fprintf(stderr, "sendbench: no zero-copy sends here\n");
+				return -1;
+			}
+		}
+	}
+
+	lseek(fdin, 0, SEEK_SET);
+
+	double wall = now(CLOCK_MONOTONIC);
+	double cpu = now(CLOCK_THREAD_CPUTIME_ID);
+
+	try {
+		trns->copyData(fdin, outFds);
+	} catch(const Doclone::Exception &ex) {
+		fprintf(stderr, "sendbench: the copy failed\n");
+		return -1;
+	}
+
+	cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+
+	for(unsigned int i = 0; i < receivers; i++) {
+		trns->disableZeroCopy(outFds[i]);
+		shutdown(outFds[i], SHUT_WR);
+	}
+
+	for(unsigned int i = 0; i < receivers; i++) {
+		pthread_join(threads[i], 0);
+		close(outFds[i]);
+	}
+
+	wall = now(CLOCK_MONOTONIC) - wall;
+
+	double mib = static_cast<double>(size) * receivers / 1048576;
+	printf("%-9s %3u receivers %8.1f MiB/s %6.2f s CPU %6.3f s/GiB\n",
+			zeroCopy ? "zerocopy" : "copy", receivers, mib / wall, cpu,
+			cpu * 1024 / mib);
+
+	return 0;
+}
+
+static void usage(const char *cmd) {
+	fprintf(stderr, "Usage: %s [ -r RECEIVERS ] [ -s MIB ] [ -c | -z ]\n"
+			"\t-r\tReceivers the data is sent to, 4 by default\n"
+			"\t-s\tData sent to each receiver, 1024 MiB by default\n"
+			"\t-c\tOnly the path that copies the data\n"
+			"\t-z\tOnly the zero-copy path\n", cmd);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	unsigned int receivers = 4;
+	uint64_t mib = 1024;
+	bool copy = true;
+	bool zeroCopy = true;
+
+	int option;
+	while((option = getopt(argc, argv, "r:s:cz")) != -1) {
+		switch(option) {
+		case 'r':
+			receivers = atoi(optarg);
+			break;
+		case 's':
+			mib = atoi(optarg);
+			break;
+		case 'c':
+			zeroCopy = false;
+			break;
+		case 'z':
+			copy = false;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if(receivers == 0 || mib == 0) {
+		usage(argv[0]);
+	}
+
+	// A sparse file: the reads are the same in both paths and cost no I/O
+	char path[] = "/tmp/sendbench-XXXXXX";
+	int fdin = mkstemp(path);
+	if(fdin < 0 || ftruncate(fdin, mib * 1048576) < 0) {
+		perror("sendbench: temporary file");
+		return 1;
+	}
+	unlink(path);
+
+	int retVal = 0;
+	if(copy && runBench(fdin, mib * 1048576, receivers, false) < 0) {
+		retVal = 1;
+	}
+	if(zeroCopy && runBench(fdin, mib * 1048576, receivers, true) < 0) {
+		retVal = 1;
+	}
+
+	close(fdin);
+
+	return retVal;
+}
@@ -0,0 +1,106 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BASEIMAGEINDEX_H_
+#define BASEIMAGEINDEX_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <string>
+
+#include <archive.h>
+
+#include <doclone/exception/Exception.h>
+
+namespace Doclone {
+
+/**
+ * \struct dcBaseFile
+ * \brief A regular file of the base image
+ *
+ * \var dcBaseFile::size
+ * 	Size of the file
+ * \var dcBaseFile::mtime
+ * 	Modification time, in seconds
+ * \var dcBaseFile::mtimeNsec
+ * 	Nanoseconds of the modification time
+ * \var dcBaseFile::ino
+ * 	Inode of the file, 0 if the image doesn't have it
+ * \var dcBaseFile::linked
+ * 	If the entry is a hard link, which is never reused
+ * \var dcBaseFile::kept
+ * 	If the file has not changed since the base image was created
+ * \var dcBaseFile::crc
+ * 	CRC32C of the data, from the manifest of the base image
+ * \var dcBaseFile::hasCrc
+ * 	If the file is in the manifest of the base image
+ */
+typedef struct {
+	uint64_t size;
+	int64_t mtime;
+	long mtimeNsec;
+	uint64_t ino;
+	bool linked;
+	bool kept;
+	uint32_t crc;
+	bool hasCrc;
+} dcBaseFile;
+
+/**
+ * \class BaseImageIndex
+ * \brief Index of the regular files of a full image, used as the base of an
+ * incremental one
+ *
+ * While an incremental image is created, the files with the same size,
+ * modification time and inode than in the base image are left out of it.
+ * The rest of regular files of the base are written in the list of removed
+ * files of the incremental image, which is skipped when the base is restored
+ * with it. The files left out keep their checksums of the manifest of the
+ * base, so the one of the incremental image lists the whole tree.
+ *
+ * \date October, 2026
+ */
+class BaseImageIndex {
+public:
+	BaseImageIndex();
+
+	void load(const std::string &base) throw(Exception);
+
+	bool keep(const std::string &path, const struct stat &filestat);
+	bool getChecksum(const std::string &path, uint32_t &crc) const;
+	void writeRemoved(FILE *file) const throw(Exception);
+
+	uint32_t getBaseId() const;
+
+	static uint32_t readHeader(struct archive *arch) throw(Exception);
+
+private:
+	void loadManifest(struct archive *arch) throw(Exception);
+
+	/// Files of the base image, by their path in the image
+	std::map<std::string, dcBaseFile> _files;
+	/// Checksum of the header of the base image
+	uint32_t _baseId;
+};
+
+}
+
+#endif /* BASEIMAGEINDEX_H_ */
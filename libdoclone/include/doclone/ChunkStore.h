@@ -0,0 +1,100 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHUNKSTORE_H_
+#define CHUNKSTORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include <archive.h>
+
+#include <doclone/exception/Exception.h>
+
+namespace Doclone {
+
+/**
+ * \struct dcChunkRef
+ * \brief A chunk of a file stored in a repository
+ */
+struct dcChunkRef {
+	/// SHA-256 of the data of the chunk, in hexadecimal
+	std::string hash;
+	/// Size of the data of the chunk
+	size_t size;
+};
+
+/**
+ * \class ChunkStore
+ * \brief Repository of deduplicated file data
+ *
+ * The files are split in content-defined chunks by Chunker. Each chunk is
+ * stored once, compressed with zlib, in the file chunks/XX/HASH of the
+ * repository, where HASH is the SHA-256 of its data and XX its first two
+ * characters.
+ *
+ * A file is referenced in an image by its chunk list, a text with a line for
+ * each chunk with its hash and its size, separated by a space.
+ *
+ * \date October, 2026
+ */
+class ChunkStore {
+public:
+	ChunkStore(const std::string &dir);
+	~ChunkStore();
+
+	void open() throw(Exception);
+
+	uint64_t storeFile(int fd, std::string &list, uint32_t &crc)
+			throw(Exception);
+	uint64_t writeFile(const std::string &list,
+			std::vector<struct archive*> &outArchives) throw(Exception);
+
+	static uint64_t parseList(const std::string &list,
+			std::vector<dcChunkRef> &chunks) throw(Exception);
+
+	uint64_t getNewBytes() const;
+	uint64_t getReusedBytes() const;
+	uint64_t getWrittenBytes() const;
+
+private:
+	std::string chunkPath(const std::string &hash) const;
+	bool hasChunk(const std::string &hash) const;
+	void storeChunk(const std::string &hash, const char *buf, size_t len)
+			throw(Exception);
+	void loadChunk(const dcChunkRef &chunk, std::string &data)
+			throw(Exception);
+
+	/// Directory of the repository
+	std::string _dir;
+	/// Buffer for the compressed chunks
+	std::vector<char> _compressed;
+	/// Bytes of data of the new chunks
+	uint64_t _newBytes;
+	/// Bytes of data of the chunks already in the repository
+	uint64_t _reusedBytes;
+	/// Compressed bytes written in the repository
+	uint64_t _writtenBytes;
+};
+
+}
+
+#endif /* CHUNKSTORE_H_ */
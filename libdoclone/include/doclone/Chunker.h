@@ -0,0 +1,67 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHUNKER_H_
+#define CHUNKER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace Doclone {
+
+/**
+ * \var CHUNK_MIN_SIZE
+ *
+ * No chunk is smaller than this, except the last one of a file
+ */
+const size_t CHUNK_MIN_SIZE = 16384;
+
+/**
+ * \var CHUNK_AVG_SIZE
+ *
+ * Size the chunks are normalized to
+ */
+const size_t CHUNK_AVG_SIZE = 65536;
+
+/**
+ * \var CHUNK_MAX_SIZE
+ *
+ * No chunk is bigger than this
+ */
+const size_t CHUNK_MAX_SIZE = 262144;
+
+/**
+ * \class Chunker
+ * \brief Splits data in content-defined chunks with FastCDC
+ *
+ * The boundaries depend only on the bytes around them, so an insertion in a
+ * file only changes the chunks near it.
+ *
+ * \date October, 2026
+ */
+class Chunker {
+public:
+	static size_t findBoundary(const uint8_t *buf, size_t len);
+
+private:
+	static void initGear();
+};
+
+}
+
+#endif /* CHUNKER_H_ */
@@ -20,6 +20,7 @@
 #define CLONE_H_
 
 #include <stdint.h>
+#include <pthread.h>
 
 #include <string>
 #include <vector>
@@ -43,6 +44,16 @@ namespace Doclone {
  * Doclone::Clone *dcl = Doclone::Clone::getInstance();
  * \endcode
  *
+ * That object belongs to the job bound to the calling thread, or to a default
+ * job. To run many jobs at the same time, each thread must create and bind
+ * its own Job before calling getInstance():
+ *
+ * \code
+ * Doclone::Job job;
+ * job.bind();
+ * Doclone::Clone *dcl = Doclone::Clone::getInstance();
+ * \endcode
+ *
  * It is possible to subscribe the events of the library. These can be used to
  * know the operations progress and possible incidences. To do this, some
  * functions must be implemented with the proper prototype.
@@ -120,6 +131,18 @@ namespace Doclone {
  * - nodes number (int): The number of receivers
  * - empty (int): Clone the partition table without reading/writing the data (true or false)
  * - force (int): Force working even if the image doesn't fit in the destination device (true or false)
+ * - memory limit (int): Memory budget of the job in MiB, 0 for no limit
+ * - base (char*): Full image an incremental image is created from or restored with
+ * - repository (char*): Directory where the data of the files is deduplicated
+ * - sync (int): Restore only the changes into the filesystems of the device (true or false)
+ * - targets (char*): The device paths a device or an image is cloned to
+ * - remote image (char*): Name of the image requested to an image server
+ * - writers (int): Images a collector writes at the same time, 0 for the default
+ * - quorum (int): Receivers a server waits for before sending, 0 for all of them
+ * - streams (int): TCP connections each receiver is sent the data on
+ * - socket buffer (int): Size of the buffers of the sockets in KiB, 0 for the default
+ * - zero copy (int): Send the data without copying it to the kernel (true or false)
+ * - trace (char*): File a timeline of the job is written in, see Tracer
  *
  * These are some setters for configuring the properties:
  *
@@ -131,6 +154,28 @@ namespace Doclone {
  * 	void setAddress(const std::string &address);
  * 	void setInterface(const std::string &interface);
  * 	void setForce(bool force);
+ * 	void setMemoryLimit(unsigned int memoryLimit);
+ * 	void setBase(const std::string &base);
+ * 	void setRepository(const std::string &repository);
+ * 	void setSync(bool sync);
+ * 	void setTarget(const std::string &target);
+ * 	void addTarget(const std::string &target);
+ * 	void setRemoteImage(const std::string &remoteImage);
+ * 	void setWriters(unsigned int writers);
+ * 	void setQuorum(unsigned int quorum);
+ * 	void setStreams(unsigned int streams);
+ * 	void setSocketBuffer(unsigned int socketBuffer);
+ * 	void setZeroCopy(bool zeroCopy);
+ * 	void setTrace(const std::string &trace);
+ * \endcode
+ *
+ * The events are delivered to the observers by a thread of the library, not
+ * by the ones that transfer the data, so the observers don't slow the
+ * transfers down. The TRANSFERRED_BYTES events are coalesced, and delivered
+ * at most as many times per second as set with:
+ *
+ * \code
+ * 	void setEventRate(unsigned int eventRate);
  * \endcode
  *
  * The last step is to call one of the methods that perform the work:
@@ -138,8 +183,13 @@ namespace Doclone {
  * \code
  * 	void create() throw(Exception);
  * 	void restore() throw(Exception);
+ * 	void verify() throw(Exception);
+ * 	void localClone() throw(Exception);
+ * 	void duplicate() throw(Exception);
  * 	void send() throw(Exception);
  * 	void receive() throw(Exception);
+ * 	void serve() throw(Exception);
+ * 	void collect() throw(Exception);
  * 	void chainOrigin() throw(Exception);
  * 	void chainLink() throw(Exception);
  * \endcode
@@ -235,9 +285,10 @@ namespace Doclone {
  *
  * Also during the execution, the library user can call to the function
  * getTransferredBytes() to know how much data has been written/read at until
- * the moment.
+ * the moment. Stats::getSnapshot() gives the rates, the ETA and the time
+ * spent in each stage of the job, and it can be called from any thread.
  *
- * This class is singleton.
+ * There is one for each job, see Job.
  */
 class Clone : public AbstractSubject {
 public:
@@ -246,8 +297,13 @@ public:
 
 	void create() throw(Exception);
 	void restore() throw(Exception);
+	void verify() throw(Exception);
+	void localClone() throw(Exception);
+	void duplicate() throw(Exception);
 	void send() throw(Exception);
 	void receive() throw(Exception);
+	void serve() throw(Exception);
+	void collect() throw(Exception);
 	void chainOrigin() throw(Exception);
 	void chainLink() throw(Exception);
 
@@ -265,15 +321,51 @@ public:
 	void setInterface(const std::string &interface);
 	bool getForce() const;
 	void setForce(bool force);
+	unsigned int getMemoryLimit() const;
+	void setMemoryLimit(unsigned int memoryLimit);
+	const std::string &getBase() const;
+	void setBase(const std::string &base);
+	const std::string &getRepository() const;
+	void setRepository(const std::string &repository);
+	bool getSync() const;
+	void setSync(bool sync);
+	const std::vector<std::string> &getTargets() const;
+	void setTarget(const std::string &target);
+	void addTarget(const std::string &target);
+	const std::string &getRemoteImage() const;
+	void setRemoteImage(const std::string &remoteImage);
+	unsigned int getWriters() const;
+	void setWriters(unsigned int writers);
+	unsigned int getQuorum() const;
+	void setQuorum(unsigned int quorum);
+	unsigned int getStreams() const;
+	void setStreams(unsigned int streams);
+	unsigned int getSocketBuffer() const;
+	void setSocketBuffer(unsigned int socketBuffer);
+	bool getZeroCopy() const;
+	void setZeroCopy(bool zeroCopy);
+	const std::string &getTrace() const;
+	void setTrace(const std::string &trace);
+	unsigned int getEventRate() const;
+	void setEventRate(unsigned int eventRate);
+
+	uint64_t getPeakMemory() const;
 
 	void addOperation(Operation *op);
+	void markStarted(dcOperationType type, const std::string &target);
 	void markCompleted(dcOperationType type, const std::string &target);
 	Operation* getOperation(dcOperationType type, const std::string &target);
 
 	void triggerEvent(dcEvent event, const std::string &target);
 protected:
-	/// Private constructor for singleton pattern
+	/// Only the Job creates its Clone
 	Clone();
+	friend class Job;
+
+	static void initProcess();
+
+	void initMemoryLimit() const;
+	void logPeakMemory() const;
 
 	/// Image path entered by the user
 	std::string _image;
@@ -289,9 +381,35 @@ protected:
 	bool _empty;
 	/// Mode force enabled/disabled
 	bool _force;
+	/// Memory budget of the job in MiB, 0 for no limit
+	unsigned int _memoryLimit;
+	/// Base image path entered by the user, empty for full images
+	std::string _base;
+	/// Repository path entered by the user, empty to keep the data in the image
+	std::string _repository;
+	/// Sync mode enabled/disabled
+	bool _sync;
+	/// Target device paths entered by the user, for local clones
+	std::vector<std::string> _targets;
+	/// Image requested to an image server, empty for a Unicast server
+	std::string _remoteImage;
+	/// Images a collector writes at the same time, 0 for the default
+	unsigned int _writers;
+	/// Receivers a server waits for before sending, 0 for all of them
+	unsigned int _quorum;
+	/// TCP connections each receiver is sent the data on, 0 for one
+	unsigned int _streams;
+	/// Size of the buffers of the sockets in KiB, 0 for the default
+	unsigned int _socketBuffer;
+	/// Zero-copy sends enabled/disabled
+	bool _zeroCopy;
+	/// File the timeline of the job is written in, empty for none
+	std::string _trace;
 
 	/// Vector with the state of the execution
 	std::vector<Operation *> _operations;
+	/// Protects _operations, which the threads of a local clone share
+	pthread_mutex_t _operationsMutex;
 };
 
 }
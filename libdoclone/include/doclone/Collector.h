@@ -0,0 +1,148 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef COLLECTOR_H_
+#define COLLECTOR_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <doclone/Node.h>
+#include <doclone/exception/Exception.h>
+
+namespace Doclone {
+
+/**
+ * \var COLLECTOR_WRITERS
+ *
+ * Images written at the same time by a collector, if the job doesn't set it
+ */
+const unsigned int COLLECTOR_WRITERS = 4;
+
+/**
+ * \var COLLECTOR_EXTENSION
+ *
+ * Extension of the images written by a collector
+ */
+const char COLLECTOR_EXTENSION[] = ".doclone";
+
+/**
+ * \var COLLECTOR_PARTIAL_EXTENSION
+ *
+ * Extension of an image while it is being received. It's renamed when the
+ * whole image has been received, so a failed stream doesn't replace the
+ * previous image of the same sender.
+ */
+const char COLLECTOR_PARTIAL_EXTENSION[] = ".part";
+
+/**
+ * \class Collector
+ * \brief Receives the images of many senders at the same time
+ *
+ * Unlike Unicast, where the receivers connect to the sender, the collector
+ * listens and many senders connect to it, each one with the name of its
+ * image (see C_SENDER_OK). Every stream is written to its own image file in
+ * the directory of the collector, by a pool of writing threads, each one
+ * with its own Job.
+ *
+ * The size of the pool limits the streams written at the same time. Also, a
+ * stream is only admitted when the free space of the directory, minus the
+ * space still needed by the other streams, is enough for it. Until then, its
+ * data is not read, so its sender waits.
+ *
+ * \date October, 2026
+ */
+class Collector : public Node {
+public:
+	Collector();
+	~Collector();
+
+	void collect() throw(Exception);
+
+private:
+	void listenSenders() throw(Exception);
+	void startWriters() throw(Exception);
+	void stopWriters(bool abort);
+
+	static void *writerThread(void *arg);
+	void work();
+	void receiveImage(int fd) throw(Exception);
+
+	static bool isComplete(int imageFd);
+	std::string getPartialPath(const std::string &name) const;
+	bool admit(const std::string &name, uint64_t size);
+	void release(const std::string &name);
+	uint64_t pendingBytes() const;
+
+	/**
+	 * \brief Releases an image when the stream ends, however it ends
+	 */
+	class Reservation {
+	public:
+		Reservation(Collector *collector, const std::string &name);
+		~Reservation();
+
+	private:
+		/// The collector receiving the image
+		Collector *_collector;
+		/// Name of the image
+		std::string _name;
+	};
+	friend class Reservation;
+
+	/// Senders to attend before finishing, 0 to collect forever
+	unsigned int _nodesNum;
+	/// Number of writing threads
+	unsigned int _writersNum;
+	/// Listening socket
+	int _listenFd;
+	/// Bytes the pool of each writer can allocate, 0 for unlimited
+	uint64_t _poolLimit;
+
+	/// The writing threads
+	std::vector<pthread_t> _threads;
+	/// Connections accepted and not attended yet
+	std::deque<int> _queue;
+	/// Connections being attended by the writers
+	std::set<int> _connections;
+	/// Set when no more connections will be accepted
+	bool _done;
+	/// Set when the streams being received must be interrupted
+	bool _aborted;
+	/// Names of the images being received
+	std::set<std::string> _names;
+	/// Expected size of each image being written, by its name
+	std::map<std::string, uint64_t> _admitted;
+	/// Protects all the above
+	pthread_mutex_t _mutex;
+	/// Signals new connections in the queue, or the end of them
+	pthread_cond_t _notEmpty;
+	/// Signals the end of a stream, which frees its reserved space
+	pthread_cond_t _released;
+};
+
+}
+
+#endif /* COLLECTOR_H_ */
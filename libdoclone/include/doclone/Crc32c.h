@@ -0,0 +1,56 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CRC32C_H_
+#define CRC32C_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace Doclone {
+
+/**
+ * \class Crc32c
+ * \brief Computes CRC32C (Castagnoli) checksums
+ *
+ * Uses the crc32 instruction of SSE 4.2 when the processor has it, and a
+ * slicing-by-8 table otherwise. The checksum of a run of zeros, like the
+ * holes of a sparse file, is computed without reading them.
+ *
+ * \date October, 2026
+ */
+class Crc32c {
+public:
+	static uint32_t compute(const void *buf, size_t len);
+	static uint32_t update(uint32_t crc, const void *buf, size_t len);
+	static uint32_t updateZeros(uint32_t crc, uint64_t len);
+	static uint32_t combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+
+	static bool isHardwareAccelerated();
+
+private:
+	static uint32_t updateSoftware(uint32_t crc, const uint8_t *buf,
+			size_t len);
+	static uint32_t updateHardware(uint32_t crc, const uint8_t *buf,
+			size_t len);
+	static void initTables();
+};
+
+}
+
+#endif /* CRC32C_H_ */
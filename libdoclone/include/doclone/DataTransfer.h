@@ -20,9 +20,12 @@
 #define DATATRANSFER_H_
 
 #include <stdint.h>
+#include <time.h>
 #include <sys/types.h>
+#include <pthread.h>
 
 #include <map>
+#include <utility>
 #include <vector>
 
 #include <archive.h>
@@ -42,17 +45,256 @@ typedef off_t dcBuffSize;
 /**
  * \var BUFFER_SIZE
  *
- * Size of data buffer
+ * Size of the small buffers used for metadata. The data buffers are sized at
+ * runtime, see DataTransfer::setBufferSize()
  */
 const dcBuffSize BUFFER_SIZE = 10240;
 
+/**
+ * \var MIB
+ *
+ * Number of bytes of one mebibyte. The size of the data buffers is set in
+ * multiples of this.
+ */
+const dcBuffSize MIB = 1048576;
+
+/**
+ * \enum dcBufferPath
+ * \brief The kind of data path a buffer is used for
+ *
+ * \var BUFFER_DISK
+ * 	Reading or writing local files and devices
+ * \var BUFFER_SOCKET
+ * 	Sending or receiving data over the network
+ * \var BUFFER_ARCHIVE
+ * 	Blocks read or written by libarchive
+ */
+enum dcBufferPath {
+	BUFFER_DISK,
+	BUFFER_SOCKET,
+	BUFFER_ARCHIVE
+};
+
+/**
+ * \var DISK_BUFFER_MIB
+ *
+ * Default size of the disk buffers, in MiB
+ */
+const unsigned int DISK_BUFFER_MIB = 4;
+
+/**
+ * \var SOCKET_BUFFER_MIB
+ *
+ * Default size of the socket buffers, in MiB
+ */
+const unsigned int SOCKET_BUFFER_MIB = 1;
+
+/**
+ * \var ARCHIVE_BUFFER_MIB
+ *
+ * Default size of the libarchive blocks, in MiB
+ */
+const unsigned int ARCHIVE_BUFFER_MIB = 1;
+
+/**
+ * \var MEMORY_POOL_QUOTIENT
+ *
+ * When the job has a memory limit, the pool of buffers can use the limit
+ * divided by this value
+ */
+const unsigned int MEMORY_POOL_QUOTIENT = 2;
+
+/**
+ * \var POOL_BUFFERS
+ *
+ * Number of buffers that must fit in a limited pool: two for the read-ahead,
+ * one for libarchive and one spare
+ */
+const unsigned int POOL_BUFFERS = 4;
+
+/**
+ * \var CHECKSUM_CHUNK_SIZE
+ *
+ * Maximum number of data bytes covered by each checksum of a checksummed
+ * stream
+ */
+const dcBuffSize CHECKSUM_CHUNK_SIZE = 1048576;
+
+/**
+ * \typedef dcDataRegion
+ *
+ * Offset and length of a region of a file with data, between its holes
+ */
+typedef std::pair<uint64_t, uint64_t> dcDataRegion;
+
+/**
+ * \var DELTA_BLOCK_SIZE
+ *
+ * Size of the blocks compared when the data of a file is written over an
+ * existing one. Only the blocks that differ are written.
+ */
+const dcBuffSize DELTA_BLOCK_SIZE = 4096;
+
+/**
+ * \enum dcFrameType
+ * \brief Types of the frames of a framed stream, see dcChecksumState
+ *
+ * The payloads are in big-endian.
+ *
+ * \var FRAME_DATA
+ * 	Data of the stream
+ * \var FRAME_CONTROL
+ * 	A control message: a uint8_t code and its arguments. The codes that the
+ * 	receiver doesn't know are ignored
+ * \var FRAME_CHECKSUM
+ * 	The bytes of data sent until now, in a uint64_t, and their CRC32C
+ * \var FRAME_STATS
+ * 	Statistics of the sender: the bytes of data sent until now and the
+ * 	seconds since the stream started, both in a uint64_t
+ * \var FRAME_END
+ * 	End of the stream: the bytes of data, the number of data frames, both in
+ * 	a uint64_t, and the CRC32C of all the data
+ */
+enum dcFrameType {
+	FRAME_DATA = 0,
+	FRAME_CONTROL,
+	FRAME_CHECKSUM,
+	FRAME_STATS,
+	FRAME_END
+};
+
+/**
+ * \var FRAME_VERSION
+ *
+ * Version of the framed streams written by this library. 0 means plain
+ * chunks, without frame types
+ */
+const uint8_t FRAME_VERSION = 1;
+
+/**
+ * \typedef dcFrameCaps
+ *
+ * Optional frames that are sent in a framed stream
+ */
+typedef uint32_t dcFrameCaps;
+
+/**
+ * \var FRAME_CAP_CHECKSUM
+ *
+ * A FRAME_CHECKSUM is sent every FRAME_CHECKSUM_INTERVAL bytes of data
+ */
+const dcFrameCaps FRAME_CAP_CHECKSUM = 1 << 0;
+
+/**
+ * \var FRAME_CAP_STATS
+ *
+ * A FRAME_STATS is sent every FRAME_STATS_INTERVAL seconds
+ */
+const dcFrameCaps FRAME_CAP_STATS = 1 << 1;
+
+/**
+ * \var FRAME_CAPS
+ *
+ * Optional frames known by this library
+ */
+const dcFrameCaps FRAME_CAPS = FRAME_CAP_CHECKSUM | FRAME_CAP_STATS;
+
+/**
+ * \var FRAME_CHECKSUM_INTERVAL
+ *
+ * Bytes of data between two FRAME_CHECKSUM
+ */
+const uint64_t FRAME_CHECKSUM_INTERVAL = 64 * 1048576;
+
+/**
+ * \var FRAME_STATS_INTERVAL
+ *
+ * Seconds between two FRAME_STATS
+ */
+const unsigned int FRAME_STATS_INTERVAL = 5;
+
+/**
+ * \var FRAME_MAX_PAYLOAD
+ *
+ * Maximum length of the frames that are not FRAME_DATA
+ */
+const size_t FRAME_MAX_PAYLOAD = 4096;
+
+/**
+ * \struct dcChecksumState
+ * \brief State of a checksummed stream on a descriptor
+ *
+ * On the wire, a checksummed stream is a sequence of chunks. Each chunk has
+ * an 8 bytes header with its length and the CRC32C of its data, both in
+ * big-endian, followed by the data. A chunk of length 0 ends the stream.
+ *
+ * In a framed stream, whose version is not 0, the chunks are frames: the
+ * high byte of the length is their type, see dcFrameType, and the CRC32C
+ * covers their payload. The data chunks are FRAME_DATA, so they are the same
+ * as in the plain streams. The stream ends with a FRAME_END, which lets the
+ * receiver check that no chunk has been lost.
+ */
+struct dcChecksumState {
+	/// Number of chunks sent or received
+	uint64_t chunks;
+	/// Number of data bytes sent or received
+	uint64_t offset;
+	/// Version of the framed stream, 0 for plain chunks
+	uint8_t version;
+	/// Optional frames sent in the stream
+	dcFrameCaps caps;
+	/// CRC32C of all the data sent or received, in framed streams
+	uint32_t crc;
+	/// Data bytes covered by the last FRAME_CHECKSUM
+	uint64_t checkedOffset;
+	/// When the stream started
+	time_t started;
+	/// When the last FRAME_STATS was sent
+	time_t statsTime;
+	/// Received chunk that didn't fit in the buffer of the caller
+	char *stage;
+	/// Valid bytes in stage
+	size_t stageLen;
+	/// Bytes of stage already given to the caller
+	size_t stagePos;
+	/// Whether the end of the stream has been received
+	bool finished;
+};
+
+/**
+ * \var ZEROCOPY_MIN_SIZE
+ *
+ * Smaller writes are copied even on the sockets with zero-copy sends, since
+ * pinning their pages costs more than copying them
+ */
+const size_t ZEROCOPY_MIN_SIZE = 16384;
+
+/**
+ * \struct dcZeroCopyState
+ * \brief State of a socket that sends the data buffers with MSG_ZEROCOPY
+ *
+ * The kernel reads a buffer sent this way after send() returns, so it can't
+ * be reused until the kernel notifies that it is done with it. The kernel
+ * numbers the sends of each socket from 0, and queues the notifications,
+ * with ranges of these numbers, in the error queue of the socket.
+ */
+struct dcZeroCopyState {
+	/// Number of sends made with MSG_ZEROCOPY
+	uint32_t issued;
+	/// Number of them that the kernel has notified
+	uint32_t completed;
+	/// Number of them whose data the kernel copied anyway
+	uint32_t copied;
+};
+
 /**
  * \var UPDATE_QUOTIENT
  *
  * The observer is notified every time the current amount of transferred data
- * exceeds a multiple of (BUFFER_SIZE * UPDATE_QUOTIENT)
+ * exceeds a multiple of (BUFFER_SIZE * UPDATE_QUOTIENT). The Notifier
+ * coalesces these events, so this only bounds the cost of raising them
  */
-const unsigned int UPDATE_QUOTIENT = 15360;
+const unsigned int UPDATE_QUOTIENT = 100;
 
 /**
  * \typedef readFunction
@@ -81,22 +323,62 @@ typedef ssize_t (*writeFunction) (int, const void*, size_t);
  * receivers. For this reason, this class has the map of descriptors
  * this->_fdd, with its corresponding IP addresses.
  *
- * This class is singleton.
+ * The data buffers are page-aligned, allocated on the heap and kept in a pool
+ * to be reused by the next transfers. Their size can be set for each kind of
+ * data path with setBufferSize(). When copying from a descriptor, a second
+ * thread reads the next buffer while the current one is being written.
+ * The pool can be limited with setPoolLimit(), then the buffers shrink to fit
+ * in the limit and the allocations beyond it fail.
+ *
+ * The data sent through a descriptor registered with enableChecksums() is
+ * split in chunks with a CRC32C each, see dcChecksumState. readData() and
+ * writeData() add and verify the checksums on these descriptors, and
+ * behave as getNbytes and putNbytes on the others. If both ends know a
+ * version of the framed streams, control frames are sent between the data
+ * chunks, see dcFrameType.
+ *
+ * patchData() writes the data of an entry over an existing file, only in the
+ * blocks whose content has changed, see DELTA_BLOCK_SIZE.
+ *
+ * The holes of sparse files are found with getDataRegions(), and
+ * sparseToArchive() reads only the data around them.
+ *
+ * relayData() copies the entries of an image to other images without
+ * decoding them again, for the local fan-out of an image to many devices.
+ *
+ * The sockets registered with enableZeroCopy() are sent the data of
+ * copyData() with MSG_ZEROCOPY: every destination is sent the same buffer of
+ * the pool, which the kernel reads without copying it. The buffer goes back
+ * to the reading thread once the kernel has notified all these sends, see
+ * dcZeroCopyState.
+ *
+ * There is one for each job, see Job.
  * \date August, 2011
  */
 class DataTransfer : public AbstractSubject {
 public:
-	~DataTransfer() {}
+	~DataTransfer();
 	static DataTransfer* getInstance();
 
 	uint64_t archiveToBuf(struct archive *arIn, std::string &target) throw(Exception);
 	uint64_t bufToArchive(const std::string &source, std::vector<struct archive*> &outArchives) throw(Exception);
-	uint64_t fdToArchive(int fd, std::vector<struct archive*> &outArchives) throw(Exception);
+	uint64_t fdToArchive(int fd, std::vector<struct archive*> &outArchives, uint32_t *crc = 0) throw(Exception);
+	uint64_t sparseToArchive(int fd, const std::vector<dcDataRegion> &regions,
+			uint64_t size, std::vector<struct archive*> &outArchives,
+			uint32_t *crc = 0) throw(Exception);
 	uint64_t copyData(struct archive *arIn, std::vector<struct archive *> &outArchives) throw(Exception);
+	uint64_t relayData(struct archive *arIn,
+			std::vector<struct archive *> &outArchives, uint64_t size)
+			throw(Exception);
 	uint64_t copyData(int fdin, std::vector<int> &outFds) throw(Exception);
 	uint64_t copyData(int fdin, int fdout) throw(Exception);
+	uint64_t patchData(struct archive *arIn, int fd, uint64_t size)
+			throw(Exception);
 	void copyHeader(struct archive_entry *entry, std::vector<struct archive*> &outArchives) throw(Exception);
 
+	static bool getDataRegions(int fd, uint64_t size,
+			std::vector<dcDataRegion> &regions);
+
 	void initLocalRead();
 	void initSocketRead();
 	void initLocalWrite();
@@ -108,7 +390,30 @@ public:
 	static ssize_t sendData (int s, const void *buf, size_t len) throw (Exception);
 	static ssize_t sendData (std::vector<int> &fds, const void *buf, size_t len) throw (Exception);
 
+	ssize_t readData(int fd, void *buf, size_t len) throw(Exception);
+	ssize_t readChunk(int fd, const void **buf) throw(Exception);
+	ssize_t writeData(int fd, const void *buf, size_t len) throw(Exception);
+
+	void enableChecksums(int fd, uint8_t version = 0, dcFrameCaps caps = 0);
+	void disableChecksums(int fd);
+	bool hasChecksums(int fd) const;
+	void finishChecksums(int fd) throw(Exception);
+	void finishChecksums(std::vector<int> &fds) throw(Exception);
+
+	bool enableZeroCopy(int fd);
+	void disableZeroCopy(int fd);
+	bool hasZeroCopy(int fd) const;
+
+	char *acquireBuffer(dcBuffSize size) throw(Exception);
+	void releaseBuffer(char *buf);
+
+	void setBufferSize(dcBufferPath path, unsigned int mib);
+	dcBuffSize getBufferSize(dcBufferPath path) const;
+	void setPoolLimit(uint64_t limit);
+	uint64_t getPoolLimit() const;
+
 	void setTotalSize(const uint64_t size);
+	void countBytes(uint64_t nbytes);
 
 	uint64_t getTotalSize() const;
 	uint64_t getTransferredBytes() const;
@@ -119,10 +424,49 @@ public:
 	/// Can be defined as write() or send()
 	Doclone::writeFunction putNbytes;
 private:
-	/// Private constructor is needed in Singleton pattern
+	/// Only the Job creates its DataTransfer
 	DataTransfer();
+	friend class Job;
+
+	uint64_t pipelinedCopy(int fdin, std::vector<int> *outFds,
+			std::vector<struct archive*> *outArchives, uint32_t *digest)
+			throw(Exception);
+	void writeBuffer(const char *buf, size_t len, const uint32_t *crc,
+			std::vector<int> *outFds,
+			std::vector<struct archive*> *outArchives) throw(Exception);
+	void writeChunks(int fd, dcChecksumState &state, const char *buf,
+			size_t len, const uint32_t *crc, dcZeroCopyState *zeroCopy)
+			throw(Exception);
+	void sendZeroCopy(int fd, dcZeroCopyState &state, const char *buf,
+			size_t len) throw(Exception);
+	bool reapZeroCopy(int fd, dcZeroCopyState &state) throw(Exception);
+	void waitZeroCopy(int fd, dcZeroCopyState &state, uint32_t mark)
+			throw(Exception);
+	void markZeroCopy(const std::vector<int> &fds,
+			std::vector<uint32_t> &marks) const;
+	void waitZeroCopy(const std::vector<int> &fds,
+			const std::vector<uint32_t> *marks) throw(Exception);
+	bool drainZeroCopy(const std::vector<int> &fds);
+	void discardBuffer(char *buf);
+	size_t readChunkData(int fd, dcChecksumState &state, char *buf)
+			throw(Exception);
+	void writeFrame(int fd, dcFrameType type, const char *payload,
+			size_t len) throw(Exception);
+	void writePeriodicFrames(int fd, dcChecksumState &state)
+			throw(Exception);
+	bool readFrame(int fd, dcChecksumState &state, dcFrameType type,
+			size_t len, uint32_t crc) throw(Exception);
+	uint64_t patchRange(int fd, const char *data, uint64_t len,
+			uint64_t offset, char *diskBuf, dcBuffSize bufSize)
+			throw(Exception);
+	void zerosToArchive(uint64_t len,
+			std::vector<struct archive*> &outArchives) throw(Exception);
+	void trimPool();
 
-	/// Total size to transfer
+	/**
+	 * Total size to transfer. It and the counters of progress are only
+	 * accessed with atomic operations, see countBytes().
+	 */
 	uint64_t _totalSize;
 	/// Transferred bytes at the moment
 	uint64_t _transferredBytes;
@@ -130,6 +474,28 @@ private:
 	uint32_t _notificationPointSize;
 	/// Number of times the observers have been notified at the moment
 	uint32_t _transferNotificationsCount;
+
+	/// Size in bytes of the buffers of each data path
+	std::map<dcBufferPath, dcBuffSize> _bufferSizes;
+	/// Free buffers ready to be reused, by size
+	std::multimap<dcBuffSize, char *> _bufferPool;
+	/// Size of every buffer allocated by the pool
+	std::map<char *, dcBuffSize> _allocatedBuffers;
+	/// Protects the pool of buffers
+	pthread_mutex_t _poolMutex;
+	/// Bytes the pool can allocate, 0 for unlimited
+	uint64_t _poolLimit;
+	/// Bytes allocated by the pool at the moment
+	uint64_t _poolAllocated;
+
+	/**
+	 * Descriptors with checksummed streams. It is only modified while no
+	 * copy is running, so the reading threads don't need to lock it.
+	 */
+	std::map<int, dcChecksumState> _checksumStates;
+
+	/// Sockets that send the data buffers with MSG_ZEROCOPY
+	std::map<int, dcZeroCopyState> _zeroCopyStates;
 };
 
 }
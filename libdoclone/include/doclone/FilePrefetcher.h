@@ -0,0 +1,165 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef FILEPREFETCHER_H_
+#define FILEPREFETCHER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <deque>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+namespace Doclone {
+
+class Job;
+
+/**
+ * \var PREFETCH_DEPTH
+ *
+ * Maximum number of files submitted and not taken yet. Each one keeps a
+ * descriptor open.
+ */
+const unsigned int PREFETCH_DEPTH = 64;
+
+/**
+ * \var PREFETCH_THREADS
+ *
+ * Number of prefetching threads, that is, the number of system calls in
+ * flight against the device
+ */
+const unsigned int PREFETCH_THREADS = 16;
+
+/**
+ * \var PREFETCH_FILE_SIZE
+ *
+ * The data of the regular files up to this size is read by the prefetching
+ * threads. The bigger ones are read by the archiving thread as usual.
+ */
+const uint64_t PREFETCH_FILE_SIZE = 262144;
+
+/**
+ * \var PREFETCH_MEMORY
+ *
+ * Bytes of prefetched data held at the same time, when the job has no
+ * memory limit
+ */
+const uint64_t PREFETCH_MEMORY = 16 * 1048576;
+
+/**
+ * \var PREFETCH_QUOTIENT
+ *
+ * Fraction of the memory limit of the job that the prefetched data can use
+ */
+const unsigned int PREFETCH_QUOTIENT = 8;
+
+/**
+ * \struct dcPrefetchedFile
+ * \brief A file of a tree being archived, prepared by a prefetching thread
+ */
+struct dcPrefetchedFile {
+	/// Path of the file in the filesystem
+	std::string path;
+	/// Path of the file in the image
+	std::string relPath;
+	/// Whether a prefetching thread has finished with it
+	bool done;
+	/// errno of lstat(), 0 if it succeeded
+	int error;
+	/// Result of lstat()
+	struct stat filestat;
+	/// Descriptor of the file, -1 if it is not a regular file
+	int fd;
+	/// Entry read from fd, NULL if it is not a regular file
+	struct archive_entry *entry;
+	/// Whether data holds all the data of the file
+	bool loaded;
+	/// Data of the file, if it is loaded
+	std::string data;
+	/// CRC32C of data
+	uint32_t crc;
+};
+
+/**
+ * \class FilePrefetcher
+ * \brief Prepares the next files of a tree while the current one is being
+ * archived
+ *
+ * The archiving thread submits the files of a directory in the order they
+ * are archived. A pool of threads calls lstat(), open() and
+ * archive_read_disk_entry_from_file() on them, which read the attributes,
+ * extended attributes and ACLs, and reads the data of the small regular
+ * files, so many of these calls are in flight against the device at the
+ * same time. The archiving thread takes each file when it gets to it, so
+ * the image is the same as if the files were read one after the other.
+ *
+ * The files that can't be submitted, because there are already
+ * PREFETCH_DEPTH of them, are read by the archiving thread as before.
+ *
+ * \date October, 2026
+ */
+class FilePrefetcher {
+public:
+	FilePrefetcher(uint64_t memoryLimit);
+	~FilePrefetcher();
+
+	void start();
+	bool submit(const std::string &path, const std::string &relPath);
+	bool take(const std::string &path, dcPrefetchedFile &file);
+	void discard(const std::string &path);
+
+private:
+	static void *workerThread(void *arg);
+
+	void work();
+	void prefetch(struct archive *disk, dcPrefetchedFile &file);
+	bool reserve(uint64_t size);
+	void unreserve(uint64_t size);
+
+	/// Files submitted and not taken yet, in the order they were submitted
+	std::list<dcPrefetchedFile> _files;
+	/// Files of _files that no thread has started yet
+	std::deque<dcPrefetchedFile *> _pending;
+	/// Set to stop the threads
+	bool _done;
+	/// The prefetching threads
+	std::vector<pthread_t> _threads;
+	/// Bytes of data the files of _files can hold
+	uint64_t _memoryLimit;
+	/// Bytes of data held by the files of _files
+	uint64_t _memoryUsage;
+	/// Job of the threads
+	Job *_job;
+	/// Protects all the above but _job
+	pthread_mutex_t _mutex;
+	/// Signals new files in _pending, or the end of them
+	pthread_cond_t _notEmpty;
+	/// Signals the files that are done
+	pthread_cond_t _fileDone;
+};
+
+}
+
+#endif /* FILEPREFETCHER_H_ */
@@ -0,0 +1,120 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HARDLINKRESOLVER_H_
+#define HARDLINKRESOLVER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <archive_entry.h>
+
+#include <doclone/exception/Exception.h>
+
+namespace Doclone {
+
+/**
+ * \var LINK_INDEX_QUOTIENT
+ *
+ * Fraction of the memory limit of the job that the hard link index can use
+ * before spilling to disk
+ */
+const unsigned int LINK_INDEX_QUOTIENT = 4;
+
+/**
+ * \var LINK_ENTRY_OVERHEAD
+ *
+ * Estimation of the bytes used by each entry of the index, without its path
+ */
+const unsigned int LINK_ENTRY_OVERHEAD = 64;
+
+/**
+ * \var LINK_BUCKETS_QUOTIENT
+ *
+ * Fraction of the memory of the index used by the buckets of the spill file
+ */
+const unsigned int LINK_BUCKETS_QUOTIENT = 8;
+
+/**
+ * \var LINK_MIN_BUCKETS
+ *
+ * Minimum number of buckets of the spill file
+ */
+const unsigned int LINK_MIN_BUCKETS = 1024;
+
+/**
+ * \class HardLinkResolver
+ * \brief Detects the hard links of a tree while it is being archived
+ *
+ * The first entry of a file with many links is archived with its data, and
+ * the next ones as hard links to it, like the libarchive link resolver does
+ * for the tar formats.
+ *
+ * The paths of the files whose links have not been found yet are kept in
+ * memory. If they exceed the given limit, the new ones are written to a
+ * temporary file, as a hash table: the records of each bucket are chained
+ * from the last one, whose offset is kept in memory. So a link not found in
+ * memory is looked for only among the records of its bucket. If the
+ * temporary file can't be created, all of them stay in memory.
+ *
+ * \date October, 2026
+ */
+class HardLinkResolver {
+public:
+	HardLinkResolver(uint64_t memoryLimit);
+	~HardLinkResolver();
+
+	void linkify(struct archive_entry *entry) throw(Exception);
+
+	uint64_t getMemoryUsage() const;
+
+private:
+	/// Identifies a file in the filesystem: device and inode
+	typedef std::pair<dev_t, ino_t> dcFileId;
+
+	bool findInSpill(const dcFileId &id, std::string &path) throw(Exception);
+	bool spill(const dcFileId &id, const std::string &path) throw(Exception);
+	size_t getBucket(const dcFileId &id) const;
+
+	/// Path of the first entry and links pending, for each file
+	std::map<dcFileId, std::pair<std::string, unsigned int> > _links;
+	/// Bytes used by the index in memory
+	uint64_t _memoryUsage;
+	/// Bytes the index can use in memory, 0 for unlimited
+	uint64_t _memoryLimit;
+	/// Temporary file where the index spills, NULL if none
+	FILE *_spillFile;
+	/// Set when the spill file can't be created, so the index stays in memory
+	bool _spillFailed;
+	/// Number of entries in the spill file
+	uint64_t _spilledEntries;
+	/// Size of the spill file
+	uint64_t _spillSize;
+	/// Offset plus one of the last record of each bucket, 0 for none
+	std::vector<uint64_t> _buckets;
+};
+
+}
+
+#endif /* HARDLINKRESOLVER_H_ */
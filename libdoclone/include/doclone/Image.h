@@ -20,9 +20,13 @@
 #define IMAGE_H_
 
 #include <stdint.h>
+#include <stdio.h>
 #include <sys/types.h>
 
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <archive.h>
 #include <archive_entry.h>
@@ -37,6 +41,37 @@
 
 namespace Doclone {
 
+class BaseImageIndex;
+class ChunkStore;
+class FilePrefetcher;
+class HardLinkResolver;
+class Verifier;
+
+/**
+ * \var MAX_HEADER_SIZE
+ *
+ * Maximum size of the XML header of an image. Bigger headers are rejected
+ * instead of being loaded in memory.
+ */
+const uint64_t MAX_HEADER_SIZE = 1048576;
+
+/**
+ * \var MANIFEST_ENTRY
+ *
+ * Path of the manifest in the image. It is the last entry of the image, and
+ * has a line for each regular file with its CRC32C in hexadecimal, its size
+ * and its path in the image, separated by spaces.
+ */
+const char MANIFEST_ENTRY[] = "_manifest";
+
+/**
+ * \var REMOVED_ENTRY
+ *
+ * Path of the list of files of the base image that must not be restored with
+ * an incremental image. It has a line for each path.
+ */
+const char REMOVED_ENTRY[] = "_removed";
+
 /**
  * \enum imageType
  *
@@ -71,6 +106,7 @@ public:
 	void initFdReadArchive(const int fdin) throw(Exception);
 	void initDiskWriteArchive();
 	void initFdWriteArchive(std::vector<int> &fds) throw(Exception);
+	void initRawWriteArchive(std::vector<int> &fds) throw(Exception);
 	void initFdWriteArchive(const int fdout) throw(Exception);
 
 	void freeReadArchive();
@@ -79,9 +115,15 @@ public:
 	void loadImageSizeFromHeader() throw(Exception);
 	void loadImageHeader() throw(Exception);
 	void saveImageHeader() throw(Exception);
+	void loadBaseImage(const std::string &base) throw(Exception);
+	void openRepository(const std::string &dir) throw(Exception);
 
 	void readPartitionsData() throw(Exception);
 	void writePartitionsData(const std::string &device) throw(Exception);
+	void verifyPartitionsData(const std::string &device) throw(Exception);
+	void relayImage() throw(Exception);
+	void readDirectoryData(const std::string &dir) throw(Exception);
+	void writeDirectoryData(const std::string &dir) throw(Exception);
 
 	void readPartitionTable(const std::string &device) throw(Exception);
 	void writePartitionTable(const std::string &device) throw(Exception);
@@ -93,6 +135,8 @@ public:
 	void initRestoreOperations(const std::string &device) const throw(Exception);
 
 	uint64_t getSize() const;
+	bool isIncremental() const;
+	bool isChunked() const;
 	Doclone::imageType getType() const;
 	void setType(Doclone::imageType type);
 	Disk *getDisk();
@@ -112,16 +156,65 @@ private:
 	struct archive *_archiveIn;
 	/// Vector of writing archive objects
 	std::vector<struct archive *> _archivesOut;
+	/// Temporary file where the manifest is written while creating, or NULL
+	FILE *_manifest;
+	/// Files of the base image, while creating an incremental image, or NULL
+	BaseImageIndex *_baseIndex;
+	/// If the image only has the changes since a base image
+	bool _incremental;
+	/// Checksum of the header of the base image
+	uint32_t _baseId;
+	/// Files of the base image not to be restored
+	std::set<std::string> _removed;
+	/// Repository of the data of the files, or NULL
+	ChunkStore *_store;
+	/// If the data of the files is in a repository
+	bool _chunked;
+	/// If the image is restored into the filesystems already on the device
+	bool _sync;
+	/// Paths in the image of all the files restored, while synchronizing
+	std::set<std::string> _synced;
+	/// Bytes of the files that were already on the device, while synchronizing
+	uint64_t _keptBytes;
+	/// Number of files deleted from the device, because they aren't in the image
+	uint64_t _deletedFiles;
+	/// Directory the image is restored in instead of a device, or empty
+	std::string _directory;
 
 	bool fitInDisk() const throw(Exception);
 
 	void readPartition(int index) throw(Exception);
+	void readTree(const std::string &dir, const std::string &imgRootDir)
+			throw(Exception);
+	void openManifest();
+	void getRoots(std::vector<std::pair<std::string, std::string> > &roots)
+			throw(Exception);
 	void writePartition(int index) const throw(Exception);
 
-	void readDataFromDisk(struct archive_entry_linkresolver *lResolv,
-			const std::string &path, const std::string &imgRootDir,
-			size_t mPointLength) throw(Exception);
-	void writeDataToDisk() throw(Exception);
+	void readDataFromDisk(HardLinkResolver &resolver,
+			FilePrefetcher &prefetcher, const std::string &path,
+			const std::string &imgRootDir, size_t mPointLength)
+			throw(Exception);
+	void writeDataToDisk(bool fromBase = false) throw(Exception);
+	void writeBaseDataToDisk() throw(Exception);
+	void writeChunkedFile(struct archive_entry *entry) throw(Exception);
+	bool isOnDisk(struct archive_entry *entry) const;
+	bool patchFile(struct archive_entry *entry) throw(Exception);
+	void deleteExtraneous(const std::string &path,
+			const std::string &imgPath) throw(Exception);
+
+	void addToManifest(const std::string &path, uint64_t size, uint32_t crc)
+			throw(Exception);
+	void saveManifest() throw(Exception);
+	void saveRemovedList() throw(Exception);
+	void loadRemovedList() throw(Exception);
+	void saveTempFile(FILE *file, const char *path) throw(Exception);
+
+	void mapTargetPartitions(bool sameLayout = false) throw(Exception);
+	void verifyDataOnDisk() throw(Exception);
+	void readManifest(Verifier &verifier,
+			const std::vector<std::pair<std::string, std::string> > &roots)
+			throw(Exception);
 };
 
 }
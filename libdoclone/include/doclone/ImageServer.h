@@ -0,0 +1,180 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef IMAGESERVER_H_
+#define IMAGESERVER_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <utility>
+
+#include <doclone/Node.h>
+#include <doclone/NetNode.h>
+#include <doclone/exception/Exception.h>
+
+namespace Doclone {
+
+/**
+ * \var SERVER_MAX_EVENTS
+ *
+ * Maximum number of events returned by each call to epoll_wait()
+ */
+const int SERVER_MAX_EVENTS = 64;
+
+/**
+ * \var SERVER_STATS_INTERVAL
+ *
+ * Seconds between two logs of the statistics of the image server
+ */
+const int SERVER_STATS_INTERVAL = 10;
+
+/**
+ * \var SERVER_SENDFILE_CHUNK
+ *
+ * Maximum bytes sent to a client in a row, so the other clients are not
+ * delayed by a fast one
+ */
+const size_t SERVER_SENDFILE_CHUNK = 4 * 1024 * 1024;
+
+/**
+ * \enum dcClientState
+ * \brief State of a client of the image server
+ *
+ * \var CLIENT_REQUEST
+ * 	Reading the request
+ * \var CLIENT_RESPONSE
+ * 	Sending the response and the size of the image
+ * \var CLIENT_DATA
+ * 	Sending the image
+ */
+enum dcClientState {
+	CLIENT_REQUEST,
+	CLIENT_RESPONSE,
+	CLIENT_DATA
+};
+
+/**
+ * \struct dcServedClient
+ * \brief A client connected to the image server
+ */
+struct dcServedClient {
+	/// Socket of the client
+	int fd;
+	/// Human readable IP of the client
+	std::string address;
+	/// State of the connection
+	dcClientState state;
+	/// Bytes of the request received until now
+	char request[sizeof(dcCommand) + sizeof(uint16_t) + MAX_IMAGE_NAME];
+	/// Number of bytes in request
+	size_t requestLength;
+	/// Response and size of the image, in big-endian
+	char response[sizeof(dcCommand) + sizeof(uint64_t)];
+	/// Number of bytes of response already sent
+	size_t responseSent;
+	/// Name of the requested image
+	std::string image;
+	/// Descriptor of the requested image, -1 if none
+	int imageFd;
+	/// Size of the image file
+	off_t fileSize;
+	/// Bytes of the image file already sent
+	off_t offset;
+	/// When the client connected
+	time_t start;
+};
+
+/**
+ * \struct dcServerStats
+ * \brief Statistics of an image server
+ */
+struct dcServerStats {
+	/// Clients connected now
+	unsigned int activeClients;
+	/// Clients that got their whole image
+	uint64_t servedClients;
+	/// Clients refused or disconnected before the end of their image
+	uint64_t failedClients;
+	/// Bytes of images sent to all the clients
+	uint64_t sentBytes;
+	/// When the server started
+	time_t start;
+};
+
+/**
+ * \class ImageServer
+ * \brief Long-running server of the images of a directory
+ *
+ * Unlike Unicast, which sends one image to a fixed number of receivers, the
+ * image server serves any image of its library directory to any number of
+ * clients, which connect at any time and ask for an image by its name (see
+ * C_IMAGE_REQUEST). Each client gets the same stream than a Unicast receiver
+ * without checksums, so the receiving side is Unicast too.
+ *
+ * All the clients are attended by a single thread, with an epoll event loop.
+ * The images are sent with sendfile(), without copying them to user space.
+ *
+ * \date October, 2026
+ */
+class ImageServer : public Node {
+public:
+	ImageServer();
+	~ImageServer();
+
+	void serve() throw(Exception);
+
+	const dcServerStats &getStats() const;
+
+private:
+	void listenClients() throw(Exception);
+	void acceptClients() throw(Exception);
+	void attendClient(dcServedClient *client, uint32_t events)
+			throw(Exception);
+
+	bool readRequest(dcServedClient *client) throw(Exception);
+	bool openImage(dcServedClient *client) throw(Exception);
+	bool sendResponse(dcServedClient *client) throw(Exception);
+	bool sendImage(dcServedClient *client) throw(Exception);
+
+	void watchClient(dcServedClient *client, uint32_t events)
+			throw(Exception);
+	void dropClient(dcServedClient *client, bool served);
+	void logStats() const;
+
+	/// Clients to serve before finishing, 0 to serve forever
+	unsigned int _nodesNum;
+	/// Listening socket
+	int _listenFd;
+	/// The epoll instance
+	int _epollFd;
+	/// Connected clients, by their socket
+	std::map<int, dcServedClient *> _clients;
+	/// Modification time and size of the images already opened, by name
+	std::map<std::string, std::pair<time_t, uint64_t> > _sizes;
+	/// Statistics of the server
+	dcServerStats _stats;
+};
+
+}
+
+#endif /* IMAGESERVER_H_ */
@@ -0,0 +1,83 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JOB_H_
+#define JOB_H_
+
+#include <pthread.h>
+
+namespace Doclone {
+
+class Clone;
+class DataTransfer;
+class PartedDevice;
+class Stats;
+class Tracer;
+
+/**
+ * \class Job
+ * \brief Context of a job of the library
+ *
+ * Holds the objects that used to be shared by the whole process: the Clone
+ * with the options and the operations of the job, the DataTransfer with its
+ * progress and buffers, the Stats with its counters of throughput, the
+ * Tracer with its timeline, and the PartedDevice being worked on. Their
+ * getInstance() methods return the ones of the job bound to the calling
+ * thread, or the ones of a default job if the thread has none. So a process
+ * can run many jobs at the same time, each one in its own threads.
+ *
+ * The threads created by a job are bound to it too. The Logger and the
+ * XMLStringHandler are shared by all the jobs, and lock what they keep.
+ *
+ * \date October, 2026
+ */
+class Job {
+public:
+	Job();
+	~Job();
+
+	static Job *getCurrent();
+
+	void bind();
+	static void unbind();
+
+	Clone *getClone() const;
+	DataTransfer *getDataTransfer() const;
+	PartedDevice *getPartedDevice() const;
+	Stats *getStats() const;
+	Tracer *getTracer() const;
+
+private:
+	static Job *getDefault();
+	static void createKey();
+
+	/// Options and operations of the job
+	Clone *_clone;
+	/// Transfers of the job
+	DataTransfer *_transfer;
+	/// Device the job works on
+	PartedDevice *_partedDevice;
+	/// Counters of throughput of the job
+	Stats *_stats;
+	/// Timeline of the job
+	Tracer *_tracer;
+};
+
+}
+
+#endif /* JOB_H_ */
@@ -26,6 +26,8 @@
 
 namespace Doclone {
 
+class Stripes;
+
 /**
  * \class Link
  * \brief Implementation of the link mode.
@@ -43,6 +45,9 @@ namespace Doclone {
  * sender sends to each receiver the IP of the next node in the chain to form
  * the network.
  *
+ * If the job sets many streams, and all the links can, every node sends the
+ * data to the next one on that number of connections, see Stripes.
+ *
  * Class inherited from Net.
  * \date August, 2011
  */
@@ -56,8 +61,10 @@ public:
 private:
 	virtual void closeConnection() throw(Exception);
 
-	int answer() const throw(Exception);
-	int netScan() const throw(Exception);
+	int answer(bool &checksums, bool &stripes) const throw(Exception);
+	int netScan(bool &checksums, bool &stripes) const throw(Exception);
+
+	void stripeOut(unsigned int count) throw(Exception);
 
 	void linkServer() throw(Exception);
 	void linkClient() throw(Exception);
@@ -74,6 +81,12 @@ private:
 	///Next link socket
 	int _fdout;
 
+	/// Stripes _fdin is the local socket of, NULL if it isn't striped
+	Stripes *_stripesIn;
+
+	/// Stripes _fdout is the local socket of, NULL if it isn't striped
+	Stripes *_stripesOut;
+
 	/// Max number of links in the chain
 	unsigned int _linksNum;
 
@@ -39,6 +39,9 @@ public:
 
 	void create() const throw(Exception);
 	void restore() const throw(Exception);
+	void verify() const throw(Exception);
+	void localClone() const throw(Exception);
+	void duplicate() const throw(Exception);
 };
 
 }
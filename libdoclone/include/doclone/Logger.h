@@ -19,6 +19,11 @@
 #ifndef LOGGER_H_
 #define LOGGER_H_
 
+#include <stdint.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <sys/time.h>
+
 #include <string>
 #include <vector>
 
@@ -30,6 +35,43 @@
 
 namespace Doclone {
 
+/**
+ * \var LOOP_DEBUG
+ *
+ * Priority of the traces of the functions called by loops, below DEBUG
+ */
+const int LOOP_DEBUG = 750;
+
+/**
+ * \var LOG_RING_SIZE
+ *
+ * Records the log backend holds before the threads that log wait for it. A
+ * power of two
+ */
+const unsigned int LOG_RING_SIZE = 256;
+
+/**
+ * \var LOG_RECORD_SIZE
+ *
+ * Maximum length of a message, with the terminating null byte
+ */
+const unsigned int LOG_RECORD_SIZE = 1024;
+
+/**
+ * \struct dcLogRecord
+ * \brief A message formatted by a thread that logs, waiting to be written
+ */
+struct dcLogRecord {
+	/// Position of the record in the ring, see Logger::enqueue()
+	uint64_t sequence;
+	/// Priority of the message
+	int priority;
+	/// When the message was logged
+	struct timeval time;
+	/// The message
+	char message[LOG_RECORD_SIZE];
+};
+
 /**
  * \class Logger
  * \brief The logger class of the project. Singleton pattern.
@@ -51,7 +93,13 @@ namespace Doclone {
  * LOOP DEBUG: Same as above, but there are some functions that are executed
  *  from a loop and can be called hundreds of times. This kind of messages
  *  really bother. For see this kind of messages, must compile with the
- *  -DDEBUG_LOOP flag.
+ *  -DDEBUG_LOOP flag. Otherwise the calls are compiled out.
+ *
+ * The messages of a disabled priority are discarded before formatting them.
+ * The DEBUG and INFO ones are formatted by the calling thread in a ring of
+ * records, and written by a thread of the logger, so the loops don't wait for
+ * the disk. The messages of the exceptions are written at once, after the
+ * records queued before them.
  *
  * This class also implements a backtrace for the exceptions of the program. All
  * exceptions are written in a vector, and there is a function to get it.
@@ -64,29 +112,74 @@ public:
 
 	static Logger* getInstance();
 
-	void loopDebug(const std::string &msg, ...) const;
-	void debug(const std::string &msg, ...) const;
-	void info(const std::string &msg, ...) const;
+#ifdef DEBUG_LOOP
+	void loopDebug(const char *msg, ...);
+#else
+	/// Without DEBUG_LOOP the traces of the loops cost nothing
+	void loopDebug(const char *, ...) {}
+#endif
+	void debug(const char *msg, ...);
+	void info(const char *msg, ...);
 	void warn(const std::string &msg, ...);
 	void error(const std::string &msg, ...);
 	void fatal(const std::string &msg, ...);
 
-	std::vector<std::string> &getBT();
+	std::vector<std::string> getBT();
+
+	/**
+	 * \brief Whether the messages of a priority are written
+	 */
+	bool isEnabled(int priority) const {
+		return priority <= this->_priority;
+	}
 
 private:
 	Logger();
 	void pushBT(const std::string &msg);
 
+	static void createInstance();
+	static void *writerThread(void *arg);
+
+	void enqueue(int priority, const char *msg, va_list vl);
+	bool hasRecord() const;
+	bool writeRecord();
+	void wakeWriter();
+	void flushRecords();
+	void runWriter();
+
 	// log4cpp stuff
 	log4cpp::RollingFileAppender *_app;
 	log4cpp::PatternLayout* _layout;
 	log4cpp::Category *_cat; // I love cats
+	/// Priority of _cat, the messages above it are discarded
+	int _priority;
+
+	/// Ring of the records formatted by the threads that log
+	dcLogRecord *_records;
+	/// Position of the next record to fill, shared by the threads that log
+	uint64_t _enqueuePos;
+	/// Position of the next record to write, advanced by the writer thread
+	uint64_t _dequeuePos;
+	/// The thread that writes the records
+	pthread_t _writer;
+	/// Protects the sleep of the writer thread and the flushes
+	pthread_mutex_t _writerMutex;
+	/// Wakes up the writer thread
+	pthread_cond_t _writerCond;
+	/// Wakes up the threads waiting for the records to be written
+	pthread_cond_t _drainedCond;
+	/// Whether the writer thread waits for new records
+	bool _writerSleeping;
+	/// Whether the writer thread must exit
+	bool _stopping;
 
 	/**
 	 * The backtrace with all the messages of all the exceptions thrown during
 	 * the execution
 	 */
 	std::vector<std::string> _backTrace;
+	/// Protects the backtrace, shared by all the jobs
+	pthread_mutex_t _btMutex;
 };
 
 }
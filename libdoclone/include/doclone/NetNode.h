@@ -22,8 +22,10 @@
 #include <arpa/inet.h>
 
 #include <string>
+#include <vector>
 
 #include <doclone/Node.h>
+#include <doclone/DataTransfer.h>
 #include <doclone/exception/Exception.h>
 
 namespace Doclone {
@@ -49,6 +51,28 @@ const dcPort PORT_PING = 7772;
  */
 const dcPort PORT_DATA = 7773;
 
+/**
+ * \var PORT_SERVE
+ *
+ * TCP port where the image server listens for requests
+ */
+const dcPort PORT_SERVE = 7774;
+
+/**
+ * \var PORT_COLLECT
+ *
+ * TCP port where the collector listens for senders
+ */
+const dcPort PORT_COLLECT = 7775;
+
+/**
+ * \var PORT_STRIPE
+ *
+ * TCP port where the extra connections of a striped stream are accepted, see
+ * C_STRIPES
+ */
+const dcPort PORT_STRIPE = 7776;
+
 /**
  * \typedef dcGroup
  *
@@ -88,6 +112,15 @@ const dcNum LINKS_NUM = 64;
  * C_LINK_SERVER_OK = 1 << 0;
  * C_LINK_CLIENT_OK = 1 << 1;
  * C_NEXT_LINK_IP = 1 << 2;
+ * C_SERVER_OK = 1 << 3;
+ * C_RECEIVER_OK = 1 << 4;
+ * C_CHECKSUMS = 1 << 5;
+ * C_IMAGE_REQUEST = 1 << 6;
+ * C_SENDER_OK = 1 << 7;
+ * C_RESUME = 1 << 2; (only on PORT_DATA, where C_NEXT_LINK_IP isn't used)
+ * C_FRAMES = 1 << 1; (only on PORT_DATA, where C_LINK_CLIENT_OK isn't used)
+ * C_STRIPES = 1 << 6; (only on PORT_DATA and in the link mode, where
+ * C_IMAGE_REQUEST isn't used)
  */
 typedef uint8_t dcCommand;
 
@@ -126,6 +159,100 @@ const dcCommand C_SERVER_OK = 1 << 3;
  */
 const dcCommand C_RECEIVER_OK = 1 << 4;
 
+/**
+ * \var C_CHECKSUMS
+ *
+ * Added to the other codes, the node supports checksummed streams. They are
+ * used only if both ends of a connection send it.
+ */
+const dcCommand C_CHECKSUMS = 1 << 5;
+
+/**
+ * \var C_IMAGE_REQUEST
+ *
+ * Added to C_RECEIVER_OK, the client asks an image server for an image. The
+ * name of the image follows: its length in a big-endian uint16_t, and its
+ * characters.
+ */
+const dcCommand C_IMAGE_REQUEST = 1 << 6;
+
+/**
+ * \var C_SENDER_OK
+ *
+ * A sender that connects to a collector is ready to work. The name of its
+ * image follows, like in C_IMAGE_REQUEST.
+ */
+const dcCommand C_SENDER_OK = 1 << 7;
+
+/**
+ * \var C_RESUME
+ *
+ * Added to C_RECEIVER_OK, the receiver can resume the session. The session it
+ * was in follows, 0 if none, and the bytes of data it has already received,
+ * both in big-endian uint64_t. Added to C_SERVER_OK, the server can resume
+ * it, and its session follows. If the receiver was in that session, the
+ * stream continues after the data it has, without the size of the data.
+ *
+ * It shares the bit of C_NEXT_LINK_IP, which is only sent in the link mode.
+ */
+const dcCommand C_RESUME = 1 << 2;
+
+/**
+ * \var C_FRAMES
+ *
+ * Added to C_RECEIVER_OK and C_CHECKSUMS, the receiver can read framed
+ * streams, see dcChecksumState. After the data of C_RESUME follow the highest
+ * version of the frames it knows, in a uint8_t, and the optional frames it
+ * accepts, see dcFrameCaps, in a big-endian uint32_t. Added to C_SERVER_OK,
+ * the server sends a framed stream, and the version and the optional frames
+ * it uses follow, after the session of C_RESUME, in the same format.
+ *
+ * It shares the bit of C_LINK_CLIENT_OK, which is only sent in the link mode.
+ */
+const dcCommand C_FRAMES = 1 << 1;
+
+/**
+ * \var C_STRIPES
+ *
+ * Added to C_RECEIVER_OK, the receiver can receive a striped stream, see
+ * Stripes. Added to C_SERVER_OK, the server stripes it, and after the data of
+ * C_FRAMES follows its offer: the number of connections, in a uint8_t, and a
+ * token, in a big-endian uint64_t. The receiver then opens the other
+ * connections to PORT_STRIPE.
+ *
+ * In the link mode, added to C_LINK_SERVER_OK, the sender can stripe the
+ * chain, and the links that can answer with it. Added to C_NEXT_LINK_IP, every
+ * link sends the offer on its connection to the next one, and opens the other
+ * connections to its PORT_STRIPE.
+ *
+ * It shares the bit of C_IMAGE_REQUEST, which is only sent to PORT_SERVE.
+ */
+const dcCommand C_STRIPES = 1 << 6;
+
+/**
+ * \struct dcHandshake
+ * \brief What a receiver and a Unicast server agree in the handshake
+ */
+struct dcHandshake {
+	/// Whether the stream has checksums
+	bool checksums;
+	/// Version of the framed stream, 0 for plain chunks
+	uint8_t frameVersion;
+	/// Optional frames sent in the stream
+	dcFrameCaps frameCaps;
+	/// Bytes of data the receiver already has, if it resumes the session
+	uint64_t offset;
+	/// Other connections of the stream, if it's striped
+	std::vector<int> stripes;
+};
+
+/**
+ * \var MAX_IMAGE_NAME
+ *
+ * Maximum length of the name of an image requested to an image server
+ */
+const uint16_t MAX_IMAGE_NAME = 255;
+
 /**
  * \class NetNode
  * \brief Common methods and attributes for all network nodes
@@ -55,6 +55,8 @@ namespace Doclone {
  * 	Waiting for connect to server
  * \var OP_WAIT_CLIENTS
  * 	Waiting for connect to client/s
+ * \var OP_VERIFY_DATA
+ * 	Verifying the restored data against the image
  */
 enum dcOperationType {
 	OP_NONE,
@@ -70,7 +72,8 @@ enum dcOperationType {
 	OP_GRUB_INSTALL,
 	OP_TRANSFER_DATA,
 	OP_WAIT_SERVER,
-	OP_WAIT_CLIENTS
+	OP_WAIT_CLIENTS,
+	OP_VERIFY_DATA
 };
 
 /**
@@ -29,10 +29,10 @@ namespace Doclone {
 
 /**
  * \class PartedDevice
- * \brief Access to libparted functions. Singleton.
+ * \brief Access to libparted functions. One for each job.
  *
- * This class is a singleton type that provides the access to the libparted
- * objects and functions from any place of the code.
+ * This class provides the access to the libparted objects and functions of
+ * the device of the job from any place of the code, see Job.
  * \date August, 2011
  */
 class PartedDevice {
@@ -56,8 +56,9 @@ public:
 	void close();
 
 private:
-	/// Private constructor to implement singleton pattern
+	/// Only the Job creates its PartedDevice
 	PartedDevice();
+	friend class Job;
 
 	/// Used to know if a new parted disk or device must be opened or closed.
 	int _openings;
@@ -0,0 +1,66 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHA256_H_
+#define SHA256_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+namespace Doclone {
+
+/**
+ * \var SHA256_SIZE
+ *
+ * Size in bytes of a SHA-256 digest
+ */
+const unsigned int SHA256_SIZE = 32;
+
+/**
+ * \class Sha256
+ * \brief Computes SHA-256 digests
+ *
+ * \date October, 2026
+ */
+class Sha256 {
+public:
+	Sha256();
+
+	void update(const void *buf, size_t len);
+	void final(uint8_t digest[SHA256_SIZE]);
+
+	static std::string hexDigest(const void *buf, size_t len);
+
+private:
+	void transform(const uint8_t *block);
+
+	/// Intermediate hash value
+	uint32_t _state[8];
+	/// Bytes of the current block not processed yet
+	uint8_t _block[64];
+	/// Number of bytes in _block
+	size_t _blockLength;
+	/// Total number of bytes hashed
+	uint64_t _length;
+};
+
+}
+
+#endif /* SHA256_H_ */
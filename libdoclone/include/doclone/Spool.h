@@ -0,0 +1,159 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPOOL_H_
+#define SPOOL_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include <set>
+#include <vector>
+
+#include <doclone/NetNode.h>
+#include <doclone/exception/Exception.h>
+
+namespace Doclone {
+
+class Job;
+
+/**
+ * \var SPOOL_ACCEPT_TIMEOUT
+ *
+ * Milliseconds the accepting thread of a Spool waits for a connection before
+ * checking whether the session has finished
+ */
+const int SPOOL_ACCEPT_TIMEOUT = 1000;
+
+/**
+ * \var SPOOL_BUFFER_SIZE
+ *
+ * Size of the blocks written to the spool file
+ */
+const unsigned int SPOOL_BUFFER_SIZE = 1048576;
+
+/**
+ * \class Spool
+ * \brief Sends the stream of a Unicast server to receivers that connect at
+ * different times
+ *
+ * The server writes its stream to the input of the spool, a socket, like to
+ * any receiver. The stream is written to a temporary file, and every receiver
+ * is sent the whole stream from it by its own thread, with its own Job, at
+ * its own pace. So the server doesn't wait for the slow receivers, and a
+ * receiver that fails doesn't interrupt the others.
+ *
+ * The spool keeps accepting receivers while the stream is being sent, and
+ * after it, until the number of nodes of the job have received it entirely.
+ * A receiver that fails can connect again. If it resumes the session, see
+ * C_RESUME, it's sent the stream after the data it has, otherwise from the
+ * beginning.
+ *
+ * \date October, 2026
+ */
+class Spool {
+public:
+	Spool(int listenFd, int stripeFd, unsigned int nodesNum)
+			throw(Exception);
+	~Spool();
+
+	int getInput() const;
+	uint64_t getSession() const;
+
+	void addReceiver(int fd, const dcHandshake &handshake,
+			const std::string &address) throw(Exception);
+	void start() throw(Exception);
+	void finish() throw(Exception);
+
+private:
+	/// A receiver and the spool it's sent from
+	typedef struct {
+		Spool *spool;
+		int fd;
+		dcHandshake handshake;
+	} dcSpoolReceiver;
+
+	static void closeReceiver(int fd, const dcHandshake &handshake);
+
+	void stop();
+
+	static void *spoolThread(void *arg);
+	void spoolStream();
+
+	static void *acceptThread(void *arg);
+	void acceptReceivers();
+
+	static void *receiverThread(void *arg);
+	void sendStream(int fd, const dcHandshake &handshake);
+	bool waitData(uint64_t offset, uint64_t &available);
+
+	/// Receivers that must receive the whole stream
+	unsigned int _nodesNum;
+	/// Socket where the late receivers connect
+	int _listenFd;
+	/// Socket where the other connections of the receivers of striped
+	/// streams connect, -1 if the streams aren't striped
+	int _stripeFd;
+	/// Socket the server writes the stream to
+	int _input;
+	/// Other end of _input, read by the spooling thread
+	int _output;
+	/// Temporary file with the stream
+	FILE *_file;
+	/// Identifier of the session, which the receivers resume
+	uint64_t _session;
+	/// Job of the server, bound to the accepting thread to notify the views
+	Job *_job;
+	/// Bytes the pool of each receiver can allocate, 0 for unlimited
+	uint64_t _poolLimit;
+
+	/// Thread writing the stream to _file
+	pthread_t _spoolThread;
+	/// Whether _spoolThread is running or hasn't been joined yet
+	bool _spooling;
+	/// Thread accepting the late receivers
+	pthread_t _acceptThread;
+	/// Whether _acceptThread is running or hasn't been joined yet
+	bool _accepting;
+	/// Threads sending the stream to the receivers
+	std::vector<pthread_t> _threads;
+
+	/// Bytes of the stream written to _file
+	uint64_t _spooled;
+	/// Set when the whole stream has been written to _file
+	bool _complete;
+	/// Set when the spooling thread fails
+	bool _failed;
+	/// Set when the session has finished, so the streams being sent are
+	/// interrupted and no more receivers are accepted
+	bool _done;
+	/// Receivers that have received the whole stream
+	unsigned int _completed;
+	/// Connections being sent the stream
+	std::set<int> _connections;
+	/// Protects all the above
+	pthread_mutex_t _mutex;
+	/// Signals more data in _file, or a receiver finishing
+	pthread_cond_t _changed;
+};
+
+}
+
+#endif /* SPOOL_H_ */
@@ -0,0 +1,244 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+namespace Doclone {
+
+class DataTransfer;
+
+/**
+ * \enum dcStage
+ * \brief Stages of a job whose bytes and time are measured
+ *
+ * \var STAGE_WALK
+ * 	Walking the trees of the filesystems and reading the metadata of their
+ * 	files
+ * \var STAGE_READ
+ * 	Reading data from local files and devices
+ * \var STAGE_COMPRESS
+ * 	Writing data in archives, which compress it and write it to their output
+ * \var STAGE_SEND
+ * 	Sending data over the network
+ * \var STAGE_RECEIVE
+ * 	Receiving data from the network
+ * \var STAGE_EXTRACT
+ * 	Reading data from archives and writing it in the files it is restored to
+ * \var STAGE_FSYNC
+ * 	Flushing the written data to the disk
+ */
+enum dcStage {
+	STAGE_WALK,
+	STAGE_READ,
+	STAGE_COMPRESS,
+	STAGE_SEND,
+	STAGE_RECEIVE,
+	STAGE_EXTRACT,
+	STAGE_FSYNC
+};
+
+/**
+ * \var STATS_STAGES
+ *
+ * Number of stages in dcStage
+ */
+const unsigned int STATS_STAGES = 7;
+
+/**
+ * \var STATS_MAX_RECEIVERS
+ *
+ * Maximum number of receivers whose rates are measured in a job. The ones
+ * that connect after them are only counted in the totals.
+ */
+const unsigned int STATS_MAX_RECEIVERS = 64;
+
+/**
+ * \var STATS_RATE_INTERVAL
+ *
+ * Minimum time, in nanoseconds, between the samples the instantaneous rates
+ * are computed from. Snapshots taken more often get the last rates.
+ */
+const uint64_t STATS_RATE_INTERVAL = 1000000000ULL;
+
+/**
+ * \struct dcStageStats
+ * \brief What a stage has done until now
+ */
+struct dcStageStats {
+	/// Bytes processed in the stage
+	uint64_t bytes;
+	/// Time spent in the stage, in seconds, added up in all the threads
+	double seconds;
+	/// Number of calls, or of files for STAGE_WALK
+	uint64_t calls;
+};
+
+/**
+ * \struct dcReceiverStats
+ * \brief What has been sent to a receiver
+ */
+struct dcReceiverStats {
+	/// Address of the receiver
+	std::string address;
+	/// Bytes sent to it
+	uint64_t bytes;
+	/// Bytes per second since the last sample
+	double rate;
+	/// Bytes per second since it connected
+	double averageRate;
+	/// Whether it is still connected
+	bool connected;
+};
+
+/**
+ * \struct dcStats
+ * \brief A snapshot of the progress of a job
+ */
+struct dcStats {
+	/// Total size to transfer, 0 while it's unknown
+	uint64_t totalSize;
+	/// Bytes transferred until now
+	uint64_t transferredBytes;
+	/// Seconds since the job started
+	double elapsed;
+	/// Bytes per second since the last sample
+	double rate;
+	/// Bytes per second since the job started
+	double averageRate;
+	/// Seconds to finish at the current rate, -1 if it's unknown
+	double eta;
+	/// Whether the job has finished
+	bool finished;
+	/// Counters of each stage, indexed by dcStage
+	dcStageStats stages[STATS_STAGES];
+	/// Receivers of a server, in the order they connected
+	std::vector<dcReceiverStats> receivers;
+};
+
+/**
+ * \struct dcStageCounters
+ * \brief Counters of a stage, updated with atomic operations
+ */
+struct dcStageCounters {
+	uint64_t bytes;
+	uint64_t nanoseconds;
+	uint64_t calls;
+};
+
+/**
+ * \struct dcReceiverCounters
+ * \brief Counters of a receiver
+ *
+ * fd and bytes are updated with atomic operations. The rest is written
+ * before the slot is published, or only used to take snapshots.
+ */
+struct dcReceiverCounters {
+	/// Descriptor the receiver is sent the data on, -1 once it's gone
+	int fd;
+	/// Bytes sent to it
+	uint64_t bytes;
+	/// Address of the receiver
+	char address[64];
+	/// When it connected
+	uint64_t connectedTime;
+	/// When it was disconnected, 0 while it's connected
+	uint64_t closedTime;
+	/// Bytes sent at the last sample
+	uint64_t sampleBytes;
+	/// Rate since the sample before the last one
+	double rate;
+};
+
+/**
+ * \class Stats
+ * \brief Counters of throughput of a job, which can be read at any time
+ *
+ * The threads of the job add the bytes and the time of each stage, see
+ * dcStage, and the bytes sent to each receiver. All the counters are
+ * updated with atomic operations, without locks, so the data path doesn't
+ * wait for the threads that take snapshots with getSnapshot().
+ *
+ * The instantaneous rates are computed between samples taken by the
+ * snapshots, at least STATS_RATE_INTERVAL apart.
+ *
+ * There is one for each job, see Job.
+ *
+ * \date October, 2026
+ */
+class Stats {
+public:
+	~Stats();
+	static Stats *getInstance();
+
+	static uint64_t now();
+
+	void start();
+	void finish();
+
+	void addStage(dcStage stage, uint64_t bytes, uint64_t startTime);
+
+	void addReceiver(int fd, const std::string &address);
+	void removeReceiver(int fd);
+	void countReceiverBytes(int fd, uint64_t bytes);
+
+	void getSnapshot(dcStats &stats);
+
+private:
+	/// Only the Job creates its Stats
+	Stats(const DataTransfer *transfer);
+	friend class Job;
+
+	/// Transfers of the job, which count the transferred bytes
+	const DataTransfer *_transfer;
+
+	/// When the job started, 0 if it hasn't started
+	uint64_t _startTime;
+	/// When the job finished, 0 while it's running
+	uint64_t _finishTime;
+
+	/// Counters of each stage, indexed by dcStage
+	dcStageCounters _stages[STATS_STAGES];
+
+	/// Counters of the receivers, the first _receiversCount are used
+	dcReceiverCounters _receivers[STATS_MAX_RECEIVERS];
+	/// Number of slots of _receivers in use
+	unsigned int _receiversCount;
+	/// Serializes addReceiver(), the counters are read without it
+	pthread_mutex_t _receiversMutex;
+
+	/// Serializes the snapshots, which take the samples
+	pthread_mutex_t _sampleMutex;
+	/// When the last sample was taken
+	uint64_t _sampleTime;
+	/// Transferred bytes at the last sample
+	uint64_t _sampleBytes;
+	/// Rate between the last two samples
+	double _rate;
+};
+
+}
+
+#endif /* STATS_H_ */
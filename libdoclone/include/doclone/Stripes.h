@@ -0,0 +1,190 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef STRIPES_H_
+#define STRIPES_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <doclone/exception/Exception.h>
+
+namespace Doclone {
+
+/**
+ * \var STRIPE_CHUNK_SIZE
+ *
+ * Bytes of the stream in each chunk sent on a stripe
+ */
+const unsigned int STRIPE_CHUNK_SIZE = 1048576;
+
+/**
+ * \var STRIPE_WINDOW
+ *
+ * Chunks, for each stripe, that a striped stream keeps in memory while they
+ * are sent, or while they wait for the ones before them when received
+ */
+const unsigned int STRIPE_WINDOW = 4;
+
+/**
+ * \var STRIPE_POOL_QUOTIENT
+ *
+ * When the job has a memory limit, the chunks of a striped stream can use the
+ * limit of the pool of buffers of its thread divided by this value, and at
+ * least one chunk for each connection
+ */
+const unsigned int STRIPE_POOL_QUOTIENT = 2;
+
+/**
+ * \var MAX_STRIPES
+ *
+ * Maximum number of connections of a striped stream
+ */
+const unsigned int MAX_STRIPES = 16;
+
+/**
+ * \var STRIPE_ACCEPT_TIMEOUT
+ *
+ * Milliseconds the connections of a striped stream are waited for after the
+ * offer
+ */
+const int STRIPE_ACCEPT_TIMEOUT = 10000;
+
+/**
+ * \class Stripes
+ * \brief A stream sent on many TCP connections at the same time
+ *
+ * A single TCP connection can't fill a link with a high bandwidth-delay
+ * product, because its window is limited and it backs off on every loss.
+ * The stream is cut into chunks, which are numbered and sent on the first
+ * connection that is free, so the fast connections carry more of them. The
+ * receiver writes them in order.
+ *
+ * Both ends see the stream as a local socket, given by getFd(), which is read
+ * and written like the connection itself. So the checksums and the frames of
+ * DataTransfer cover the stream as it's reassembled.
+ *
+ * Each chunk is sent as its number, in a big-endian uint64_t, its length, in
+ * a big-endian uint32_t, and its data. A chunk of length 0 ends a stripe, and
+ * its number is the number of chunks of the stream.
+ *
+ * The connections are opened after an offer on the first one: the number of
+ * connections, in a uint8_t, and a random token, in a big-endian uint64_t.
+ * The other ones are opened to PORT_STRIPE, and they send the token and their
+ * index, in a uint8_t.
+ *
+ * \date October, 2026
+ */
+class Stripes {
+public:
+	Stripes(int fd, const std::vector<int> &stripes, bool sending)
+			throw(Exception);
+	~Stripes();
+
+	int getFd() const;
+	void finish() throw(Exception);
+
+	static unsigned int getStreams();
+	static void setBufferSize(int fd);
+
+	static int listenStripes() throw(Exception);
+	static uint64_t offer(int fd, unsigned int count) throw(Exception);
+	static unsigned int readOffer(int fd, uint64_t &token) throw(Exception);
+	static bool acceptStripes(int listenFd, uint64_t token,
+			unsigned int count, std::vector<int> &stripes) throw(Exception);
+	static void connectStripes(int fd, uint64_t token, unsigned int count,
+			std::vector<int> &stripes) throw(Exception);
+
+private:
+	/// A chunk of the stream
+	typedef struct {
+		uint64_t seq;
+		uint32_t length;
+		char *data;
+	} dcStripeChunk;
+
+	/// A connection and the stream it belongs to
+	typedef struct {
+		Stripes *stripes;
+		int fd;
+	} dcStripe;
+
+	void startThread(void *(*body)(void *), void *arg) throw(Exception);
+	void stop();
+	void fail();
+
+	char *acquireChunk();
+
+	static bool sendAll(int fd, const void *buf, size_t len);
+	static bool recvAll(int fd, void *buf, size_t len);
+
+	static void *splitThread(void *arg);
+	void splitStream();
+
+	static void *sendThread(void *arg);
+	void sendStripe(int fd);
+
+	static void *recvThread(void *arg);
+	void recvStripe(int fd);
+
+	static void *joinThread(void *arg);
+	void joinStream();
+
+	/// Whether the stream is sent or received
+	bool _sending;
+	/// The connections, the first one is the one of the offer
+	std::vector<int> _sockets;
+	/// Local socket read or written by the user
+	int _fd;
+	/// Other end of _fd, used by the threads
+	int _end;
+	/// Threads splitting or joining the stream
+	std::vector<pthread_t> _threads;
+	/// Chunks queued, or received ahead of the next one, at most
+	uint64_t _window;
+
+	/// Chunks waiting to be sent
+	std::deque<dcStripeChunk> _queue;
+	/// Chunks received before the ones before them
+	std::map<uint64_t, dcStripeChunk> _pending;
+	/// Buffers of the chunks already sent or written
+	std::vector<char *> _free;
+	/// Number of the next chunk read from _end, or written to it
+	uint64_t _next;
+	/// Number of chunks of the stream, known when a stripe ends
+	uint64_t _total;
+	/// Stripes that have ended
+	unsigned int _ended;
+	/// Set when the whole stream has been read from _end
+	bool _eof;
+	/// Set when a connection fails, or the stream is interrupted
+	bool _failed;
+	/// Protects all the above
+	pthread_mutex_t _mutex;
+	/// Signals a chunk queued, sent, received or written
+	pthread_cond_t _changed;
+};
+
+}
+
+#endif /* STRIPES_H_ */
@@ -0,0 +1,152 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TRACER_H_
+#define TRACER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <doclone/Operation.h>
+#include <doclone/Stats.h>
+
+namespace Doclone {
+
+/**
+ * \var TRACE_SAMPLE_INTERVAL
+ *
+ * Time between the samples of the stages in a trace, in nanoseconds
+ */
+const uint64_t TRACE_SAMPLE_INTERVAL = 100000000ULL;
+
+/**
+ * \struct dcTracedOperation
+ * \brief An operation of the job that hasn't completed yet
+ */
+struct dcTracedOperation {
+	/// When it began, see Stats::now(), 0 if it hasn't yet
+	uint64_t start;
+	/// Id of the thread that began it, as the kernel knows it
+	long thread;
+};
+
+/**
+ * \struct dcTraceEvent
+ * \brief An event of a trace
+ */
+struct dcTraceEvent {
+	/// Phase of the event: 'X' for a span, 'C' for a counter
+	char phase;
+	/// Category of the event, like "operation" or "command"
+	std::string category;
+	/// Name of the event
+	std::string name;
+	/// When it started, see Stats::now()
+	uint64_t start;
+	/// How long it lasted, in nanoseconds
+	uint64_t duration;
+	/// Id of the thread, as the kernel knows it
+	long thread;
+	/// Members of the "args" object, already in JSON
+	std::string args;
+};
+
+/**
+ * \class Tracer
+ * \brief Records a timeline of a job and writes it as a Chrome trace
+ *
+ * Records spans for the operations, the external commands and the mounts
+ * and unmounts of the partitions, and samples the stages of Stats. The span
+ * of an operation goes from Clone::markStarted() to Clone::markCompleted(),
+ * on the thread that started it, so the operations of the targets that run
+ * at the same time are seen in parallel. When the job finishes, it writes
+ * them in the Trace Event Format of Chrome, which chrome://tracing and
+ * Perfetto load.
+ *
+ * The timestamps are the ones of CLOCK_MONOTONIC, and the threads are the
+ * ids of the kernel, as in the samples of perf.
+ *
+ * It records nothing unless a path is given to start(). Each Job has its own
+ * Tracer.
+ *
+ * \date October, 2026
+ */
+class Tracer {
+public:
+	~Tracer();
+
+	static Tracer *getInstance();
+
+	void start(const std::string &path);
+	void finish();
+	bool isEnabled() const;
+
+	void addSpan(const std::string &category, const std::string &name,
+			uint64_t startTime, const std::string &detail);
+	void queueOperation(dcOperationType type, const std::string &target);
+	void beginOperation(dcOperationType type, const std::string &target);
+	void endOperation(dcOperationType type, const std::string &target);
+
+private:
+	/// Only the Job creates its Tracer
+	Tracer(Stats *stats);
+	friend class Job;
+
+	static void *samplerThread(void *arg);
+	static long getThreadId();
+
+	void runSampler();
+	void sample(uint64_t time, const dcStats &stats, const dcStats &previous,
+			double seconds);
+	void write(uint64_t endTime);
+
+	/// Counters of the job, which are sampled
+	Stats *_stats;
+	/// File the trace is written in, empty if it's disabled
+	std::string _path;
+	/// Whether the events are recorded
+	bool _enabled;
+
+	/// Events recorded until now
+	std::vector<dcTraceEvent> _events;
+	/// Operations not completed yet, by their type and target
+	std::map<std::pair<int, std::string>, dcTracedOperation> _operations;
+	/// Protects the events and the operations
+	pthread_mutex_t _eventsMutex;
+
+	/// Thread that samples the stages
+	pthread_t _sampler;
+	/// Whether the sampler thread runs
+	bool _samplerStarted;
+	/// Whether the sampler thread must exit
+	bool _stopping;
+	/// Protects _stopping
+	pthread_mutex_t _samplerMutex;
+	/// Wakes up the sampler thread to exit
+	pthread_cond_t _samplerCond;
+};
+
+}
+
+#endif /* TRACER_H_ */
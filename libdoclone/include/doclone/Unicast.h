@@ -19,6 +19,9 @@
 #ifndef UNICAST_H_
 #define UNICAST_H_
 
+#include <stdint.h>
+
+#include <map>
 #include <string>
 #include <vector>
 
@@ -27,26 +30,65 @@
 
 namespace Doclone {
 
+class Spool;
+class Stripes;
+
+/**
+ * \var RESUME_RETRIES
+ *
+ * Times a receiver tries to resume a session without receiving more data
+ */
+const unsigned int RESUME_RETRIES = 5;
+
+/**
+ * \var RESUME_DELAY
+ *
+ * Seconds a receiver waits before connecting again to resume a session
+ */
+const unsigned int RESUME_DELAY = 2;
+
 /**
  * \class Unicast
  * \brief Implementation of the unicast/multicast server and client.
  *
  * Methods and attributes to clone over network using unicast or multicast.
+ * The sender can also push its image to a Collector, and the receiver can
+ * pull an image from an ImageServer.
+ * If the job sets a quorum lower than the number of nodes, the server starts
+ * sending when the quorum has connected, and the stream is sent to every
+ * receiver through a Spool. Then a receiver of an image that loses the
+ * connection connects again and resumes the session, see C_RESUME.
+ * If the job sets many streams, the stream of each receiver is striped across
+ * that number of connections, see Stripes.
  * Class inherited from Net.
  * \date August, 2011
  */
 class Unicast : public NetNode {
 public:
 	Unicast();
+	~Unicast();
 
 	void send() throw(Exception);
 	void receive() throw(Exception);
 
+	static int acceptReceiver(int listenFd, int stripeFd, uint64_t session,
+			dcHandshake &handshake, std::string &address) throw(Exception);
+
 private:
 	virtual void closeConnection() throw(Exception);
 
 	void tcpServer() throw(Exception);
-	void tcpClient() throw(Exception);
+	bool tcpClient(uint64_t offset) throw(Exception);
+	void tcpCollector() throw(Exception);
+
+	int connectServer(dcPort port) throw(Exception);
+	void sendRequest(int fd, dcCommand request, const std::string &name)
+			throw(Exception);
+	dcCommand readResponse(int fd) throw(Exception);
+
+	void stripeConnection(const std::vector<int> &stripes, bool sending)
+			throw(Exception);
+	void finishStripes() throw(Exception);
 
 	void sendFromImage() throw(Exception);
 	void sendFromDevice() throw(Exception);
@@ -54,11 +96,22 @@ private:
 	void receiveToImage() throw(Exception);
 	void receiveToDevice() throw(Exception);
 
+	uint64_t receiveSize() throw(Exception);
+	void receiveResuming(int fd, uint64_t totalSize) throw(Exception);
+
 	/// Number of receivers (for server)
 	unsigned int _nodesNum;
 
 	///Vector of sockets connected to the client or server
 	std::vector<int> _fds;
+
+	/// Striped streams, by their local socket in _fds
+	std::map<int, Stripes *> _stripes;
+
+	/// Spool the stream is sent through, NULL if there isn't a quorum
+	Spool *_spool;
+	/// Session of the server the receiver is in, 0 if it can't be resumed
+	uint64_t _session;
 };
 
 }
@@ -22,6 +22,7 @@
 #include <config.h>
 
 #include <stdint.h>
+#include <stdio.h>
 
 #include <string>
 
@@ -132,6 +133,12 @@ public:
 
 	static char *doubletoString(const double value, char *dst);
 	static double stringToDouble(const char* str);
+
+	static uint64_t getPeakMemory();
+
+	static FILE *createTempFile(const std::string &prefix);
+
+	static uint64_t randomId();
 };
 
 }
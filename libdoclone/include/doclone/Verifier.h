@@ -0,0 +1,120 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VERIFIER_H_
+#define VERIFIER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <doclone/exception/Exception.h>
+
+namespace Doclone {
+
+class Job;
+
+/**
+ * \var VERIFY_QUEUE_SIZE
+ *
+ * Maximum number of files waiting to be verified. Bounds the memory used
+ * while the manifest of the image is being read.
+ */
+const unsigned int VERIFY_QUEUE_SIZE = 1024;
+
+/**
+ * \var VERIFY_MIN_THREADS
+ *
+ * Minimum number of verifying threads. The verification is bound by the
+ * device, so there are more threads than processors in small systems.
+ */
+const unsigned int VERIFY_MIN_THREADS = 4;
+
+/**
+ * \struct dcVerifyFile
+ * \brief A file to be verified
+ */
+struct dcVerifyFile {
+	/// Path of the file in the filesystem
+	std::string path;
+	/// Size of the file in the image
+	uint64_t size;
+	/// CRC32C of the data of the file in the image
+	uint32_t crc;
+};
+
+/**
+ * \class Verifier
+ * \brief Compares many files with their checksums in parallel
+ *
+ * The files are queued with addFile() and read by a pool of threads. Each
+ * file that is missing or whose size or CRC32C don't match is reported as a
+ * FileMismatchException.
+ *
+ * \date October, 2026
+ */
+class Verifier {
+public:
+	Verifier();
+	~Verifier();
+
+	void start() throw(Exception);
+	void addFile(const dcVerifyFile &file);
+	void finish();
+
+	uint64_t getVerifiedFiles() const;
+	uint64_t getMismatches() const;
+
+private:
+	static void *workerThread(void *arg);
+
+	void work();
+	bool verifyFile(const dcVerifyFile &file, char *buf, size_t size);
+
+	/// Files waiting to be verified
+	std::deque<dcVerifyFile> _queue;
+	/// Set when no more files will be added
+	bool _done;
+	/// The verifying threads
+	std::vector<pthread_t> _threads;
+	/// Job of the thread that started the verification
+	Job *_job;
+	/// A buffer of the pool of DataTransfer for each thread
+	std::vector<char *> _buffers;
+	/// Next buffer to be taken by a starting thread
+	unsigned int _nextBuffer;
+	/// Size of each buffer
+	size_t _bufferSize;
+	/// Number of files verified
+	uint64_t _verifiedFiles;
+	/// Number of files that don't match
+	uint64_t _mismatches;
+	/// Protects all the above
+	pthread_mutex_t _mutex;
+	/// Signals new files in the queue, or the end of them
+	pthread_cond_t _notEmpty;
+	/// Signals free room in the queue
+	pthread_cond_t _notFull;
+};
+
+}
+
+#endif /* VERIFIER_H_ */
@@ -53,9 +53,11 @@
 #ifdef __cplusplus
 
 #include <doclone/DataTransfer.h>
+#include <doclone/Job.h>
 #include <doclone/Logger.h>
 #include <doclone/observer/AbstractObserver.h>
 #include <doclone/Operation.h>
+#include <doclone/Stats.h>
 #include <doclone/exception/Exception.h>
 
 #endif //__cplusplus
@@ -82,6 +84,10 @@
  * 	doclone_destroy(dc_obj);
  * \endcode
  *
+ * Each dc_doclone object is an independent job, with its own options, progress
+ * and events. Many of them can run at the same time, each one in a different
+ * thread.
+ *
  * It is possible to subscribe the events of the library. These can be used to
  * know the operations progress and possible incidences.
  * To do this, some functions must be implemented with the proper prototype.
@@ -179,6 +185,18 @@
  * - nodes number (int): The number of receivers
  * - empty (int): Clone the partition table without reading/writing the data (true or false)
  * - force (int): Force working even if the image doesn't fit in the destination device (true or false)
+ * - memory limit (int): Memory budget of the job in MiB, 0 for no limit
+ * - base (char*): Full image an incremental image is created from or restored with
+ * - repository (char*): Directory where the data of the files is deduplicated
+ * - sync (int): Restore only the changes into the filesystems of the device (true or false)
+ * - targets (char*): The device paths a device or an image is cloned to
+ * - remote image (char*): Name of the image requested to an image server
+ * - writers (int): Images a collector writes at the same time, 0 for the default
+ * - quorum (int): Receivers a server waits for before sending, 0 for all of them
+ * - streams (int): TCP connections each receiver is sent the data on
+ * - socket buffer (int): Size of the buffers of the sockets in KiB, 0 for the default
+ * - zero copy (int): Send the data without copying it to the kernel (true or false)
+ * - trace (char*): File a timeline of the operations is written in, empty for none
  *
  * These are some functions for configuring those properties:
  *
@@ -190,6 +208,19 @@
  * 	void doclone_set_nodes_number(dc_doclone *dc_obj, unsigned int number);
  * 	void doclone_set_empty(dc_doclone *dc_obj, unsigned short empty);
  * 	void doclone_set_force(dc_doclone *dc_obj, unsigned short force);
+ * 	void doclone_set_memory_limit(dc_doclone *dc_obj, unsigned int memoryLimit);
+ * 	void doclone_set_base(dc_doclone *dc_obj, const char *base);
+ * 	void doclone_set_repository(dc_doclone *dc_obj, const char *repository);
+ * 	void doclone_set_sync(dc_doclone *dc_obj, unsigned short sync);
+ * 	void doclone_set_target(dc_doclone *dc_obj, const char *target);
+ * 	void doclone_add_target(dc_doclone *dc_obj, const char *target);
+ * 	void doclone_set_remote_image(dc_doclone *dc_obj, const char *remoteImage);
+ * 	void doclone_set_writers(dc_doclone *dc_obj, unsigned int writers);
+ * 	void doclone_set_quorum(dc_doclone *dc_obj, unsigned int quorum);
+ * 	void doclone_set_streams(dc_doclone *dc_obj, unsigned int streams);
+ * 	void doclone_set_socket_buffer(dc_doclone *dc_obj, unsigned int socketBuffer);
+ * 	void doclone_set_zero_copy(dc_doclone *dc_obj, unsigned short zeroCopy);
+ * 	void doclone_set_trace(dc_doclone *dc_obj, const char *trace);
  * \endcode
  *
  * The last step is to call one of the functions that perform the work:
@@ -197,8 +228,13 @@
  * \code
  * 	int doclone_create(const dc_doclone *dc_obj);
  * 	int doclone_restore(const dc_doclone *dc_obj);
+ * 	int doclone_verify(const dc_doclone *dc_obj);
+ * 	int doclone_local_clone(const dc_doclone *dc_obj);
+ * 	int doclone_duplicate(const dc_doclone *dc_obj);
  * 	int doclone_send(const dc_doclone *dc_obj);
  * 	int doclone_receive(const dc_doclone *dc_obj);
+ * 	int doclone_serve(const dc_doclone *dc_obj);
+ * 	int doclone_collect(const dc_doclone *dc_obj);
  * 	int doclone_chain_origin(const dc_doclone *dc_obj);
  * 	int doclone_chain_link(const dc_doclone *dc_obj);
  * \endcode
@@ -207,6 +243,25 @@
  * attributes must be properly set, and return 0 if everything is OK, or -1 if
  * something has failed.
  *
+ * While one of them runs, another thread can read the progress of the job
+ * with:
+ *
+ * \code
+ * 	int doclone_get_stats(const dc_doclone *dc_obj, dc_stats *stats);
+ * \endcode
+ *
+ * It fills a dc_stats with the instantaneous and average rates, the ETA, the
+ * bytes and time of each stage of the job and the rates of the receivers of
+ * a server. Reading them doesn't slow the transfers down.
+ *
+ * The callbacks are called by a thread of the library, not by the ones that
+ * transfer the data. The transfer events are coalesced, and the callback gets
+ * at most as many per second as set, for all the jobs, with:
+ *
+ * \code
+ * 	void doclone_set_event_rate(unsigned int eventRate);
+ * \endcode
+ *
  * These are some examples of use:
  *
  * - Creating or restoring an image of/into a device:
@@ -310,6 +365,8 @@ typedef enum dcOperationEvent {
  * 	Waiting for connect to server
  * \var OP_WAIT_CLIENTS
  * 	Waiting for connect to client/s
+ * \var OP_VERIFY_DATA
+ * 	Verifying the restored data against the image
  */
 typedef enum dcOperationType {
 	OP_NONE,
@@ -325,7 +382,8 @@ typedef enum dcOperationType {
 	OP_GRUB_INSTALL,
 	OP_TRANSFER_DATA,
 	OP_WAIT_SERVER,
-	OP_WAIT_CLIENTS
+	OP_WAIT_CLIENTS,
+	OP_VERIFY_DATA
 } dcOperationType;
 
 /**
@@ -345,6 +403,35 @@ typedef enum dcEvent {
 	EVT_NEW_CONNECION
 } dcEvent;
 
+/**
+ * \enum dcStage
+ * \brief C wrapper for Doclone::dcStage
+ *
+ * \var STAGE_WALK
+ * 	Walking the trees of the filesystems
+ * \var STAGE_READ
+ * 	Reading data from local files and devices
+ * \var STAGE_COMPRESS
+ * 	Writing data in archives
+ * \var STAGE_SEND
+ * 	Sending data over the network
+ * \var STAGE_RECEIVE
+ * 	Receiving data from the network
+ * \var STAGE_EXTRACT
+ * 	Writing the data of archives in the files it is restored to
+ * \var STAGE_FSYNC
+ * 	Flushing the written data to the disk
+ */
+typedef enum dcStage {
+	STAGE_WALK,
+	STAGE_READ,
+	STAGE_COMPRESS,
+	STAGE_SEND,
+	STAGE_RECEIVE,
+	STAGE_EXTRACT,
+	STAGE_FSYNC
+} dcStage;
+
 /**
  * \typedef transferCallback
  *
@@ -378,6 +465,13 @@ typedef void (*generalCallback) (dcEvent event, const char *target);
  */
 typedef void (*notificationCallback) (const char *str);
 
+/**
+ * \def DC_MAX_TARGETS
+ *
+ * Maximum number of target devices of a local clone
+ */
+#define DC_MAX_TARGETS 16
+
 /**
  * \struct dc_doclone
  * \brief Main object of the C wrapper API of libdoclone
@@ -397,10 +491,109 @@ typedef struct dc_doclone {
 	uint8_t _empty;
 	/// Mode force enabled/disabled
 	uint8_t _force;
+	/// Memory budget of the job in MiB, 0 for no limit
+	uint32_t _memoryLimit;
+	/// Base image path entered by the user, empty for full images
+	char _base[512];
+	/// Repository path entered by the user, empty to keep the data in the image
+	char _repository[512];
+	/// Sync mode enabled/disabled
+	uint8_t _sync;
+	/// Target device paths entered by the user, for local clones
+	char _targets[DC_MAX_TARGETS][512];
+	/// Number of target devices entered by the user
+	uint32_t _targetsNumber;
+	/// Image requested to an image server, empty for a Unicast server
+	char _remoteImage[256];
+	/// Images a collector writes at the same time, 0 for the default
+	uint32_t _writers;
+	/// Receivers a server waits for before sending, 0 for all of them
+	uint32_t _quorum;
+	/// TCP connections each receiver is sent the data on, 0 for one
+	uint32_t _streams;
+	/// Size of the buffers of the sockets in KiB, 0 for the default
+	uint32_t _socketBuffer;
+	/// Zero-copy sends enabled/disabled
+	uint8_t _zeroCopy;
+	/// Trace file path entered by the user, empty for none
+	char _trace[512];
 	/// Event subscriber object
 	void * _observer;
+	/// Job of the library where the operations of this object run
+	void * _job;
 } dc_doclone;
 
+/**
+ * \def DC_STATS_STAGES
+ *
+ * Number of stages in dcStage
+ */
+#define DC_STATS_STAGES 7
+
+/**
+ * \def DC_STATS_MAX_RECEIVERS
+ *
+ * Maximum number of receivers in a dc_stats
+ */
+#define DC_STATS_MAX_RECEIVERS 64
+
+/**
+ * \struct dc_stage_stats
+ * \brief What a stage of a job has done until now
+ */
+typedef struct dc_stage_stats {
+	/// Bytes processed in the stage
+	uint64_t bytes;
+	/// Time spent in the stage, in seconds, added up in all the threads
+	double seconds;
+	/// Number of calls, or of files for STAGE_WALK
+	uint64_t calls;
+} dc_stage_stats;
+
+/**
+ * \struct dc_receiver_stats
+ * \brief What has been sent to a receiver
+ */
+typedef struct dc_receiver_stats {
+	/// Address of the receiver
+	char address[64];
+	/// Bytes sent to it
+	uint64_t bytes;
+	/// Bytes per second since the last sample
+	double rate;
+	/// Bytes per second since it connected
+	double averageRate;
+	/// Whether it is still connected
+	uint8_t connected;
+} dc_receiver_stats;
+
+/**
+ * \struct dc_stats
+ * \brief A snapshot of the progress of a job, see doclone_get_stats()
+ */
+typedef struct dc_stats {
+	/// Total size to transfer, 0 while it's unknown
+	uint64_t totalSize;
+	/// Bytes transferred until now
+	uint64_t transferredBytes;
+	/// Seconds since the job started
+	double elapsed;
+	/// Bytes per second since the last sample
+	double rate;
+	/// Bytes per second since the job started
+	double averageRate;
+	/// Seconds to finish at the current rate, -1 if it's unknown
+	double eta;
+	/// Whether the job has finished
+	uint8_t finished;
+	/// Counters of each stage, indexed by dcStage
+	dc_stage_stats stages[DC_STATS_STAGES];
+	/// Number of receivers in receivers
+	uint32_t receiversNumber;
+	/// Receivers of a server, in the order they connected
+	dc_receiver_stats receivers[DC_STATS_MAX_RECEIVERS];
+} dc_stats;
+
 
 /*
  * AC_CHECK_LIB Macro compatibility
@@ -418,8 +611,13 @@ void doclone_destroy(dc_doclone *dc_obj);
  */
 int doclone_create(const dc_doclone *dc_obj);
 int doclone_restore(const dc_doclone *dc_obj);
+int doclone_verify(const dc_doclone *dc_obj);
+int doclone_local_clone(const dc_doclone *dc_obj);
+int doclone_duplicate(const dc_doclone *dc_obj);
 int doclone_send(const dc_doclone *dc_obj);
 int doclone_receive(const dc_doclone *dc_obj);
+int doclone_serve(const dc_doclone *dc_obj);
+int doclone_collect(const dc_doclone *dc_obj);
 int doclone_chain_origin(const dc_doclone *dc_obj);
 int doclone_chain_link(const dc_doclone *dc_obj);
 
@@ -433,6 +631,26 @@ void doclone_set_interface(dc_doclone *dc_obj, const char *interface);
 void doclone_set_nodes_number(dc_doclone *dc_obj, unsigned int number);
 void doclone_set_empty(dc_doclone *dc_obj, unsigned short empty);
 void doclone_set_force(dc_doclone *dc_obj, unsigned short force);
+void doclone_set_memory_limit(dc_doclone *dc_obj, unsigned int memoryLimit);
+void doclone_set_base(dc_doclone *dc_obj, const char *base);
+void doclone_set_repository(dc_doclone *dc_obj, const char *repository);
+void doclone_set_sync(dc_doclone *dc_obj, unsigned short sync);
+void doclone_set_target(dc_doclone *dc_obj, const char *target);
+void doclone_add_target(dc_doclone *dc_obj, const char *target);
+void doclone_set_remote_image(dc_doclone *dc_obj, const char *remoteImage);
+void doclone_set_writers(dc_doclone *dc_obj, unsigned int writers);
+void doclone_set_quorum(dc_doclone *dc_obj, unsigned int quorum);
+void doclone_set_streams(dc_doclone *dc_obj, unsigned int streams);
+void doclone_set_socket_buffer(dc_doclone *dc_obj, unsigned int socketBuffer);
+void doclone_set_zero_copy(dc_doclone *dc_obj, unsigned short zeroCopy);
+void doclone_set_trace(dc_doclone *dc_obj, const char *trace);
+void doclone_set_event_rate(unsigned int eventRate);
+
+/*
+ * Statistics of the last job
+ */
+uint64_t doclone_get_peak_memory();
+int doclone_get_stats(const dc_doclone *dc_obj, dc_stats *stats);
 
 /*
  * Functions for set the callbacks of libdoclone events
@@ -462,13 +680,15 @@ void doclone_subscribe_to_notifications(dc_doclone *dc_obj,
  */
 class DefaultObserver : public Doclone::AbstractObserver {
 public:
-	DefaultObserver();
+	DefaultObserver(Doclone::Job *job);
+	~DefaultObserver();
 
 	void notify(Doclone::dcTransferEvent event, uint64_t numBytes);
 	void notify(Doclone::dcOperationEvent event,
 			Doclone::dcOperationType type, const std::string &target);
 	void notify(Doclone::dcEvent event, const std::string &target);
 	void notify(const std::string &str);
+	void notify(const std::string &str, Doclone::Job *job);
 
 	void setTCallback(const transferCallback call);
 	void setOCallback(const operationCallback call);
@@ -484,6 +704,8 @@ private:
 	generalCallback _gCallback;
 	/// Callback function for the notifications of the exceptions
 	notificationCallback _nCallback;
+	/// Job whose events are listened
+	Doclone::Job *_job;
 };
 
 #endif //__cplusplus
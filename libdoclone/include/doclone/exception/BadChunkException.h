@@ -0,0 +1,58 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BADCHUNKEXCEPTION_H_
+#define BADCHUNKEXCEPTION_H_
+
+#include <string>
+
+#include <doclone/exception/ErrorException.h>
+
+namespace Doclone {
+
+/**
+ * \addtogroup Exceptions
+ * @{
+ *
+ * \class BadChunkException
+ * \brief A chunk of a repository is missing or its data is damaged
+ * \date October, 2026
+ */
+class BadChunkException : public ErrorException {
+public:
+	/// \param chunk The SHA-256 of the chunk
+	BadChunkException(const std::string &chunk) throw()
+		: _chunk(chunk) {
+		// TO TRANSLATORS: looks like	Missing or damaged chunk: 9f86d08...
+		std::string msg= D_("Missing or damaged chunk:");
+		msg.append(" ");
+		msg.append(this->_chunk);
+
+		this->_msg = msg;
+	}
+	~BadChunkException() throw() {}
+
+private:
+	/// The SHA-256 of the chunk
+	const std::string _chunk;
+};
+/**@}*/
+
+}
+
+#endif /* BADCHUNKEXCEPTION_H_ */
@@ -0,0 +1,75 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CORRUPTEDCHUNKEXCEPTION_H_
+#define CORRUPTEDCHUNKEXCEPTION_H_
+
+#include <stdint.h>
+
+#include <sstream>
+
+#include <doclone/exception/ErrorException.h>
+
+namespace Doclone {
+
+/**
+ * \addtogroup Exceptions
+ * @{
+ *
+ * \class CorruptedChunkException
+ * \brief A chunk of a checksummed stream doesn't match its checksum
+ * \date October, 2026
+ */
+class CorruptedChunkException : public ErrorException {
+public:
+	/**
+	 * \param chunk Index of the chunk in the stream
+	 * \param offset Position of the first byte of the chunk in the stream
+	 * \param length Number of bytes of the chunk
+	 */
+	CorruptedChunkException(uint64_t chunk, uint64_t offset,
+			uint64_t length) throw()
+		: _chunk(chunk), _offset(offset), _length(length) {
+		std::ostringstream range;
+		range << " " << this->_chunk << " (" << this->_offset << "-"
+				<< this->_offset + this->_length << ")";
+
+		// TO TRANSLATORS: looks like	Corrupted data in chunk 12 (12582912-13631488)
+		std::string msg = D_("Corrupted data in chunk");
+		msg.append(range.str());
+
+		this->_msg = msg;
+	}
+
+	uint64_t getChunk() const throw() { return this->_chunk; }
+	uint64_t getOffset() const throw() { return this->_offset; }
+	uint64_t getLength() const throw() { return this->_length; }
+
+private:
+	/// Index of the chunk in the stream
+	const uint64_t _chunk;
+	/// Position of the first byte of the chunk in the stream
+	const uint64_t _offset;
+	/// Number of bytes of the chunk
+	const uint64_t _length;
+};
+/**@}*/
+
+}
+
+#endif /* CORRUPTEDCHUNKEXCEPTION_H_ */
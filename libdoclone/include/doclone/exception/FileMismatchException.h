@@ -0,0 +1,58 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILEMISMATCHEXCEPTION_H_
+#define FILEMISMATCHEXCEPTION_H_
+
+#include <string>
+
+#include <doclone/exception/WarningException.h>
+
+namespace Doclone {
+
+/**
+ * \addtogroup Exceptions
+ * @{
+ *
+ * \class FileMismatchException
+ * \brief A restored file is missing or its data differs from the image
+ * \date October, 2026
+ */
+class FileMismatchException : public WarningException {
+public:
+	/// \param file The path of the file
+	FileMismatchException(const std::string &file) throw()
+		: _file(file) {
+		// TO TRANSLATORS: looks like	File doesn't match the image: /etc/fstab
+		std::string msg= D_("File doesn't match the image:");
+		msg.append(" ");
+		msg.append(this->_file);
+
+		this->_msg = msg;
+	}
+	~FileMismatchException() throw() {}
+
+private:
+	/// The path of the file
+	const std::string _file;
+};
+/**@}*/
+
+}
+
+#endif /* FILEMISMATCHEXCEPTION_H_ */
@@ -0,0 +1,45 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NOMANIFESTEXCEPTION_H_
+#define NOMANIFESTEXCEPTION_H_
+
+#include <doclone/exception/ErrorException.h>
+
+namespace Doclone {
+
+/**
+ * \addtogroup Exceptions
+ * @{
+ *
+ * \class NoManifestException
+ * \brief The image has no checksums of its files to verify them
+ * \date October, 2026
+ */
+class NoManifestException : public ErrorException {
+public:
+	NoManifestException() throw() {
+		this->_msg=D_("The image has no checksums to verify the data");
+	}
+
+};
+/**@}*/
+
+}
+
+#endif /* NOMANIFESTEXCEPTION_H_ */
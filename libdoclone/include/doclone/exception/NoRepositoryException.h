@@ -0,0 +1,45 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NOREPOSITORYEXCEPTION_H_
+#define NOREPOSITORYEXCEPTION_H_
+
+#include <doclone/exception/ErrorException.h>
+
+namespace Doclone {
+
+/**
+ * \addtogroup Exceptions
+ * @{
+ *
+ * \class NoRepositoryException
+ * \brief The image has its data in a repository and none has been given
+ * \date October, 2026
+ */
+class NoRepositoryException : public ErrorException {
+public:
+	NoRepositoryException() throw() {
+		this->_msg=D_("The data of the image is in a repository, it is needed to restore it");
+	}
+
+};
+/**@}*/
+
+}
+
+#endif /* NOREPOSITORYEXCEPTION_H_ */
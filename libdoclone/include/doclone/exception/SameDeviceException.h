@@ -0,0 +1,45 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SAMEDEVICEEXCEPTION_H_
+#define SAMEDEVICEEXCEPTION_H_
+
+#include <doclone/exception/ErrorException.h>
+
+namespace Doclone {
+
+/**
+ * \addtogroup Exceptions
+ * @{
+ *
+ * \class SameDeviceException
+ * \brief The source and the target of a local clone are the same device
+ * \date October, 2026
+ */
+class SameDeviceException : public ErrorException {
+public:
+	SameDeviceException() throw() {
+		this->_msg=D_("The source and the target must be different devices");
+	}
+
+};
+/**@}*/
+
+}
+
+#endif /* SAMEDEVICEEXCEPTION_H_ */
@@ -0,0 +1,54 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SYNCLAYOUTEXCEPTION_H_
+#define SYNCLAYOUTEXCEPTION_H_
+
+#include <string>
+
+#include <doclone/exception/ErrorException.h>
+
+namespace Doclone {
+
+/**
+ * \addtogroup Exceptions
+ * @{
+ *
+ * \class SyncLayoutException
+ * \brief The partitions of the device are not the ones of the image, so
+ * it can't be synchronized with it
+ * \date October, 2026
+ */
+class SyncLayoutException : public ErrorException {
+public:
+	/// \param device The device to be synchronized
+	SyncLayoutException(const std::string &device) throw() {
+		// TO TRANSLATORS: looks like	The partitions don't match the image: /dev/sdb
+		std::string msg= D_("The partitions don't match the image:");
+		msg.append(" ");
+		msg.append(device);
+
+		this->_msg = msg;
+	}
+
+};
+/**@}*/
+
+}
+
+#endif /* SYNCLAYOUTEXCEPTION_H_ */
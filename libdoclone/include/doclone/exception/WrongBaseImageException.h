@@ -0,0 +1,45 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WRONGBASEIMAGEEXCEPTION_H_
+#define WRONGBASEIMAGEEXCEPTION_H_
+
+#include <doclone/exception/ErrorException.h>
+
+namespace Doclone {
+
+/**
+ * \addtogroup Exceptions
+ * @{
+ *
+ * \class WrongBaseImageException
+ * \brief The base image can't be used with this image
+ * \date October, 2026
+ */
+class WrongBaseImageException : public ErrorException {
+public:
+	WrongBaseImageException() throw() {
+		this->_msg=D_("The base image is not a full image or not the one the image was created from");
+	}
+
+};
+/**@}*/
+
+}
+
+#endif /* WRONGBASEIMAGEEXCEPTION_H_ */
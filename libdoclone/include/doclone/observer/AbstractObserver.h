@@ -27,6 +27,8 @@
 
 namespace Doclone {
 
+class Job;
+
 /**
  * \enum dcEvent
  * \brief Type for general events in the library
@@ -137,6 +139,21 @@ public:
 	 * 		The message of the exception.
 	 */
 	virtual void notify(const std::string &str)=0;
+
+	/**
+	 * \brief Gets the notification of the exceptions, with their job.
+	 *
+	 * The messages of all the jobs come from the same Logger, this one tells
+	 * which job raised each of them. By default it calls notify(str).
+	 *
+	 * \param str
+	 * 		The message of the exception.
+	 * \param job
+	 * 		The job of the thread that raised the exception.
+	 */
+	virtual void notify(const std::string &str, Job *job) {
+		this->notify(str);
+	}
 };
 
 } /* namespace Doclone */
@@ -19,6 +19,8 @@
 #ifndef ABSTRACTSUBJECT_H_
 #define ABSTRACTSUBJECT_H_
 
+#include <pthread.h>
+
 #include <set>
 #include <string>
 
@@ -26,18 +28,23 @@
 
 namespace Doclone {
 
+struct dcNotification;
+
 /**
  * \class AbstractSubject
  *
  * Base class for the subjects of the observer pattern. When other class extends
  * this one, it can notify new events to the observers.
  *
+ * The events are delivered by the Notifier in its own thread. The end and the
+ * cancellation of an execution wait until the observers have all the events.
+ *
  * \date September, 2011
  */
 class AbstractSubject {
 public:
 	AbstractSubject();
-	virtual ~AbstractSubject(){}
+	virtual ~AbstractSubject();
 
 	void addObserver(AbstractObserver* ob);
 	void removeObserver(AbstractObserver* ob);
@@ -51,6 +58,24 @@ protected:
 
 	/// List of the observers subscribed
 	std::set<AbstractObserver*> _observers;
+	/// Protects the list of observers, shared by the threads of the jobs
+	pthread_mutex_t _observersMutex;
+
+private:
+	/// Only the Notifier delivers the events
+	friend class Notifier;
+
+	void dispatch(const dcNotification &notification);
+	void dispatchProgress(uint64_t now);
+
+	/// Last amount of bytes transferred, waiting to be delivered
+	uint64_t _pendingBytes;
+	/// Whether the progress of this subject is queued in the Notifier
+	bool _progressQueued;
+	/// When the last progress was delivered, only used by the Notifier
+	uint64_t _lastProgress;
+	/// Whether any event of this subject has been posted to the Notifier
+	bool _posted;
 };
 
 } /* namespace Doclone */
@@ -0,0 +1,159 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef NOTIFIER_H_
+#define NOTIFIER_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+#include <doclone/observer/AbstractObserver.h>
+
+namespace Doclone {
+
+class AbstractSubject;
+
+/**
+ * \var DEFAULT_EVENT_RATE
+ *
+ * Transfer progress events delivered per second by default
+ */
+const unsigned int DEFAULT_EVENT_RATE = 10;
+
+/**
+ * \enum dcNotificationKind
+ * \brief Kind of a queued notification
+ *
+ * \var NOTIF_TRANSFER
+ * 	A transfer event, other than the progress
+ * \var NOTIF_PROGRESS
+ * 	The subject has a new amount of bytes transferred
+ * \var NOTIF_OPERATION
+ * 	An operation event
+ * \var NOTIF_GENERAL
+ * 	A general event
+ * \var NOTIF_MESSAGE
+ * 	The message of an exception
+ * \var NOTIF_FLUSH
+ * 	A thread waits until the notifications before this one are delivered
+ */
+enum dcNotificationKind {
+	NOTIF_TRANSFER,
+	NOTIF_PROGRESS,
+	NOTIF_OPERATION,
+	NOTIF_GENERAL,
+	NOTIF_MESSAGE,
+	NOTIF_FLUSH
+};
+
+/**
+ * \struct dcNotification
+ * \brief A notification in the queue of the Notifier
+ */
+struct dcNotification {
+	/// Next notification in the queue
+	dcNotification *next;
+	/// Kind of the notification
+	dcNotificationKind kind;
+	/// Subject whose observers are notified
+	AbstractSubject *subject;
+	/// The event, of the type given by the kind
+	int event;
+	/// The involving operation, for the operation events
+	dcOperationType type;
+	/// Number of bytes, for the transfer events
+	uint64_t numBytes;
+	/// The involving target, or the message
+	std::string text;
+	/// Job of the thread that posted the notification, for the messages
+	Job *job;
+	/// Set when a flush is done, for NOTIF_FLUSH
+	bool *done;
+};
+
+/**
+ * \class Notifier
+ * \brief Delivers the events of the subjects to their observers in its own
+ * thread
+ *
+ * The threads that raise the events only push them in a lock-free queue,
+ * so a slow observer doesn't stop the transfers. The events are delivered in
+ * the order they were raised.
+ *
+ * The progress events of a subject are coalesced: it only keeps the last
+ * amount of bytes transferred, which is delivered at most getMaxRate() times
+ * per second. Any other event delivers the pending progress first.
+ *
+ * There is one notifier for all the jobs.
+ *
+ * \date October, 2026
+ */
+class Notifier {
+public:
+	static Notifier *getInstance();
+
+	void post(dcNotification *notification);
+	void postProgress(AbstractSubject *subject);
+	void flush();
+
+	unsigned int getMaxRate() const;
+	void setMaxRate(unsigned int maxRate);
+
+private:
+	Notifier();
+
+	static void *notifierThread(void *arg);
+	static void createInstance();
+
+	void push(dcNotification *notification);
+	dcNotification *pop();
+	bool isEmpty() const;
+
+	void run();
+	void dispatch(dcNotification *notification);
+	uint64_t deliverDeferred(bool all);
+
+	/// Last notification pushed, written by any thread
+	dcNotification *_head;
+	/// Last notification popped, only used by the notifier thread
+	dcNotification *_tail;
+
+	/// Subjects whose progress waits for the rate limit
+	std::vector<AbstractSubject *> _deferred;
+	/// Progress events delivered per second and subject, 0 for no limit
+	unsigned int _maxRate;
+
+	/// The thread that delivers the events
+	pthread_t _thread;
+	/// Protects the sleep of the notifier thread and the flushes
+	pthread_mutex_t _mutex;
+	/// Wakes up the notifier thread
+	pthread_cond_t _cond;
+	/// Wakes up the threads waiting for a flush
+	pthread_cond_t _flushedCond;
+	/// Whether the notifier thread waits for new notifications
+	bool _sleeping;
+};
+
+}
+
+#endif /* NOTIFIER_H_ */
@@ -20,6 +20,7 @@
 #define XMLSTRINGHANDLER_H_
 
 #include <stdint.h>
+#include <pthread.h>
 
 #include <vector>
 
@@ -36,6 +37,8 @@ namespace Doclone {
  *
  * \brief Handling of the memory management for the transcoded strings.
  *
+ * It is shared by all the jobs, so the storage is protected by a mutex.
+ *
  * \date Junde, 2015
  */
 class XMLStringHandler {
@@ -64,6 +67,9 @@ private:
 
 	///Storage for the C strings
 	std::vector<const char*> _listCStrings;
+
+	/// Protects the storage, for the jobs running at the same time
+	pthread_mutex_t _listsMutex;
 };
 
 }
@@ -18,9 +18,29 @@
 
 #include <doclone/observer/AbstractSubject.h>
 
+#include <doclone/Job.h>
+#include <doclone/observer/Notifier.h>
+
 namespace Doclone {
 
-AbstractSubject::AbstractSubject(): _observers() {
+AbstractSubject::AbstractSubject(): _observers(), _observersMutex(),
+		_pendingBytes(0), _progressQueued(false), _lastProgress(0),
+		_posted(false) {
+	// Recursive, an observer can raise a new event while being notified
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&this->_observersMutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+AbstractSubject::~AbstractSubject() {
+	// No event of this subject may stay in the notifier
+	if(__atomic_load_n(&this->_posted, __ATOMIC_ACQUIRE)) {
+		Notifier::getInstance()->flush();
+	}
+
+	pthread_mutex_destroy(&this->_observersMutex);
 }
 
 /**
@@ -30,21 +50,29 @@ AbstractSubject::AbstractSubject(): _observers() {
  * 		An object whose class extends AbstractObserver
  */
 void AbstractSubject::addObserver(AbstractObserver* ob) {
+	pthread_mutex_lock(&this->_observersMutex);
 	this->_observers.insert(ob);
+	pthread_mutex_unlock(&this->_observersMutex);
 }
 
 /**
  * Unsubscribes an observer
  *
+ * It isn't notified anymore once this function returns.
+ *
  * \param ob
  * 		An object whose class extends AbstractObserver
  */
 void AbstractSubject::removeObserver(AbstractObserver* ob) {
+	pthread_mutex_lock(&this->_observersMutex);
 	this->_observers.erase(ob);
+	pthread_mutex_unlock(&this->_observersMutex);
 }
 
 /**
- * Calls the method notify() in all observers, for the transfer events
+ * Queues a transfer event for all observers
+ *
+ * The progress events are coalesced, see Notifier.
  *
  * \param event
  * 		The event triggered
@@ -52,17 +80,31 @@ void AbstractSubject::removeObserver(AbstractObserver* ob) {
  * 		Number of bytes to set/update
  */
 void AbstractSubject::notifyObservers(dcTransferEvent event, uint64_t numBytes) {
+	__atomic_store_n(&this->_posted, true, __ATOMIC_RELEASE);
 
-	 std::set<AbstractObserver*>::iterator itr;
+	if(event == Doclone::TRANS_TRANSFERRED_BYTES) {
+		__atomic_store_n(&this->_pendingBytes, numBytes, __ATOMIC_SEQ_CST);
 
-	for ( itr = this->_observers.begin();
-		  itr != this->_observers.end(); itr++ ) {
-		(*itr)->notify(event, numBytes);
+		// Only queued if the notifier hasn't got the previous amount yet
+		if(!__atomic_exchange_n(&this->_progressQueued, true,
+				__ATOMIC_SEQ_CST)) {
+			Notifier::getInstance()->postProgress(this);
+		}
+
+		return;
 	}
+
+	dcNotification *notification = new dcNotification();
+	notification->kind = NOTIF_TRANSFER;
+	notification->subject = this;
+	notification->event = event;
+	notification->numBytes = numBytes;
+
+	Notifier::getInstance()->post(notification);
 }
 
 /**
- * Calls the method notify() in all observers, for the operation events
+ * Queues an operation event for all observers
  *
  * \param event
  * 		The event triggered
@@ -73,17 +115,23 @@ void AbstractSubject::notifyObservers(dcTransferEvent event, uint64_t numBytes)
  */
 void AbstractSubject::notifyObservers(dcOperationEvent event,
 		dcOperationType type, const std::string &target) {
+	__atomic_store_n(&this->_posted, true, __ATOMIC_RELEASE);
 
-	 std::set<AbstractObserver*>::iterator itr;
+	dcNotification *notification = new dcNotification();
+	notification->kind = NOTIF_OPERATION;
+	notification->subject = this;
+	notification->event = event;
+	notification->type = type;
+	notification->text = target;
 
-	for ( itr = this->_observers.begin();
-		  itr != this->_observers.end(); itr++ ) {
-		(*itr)->notify(event, type, target);
-	}
+	Notifier::getInstance()->post(notification);
 }
 
 /**
- * Calls the method notify() in all observers, for the general events
+ * Queues a general event for all observers
+ *
+ * The end and the cancellation of the execution wait until they are
+ * delivered, since the program may exit right after them.
  *
  * \param event
  * 		The event triggered
@@ -92,29 +140,108 @@ void AbstractSubject::notifyObservers(dcOperationEvent event,
  */
 void AbstractSubject::notifyObservers(dcEvent event,
 		const std::string &target) {
+	__atomic_store_n(&this->_posted, true, __ATOMIC_RELEASE);
 
-	 std::set<AbstractObserver*>::iterator itr;
+	dcNotification *notification = new dcNotification();
+	notification->kind = NOTIF_GENERAL;
+	notification->subject = this;
+	notification->event = event;
+	notification->text = target;
 
-	for ( itr = this->_observers.begin();
-		  itr != this->_observers.end(); itr++ ) {
-		(*itr)->notify(event, target);
+	Notifier *notifier = Notifier::getInstance();
+	notifier->post(notification);
+
+	if(event == Doclone::EVT_FINISH_EXECUTION
+			|| event == Doclone::EVT_CANCEL_EXECUTION) {
+		notifier->flush();
 	}
 }
 
 /**
- * Calls the method notify() in all observers, for the error messages
+ * Queues an error message for all observers, with the job of the calling
+ * thread
  *
  * \param message
  * 		The error message
  */
 void AbstractSubject::notifyObservers(const std::string &message) {
+	__atomic_store_n(&this->_posted, true, __ATOMIC_RELEASE);
+
+	dcNotification *notification = new dcNotification();
+	notification->kind = NOTIF_MESSAGE;
+	notification->subject = this;
+	notification->text = message;
+	notification->job = Job::getCurrent();
+
+	Notifier::getInstance()->post(notification);
+}
+
+/**
+ * Calls the method notify() in all observers, from the notifier thread
+ *
+ * \param notification
+ * 		The event to deliver
+ */
+void AbstractSubject::dispatch(const dcNotification &notification) {
 
 	 std::set<AbstractObserver*>::iterator itr;
 
+	pthread_mutex_lock(&this->_observersMutex);
+
+	for ( itr = this->_observers.begin();
+		  itr != this->_observers.end(); itr++ ) {
+		switch(notification.kind) {
+		case NOTIF_TRANSFER: {
+			(*itr)->notify(static_cast<dcTransferEvent>(notification.event),
+					notification.numBytes);
+			break;
+		}
+		case NOTIF_OPERATION: {
+			(*itr)->notify(static_cast<dcOperationEvent>(notification.event),
+					notification.type, notification.text);
+			break;
+		}
+		case NOTIF_GENERAL: {
+			(*itr)->notify(static_cast<dcEvent>(notification.event),
+					notification.text);
+			break;
+		}
+		case NOTIF_MESSAGE: {
+			(*itr)->notify(notification.text, notification.job);
+			break;
+		}
+		default: {
+			break;
+		}
+		}
+	}
+	pthread_mutex_unlock(&this->_observersMutex);
+}
+
+/**
+ * Calls the method notify() in all observers with the last amount of bytes
+ * transferred, from the notifier thread
+ *
+ * \param now
+ * 		Current time, see Stats::now()
+ */
+void AbstractSubject::dispatchProgress(uint64_t now) {
+	// Cleared before reading the amount: a newer one is queued again
+	__atomic_store_n(&this->_progressQueued, false, __ATOMIC_SEQ_CST);
+	uint64_t numBytes = __atomic_load_n(&this->_pendingBytes,
+			__ATOMIC_SEQ_CST);
+
+	this->_lastProgress = now;
+
+	 std::set<AbstractObserver*>::iterator itr;
+
+	pthread_mutex_lock(&this->_observersMutex);
+
 	for ( itr = this->_observers.begin();
 		  itr != this->_observers.end(); itr++ ) {
-		(*itr)->notify(message);
+		(*itr)->notify(Doclone::TRANS_TRANSFERRED_BYTES, numBytes);
 	}
+	pthread_mutex_unlock(&this->_observersMutex);
 }
 
 } /* namespace Doclone */
@@ -0,0 +1,323 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <doclone/BaseImageIndex.h>
+
+#include <string.h>
+
+#include <archive_entry.h>
+
+#include <xercesc/dom/DOM.hpp>
+
+#include <doclone/Crc32c.h>
+#include <doclone/DataTransfer.h>
+#include <doclone/Image.h>
+#include <doclone/Logger.h>
+#include <doclone/Util.h>
+#include <doclone/xml/XMLDocument.h>
+#include <doclone/exception/InitializationException.h>
+#include <doclone/exception/InvalidImageException.h>
+#include <doclone/exception/ReadDataException.h>
+#include <doclone/exception/WriteDataException.h>
+#include <doclone/exception/WrongBaseImageException.h>
+
+namespace Doclone {
+
+/**
+ * \brief Initializes the attributes
+ */
+BaseImageIndex::BaseImageIndex() : _files(), _baseId() {
+}
+
+/**
+ * \brief Reads the regular files of the base image
+ *
+ * The whole image is read, but the data of the files is skipped. The
+ * checksums of the files are read from its manifest, if it has one.
+ *
+ * \param base
+ * 		Path of the base image
+ */
+void BaseImageIndex::load(const std::string &base) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("BaseImageIndex::load(base=>%s) start", base.c_str());
+
+	int fd = Util::openFile(base);
+
+	struct archive *arch = archive_read_new();
+	archive_read_support_format_tar(arch);
+	archive_read_support_filter_gzip(arch);
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	size_t blockSize = trns->getBufferSize(Doclone::BUFFER_ARCHIVE);
+
+	try {
+		if(archive_read_open_fd(arch, fd, blockSize) != ARCHIVE_OK) {
+			InitializationException ex;
+			throw ex;
+		}
+
+		this->_baseId = BaseImageIndex::readHeader(arch);
+
+		struct archive_entry *entry;
+		bool manifest = false;
+		int r;
+		while((r = archive_read_next_header(arch, &entry)) == ARCHIVE_OK) {
+			if(!strcmp(archive_entry_pathname(entry),
+					Doclone::MANIFEST_ENTRY)) {
+				this->loadManifest(arch);
+				manifest = true;
+				continue;
+			}
+
+			if(archive_entry_filetype(entry) != AE_IFREG
+					|| strchr(archive_entry_pathname(entry), '/') == 0) {
+				continue;
+			}
+
+			dcBaseFile file;
+			file.size = archive_entry_size(entry);
+			file.mtime = archive_entry_mtime(entry);
+			file.mtimeNsec = archive_entry_mtime_nsec(entry);
+			file.ino = archive_entry_ino_is_set(entry) ?
+					archive_entry_ino64(entry) : 0;
+			file.linked = archive_entry_hardlink(entry) != 0;
+			file.kept = false;
+			file.crc = 0;
+			file.hasCrc = false;
+
+			this->_files[archive_entry_pathname(entry)] = file;
+		}
+
+		if(r != ARCHIVE_EOF) {
+			ReadDataException ex;
+			throw ex;
+		}
+
+		if(!manifest) {
+			log->warn("The base image has no manifest, the files kept from "
+					"it won't be verified");
+		}
+	} catch (const Exception &ex) {
+		archive_read_free(arch);
+		Util::closeFile(fd);
+		throw;
+	}
+
+	archive_read_free(arch);
+	Util::closeFile(fd);
+
+	log->info("%llu files in the base image",
+			static_cast<unsigned long long>(this->_files.size()));
+
+	log->debug("BaseImageIndex::load() end");
+}
+
+/**
+ * \brief Checks if a file has not changed since the base image was created
+ *
+ * Files with many links are always archived again, so their links are not
+ * split between the two images.
+ *
+ * \param path
+ * 		Path of the file in the image
+ * \param filestat
+ * 		Current status of the file
+ *
+ * \return true if the file can be restored from the base image
+ */
+bool BaseImageIndex::keep(const std::string &path,
+		const struct stat &filestat) {
+	std::map<std::string, dcBaseFile>::iterator it = this->_files.find(path);
+	if(it == this->_files.end()) {
+		return false;
+	}
+
+	dcBaseFile &file = it->second;
+
+	if(!S_ISREG(filestat.st_mode) || filestat.st_nlink != 1 || file.linked
+			|| file.size != static_cast<uint64_t>(filestat.st_size)
+			|| file.mtime != static_cast<int64_t>(filestat.st_mtim.tv_sec)
+			|| file.mtimeNsec != filestat.st_mtim.tv_nsec
+			|| (file.ino != 0
+					&& file.ino != static_cast<uint64_t>(filestat.st_ino))) {
+		return false;
+	}
+
+	file.kept = true;
+
+	return true;
+}
+
+/**
+ * \brief Gets the checksum of a file of the base image
+ *
+ * \param path
+ * 		Path of the file in the image
+ * \param [out] crc
+ * 		CRC32C of the data of the file
+ *
+ * \return false if the file is not in the manifest of the base image
+ */
+bool BaseImageIndex::getChecksum(const std::string &path,
+		uint32_t &crc) const {
+	std::map<std::string, dcBaseFile>::const_iterator it =
+			this->_files.find(path);
+	if(it == this->_files.end() || !it->second.hasCrc) {
+		return false;
+	}
+
+	crc = it->second.crc;
+
+	return true;
+}
+
+/**
+ * \brief Reads the checksums of the files from the manifest of the base
+ * image, see Image::addToManifest()
+ *
+ * The manifest is the last entry, so the files are already known.
+ *
+ * \param arch
+ * 		The archive of the base image, at the manifest
+ */
+void BaseImageIndex::loadManifest(struct archive *arch) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("BaseImageIndex::loadManifest() start");
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	dcBuffSize size = trns->getBufferSize(Doclone::BUFFER_ARCHIVE);
+	char *buf = trns->acquireBuffer(size);
+
+	std::string pending;
+	ssize_t nbytes;
+
+	while((nbytes = archive_read_data(arch, buf, size)) > 0) {
+		pending.append(buf, nbytes);
+
+		size_t start = 0;
+		size_t end;
+		while((end = pending.find('\n', start)) != std::string::npos) {
+			std::string line = pending.substr(start, end - start);
+			start = end + 1;
+
+			unsigned int crc;
+			unsigned long long fileSize;
+			int pathPos = 0;
+			if(sscanf(line.c_str(), "%8x %llu %n", &crc, &fileSize,
+					&pathPos) < 2 || pathPos == 0) {
+				continue;
+			}
+
+			std::map<std::string, dcBaseFile>::iterator it =
+					this->_files.find(line.substr(pathPos));
+			if(it != this->_files.end() && it->second.size == fileSize) {
+				it->second.crc = crc;
+				it->second.hasCrc = true;
+			}
+		}
+
+		pending.erase(0, start);
+	}
+
+	trns->releaseBuffer(buf);
+
+	if(nbytes < 0) {
+		ReadDataException ex;
+		throw ex;
+	}
+
+	log->debug("BaseImageIndex::loadManifest() end");
+}
+
+/**
+ * \brief Writes the paths of the files of the base image that must not be
+ * restored, one per line
+ *
+ * These are the files that have been deleted or changed since the base
+ * image was created.
+ *
+ * \param file
+ * 		Where the list is written
+ */
+void BaseImageIndex::writeRemoved(FILE *file) const throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("BaseImageIndex::writeRemoved(file=>0x%x) start", file);
+
+	std::map<std::string, dcBaseFile>::const_iterator it;
+	for(it = this->_files.begin(); it != this->_files.end(); ++it) {
+		if(!it->second.kept
+				&& fprintf(file, "%s\n", it->first.c_str()) < 0) {
+			WriteDataException ex;
+			throw ex;
+		}
+	}
+
+	log->debug("BaseImageIndex::writeRemoved() end");
+}
+
+/**
+ * \brief Reads the header of a base image and returns its identifier
+ *
+ * \param arch
+ * 		The archive of the base image, before reading any entry
+ *
+ * \return The CRC32C of the header
+ */
+uint32_t BaseImageIndex::readHeader(struct archive *arch) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("BaseImageIndex::readHeader(arch=>0x%x) start", arch);
+
+	struct archive_entry *entry;
+	std::string xmlText;
+
+	if(archive_read_next_header(arch, &entry) != ARCHIVE_OK) {
+		ReadDataException ex;
+		throw ex;
+	}
+
+	if(archive_entry_size(entry) > static_cast<int64_t>(Doclone::MAX_HEADER_SIZE)) {
+		InvalidImageException ex;
+		throw ex;
+	}
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	xmlText.reserve(archive_entry_size(entry));
+	trns->archiveToBuf(arch, xmlText);
+
+	XMLDocument doc;
+	doc.openFromMem(xmlText.c_str());
+
+	// Only full images with their data inside can be a base
+	if(doc.getElementValueCString(doc.getRootElement(), "baseImage") != 0
+			|| doc.getElementValueU8(doc.getRootElement(), "chunked") != 0) {
+		WrongBaseImageException ex;
+		throw ex;
+	}
+
+	uint32_t baseId = Crc32c::compute(xmlText.data(), xmlText.length());
+
+	log->debug("BaseImageIndex::readHeader(baseId=>%x) end", baseId);
+	return baseId;
+}
+
+uint32_t BaseImageIndex::getBaseId() const {
+	return this->_baseId;
+}
+
+}
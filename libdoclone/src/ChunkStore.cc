@@ -0,0 +1,386 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <doclone/ChunkStore.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <zlib.h>
+
+#include <doclone/Chunker.h>
+#include <doclone/Crc32c.h>
+#include <doclone/DataTransfer.h>
+#include <doclone/Logger.h>
+#include <doclone/Sha256.h>
+#include <doclone/exception/BadChunkException.h>
+#include <doclone/exception/CreateFileException.h>
+#include <doclone/exception/InvalidImageException.h>
+#include <doclone/exception/ReadDataException.h>
+#include <doclone/exception/WriteDataException.h>
+
+namespace Doclone {
+
+/**
+ * \brief Initializes the attributes
+ *
+ * \param dir
+ * 		Directory of the repository
+ */
+ChunkStore::ChunkStore(const std::string &dir)
+	: _dir(dir), _compressed(compressBound(CHUNK_MAX_SIZE)), _newBytes(0),
+	  _reusedBytes(0), _writtenBytes(0) {
+}
+
+ChunkStore::~ChunkStore() {
+}
+
+/**
+ * \brief Creates the directories of the repository, if they don't exist
+ */
+void ChunkStore::open() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("ChunkStore::open() start");
+
+	std::string chunksDir = this->_dir + "/chunks";
+
+	if((mkdir(this->_dir.c_str(), 0755) < 0 && errno != EEXIST)
+			|| (mkdir(chunksDir.c_str(), 0755) < 0 && errno != EEXIST)) {
+		CreateFileException ex(chunksDir);
+		throw ex;
+	}
+
+	log->debug("ChunkStore::open() end");
+}
+
+/**
+ * \brief Stores the chunks of a file that are not in the repository yet
+ *
+ * \param fd
+ * 		Descriptor of the file
+ * \param [out] list
+ * 		The chunk list of the file
+ * \param [out] crc
+ * 		CRC32C of the data of the file
+ *
+ * \return Size of the file
+ */
+uint64_t ChunkStore::storeFile(int fd, std::string &list, uint32_t &crc)
+		throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("ChunkStore::storeFile(fd=>%d) start", fd);
+
+	DataTransfer *trns = DataTransfer::getInstance();
+
+	// Room for a whole chunk after the rest of the previous read
+	const size_t window = 2 * CHUNK_MAX_SIZE;
+	char *buf = trns->acquireBuffer(window);
+
+	size_t start = 0;
+	size_t end = 0;
+	bool eof = false;
+	uint64_t size = 0;
+
+	list.clear();
+	crc = 0;
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	try {
+		while(!eof || start < end) {
+			// Fill the window until it has a whole chunk
+			if(!eof && end - start < CHUNK_MAX_SIZE) {
+				memmove(buf, buf + start, end - start);
+				end -= start;
+				start = 0;
+
+				while(!eof && end < window) {
+					ssize_t nbytes = read(fd, buf + end, window - end);
+					if(nbytes < 0) {
+						if(errno == EINTR) {
+							continue;
+						}
+
+						ReadDataException ex;
+						throw ex;
+					}
+
+					eof = nbytes == 0;
+					end += nbytes;
+				}
+			}
+
+			if(start == end) {
+				break;
+			}
+
+			size_t length = Chunker::findBoundary(
+					reinterpret_cast<uint8_t *>(buf + start), end - start);
+			std::string hash = Sha256::hexDigest(buf + start, length);
+
+			if(this->hasChunk(hash)) {
+				this->_reusedBytes += length;
+			} else {
+				this->storeChunk(hash, buf + start, length);
+				this->_newBytes += length;
+			}
+
+			char line[96];
+			snprintf(line, sizeof(line), "%s %lu\n", hash.c_str(),
+					static_cast<unsigned long>(length));
+			list.append(line);
+
+			crc = Crc32c::update(crc, buf + start, length);
+			trns->countBytes(length);
+
+			size += length;
+			start += length;
+		}
+	} catch (const Exception &ex) {
+		trns->releaseBuffer(buf);
+		throw;
+	}
+
+	trns->releaseBuffer(buf);
+
+	log->loopDebug("ChunkStore::storeFile(size=>%d) end", size);
+	return size;
+}
+
+/**
+ * \brief Writes the data of a file of the repository in the archives
+ *
+ * \param list
+ * 		The chunk list of the file
+ * \param outArchives
+ * 		Vector of archives where data will be written
+ *
+ * \return Number of transferred bytes
+ */
+uint64_t ChunkStore::writeFile(const std::string &list,
+		std::vector<struct archive*> &outArchives) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("ChunkStore::writeFile(outArchives=>0x%x) start", &outArchives);
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	std::vector<dcChunkRef> chunks;
+	ChunkStore::parseList(list, chunks);
+
+	uint64_t totalNbytes = 0;
+	std::string data;
+
+	std::vector<dcChunkRef>::const_iterator it;
+	for(it = chunks.begin(); it != chunks.end(); ++it) {
+		this->loadChunk(*it, data);
+		totalNbytes += trns->bufToArchive(data, outArchives);
+	}
+
+	log->loopDebug("ChunkStore::writeFile(totalNbytes=>%d) end", totalNbytes);
+	return totalNbytes;
+}
+
+/**
+ * \brief Reads a chunk list
+ *
+ * \param list
+ * 		The chunk list of a file
+ * \param [out] chunks
+ * 		The chunks of the file, in order
+ *
+ * \return Size of the file
+ */
+uint64_t ChunkStore::parseList(const std::string &list,
+		std::vector<dcChunkRef> &chunks) throw(Exception) {
+	uint64_t size = 0;
+	size_t start = 0;
+	size_t end;
+
+	chunks.clear();
+
+	while((end = list.find('\n', start)) != std::string::npos) {
+		size_t space = list.find(' ', start);
+		if(space == std::string::npos || space > end
+				|| space - start != 2 * SHA256_SIZE) {
+			InvalidImageException ex;
+			throw ex;
+		}
+
+		dcChunkRef chunk;
+		chunk.hash = list.substr(start, space - start);
+		chunk.size = strtoul(list.c_str() + space + 1, 0, 10);
+		if(chunk.size == 0 || chunk.size > CHUNK_MAX_SIZE) {
+			InvalidImageException ex;
+			throw ex;
+		}
+
+		chunks.push_back(chunk);
+		size += chunk.size;
+		start = end + 1;
+	}
+
+	return size;
+}
+
+/**
+ * \brief Path of the file of a chunk
+ */
+std::string ChunkStore::chunkPath(const std::string &hash) const {
+	return this->_dir + "/chunks/" + hash.substr(0, 2) + "/" + hash;
+}
+
+/**
+ * \brief Checks if a chunk is in the repository
+ */
+bool ChunkStore::hasChunk(const std::string &hash) const {
+	struct stat chunkStat;
+
+	return stat(this->chunkPath(hash).c_str(), &chunkStat) == 0;
+}
+
+/**
+ * \brief Compresses and writes a chunk in the repository
+ *
+ * The chunk is written in a temporary file and renamed, so a failed job
+ * doesn't leave partial chunks.
+ *
+ * \param hash
+ * 		SHA-256 of the data
+ * \param buf
+ * 		The data
+ * \param len
+ * 		Number of bytes of data
+ */
+void ChunkStore::storeChunk(const std::string &hash, const char *buf,
+		size_t len) throw(Exception) {
+	std::string path = this->chunkPath(hash);
+	std::string dir = path.substr(0, path.rfind('/'));
+
+	uLongf compressedLength = this->_compressed.size();
+	if(compress2(reinterpret_cast<Bytef *>(&this->_compressed[0]),
+			&compressedLength, reinterpret_cast<const Bytef *>(buf), len,
+			Z_DEFAULT_COMPRESSION) != Z_OK) {
+		WriteDataException ex;
+		throw ex;
+	}
+
+	if(mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+		CreateFileException ex(dir);
+		throw ex;
+	}
+
+	std::string tmpPath = dir + "/.tmpXXXXXX";
+	int fd = mkstemp(&tmpPath[0]);
+	if(fd < 0) {
+		CreateFileException ex(tmpPath);
+		throw ex;
+	}
+
+	size_t written = 0;
+	while(written < compressedLength) {
+		ssize_t nbytes = write(fd, &this->_compressed[written],
+				compressedLength - written);
+		if(nbytes < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			close(fd);
+			unlink(tmpPath.c_str());
+			WriteDataException ex;
+			throw ex;
+		}
+
+		written += nbytes;
+	}
+
+	if(close(fd) < 0 || rename(tmpPath.c_str(), path.c_str()) < 0) {
+		unlink(tmpPath.c_str());
+		WriteDataException ex;
+		throw ex;
+	}
+
+	this->_writtenBytes += compressedLength;
+}
+
+/**
+ * \brief Reads, uncompresses and checks a chunk of the repository
+ *
+ * \param chunk
+ * 		The chunk
+ * \param [out] data
+ * 		The data of the chunk
+ */
+void ChunkStore::loadChunk(const dcChunkRef &chunk, std::string &data)
+		throw(Exception) {
+	int fd = ::open(this->chunkPath(chunk.hash).c_str(), O_RDONLY);
+	if(fd < 0) {
+		BadChunkException ex(chunk.hash);
+		throw ex;
+	}
+
+	size_t compressedLength = 0;
+	ssize_t nbytes;
+	while(compressedLength < this->_compressed.size()
+			&& (nbytes = read(fd, &this->_compressed[compressedLength],
+					this->_compressed.size() - compressedLength)) != 0) {
+		if(nbytes < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			close(fd);
+			ReadDataException ex;
+			throw ex;
+		}
+
+		compressedLength += nbytes;
+	}
+
+	close(fd);
+
+	data.resize(chunk.size);
+	uLongf length = chunk.size;
+	if(uncompress(reinterpret_cast<Bytef *>(&data[0]), &length,
+			reinterpret_cast<const Bytef *>(&this->_compressed[0]),
+			compressedLength) != Z_OK
+			|| length != chunk.size
+			|| Sha256::hexDigest(data.data(), length) != chunk.hash) {
+		BadChunkException ex(chunk.hash);
+		throw ex;
+	}
+}
+
+uint64_t ChunkStore::getNewBytes() const {
+	return this->_newBytes;
+}
+
+uint64_t ChunkStore::getReusedBytes() const {
+	return this->_reusedBytes;
+}
+
+uint64_t ChunkStore::getWrittenBytes() const {
+	return this->_writtenBytes;
+}
+
+}
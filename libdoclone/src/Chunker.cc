@@ -0,0 +1,106 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <doclone/Chunker.h>
+
+#include <pthread.h>
+
+namespace Doclone {
+
+/**
+ * Mask for the bytes before CHUNK_AVG_SIZE. It has more bits than the
+ * average, so cutting there is less likely.
+ */
+static const uint64_t CHUNK_MASK_SMALL = 0xFFFFC00000000000ULL;
+
+/**
+ * Mask for the bytes after CHUNK_AVG_SIZE. It has less bits than the
+ * average, so cutting there is more likely.
+ */
+static const uint64_t CHUNK_MASK_LARGE = 0xFFFC000000000000ULL;
+
+/// Random value of each byte for the gear hash
+static uint64_t gear[256];
+
+/// Initializes gear only once
+static pthread_once_t gearOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * \brief Finds the end of the first chunk of a buffer
+ *
+ * If the data goes on after [buf], [len] must be at least CHUNK_MAX_SIZE.
+ *
+ * \param buf
+ * 		The data
+ * \param len
+ * 		Number of bytes of data
+ *
+ * \return Size of the first chunk
+ */
+size_t Chunker::findBoundary(const uint8_t *buf, size_t len) {
+	pthread_once(&gearOnce, Chunker::initGear);
+
+	if(len <= CHUNK_MIN_SIZE) {
+		return len;
+	}
+
+	if(len > CHUNK_MAX_SIZE) {
+		len = CHUNK_MAX_SIZE;
+	}
+
+	size_t normal = len < CHUNK_AVG_SIZE ? len : CHUNK_AVG_SIZE;
+	uint64_t hash = 0;
+	size_t i = CHUNK_MIN_SIZE;
+
+	for(; i < normal; i++) {
+		hash = (hash << 1) + gear[buf[i]];
+		if((hash & CHUNK_MASK_SMALL) == 0) {
+			return i + 1;
+		}
+	}
+
+	for(; i < len; i++) {
+		hash = (hash << 1) + gear[buf[i]];
+		if((hash & CHUNK_MASK_LARGE) == 0) {
+			return i + 1;
+		}
+	}
+
+	return len;
+}
+
+/**
+ * \brief Fills the gear table
+ *
+ * The values come from a fixed seed, so the boundaries are the same in every
+ * version.
+ */
+void Chunker::initGear() {
+	// splitmix64
+	uint64_t seed = 0x646f636c6f6e6563ULL;
+
+	for(int i = 0; i < 256; i++) {
+		seed += 0x9E3779B97F4A7C15ULL;
+		uint64_t z = seed;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		gear[i] = z ^ (z >> 31);
+	}
+}
+
+}
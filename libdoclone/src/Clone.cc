@@ -25,47 +25,67 @@
 #include <pthread.h>
 
 #include <doclone/Logger.h>
+#include <doclone/Job.h>
 #include <doclone/LocalNode.h>
 #include <doclone/DataTransfer.h>
 #include <doclone/PartedDevice.h>
 #include <doclone/Util.h>
 #include <doclone/Unicast.h>
+#include <doclone/ImageServer.h>
+#include <doclone/Collector.h>
 #include <doclone/Link.h>
+#include <doclone/Stats.h>
+#include <doclone/Tracer.h>
 #include <doclone/exception/Exception.h>
 #include <doclone/exception/ErrorException.h>
+#include <doclone/observer/Notifier.h>
 
 namespace Doclone {
 
+/// Initializes the process only once, for the first job
+static pthread_once_t processOnce = PTHREAD_ONCE_INIT;
+
 /**
- * \brief Initializes gettext, signal handlers and some attributes of this class
+ * \brief Initializes some attributes of this class, and gettext and the
+ * signal handlers for the first job of the process
  */
 Clone::Clone(): _image(), _device(), _address(), _interface(), _nodesNumber(0),
-		_empty(false), _force(), _operations() {
-	setlocale(LC_ALL, "");
-	bindtextdomain(PACKAGE, LOCALEDIR);
+		_empty(false), _force(), _memoryLimit(0), _base(), _repository(),
+		_sync(), _targets(), _remoteImage(), _writers(0),
+		_quorum(0), _streams(0), _socketBuffer(0), _zeroCopy(false),
+		_trace(), _operations() {
+	pthread_mutex_init(&this->_operationsMutex, 0);
 
-	Util::signalCapture();
+	pthread_once(&processOnce, Clone::initProcess);
 
 	this->_nodesNumber = 0;
 	this->_empty = false;
 }
 
+/**
+ * \brief Initializes gettext and the signal handlers
+ *
+ * They are shared by the whole process, and the jobs of the worker threads
+ * can't change them while other threads are running.
+ */
+void Clone::initProcess() {
+	setlocale(LC_ALL, "");
+	bindtextdomain(PACKAGE, LOCALEDIR);
+
+	Util::signalCapture();
+}
+
 /**
  * \ingroup CPPAPI
- * \brief Returns a pointer to a Doclone::Clone object
+ * \brief Returns a pointer to the Doclone::Clone object of the job of the
+ * calling thread
+ *
+ * See Job to run many jobs at the same time.
  *
  * \return A pointer to a doclone object
  */
 Clone* Clone::getInstance() {
-	static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-
-	pthread_mutex_lock(&mutex);
-
-	static Clone instance;
-
-	pthread_mutex_unlock(&mutex);
-
-	return &instance;
+	return Job::getCurrent()->getClone();
 }
 
 /**
@@ -78,6 +98,10 @@ void Clone::create() throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("doclone::create() start");
 
+	this->initMemoryLimit();
+	Stats::getInstance()->start();
+	Tracer::getInstance()->start(this->_trace);
+
 	try {
 		PartedDevice *pedDev = PartedDevice::getInstance();
 		pedDev->initialize(Util::getDiskPath(this->_device));
@@ -90,12 +114,19 @@ void Clone::create() throw(Exception) {
 		LocalNode local;
 		local.create();
 	} catch(const ErrorException &ex) {
+		Stats::getInstance()->finish();
+		Tracer::getInstance()->finish();
+
 		// Alert to view
 		this->notifyObservers(Doclone::EVT_CANCEL_EXECUTION, "");
 
 		throw;
 	}
 
+	Stats::getInstance()->finish();
+	Tracer::getInstance()->finish();
+	this->logPeakMemory();
+
 	// Notify to view
 	this->notifyObservers(Doclone::EVT_FINISH_EXECUTION, "");
 
@@ -112,6 +143,10 @@ void Clone::restore() throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("doclone::restore() start");
 
+	this->initMemoryLimit();
+	Stats::getInstance()->start();
+	Tracer::getInstance()->start(this->_trace);
+
 	try {
 		PartedDevice *pedDev = PartedDevice::getInstance();
 		pedDev->initialize(Util::getDiskPath(this->_device));
@@ -123,18 +158,153 @@ void Clone::restore() throw(Exception) {
 		LocalNode local;
 		local.restore();
 	} catch(const ErrorException &ex) {
+		Stats::getInstance()->finish();
+		Tracer::getInstance()->finish();
+
 		// Alert to view
 		this->notifyObservers(Doclone::EVT_CANCEL_EXECUTION, "");
 
 		throw;
 	}
 
+	Stats::getInstance()->finish();
+	Tracer::getInstance()->finish();
+	this->logPeakMemory();
+
 	// Notify to view
 	this->notifyObservers(Doclone::EVT_FINISH_EXECUTION, "");
 
 	log->debug("doclone::restore() end");
 }
 
+/**
+ * \ingroup CPPAPI
+ * \brief Verifies the data of a device against the image it was restored from.
+ *
+ * Both image an device path must be set before calling this function.
+ */
+void Clone::verify() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("doclone::verify() start");
+
+	this->initMemoryLimit();
+	Stats::getInstance()->start();
+	Tracer::getInstance()->start(this->_trace);
+
+	try {
+		PartedDevice *pedDev = PartedDevice::getInstance();
+		pedDev->initialize(Util::getDiskPath(this->_device));
+
+		DataTransfer *trns = DataTransfer::getInstance();
+		trns->initLocalRead();
+
+		LocalNode local;
+		local.verify();
+	} catch(const ErrorException &ex) {
+		Stats::getInstance()->finish();
+		Tracer::getInstance()->finish();
+
+		// Alert to view
+		this->notifyObservers(Doclone::EVT_CANCEL_EXECUTION, "");
+
+		throw;
+	}
+
+	Stats::getInstance()->finish();
+	Tracer::getInstance()->finish();
+	this->logPeakMemory();
+
+	// Notify to view
+	this->notifyObservers(Doclone::EVT_FINISH_EXECUTION, "");
+
+	log->debug("doclone::verify() end");
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Clones a device to one or more devices of the same machine.
+ *
+ * The device and target paths must be set before calling this function.
+ */
+void Clone::localClone() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("doclone::localClone() start");
+
+	this->initMemoryLimit();
+	Stats::getInstance()->start();
+	Tracer::getInstance()->start(this->_trace);
+
+	try {
+		PartedDevice *pedDev = PartedDevice::getInstance();
+		pedDev->initialize(Util::getDiskPath(this->_device));
+
+		DataTransfer *trns = DataTransfer::getInstance();
+		trns->initLocalRead();
+		trns->initLocalWrite();
+
+		LocalNode local;
+		local.localClone();
+	} catch(const ErrorException &ex) {
+		Stats::getInstance()->finish();
+		Tracer::getInstance()->finish();
+
+		// Alert to view
+		this->notifyObservers(Doclone::EVT_CANCEL_EXECUTION, "");
+
+		throw;
+	}
+
+	Stats::getInstance()->finish();
+	Tracer::getInstance()->finish();
+	this->logPeakMemory();
+
+	// Notify to view
+	this->notifyObservers(Doclone::EVT_FINISH_EXECUTION, "");
+
+	log->debug("doclone::localClone() end");
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Restores an image in many devices of the same machine at once.
+ *
+ * The image and target paths must be set before calling this function.
+ */
+void Clone::duplicate() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("doclone::duplicate() start");
+
+	this->initMemoryLimit();
+	Stats::getInstance()->start();
+	Tracer::getInstance()->start(this->_trace);
+
+	try {
+		DataTransfer *trns = DataTransfer::getInstance();
+		trns->initLocalRead();
+		trns->initLocalWrite();
+
+		LocalNode local;
+		local.duplicate();
+	} catch(const ErrorException &ex) {
+		Stats::getInstance()->finish();
+		Tracer::getInstance()->finish();
+
+		// Alert to view
+		this->notifyObservers(Doclone::EVT_CANCEL_EXECUTION, "");
+
+		throw;
+	}
+
+	Stats::getInstance()->finish();
+	Tracer::getInstance()->finish();
+	this->logPeakMemory();
+
+	// Notify to view
+	this->notifyObservers(Doclone::EVT_FINISH_EXECUTION, "");
+
+	log->debug("doclone::duplicate() end");
+}
+
 /**
  * \ingroup CPPAPI
  * \brief Sends an image or a device to the network.
@@ -146,6 +316,10 @@ void Clone::send() throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("doclone::send() start");
 
+	this->initMemoryLimit();
+	Stats::getInstance()->start();
+	Tracer::getInstance()->start(this->_trace);
+
 	DataTransfer *trns = DataTransfer::getInstance();
 	trns->initLocalRead();
 	trns->initSocketWrite();
@@ -154,12 +328,19 @@ void Clone::send() throw(Exception) {
 		Unicast unicast;
 		unicast.send();
 	} catch(const ErrorException &ex) {
+		Stats::getInstance()->finish();
+		Tracer::getInstance()->finish();
+
 		// Alert to view
 		this->notifyObservers(Doclone::EVT_CANCEL_EXECUTION, "");
 
 		throw;
 	}
 
+	Stats::getInstance()->finish();
+	Tracer::getInstance()->finish();
+	this->logPeakMemory();
+
 	// Notify to view
 	this->notifyObservers(Doclone::EVT_FINISH_EXECUTION, "");
 
@@ -177,6 +358,10 @@ void Clone::receive() throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("doclone::receive() start");
 
+	this->initMemoryLimit();
+	Stats::getInstance()->start();
+	Tracer::getInstance()->start(this->_trace);
+
 	DataTransfer *trns = DataTransfer::getInstance();
 	trns->initSocketRead();
 	trns->initLocalWrite();
@@ -185,18 +370,109 @@ void Clone::receive() throw(Exception) {
 		Unicast unicast;
 		unicast.receive();
 	} catch(const ErrorException &ex) {
+		Stats::getInstance()->finish();
+		Tracer::getInstance()->finish();
+
 		// Alert to view
 		this->notifyObservers(Doclone::EVT_CANCEL_EXECUTION, "");
 
 		throw;
 	}
 
+	Stats::getInstance()->finish();
+	Tracer::getInstance()->finish();
+	this->logPeakMemory();
+
 	// Notify to view
 	this->notifyObservers(Doclone::EVT_FINISH_EXECUTION, "");
 
 	log->debug("doclone::receive() end");
 }
 
+/**
+ * \ingroup CPPAPI
+ * \brief Serves the images of a directory to the network.
+ *
+ * The image path must be set to the directory before calling this function.
+ * The clients ask for an image by its name, see setRemoteImage(). If the
+ * number of nodes is set, it returns after attending that number of clients.
+ * Otherwise, it serves until it's interrupted.
+ */
+void Clone::serve() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("doclone::serve() start");
+
+	this->initMemoryLimit();
+	Stats::getInstance()->start();
+	Tracer::getInstance()->start(this->_trace);
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	trns->initLocalRead();
+
+	try {
+		ImageServer server;
+		server.serve();
+	} catch(const ErrorException &ex) {
+		Stats::getInstance()->finish();
+		Tracer::getInstance()->finish();
+
+		// Alert to view
+		this->notifyObservers(Doclone::EVT_CANCEL_EXECUTION, "");
+
+		throw;
+	}
+
+	Stats::getInstance()->finish();
+	Tracer::getInstance()->finish();
+	this->logPeakMemory();
+
+	// Notify to view
+	this->notifyObservers(Doclone::EVT_FINISH_EXECUTION, "");
+
+	log->debug("doclone::serve() end");
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Receives the images of many senders at the same time.
+ *
+ * The image path must be set to the directory where the images are written
+ * before calling this function. The senders connect to the collector with
+ * send(), see setAddress(). If the number of nodes is set, it returns after
+ * receiving that number of images. Otherwise, it collects until it's
+ * interrupted.
+ */
+void Clone::collect() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("doclone::collect() start");
+
+	this->initMemoryLimit();
+	Stats::getInstance()->start();
+	Tracer::getInstance()->start(this->_trace);
+
+	try {
+		Collector collector;
+		collector.collect();
+	} catch(const ErrorException &ex) {
+		Stats::getInstance()->finish();
+		Tracer::getInstance()->finish();
+
+		// Alert to view
+		this->notifyObservers(Doclone::EVT_CANCEL_EXECUTION, "");
+
+		throw;
+	}
+
+	Stats::getInstance()->finish();
+	Tracer::getInstance()->finish();
+	this->logPeakMemory();
+
+	// Notify to view
+	this->notifyObservers(Doclone::EVT_FINISH_EXECUTION, "");
+
+	log->debug("doclone::collect() end");
+}
+
 /**
  * \ingroup CPPAPI
  * \brief Sends an image or a device to the network in link mode.
@@ -207,6 +483,10 @@ void Clone::chainOrigin() throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("doclone::chainOrigin() start");
 
+	this->initMemoryLimit();
+	Stats::getInstance()->start();
+	Tracer::getInstance()->start(this->_trace);
+
 	DataTransfer *trns = DataTransfer::getInstance();
 	trns->initLocalRead();
 	trns->initSocketWrite();
@@ -215,12 +495,19 @@ void Clone::chainOrigin() throw(Exception) {
 		Link lnk;
 		lnk.send();
 	} catch(const ErrorException &ex) {
+		Stats::getInstance()->finish();
+		Tracer::getInstance()->finish();
+
 		// Alert to view
 		this->notifyObservers(Doclone::EVT_CANCEL_EXECUTION, "");
 
 		throw;
 	}
 
+	Stats::getInstance()->finish();
+	Tracer::getInstance()->finish();
+	this->logPeakMemory();
+
 	// Notify to view
 	this->notifyObservers(Doclone::EVT_FINISH_EXECUTION, "");
 
@@ -237,6 +524,10 @@ void Clone::chainLink() throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("doclone::chainLink() start");
 
+	this->initMemoryLimit();
+	Stats::getInstance()->start();
+	Tracer::getInstance()->start(this->_trace);
+
 	DataTransfer *trns = DataTransfer::getInstance();
 	trns->initSocketRead();
 	trns->initLocalWrite();
@@ -245,12 +536,19 @@ void Clone::chainLink() throw(Exception) {
 		Link lnk;
 		lnk.receive();
 	} catch(const ErrorException &ex) {
+		Stats::getInstance()->finish();
+		Tracer::getInstance()->finish();
+
 		// Alert to view
 		this->notifyObservers(Doclone::EVT_CANCEL_EXECUTION, "");
 
 		throw;
 	}
 
+	Stats::getInstance()->finish();
+	Tracer::getInstance()->finish();
+	this->logPeakMemory();
+
 	// Notify to view
 	this->notifyObservers(Doclone::EVT_FINISH_EXECUTION, "");
 
@@ -322,6 +620,9 @@ const std::string &Clone::getAddress() const {
  * \ingroup CPPAPI
  * \brief Sets the IP address of the server in unicast/multicast mode.
  *
+ * When sending, it's the address of a collector to send the image to, see
+ * collect().
+ *
  * \param address
  * 		IP Address
  */
@@ -359,6 +660,304 @@ void Clone::setForce(bool force) {
 	this->_force = force;
 }
 
+unsigned int Clone::getMemoryLimit() const {
+	return this->_memoryLimit;
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Sets the memory budget of the job
+ *
+ * With a budget, the buffers are sized to fit in it and the structures that
+ * grow with the data spill to disk instead of growing in memory.
+ *
+ * While restoring, the paths restored in sync mode, the files removed since
+ * the base image and the directories libarchive fixes up at the end are still
+ * kept in memory, so they grow with the number of files.
+ *
+ * \param memoryLimit
+ * 		Budget in MiB, 0 for no limit
+ */
+void Clone::setMemoryLimit(unsigned int memoryLimit) {
+	this->_memoryLimit = memoryLimit;
+}
+
+const std::string &Clone::getBase() const {
+	return this->_base;
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Sets the base image of an incremental image
+ *
+ * When creating, only the files changed since the base was created are
+ * written in the new image. When restoring an incremental image, its base is
+ * restored with it.
+ *
+ * \param base
+ * 		Path of a full image, or empty for full images
+ */
+void Clone::setBase(const std::string &base) {
+	this->_base = base;
+}
+
+const std::string &Clone::getRepository() const {
+	return this->_repository;
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Sets the repository where the data of the images is deduplicated
+ *
+ * When creating, the data of the files is stored in the repository in
+ * chunks, only once for all its images, and the image only has the list of
+ * chunks of each file. An image created this way needs the same repository to
+ * be restored.
+ *
+ * \param repository
+ * 		Path of the directory of the repository, or empty to keep the data in
+ * 		the image
+ */
+void Clone::setRepository(const std::string &repository) {
+	this->_repository = repository;
+}
+
+bool Clone::getSync() const {
+	return this->_sync;
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Sets the sync mode on/off
+ *
+ * In sync mode, an image is restored into the filesystems already on the
+ * device, without formatting them. Only the files that differ from the image
+ * are written, and the ones that are not in the image are deleted.
+ *
+ * \param sync
+ * 		true = on; false = off
+ */
+void Clone::setSync(bool sync) {
+	this->_sync = sync;
+}
+
+const std::vector<std::string> &Clone::getTargets() const {
+	return this->_targets;
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Sets the only target device of a local clone
+ *
+ * \param target
+ * 		Path of the disk or partition the device is cloned to
+ */
+void Clone::setTarget(const std::string &target) {
+	this->_targets.clear();
+	this->_targets.push_back(target);
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Adds a target device to a local clone or a duplication
+ *
+ * All the targets are written at the same time, from a single read of the
+ * device or the image.
+ *
+ * \param target
+ * 		Path of the disk or partition the device or image is cloned to
+ */
+void Clone::addTarget(const std::string &target) {
+	this->_targets.push_back(target);
+}
+
+const std::string &Clone::getRemoteImage() const {
+	return this->_remoteImage;
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Sets the image to ask an image server for
+ *
+ * When it is set, receive() connects to an image server, see serve(), and
+ * asks for this image of its directory.
+ *
+ * \param remoteImage
+ * 		Name of the image in the directory of the server, or empty to receive
+ * 		from a Unicast server
+ */
+void Clone::setRemoteImage(const std::string &remoteImage) {
+	this->_remoteImage = remoteImage;
+}
+
+unsigned int Clone::getWriters() const {
+	return this->_writers;
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Sets the number of images a collector writes at the same time
+ *
+ * The other senders wait until a writer is free.
+ *
+ * \param writers
+ * 		Number of writing threads, 0 for COLLECTOR_WRITERS
+ */
+void Clone::setWriters(unsigned int writers) {
+	this->_writers = writers;
+}
+
+unsigned int Clone::getQuorum() const {
+	return this->_quorum;
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Sets the number of receivers a Unicast server waits for before
+ * sending
+ *
+ * When it is lower than the number of nodes, the stream is spooled to a
+ * temporary file and the receivers that connect later, or connect again
+ * after failing, are sent the whole stream from it.
+ *
+ * \param quorum
+ * 		Number of receivers, 0 to wait for all of them
+ */
+void Clone::setQuorum(unsigned int quorum) {
+	this->_quorum = quorum;
+}
+
+unsigned int Clone::getStreams() const {
+	return this->_streams;
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Sets the number of TCP connections each receiver is sent the data
+ * on, in the Unicast and the link modes
+ *
+ * The stream is striped across them, see Stripes. The receivers use the
+ * number of the sender.
+ *
+ * \param streams
+ * 		Number of connections, up to MAX_STRIPES. 0 or 1 for one
+ */
+void Clone::setStreams(unsigned int streams) {
+	this->_streams = streams;
+}
+
+unsigned int Clone::getSocketBuffer() const {
+	return this->_socketBuffer;
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Sets the size of the send and receive buffers of the sockets that
+ * transfer data
+ *
+ * Links with a high bandwidth-delay product need buffers bigger than the
+ * ones the kernel gives by default.
+ *
+ * \param socketBuffer
+ * 		Size in KiB, 0 to let the kernel size them
+ */
+void Clone::setSocketBuffer(unsigned int socketBuffer) {
+	this->_socketBuffer = socketBuffer;
+}
+
+bool Clone::getZeroCopy() const {
+	return this->_zeroCopy;
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Sets the zero-copy sends on/off, in the Unicast and the link modes
+ *
+ * The data of a device, and the data relayed by the links, is sent with
+ * MSG_ZEROCOPY, so the kernel reads it from the buffers of the library
+ * instead of copying it.
+ * It only pays off on fast links, and the sockets that don't support it
+ * copy the data as usual.
+ *
+ * \param zeroCopy
+ * 		true = on; false = off
+ */
+void Clone::setZeroCopy(bool zeroCopy) {
+	this->_zeroCopy = zeroCopy;
+}
+
+const std::string &Clone::getTrace() const {
+	return this->_trace;
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Sets the file a timeline of the next operations is written in
+ *
+ * It has spans for the operations, the external commands and the mounts, and
+ * samples of the stages of Stats, in the Trace Event Format that
+ * chrome://tracing and Perfetto load. See Tracer.
+ *
+ * \param trace
+ * 		Path of the file, or empty to trace nothing
+ */
+void Clone::setTrace(const std::string &trace) {
+	this->_trace = trace;
+}
+
+unsigned int Clone::getEventRate() const {
+	return Notifier::getInstance()->getMaxRate();
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Sets how many TRANSFERRED_BYTES events per second the observers get
+ *
+ * The events are delivered by one thread for all the jobs, see Notifier, so
+ * this applies to all of them.
+ *
+ * \param eventRate
+ * 		Events per second, 0 for no limit
+ */
+void Clone::setEventRate(unsigned int eventRate) {
+	Notifier::getInstance()->setMaxRate(eventRate);
+}
+
+/**
+ * \ingroup CPPAPI
+ * \brief Gets the peak memory used by the process until now
+ *
+ * \return Peak resident set size in bytes
+ */
+uint64_t Clone::getPeakMemory() const {
+	return Util::getPeakMemory();
+}
+
+/**
+ * \brief Shares the memory budget of the job among the pools of the library
+ */
+void Clone::initMemoryLimit() const {
+	Logger *log = Logger::getInstance();
+	log->debug("doclone::initMemoryLimit() start");
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	uint64_t limit = static_cast<uint64_t>(this->_memoryLimit) * Doclone::MIB;
+
+	trns->setPoolLimit(limit / Doclone::MEMORY_POOL_QUOTIENT);
+
+	log->debug("doclone::initMemoryLimit() end");
+}
+
+/**
+ * \brief Writes the peak memory used by the job in the log
+ */
+void Clone::logPeakMemory() const {
+	Logger *log = Logger::getInstance();
+
+	log->info("Peak memory usage: %d KiB, limit: %d MiB",
+			this->getPeakMemory() / 1024, this->_memoryLimit);
+}
+
 /**
  * \brief Adds a pending operation to the vector
  *
@@ -366,11 +965,39 @@ void Clone::setForce(bool force) {
  * 		Operation that will be added.
  */
 void Clone::addOperation(Operation *op) {
+	pthread_mutex_lock(&this->_operationsMutex);
 	this->_operations.push_back(op);
+	pthread_mutex_unlock(&this->_operationsMutex);
+
+	Tracer::getInstance()->queueOperation(op->getType(), op->getTarget());
 
 	this->notifyObservers(Doclone::OPER_ADD, op->getType(), op->getTarget());
 }
 
+/**
+ * \brief Marks one operation as started.
+ *
+ * The parameters are necessary to identify the operation to be marked. It
+ * is called by the thread that does the operation, when it begins.
+ *
+ * \param type
+ * 		The type of the operation.
+ * \param target
+ * 		The target of the operation.
+ */
+void Clone::markStarted(dcOperationType type, const std::string &target) {
+	Logger *log = Logger::getInstance();
+	log->debug("doclone::markStarted(type=>%d, target=>%s) start", type, target.c_str());
+
+	Operation *op = this->getOperation(type, target);
+
+	if(op != 0) {
+		Tracer::getInstance()->beginOperation(type, target);
+	}
+
+	log->debug("doclone::markStarted() end");
+}
+
 /**
  * \brief Marks one operation as completed.
  *
@@ -389,6 +1016,7 @@ void Clone::markCompleted(dcOperationType type, const std::string &target) {
 
 	if(op != 0) {
 		op->setCompleted(true);
+		Tracer::getInstance()->endOperation(type, target);
 
 		this->notifyObservers(Doclone::OPER_MARK_COMPLETED, type, target);
 	}
@@ -412,6 +1040,8 @@ Operation* Clone::getOperation(dcOperationType type, const std::string &target)
 
 	Operation *op = 0;
 
+	pthread_mutex_lock(&this->_operationsMutex);
+
 	std::vector<Operation *>::iterator it;
 	for(it = this->_operations.begin();it != this->_operations.end();++it) {
 		Operation* tmpOp=(*it);
@@ -424,6 +1054,8 @@ Operation* Clone::getOperation(dcOperationType type, const std::string &target)
 		}
 	}
 
+	pthread_mutex_unlock(&this->_operationsMutex);
+
 	log->debug("doclone::getOperation(op=>0x%x) start", op);
 
 	return op;
@@ -442,6 +1074,8 @@ Clone::~Clone() {
 	}
 
 	this->_operations.clear();
+
+	pthread_mutex_destroy(&this->_operationsMutex);
 }
 
 /**
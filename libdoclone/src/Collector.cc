@@ -0,0 +1,619 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <doclone/Collector.h>
+
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/socket.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+#include <doclone/Clone.h>
+#include <doclone/DataTransfer.h>
+#include <doclone/Job.h>
+#include <doclone/Logger.h>
+#include <doclone/NetNode.h>
+#include <doclone/Operation.h>
+#include <doclone/Util.h>
+#include <doclone/exception/ConnectionException.h>
+#include <doclone/exception/InitializationException.h>
+#include <doclone/exception/NoSpaceForImageException.h>
+#include <doclone/exception/ReceiveDataException.h>
+#include <doclone/exception/WriteDataException.h>
+
+namespace Doclone {
+
+/**
+ * \brief Initializes the attributes
+ */
+Collector::Collector()
+	: _nodesNum(0), _writersNum(0), _listenFd(-1), _poolLimit(0), _threads(),
+	  _queue(), _connections(), _done(false), _aborted(false), _names(),
+	  _admitted() {
+	Clone *dcl = Clone::getInstance();
+
+	this->_nodesNum = dcl->getNodesNumber();
+
+	this->_writersNum = dcl->getWriters();
+	if(this->_writersNum == 0) {
+		this->_writersNum = Doclone::COLLECTOR_WRITERS;
+	}
+
+	// The memory budget of the job is shared by the writers
+	DataTransfer *trns = DataTransfer::getInstance();
+	this->_poolLimit = trns->getPoolLimit() / this->_writersNum;
+
+	pthread_mutex_init(&this->_mutex, 0);
+	pthread_cond_init(&this->_notEmpty, 0);
+	pthread_cond_init(&this->_released, 0);
+}
+
+/**
+ * \brief Stops listening
+ */
+Collector::~Collector() {
+	if(this->_listenFd >= 0) {
+		close(this->_listenFd);
+	}
+
+	pthread_cond_destroy(&this->_released);
+	pthread_cond_destroy(&this->_notEmpty);
+	pthread_mutex_destroy(&this->_mutex);
+}
+
+/**
+ * \brief Receives the images of the senders that connect to the collector
+ *
+ * Returns when the images of the number of nodes of the job have been
+ * received, or never if it is 0.
+ */
+void Collector::collect() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Collector::collect() start");
+
+	Clone *dcl = Clone::getInstance();
+
+	Operation *waitOp = new Operation(
+			Doclone::OP_WAIT_CLIENTS, "");
+	dcl->addOperation(waitOp);
+	dcl->markStarted(Doclone::OP_WAIT_CLIENTS, "");
+
+	this->listenSenders();
+	this->startWriters();
+
+	try {
+		unsigned int accepted = 0;
+
+		while(this->_nodesNum == 0 || accepted < this->_nodesNum) {
+			sockaddr_in host_client;
+			socklen_t size = sizeof(host_client);
+
+			int fd = accept(this->_listenFd,
+					reinterpret_cast<sockaddr*>(&host_client), &size);
+
+			if(fd < 0) {
+				if(errno == EINTR || errno == ECONNABORTED) {
+					continue;
+				}
+
+				ConnectionException ex;
+				throw ex;
+			}
+
+			accepted++;
+
+			pthread_mutex_lock(&this->_mutex);
+			this->_queue.push_back(fd);
+			pthread_cond_signal(&this->_notEmpty);
+			pthread_mutex_unlock(&this->_mutex);
+
+			// Notify the views
+			dcl->triggerEvent(Doclone::EVT_NEW_CONNECION,
+					inet_ntoa (host_client.sin_addr));
+		}
+	} catch(const Exception &ex) {
+		this->stopWriters(true);
+		throw;
+	}
+
+	// The writers finish the streams already accepted
+	this->stopWriters(false);
+
+	dcl->markCompleted(Doclone::OP_WAIT_CLIENTS, "");
+
+	log->debug("Collector::collect() end");
+}
+
+/**
+ * \brief Creates the listening socket
+ */
+void Collector::listenSenders() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Collector::listenSenders() start");
+
+	sockaddr_in host_server = {};
+	host_server.sin_family = AF_INET;
+	host_server.sin_port = htons (Doclone::PORT_COLLECT);
+	host_server.sin_addr.s_addr = INADDR_ANY;
+
+	if ((this->_listenFd = socket (AF_INET, SOCK_STREAM | SOCK_CLOEXEC,
+			0)) < 0) {
+		ConnectionException ex;
+		throw ex;
+	}
+
+	// Connect even in TIME_WAIT state
+	int iSetOption = 1;
+	setsockopt(this->_listenFd, SOL_SOCKET, SO_REUSEADDR,
+			&iSetOption, sizeof(iSetOption));
+
+	if ((bind (this->_listenFd, reinterpret_cast<sockaddr*>(&host_server),
+			sizeof(host_server))) < 0) {
+		ConnectionException ex;
+		throw ex;
+	}
+
+	if ((listen (this->_listenFd, SOMAXCONN)) < 0) {
+		ConnectionException ex;
+		throw ex;
+	}
+
+	log->info("Collecting images in %s with %u writers", this->_image.c_str(),
+			this->_writersNum);
+
+	log->debug("Collector::listenSenders() end");
+}
+
+/**
+ * \brief Starts the writing threads
+ *
+ * SIGINT and SIGPIPE are blocked in them, so their handlers, which throw
+ * exceptions, always run in the accepting thread.
+ */
+void Collector::startWriters() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Collector::startWriters() start");
+
+	sigset_t set;
+	sigset_t oldSet;
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &set, &oldSet);
+
+	for(unsigned int i = 0; i < this->_writersNum; i++) {
+		pthread_t thread;
+
+		if(pthread_create(&thread, 0, Collector::writerThread, this) != 0) {
+			break;
+		}
+
+		this->_threads.push_back(thread);
+	}
+
+	pthread_sigmask(SIG_SETMASK, &oldSet, 0);
+
+	if(this->_threads.empty()) {
+		InitializationException ex;
+		throw ex;
+	}
+
+	log->debug("Collector::startWriters() end");
+}
+
+/**
+ * \brief Waits for the writing threads to finish
+ *
+ * \param abort
+ * 		Whether the streams being received are interrupted, and the queued
+ * 		ones are discarded
+ */
+void Collector::stopWriters(bool abort) {
+	Logger *log = Logger::getInstance();
+	log->debug("Collector::stopWriters(abort=>%d) start", abort);
+
+	pthread_mutex_lock(&this->_mutex);
+	this->_done = true;
+	this->_aborted = abort;
+
+	if(abort) {
+		while(!this->_queue.empty()) {
+			close(this->_queue.front());
+			this->_queue.pop_front();
+		}
+
+		std::set<int>::iterator it;
+		for(it = this->_connections.begin(); it != this->_connections.end();
+				++it) {
+			shutdown(*it, SHUT_RDWR);
+		}
+	}
+
+	pthread_cond_broadcast(&this->_notEmpty);
+	pthread_cond_broadcast(&this->_released);
+	pthread_mutex_unlock(&this->_mutex);
+
+	std::vector<pthread_t>::iterator it;
+	for(it = this->_threads.begin(); it != this->_threads.end(); ++it) {
+		pthread_join(*it, 0);
+	}
+	this->_threads.clear();
+
+	log->debug("Collector::stopWriters() end");
+}
+
+/**
+ * \brief Body of the writing threads
+ *
+ * \param arg
+ * 		Pointer to the Collector
+ */
+void *Collector::writerThread(void *arg) {
+	static_cast<Collector *>(arg)->work();
+
+	return 0;
+}
+
+/**
+ * \brief Receives the queued streams until the queue is empty and the
+ * collector has stopped accepting
+ *
+ * Each writer has its own Job, so the progress and the checksums of its
+ * stream don't mix with the other ones.
+ */
+void Collector::work() {
+	Job job;
+	job.bind();
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	trns->initSocketRead();
+	trns->initLocalWrite();
+	trns->setPoolLimit(this->_poolLimit);
+
+	pthread_mutex_lock(&this->_mutex);
+
+	while(true) {
+		while(this->_queue.empty() && !this->_done) {
+			pthread_cond_wait(&this->_notEmpty, &this->_mutex);
+		}
+
+		if(this->_queue.empty()) {
+			break;
+		}
+
+		int fd = this->_queue.front();
+		this->_queue.pop_front();
+		this->_connections.insert(fd);
+		pthread_mutex_unlock(&this->_mutex);
+
+		try {
+			this->receiveImage(fd);
+		} catch(const Exception &ex) {
+			ex.logMsg();
+		}
+
+		trns->disableChecksums(fd);
+
+		pthread_mutex_lock(&this->_mutex);
+		this->_connections.erase(fd);
+		close(fd);
+	}
+
+	pthread_mutex_unlock(&this->_mutex);
+
+	Job::unbind();
+}
+
+/**
+ * \brief Receives the image of a sender in the directory of the collector
+ *
+ * The image is written as NAME.doclone, where NAME is the one the sender
+ * gives.
+ *
+ * \param fd
+ * 		Socket of the sender
+ */
+void Collector::receiveImage(int fd) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Collector::receiveImage(fd=>%d) start", fd);
+
+	std::string address;
+	sockaddr_in host_client;
+	socklen_t size = sizeof(host_client);
+	if(getpeername(fd, reinterpret_cast<sockaddr*>(&host_client),
+			&size) == 0) {
+		address = inet_ntoa (host_client.sin_addr);
+	}
+
+	dcCommand request = 0;
+	DataTransfer::recvData(fd, &request, sizeof(request));
+
+	uint16_t length = 0;
+	DataTransfer::recvData(fd, &length, sizeof(length));
+	length = be16toh(length);
+
+	if(!(request & Doclone::C_SENDER_OK)
+			|| length == 0 || length > Doclone::MAX_IMAGE_NAME) {
+		ConnectionException ex;
+		throw ex;
+	}
+
+	std::string name(length, '\0');
+	DataTransfer::recvData(fd, &name[0], length);
+
+	// Only files just inside the directory, and one stream for each
+	pthread_mutex_lock(&this->_mutex);
+	bool valid = name[0] != '.' && name.find('/') == std::string::npos
+			&& this->_names.insert(name).second;
+	pthread_mutex_unlock(&this->_mutex);
+
+	if(!valid) {
+		log->info("Image %s sent by %s refused", name.c_str(),
+				address.c_str());
+
+		ConnectionException ex;
+		throw ex;
+	}
+
+	/*
+	 * The name and the space are released once the image is renamed, or
+	 * removed, so another stream of the same name can't touch it before
+	 */
+	Reservation reservation(this, name);
+
+	int imageFd = -1;
+	std::string partial = this->getPartialPath(name);
+	std::string path = this->_image + "/" + name + Doclone::COLLECTOR_EXTENSION;
+
+	try {
+		dcCommand response = Doclone::C_SERVER_OK;
+
+		// Old senders don't ask for checksums
+		if(request & Doclone::C_CHECKSUMS) {
+			response |= Doclone::C_CHECKSUMS;
+		}
+
+		DataTransfer::sendData(fd, &response, sizeof(response));
+
+		DataTransfer *trns = DataTransfer::getInstance();
+		if(response & Doclone::C_CHECKSUMS) {
+			trns->enableChecksums(fd);
+		}
+
+		uint64_t totalSize;
+		DataTransfer::recvData(fd, &totalSize, sizeof(totalSize));
+		totalSize = be64toh(totalSize);
+		trns->setTotalSize(totalSize);
+
+		Util::createFile(partial);
+		imageFd = Util::openFile(partial);
+
+		/*
+		 * Until the stream is admitted its data is not read, so the sender
+		 * waits with a full socket
+		 */
+		if(!this->admit(name, totalSize)) {
+			NoSpaceForImageException ex;
+			throw ex;
+		}
+
+		log->info("Receiving image %s from %s", name.c_str(),
+				address.c_str());
+
+		time_t start = time(0);
+		bool checksums = trns->hasChecksums(fd);
+		uint64_t received = trns->copyData(fd, imageFd);
+
+		time_t elapsed = time(0) - start;
+		if(elapsed == 0) {
+			elapsed = 1;
+		}
+
+		/*
+		 * The size sent is the one of the data of the image, not of the
+		 * compressed stream, so it can't tell a cut stream. With checksums,
+		 * copyData() fails unless the stream has its end. Without them, the
+		 * image must be read to its end.
+		 */
+		if(received == 0
+				|| (!checksums && !Collector::isComplete(imageFd))) {
+			log->warn("Image %s sent by %s is incomplete: %llu bytes",
+					name.c_str(), address.c_str(),
+					static_cast<unsigned long long>(received));
+
+			ReceiveDataException ex;
+			throw ex;
+		}
+
+		Util::closeFile(imageFd);
+		imageFd = -1;
+
+		if(rename(partial.c_str(), path.c_str()) < 0) {
+			WriteDataException ex;
+			throw ex;
+		}
+
+		log->info("Image %s received from %s: %llu bytes in %ld s, "
+				"%llu bytes/s", name.c_str(), address.c_str(),
+				static_cast<unsigned long long>(received),
+				static_cast<long>(elapsed),
+				static_cast<unsigned long long>(received / elapsed));
+	} catch(const Exception &ex) {
+		if(imageFd >= 0) {
+			close(imageFd);
+		}
+
+		unlink(partial.c_str());
+
+		throw;
+	}
+
+	log->debug("Collector::receiveImage() end");
+}
+
+/**
+ * \brief Checks that an image is a whole archive, reading all its entries
+ *
+ * \param imageFd
+ * 		Descriptor of the image
+ *
+ * \return false if the image is cut or corrupted
+ */
+bool Collector::isComplete(int imageFd) {
+	Logger *log = Logger::getInstance();
+	log->debug("Collector::isComplete(imageFd=>%d) start", imageFd);
+
+	struct archive *arch = archive_read_new();
+	archive_read_support_format_tar(arch);
+	archive_read_support_filter_gzip(arch);
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	size_t blockSize = trns->getBufferSize(Doclone::BUFFER_ARCHIVE);
+
+	int r = ARCHIVE_FATAL;
+	if(lseek(imageFd, 0, SEEK_SET) == 0
+			&& archive_read_open_fd(arch, imageFd, blockSize) == ARCHIVE_OK) {
+		struct archive_entry *entry;
+
+		// The data of each entry is read when skipped
+		while((r = archive_read_next_header(arch, &entry)) == ARCHIVE_OK);
+	}
+
+	archive_read_free(arch);
+
+	bool retVal = (r == ARCHIVE_EOF);
+
+	log->debug("Collector::isComplete(retVal=>%d) end", retVal);
+	return retVal;
+}
+
+/**
+ * \brief Gets the path an image is written to until it is complete
+ */
+std::string Collector::getPartialPath(const std::string &name) const {
+	return this->_image + "/" + name + Doclone::COLLECTOR_EXTENSION
+			+ Doclone::COLLECTOR_PARTIAL_EXTENSION;
+}
+
+/**
+ * \brief Waits until there is free space for a new image
+ *
+ * \param name
+ * 		Name of the image being written
+ * \param size
+ * 		Expected size of the image
+ *
+ * \return false if the image won't fit even when the other ones finish
+ */
+bool Collector::admit(const std::string &name, uint64_t size) {
+	Logger *log = Logger::getInstance();
+	log->debug("Collector::admit(size=>%llu) start", size);
+
+	bool retVal = false;
+
+	pthread_mutex_lock(&this->_mutex);
+
+	while(!this->_aborted) {
+		struct statvfs st;
+		if(statvfs(this->_image.c_str(), &st) < 0) {
+			// The free space is unknown, the stream is admitted
+			retVal = true;
+			break;
+		}
+
+		uint64_t freeBytes = static_cast<uint64_t>(st.f_bavail) * st.f_frsize;
+		if(freeBytes >= this->pendingBytes() + size) {
+			retVal = true;
+			break;
+		}
+
+		if(this->_admitted.empty()) {
+			break;
+		}
+
+		pthread_cond_wait(&this->_released, &this->_mutex);
+	}
+
+	if(retVal) {
+		this->_admitted[name] = size;
+	}
+
+	pthread_mutex_unlock(&this->_mutex);
+
+	log->debug("Collector::admit(retVal=>%d) end", retVal);
+	return retVal;
+}
+
+/**
+ * \brief Frees the name and the reserved space of an image
+ */
+void Collector::release(const std::string &name) {
+	pthread_mutex_lock(&this->_mutex);
+
+	this->_names.erase(name);
+	this->_admitted.erase(name);
+	pthread_cond_broadcast(&this->_released);
+
+	pthread_mutex_unlock(&this->_mutex);
+}
+
+/**
+ * \brief Space still needed by the images being written
+ *
+ * Must be called with _mutex locked.
+ */
+uint64_t Collector::pendingBytes() const {
+	uint64_t retVal = 0;
+
+	std::map<std::string, uint64_t>::const_iterator it;
+	for(it = this->_admitted.begin(); it != this->_admitted.end(); ++it) {
+		struct stat st;
+		uint64_t written = 0;
+		if(stat(this->getPartialPath(it->first).c_str(), &st) == 0) {
+			written = static_cast<uint64_t>(st.st_blocks) * 512;
+		}
+
+		if(written < it->second) {
+			retVal += it->second - written;
+		}
+	}
+
+	return retVal;
+}
+
+Collector::Reservation::Reservation(Collector *collector,
+		const std::string &name)
+	: _collector(collector), _name(name) {
+}
+
+Collector::Reservation::~Reservation() {
+	this->_collector->release(this->_name);
+}
+
+}
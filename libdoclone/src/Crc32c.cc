@@ -0,0 +1,289 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <doclone/Crc32c.h>
+
+#include <string.h>
+#include <endian.h>
+#include <pthread.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define DC_CRC32C_SSE42 1
+#endif
+
+namespace Doclone {
+
+/// Reversed Castagnoli polynomial
+static const uint32_t CRC32C_POLY = 0x82F63B78;
+
+/// Tables for the slicing-by-8 algorithm
+static uint32_t crcTables[8][256];
+
+/// Initializes crcTables only once
+static pthread_once_t crcTablesOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * \brief Computes the CRC32C of a buffer
+ *
+ * \param buf
+ * 		The data
+ * \param len
+ * 		Number of bytes of data
+ *
+ * \return The checksum
+ */
+uint32_t Crc32c::compute(const void *buf, size_t len) {
+	return Crc32c::update(0, buf, len);
+}
+
+/**
+ * \brief Continues a CRC32C with more data
+ *
+ * \param crc
+ * 		Checksum of the previous data, 0 for the first call
+ * \param buf
+ * 		The data
+ * \param len
+ * 		Number of bytes of data
+ *
+ * \return The checksum of all the data
+ */
+uint32_t Crc32c::update(uint32_t crc, const void *buf, size_t len) {
+	const uint8_t *data = static_cast<const uint8_t *>(buf);
+
+	if(Crc32c::isHardwareAccelerated()) {
+		return Crc32c::updateHardware(crc, data, len);
+	}
+
+	pthread_once(&crcTablesOnce, Crc32c::initTables);
+
+	return Crc32c::updateSoftware(crc, data, len);
+}
+
+/**
+ * \brief Multiplies a vector by a matrix over GF(2)
+ *
+ * \param mat
+ * 		32 columns of the matrix
+ * \param vec
+ * 		The vector
+ */
+static uint32_t gf2MatrixTimes(const uint32_t *mat, uint32_t vec) {
+	uint32_t sum = 0;
+
+	while(vec != 0) {
+		if(vec & 1) {
+			sum ^= *mat;
+		}
+		vec >>= 1;
+		mat++;
+	}
+
+	return sum;
+}
+
+/**
+ * \brief Squares a matrix over GF(2)
+ */
+static void gf2MatrixSquare(uint32_t *square, const uint32_t *mat) {
+	for(int n = 0; n < 32; n++) {
+		square[n] = gf2MatrixTimes(mat, mat[n]);
+	}
+}
+
+/**
+ * \brief Continues a CRC32C with a run of zeros
+ *
+ * Gives the same result as update() with a buffer of zeros, in a time
+ * logarithmic in len, like crc32_combine() of zlib.
+ *
+ * \param crc
+ * 		Checksum of the previous data, 0 for the first call
+ * \param len
+ * 		Number of zeros
+ *
+ * \return The checksum of all the data
+ */
+uint32_t Crc32c::updateZeros(uint32_t crc, uint64_t len) {
+	if(len == 0) {
+		return crc;
+	}
+
+	// Operators for 1 zero bit, then 2, 4...
+	uint32_t even[32];
+	uint32_t odd[32];
+
+	odd[0] = CRC32C_POLY;
+	uint32_t row = 1;
+	for(int n = 1; n < 32; n++) {
+		odd[n] = row;
+		row <<= 1;
+	}
+
+	gf2MatrixSquare(even, odd);
+	gf2MatrixSquare(odd, even);
+
+	// Apply the operator of each bit of len, from 1 zero byte up
+	uint32_t reg = ~crc;
+	do {
+		gf2MatrixSquare(even, odd);
+		if(len & 1) {
+			reg = gf2MatrixTimes(even, reg);
+		}
+		len >>= 1;
+
+		if(len == 0) {
+			break;
+		}
+
+		gf2MatrixSquare(odd, even);
+		if(len & 1) {
+			reg = gf2MatrixTimes(odd, reg);
+		}
+		len >>= 1;
+	} while(len != 0);
+
+	return ~reg;
+}
+
+/**
+ * \brief Computes the CRC32C of two pieces of data from the ones of each
+ * piece, without reading them
+ *
+ * \param crc1
+ * 		Checksum of the first piece
+ * \param crc2
+ * 		Checksum of the second piece
+ * \param len2
+ * 		Length of the second piece
+ *
+ * \return The checksum of the first piece followed by the second one
+ */
+uint32_t Crc32c::combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+	// The CRC is linear, but for the inversions, which only depend on len2
+	return Crc32c::updateZeros(crc1, len2) ^ crc2
+			^ Crc32c::updateZeros(0, len2);
+}
+
+/**
+ * \brief Whether the processor computes the checksums
+ */
+bool Crc32c::isHardwareAccelerated() {
+#ifdef DC_CRC32C_SSE42
+	static const bool hasSse42 = __builtin_cpu_supports("sse4.2");
+
+	return hasSse42;
+#else
+	return false;
+#endif
+}
+
+/**
+ * \brief Fills the tables of the slicing-by-8 algorithm
+ */
+void Crc32c::initTables() {
+	for(uint32_t i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for(int j = 0; j < 8; j++) {
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+		}
+		crcTables[0][i] = crc;
+	}
+
+	for(uint32_t i = 0; i < 256; i++) {
+		for(int t = 1; t < 8; t++) {
+			uint32_t prev = crcTables[t - 1][i];
+			crcTables[t][i] = (prev >> 8) ^ crcTables[0][prev & 0xFF];
+		}
+	}
+}
+
+/**
+ * \brief Slicing-by-8 CRC32C, for processors without the crc32 instruction
+ */
+uint32_t Crc32c::updateSoftware(uint32_t crc, const uint8_t *buf,
+		size_t len) {
+	crc = ~crc;
+
+	while(len >= 8) {
+		uint32_t low;
+		uint32_t high;
+		memcpy(&low, buf, sizeof(low));
+		memcpy(&high, buf + 4, sizeof(high));
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+		low = __builtin_bswap32(low);
+		high = __builtin_bswap32(high);
+#endif
+
+		low ^= crc;
+		crc = crcTables[7][low & 0xFF]
+			^ crcTables[6][(low >> 8) & 0xFF]
+			^ crcTables[5][(low >> 16) & 0xFF]
+			^ crcTables[4][low >> 24]
+			^ crcTables[3][high & 0xFF]
+			^ crcTables[2][(high >> 8) & 0xFF]
+			^ crcTables[1][(high >> 16) & 0xFF]
+			^ crcTables[0][high >> 24];
+
+		buf += 8;
+		len -= 8;
+	}
+
+	while(len-- > 0) {
+		crc = (crc >> 8) ^ crcTables[0][(crc ^ *buf++) & 0xFF];
+	}
+
+	return ~crc;
+}
+
+#ifdef DC_CRC32C_SSE42
+/**
+ * \brief CRC32C with the crc32 instruction of SSE 4.2
+ */
+__attribute__((target("sse4.2")))
+uint32_t Crc32c::updateHardware(uint32_t crc, const uint8_t *buf,
+		size_t len) {
+	uint64_t crc64 = ~crc;
+
+	while(len >= 8) {
+		uint64_t word;
+		memcpy(&word, buf, sizeof(word));
+		crc64 = __builtin_ia32_crc32di(crc64, word);
+
+		buf += 8;
+		len -= 8;
+	}
+
+	uint32_t crc32 = static_cast<uint32_t>(crc64);
+	while(len-- > 0) {
+		crc32 = __builtin_ia32_crc32qi(crc32, *buf++);
+	}
+
+	return ~crc32;
+}
+#else
+uint32_t Crc32c::updateHardware(uint32_t crc, const uint8_t *buf,
+		size_t len) {
+	pthread_once(&crcTablesOnce, Crc32c::initTables);
+
+	return Crc32c::updateSoftware(crc, buf, len);
+}
+#endif
+
+}
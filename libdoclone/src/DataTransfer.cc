@@ -18,49 +18,265 @@
 
 #include <doclone/DataTransfer.h>
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <endian.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <poll.h>
 #include <pthread.h>
+#include <linux/errqueue.h>
 
 #include <doclone/Logger.h>
+#include <doclone/Job.h>
+#include <doclone/Crc32c.h>
+#include <doclone/Stats.h>
 #include <doclone/exception/ReadDataException.h>
 #include <doclone/exception/WriteDataException.h>
 #include <doclone/exception/ReceiveDataException.h>
 #include <doclone/exception/SendDataException.h>
 #include <doclone/exception/BrokenPipeException.h>
 #include <doclone/exception/InitializationException.h>
+#include <doclone/exception/AllocateBufferException.h>
+#include <doclone/exception/CorruptedChunkException.h>
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) \
+		&& defined(SO_EE_ORIGIN_ZEROCOPY)
+#define DC_ZEROCOPY 1
+#endif
 
 namespace Doclone {
 
+/**
+ * \struct dcReadAhead
+ * \brief State shared by a pipelined copy and its reading thread
+ *
+ * The reading thread fills the two buffers alternately, and the copying
+ * thread writes and frees them in the same order.
+ */
+struct dcReadAhead {
+	/// Origin descriptor
+	int fd;
+	/// Reads from fd, verifying the checksums if it has them
+	DataTransfer *trns;
+	/// Job of the copying thread
+	Job *job;
+	/// Size of each buffer
+	dcBuffSize size;
+	/// The two buffers
+	char *buffers[2];
+	/// Number of valid bytes in each buffer
+	ssize_t lengths[2];
+	/// Whether each buffer holds data not yet written
+	bool full[2];
+	/// Whether the read of each buffer failed
+	bool failed[2];
+	/// Whether the CRC32C of the data must be computed for the destinations
+	bool checksum;
+	/// CRC32C of each CHECKSUM_CHUNK_SIZE piece of each buffer
+	std::vector<uint32_t> crcs[2];
+	/// Whether a read failed because of a corrupted chunk
+	bool corrupted;
+	/// Index, offset and length of the corrupted chunk
+	uint64_t badChunk, badOffset, badLength;
+	/// Whether the CRC32C of all the data must be computed
+	bool digest;
+	/// CRC32C of all the data read until now
+	uint32_t digestCrc;
+	/// Set by the copying thread to make the reading thread finish
+	bool stop;
+	/// Protects all the above
+	pthread_mutex_t mutex;
+	/// Signals the changes of state of the buffers
+	pthread_cond_t cond;
+};
+
+/**
+ * \brief Throws a SendDataException with the address of a socket
+ */
+static void throwSendError(int s) throw(Exception) {
+	struct sockaddr_in addr;
+	socklen_t addr_size = sizeof(struct sockaddr_in);
+	getsockname(s, (struct sockaddr *)&addr, &addr_size);
+	SendDataException ex(inet_ntoa(addr.sin_addr));
+	throw ex;
+}
+
+/**
+ * \brief Reads from a descriptor until the buffer is full or the end of the
+ * data is reached
+ *
+ * \return Number of bytes read. Lower than size only at the end of the data
+ */
+static ssize_t fillBuffer(DataTransfer *trns, int fd, char *buf,
+		dcBuffSize size) throw(Exception) {
+	ssize_t nbytes = 0;
+	ssize_t r;
+
+	while (nbytes < size
+			&& (r = trns->readData(fd, buf + nbytes, size - nbytes)) > 0) {
+		nbytes += r;
+	}
+
+	return nbytes;
+}
+
+/**
+ * \brief Reads exactly len bytes, unless the end of the data is reached
+ *
+ * \return Number of bytes read
+ */
+static size_t readFully(readFunction getNbytes, int fd, char *buf,
+		size_t len) throw(Exception) {
+	size_t nbytes = 0;
+	ssize_t r;
+
+	while (nbytes < len
+			&& (r = (*getNbytes) (fd, buf + nbytes, len - nbytes)) > 0) {
+		nbytes += r;
+	}
+
+	return nbytes;
+}
+
+/**
+ * \brief Computes the CRC32C of each CHECKSUM_CHUNK_SIZE piece of a buffer
+ */
+static void computeCrcs(const char *buf, size_t len,
+		std::vector<uint32_t> &crcs) {
+	size_t i = 0;
+
+	for(size_t pos = 0; pos < len; pos += Doclone::CHECKSUM_CHUNK_SIZE) {
+		size_t chunkLen = len - pos;
+		if(chunkLen > static_cast<size_t>(Doclone::CHECKSUM_CHUNK_SIZE)) {
+			chunkLen = Doclone::CHECKSUM_CHUNK_SIZE;
+		}
+
+		crcs[i++] = Crc32c::compute(buf + pos, chunkLen);
+	}
+}
+
+/**
+ * \brief Body of the reading thread of a pipelined copy
+ *
+ * \param arg
+ * 		Pointer to the dcReadAhead shared with the copying thread
+ */
+static void *readAheadThread(void *arg) {
+	dcReadAhead *ra = static_cast<dcReadAhead *>(arg);
+	int slot = 1;
+
+	ra->job->bind();
+
+	while(true) {
+		pthread_mutex_lock(&ra->mutex);
+		while(ra->full[slot] && !ra->stop) {
+			pthread_cond_wait(&ra->cond, &ra->mutex);
+		}
+		bool stop = ra->stop;
+		pthread_mutex_unlock(&ra->mutex);
+
+		if(stop) {
+			break;
+		}
+
+		ssize_t nbytes = 0;
+		bool failed = false;
+		bool corrupted = false;
+		uint64_t badChunk = 0, badOffset = 0, badLength = 0;
+		try {
+			nbytes = fillBuffer(ra->trns, ra->fd, ra->buffers[slot],
+					ra->size);
+
+			if(ra->checksum) {
+				computeCrcs(ra->buffers[slot], nbytes, ra->crcs[slot]);
+			}
+
+			if(ra->digest) {
+				ra->digestCrc = Crc32c::update(ra->digestCrc,
+						ra->buffers[slot], nbytes);
+			}
+		} catch (const CorruptedChunkException &ex) {
+			failed = corrupted = true;
+			badChunk = ex.getChunk();
+			badOffset = ex.getOffset();
+			badLength = ex.getLength();
+		} catch (const Exception &ex) {
+			failed = true;
+		}
+
+		pthread_mutex_lock(&ra->mutex);
+		ra->lengths[slot] = nbytes;
+		ra->failed[slot] = failed;
+		if(corrupted) {
+			ra->corrupted = true;
+			ra->badChunk = badChunk;
+			ra->badOffset = badOffset;
+			ra->badLength = badLength;
+		}
+		ra->full[slot] = true;
+		pthread_cond_broadcast(&ra->cond);
+		pthread_mutex_unlock(&ra->mutex);
+
+		// A short buffer means the end of the data
+		if(failed || nbytes < ra->size) {
+			break;
+		}
+
+		slot ^= 1;
+	}
+
+	return 0;
+}
+
 /**
  * \brief Initializes the attributes
  */
 DataTransfer::DataTransfer()
 	:  getNbytes(0), putNbytes(0), _totalSize(0), _transferredBytes(0),
-	   _transferNotificationsCount(0) {
+	   _transferNotificationsCount(0), _bufferSizes(), _bufferPool(),
+	   _allocatedBuffers(), _poolLimit(0), _poolAllocated(0) {
 	this->_notificationPointSize = Doclone::BUFFER_SIZE*Doclone::UPDATE_QUOTIENT;
+
+	this->_bufferSizes[Doclone::BUFFER_DISK] =
+			Doclone::DISK_BUFFER_MIB * Doclone::MIB;
+	this->_bufferSizes[Doclone::BUFFER_SOCKET] =
+			Doclone::SOCKET_BUFFER_MIB * Doclone::MIB;
+	this->_bufferSizes[Doclone::BUFFER_ARCHIVE] =
+			Doclone::ARCHIVE_BUFFER_MIB * Doclone::MIB;
+
+	pthread_mutex_init(&this->_poolMutex, 0);
 }
 
 /**
- * \brief Singleton stuff
- *
- * \return Pointer to a DataTransfer object
+ * \brief Frees all the buffers of the pool
  */
-DataTransfer* DataTransfer::getInstance() {
-	static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-
-	pthread_mutex_lock(&mutex);
+DataTransfer::~DataTransfer() {
+	std::map<char *, dcBuffSize>::iterator it;
+	for(it = this->_allocatedBuffers.begin();
+			it != this->_allocatedBuffers.end(); ++it) {
+		free(it->first);
+	}
 
-	static DataTransfer instance;
+	this->_allocatedBuffers.clear();
+	this->_bufferPool.clear();
 
-	pthread_mutex_unlock(&mutex);
+	pthread_mutex_destroy(&this->_poolMutex);
+}
 
-	return &instance;
+/**
+ * \brief Gets the DataTransfer of the job of the calling thread
+ *
+ * \return Pointer to a DataTransfer object
+ */
+DataTransfer* DataTransfer::getInstance() {
+	return Job::getCurrent()->getDataTransfer();
 }
 
 /**
@@ -79,30 +295,22 @@ uint64_t DataTransfer::archiveToBuf(struct archive *arIn, std::string &target) t
 	Logger *log = Logger::getInstance();
 	log->loopDebug("DataTransfer::archiveToBuf(arIn=>0x%x, buff=>%s) start", arIn, target.c_str());
 
-	char buf[Doclone::BUFFER_SIZE];
-	memset(buf, 0, Doclone::BUFFER_SIZE);
+	dcBuffSize size = this->getBufferSize(Doclone::BUFFER_ARCHIVE);
+	char *buf = this->acquireBuffer(size);
 
-	unsigned int nbytes = Doclone::BUFFER_SIZE;
-	unsigned int totalNbytes = 0;
+	ssize_t nbytes = 0;
+	uint64_t totalNbytes = 0;
 	target.clear();
 
-	while ((nbytes = archive_read_data(arIn, buf, Doclone::BUFFER_SIZE)) > 0) {
-		target.append(buf);
+	while ((nbytes = archive_read_data(arIn, buf, size)) > 0) {
+		target.append(buf, nbytes);
 
-		this->_transferredBytes += nbytes;
 		totalNbytes += nbytes;
-
-		// Notify the views if it crosses a notification point
-		if(this->_transferredBytes >
-			(this->_notificationPointSize * this->_transferNotificationsCount)) {
-			this->_transferNotificationsCount++;
-			this->notifyObservers(Doclone::TRANS_TRANSFERRED_BYTES,
-					this->_transferredBytes);
-		}
-
-		memset(buf, 0, Doclone::BUFFER_SIZE);
+		this->countBytes(nbytes);
 	}
 
+	this->releaseBuffer(buf);
+
 	// If the transfer stopped due to an error
 	if(nbytes < 0) {
 		ReadDataException ex;
@@ -130,28 +338,12 @@ uint64_t DataTransfer::bufToArchive(const std::string &source,
 	Logger *log = Logger::getInstance();
 	log->loopDebug("DataTransfer::bufToArchive(source=>%s, outArchives=>0x%x) start", source.c_str(), &outArchives);
 
-	int r;
-	unsigned int totalNbytes = 0;
+	uint64_t totalNbytes = 0;
 
-	std::vector<struct archive*>::iterator it;
-	for(it = outArchives.begin(); it != outArchives.end(); ++it) {
-		r = archive_write_data(*it, source.c_str(), source.length());
-		if (r < ARCHIVE_OK) {
-			WriteDataException ex;
-			throw ex;
-		}
-	}
+	this->writeBuffer(source.c_str(), source.length(), 0, 0, &outArchives);
 
-	this->_transferredBytes += source.length();
 	totalNbytes += source.length();
-
-	// Notify the views if it crosses a notification point
-	if(this->_transferredBytes >
-		(this->_notificationPointSize * this->_transferNotificationsCount)) {
-		this->_transferNotificationsCount++;
-		this->notifyObservers(Doclone::TRANS_TRANSFERRED_BYTES,
-				this->_transferredBytes);
-	}
+	this->countBytes(source.length());
 
 	log->loopDebug("DataTransfer::bufToArchive(totalNbytes=>%d) end", totalNbytes);
 	return totalNbytes;
@@ -166,44 +358,177 @@ uint64_t DataTransfer::bufToArchive(const std::string &source,
  * 		Source file descriptor
  * \param outArchives
  * 		Vector of archives where data will be written
+ * \param [out] crc
+ * 		If not NULL, the CRC32C of all the data is stored here
  *
  * \return Number of transferred bytes
  */
-uint64_t DataTransfer::fdToArchive(int fd, std::vector<struct archive*> &outArchives) throw(Exception) {
+uint64_t DataTransfer::fdToArchive(int fd,
+		std::vector<struct archive*> &outArchives, uint32_t *crc)
+		throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->loopDebug("DataTransfer::transferFile(fd=>%d, outArchives=>0x%x) start", fd, &outArchives);
 
-	int r;
-	char buf[Doclone::BUFFER_SIZE];
-	unsigned int nbytes = 0;
-	unsigned int totalNbytes = 0;
+	uint64_t totalNbytes = this->pipelinedCopy(fd, 0, &outArchives, crc);
 
-	while ((nbytes = (*this->getNbytes) (fd, buf, Doclone::BUFFER_SIZE)) > 0) {
-		std::vector<struct archive*>::iterator it;
-		for(it = outArchives.begin(); it != outArchives.end(); ++it) {
-			r = archive_write_data(*it, buf, nbytes);
-			if (r < ARCHIVE_OK) {
-				WriteDataException ex;
-				throw ex;
+	log->loopDebug("DataTransfer::fdToArchive(totalNbytes=>%d) end", totalNbytes);
+	return totalNbytes;
+}
+
+/**
+ * \brief Reads the data regions of a sparse file and writes the whole file
+ * in the archives
+ *
+ * The holes are not read: zeros are given to libarchive for them, which it
+ * doesn't store if the entry has the same regions in its sparse map.
+ *
+ * \param fd
+ * 		Source file descriptor
+ * \param regions
+ * 		Data regions of the file, see getDataRegions()
+ * \param size
+ * 		Size of the file
+ * \param outArchives
+ * 		Vector of archives where data will be written
+ * \param [out] crc
+ * 		If not NULL, the CRC32C of all the data, holes included, is stored here
+ *
+ * \return Number of bytes read from the file
+ */
+uint64_t DataTransfer::sparseToArchive(int fd,
+		const std::vector<dcDataRegion> &regions, uint64_t size,
+		std::vector<struct archive*> &outArchives, uint32_t *crc)
+		throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("DataTransfer::sparseToArchive(fd=>%d, regions=>%d, size=>%d) start", fd, regions.size(), size);
+
+	dcBuffSize bufSize = this->getBufferSize(BUFFER_DISK);
+	char *buf = this->acquireBuffer(bufSize);
+
+	uint64_t totalNbytes = 0;
+	uint64_t pos = 0;
+	uint32_t digest = 0;
+
+	try {
+		for(unsigned int i = 0; i <= regions.size(); i++) {
+			dcDataRegion region = i < regions.size() ? regions[i]
+					: dcDataRegion(size, 0);
+
+			// The hole before the region
+			if(region.first > pos) {
+				uint64_t holeLen = region.first - pos;
+
+				memset(buf, 0, bufSize);
+				while(holeLen > 0) {
+					size_t n = holeLen < static_cast<uint64_t>(bufSize)
+							? holeLen : bufSize;
+					this->writeBuffer(buf, n, 0, 0, &outArchives);
+					holeLen -= n;
+				}
+
+				digest = Crc32c::updateZeros(digest, region.first - pos);
 			}
-		}
 
-		this->_transferredBytes += nbytes;
-		totalNbytes += nbytes;
+			uint64_t offset = region.first;
+			uint64_t remaining = region.second;
+			while(remaining > 0) {
+				size_t n = remaining < static_cast<uint64_t>(bufSize)
+						? remaining : bufSize;
+
+				uint64_t startTime = Stats::now();
+				ssize_t nbytes = pread(fd, buf, n, offset);
+				if(nbytes <= 0) {
+					ReadDataException ex;
+					throw ex;
+				}
+				Stats::getInstance()->addStage(Doclone::STAGE_READ, nbytes,
+						startTime);
+
+				this->writeBuffer(buf, nbytes, 0, 0, &outArchives);
+				digest = Crc32c::update(digest, buf, nbytes);
+
+				totalNbytes += nbytes;
+				this->countBytes(nbytes);
+
+				offset += nbytes;
+				remaining -= nbytes;
+			}
 
-		// Notify the views if it crosses a notification point
-		if(this->_transferredBytes >
-			(this->_notificationPointSize * this->_transferNotificationsCount)) {
-			this->_transferNotificationsCount++;
-			this->notifyObservers(Doclone::TRANS_TRANSFERRED_BYTES,
-					this->_transferredBytes);
+			pos = region.first + region.second;
 		}
+	} catch (const Exception &ex) {
+		this->releaseBuffer(buf);
+		throw;
 	}
 
-	log->loopDebug("DataTransfer::fdToArchive(totalNbytes=>%d) end", totalNbytes);
+	this->releaseBuffer(buf);
+
+	if(crc != 0) {
+		*crc = digest;
+	}
+
+	log->loopDebug("DataTransfer::sparseToArchive(totalNbytes=>%d) end", totalNbytes);
 	return totalNbytes;
 }
 
+/**
+ * \brief Finds the regions of a file with data, between its holes
+ *
+ * \param fd
+ * 		Descriptor of the file
+ * \param size
+ * 		Size of the file
+ * \param [out] regions
+ * 		Offset and length of each data region, in order
+ *
+ * \return true if the file has holes. false if it hasn't, or if the
+ * filesystem can't tell them, in which case regions is empty
+ */
+bool DataTransfer::getDataRegions(int fd, uint64_t size,
+		std::vector<dcDataRegion> &regions) {
+	regions.clear();
+
+	uint64_t pos = 0;
+	uint64_t dataLen = 0;
+
+	while(pos < size) {
+		off_t data = lseek(fd, pos, SEEK_DATA);
+		if(data < 0) {
+			// ENXIO: the rest of the file is a hole
+			if(errno == ENXIO) {
+				break;
+			}
+
+			regions.clear();
+			return false;
+		}
+
+		off_t hole = lseek(fd, data, SEEK_HOLE);
+		if(hole < 0) {
+			regions.clear();
+			return false;
+		}
+
+		uint64_t end = static_cast<uint64_t>(hole) < size ? hole : size;
+		if(static_cast<uint64_t>(data) >= end) {
+			break;
+		}
+
+		regions.push_back(dcDataRegion(data, end - data));
+		dataLen += end - data;
+		pos = end;
+	}
+
+	lseek(fd, 0, SEEK_SET);
+
+	if(dataLen == size) {
+		regions.clear();
+		return false;
+	}
+
+	return true;
+}
+
 /**
  * \brief Writes the libarchive entry of a file in many archives
  *
@@ -231,6 +556,80 @@ void DataTransfer::copyHeader(struct archive_entry *entry,
 	log->loopDebug("DataTransfer::fdToArchive() end");
 }
 
+/**
+ * \brief Writes the data of the current entry of an archive over an
+ * existing file
+ *
+ * Every block of the entry is compared with the same block of the file, and
+ * only written if they differ. The holes of a sparse entry are compared with
+ * zeros. The file is not truncated.
+ *
+ * \param arIn
+ * 		Archive being read
+ * \param fd
+ * 		Descriptor of the file, open for reading and writing
+ * \param size
+ * 		Size of the entry
+ *
+ * \return Number of bytes written in the file
+ */
+uint64_t DataTransfer::patchData(struct archive *arIn, int fd, uint64_t size)
+		throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("DataTransfer::patchData(arIn=>0x%x, fd=>%d, size=>%d) start", arIn, fd, size);
+
+	int r;
+	const void *buff;
+	size_t len;
+	off_t offset;
+	uint64_t pos = 0;
+	uint64_t written = 0;
+
+	dcBuffSize bufSize = this->getBufferSize(BUFFER_DISK);
+	char *diskBuf = this->acquireBuffer(bufSize);
+	Stats *stats = Stats::getInstance();
+
+	// The kernel reads the file ahead while the archive is being read
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	try {
+		uint64_t startTime = Stats::now();
+		while ((r = archive_read_data_block(arIn, &buff, &len, &offset)) != ARCHIVE_EOF) {
+			if (r < ARCHIVE_OK) {
+				ReadDataException ex;
+				throw ex;
+			}
+
+			if(static_cast<uint64_t>(offset) > pos) {
+				written += this->patchRange(fd, 0, offset - pos, pos, diskBuf,
+						bufSize);
+			}
+
+			written += this->patchRange(fd, static_cast<const char *>(buff),
+					len, offset, diskBuf, bufSize);
+
+			pos = offset + len;
+			this->countBytes(len);
+
+			stats->addStage(Doclone::STAGE_EXTRACT, len, startTime);
+			startTime = Stats::now();
+		}
+
+		if(pos < size) {
+			written += this->patchRange(fd, 0, size - pos, pos, diskBuf,
+					bufSize);
+		}
+	} catch (const Exception &ex) {
+		this->releaseBuffer(diskBuf);
+		throw;
+	}
+
+	this->releaseBuffer(diskBuf);
+
+	log->loopDebug("DataTransfer::patchData(written=>%d) end", written);
+	return written;
+}
+
 /**
  * \brief Transfers all the data from fdin to fdout.
  *
@@ -249,8 +648,10 @@ uint64_t DataTransfer::copyData(struct archive *arIn, std::vector<struct archive
 	const void *buff;
 	size_t size;
 	off_t offset;
-	unsigned int totalNbytes = 0;
+	uint64_t totalNbytes = 0;
+	Stats *stats = Stats::getInstance();
 
+	uint64_t startTime = Stats::now();
 	while ((r = archive_read_data_block(arIn, &buff, &size, &offset)) != ARCHIVE_EOF) {
 		if (r < ARCHIVE_OK) {
 			ReadDataException ex;
@@ -266,22 +667,97 @@ uint64_t DataTransfer::copyData(struct archive *arIn, std::vector<struct archive
 			}
 		}
 
-		this->_transferredBytes += size;
 		totalNbytes += size;
+		this->countBytes(size);
 
-		// Notify the views if it crosses a notification point
-		if(this->_transferredBytes >
-			(this->_notificationPointSize * this->_transferNotificationsCount)) {
-			this->_transferNotificationsCount++;
-			this->notifyObservers(Doclone::TRANS_TRANSFERRED_BYTES,
-					this->_transferredBytes);
-		}
+		stats->addStage(Doclone::STAGE_EXTRACT, size, startTime);
+		startTime = Stats::now();
 	}
 
 	log->loopDebug("DataTransfer::copyData(totalNbytes=>%d) end", totalNbytes);
 	return totalNbytes;
 }
 
+/**
+ * \brief Copies the data of the current entry of an archive to other
+ * archives that are not disk archives
+ *
+ * The data blocks are written one after the other, and the holes between
+ * them as zeros, like in sparseToArchive(): libarchive doesn't store the
+ * ones of a sparse entry, whose header has the map of the data.
+ *
+ * The bytes are not counted, the archives that read outArchives count them.
+ *
+ * \param arIn
+ * 		Archive being read
+ * \param outArchives
+ * 		Vector of archives where data will be written
+ * \param size
+ * 		Size of the entry
+ *
+ * \return Number of bytes read from arIn
+ */
+uint64_t DataTransfer::relayData(struct archive *arIn,
+		std::vector<struct archive *> &outArchives, uint64_t size)
+		throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("DataTransfer::relayData(arIn=>0x%x, size=>%d) start", arIn, size);
+
+	int r;
+	const void *buff;
+	size_t len;
+	off_t offset;
+	uint64_t pos = 0;
+	uint64_t totalNbytes = 0;
+
+	while ((r = archive_read_data_block(arIn, &buff, &len, &offset)) != ARCHIVE_EOF) {
+		if (r < ARCHIVE_OK) {
+			ReadDataException ex;
+			throw ex;
+		}
+
+		if(static_cast<uint64_t>(offset) > pos) {
+			this->zerosToArchive(offset - pos, outArchives);
+		}
+
+		this->writeBuffer(static_cast<const char *>(buff), len, 0, 0,
+				&outArchives);
+
+		pos = offset + len;
+		totalNbytes += len;
+	}
+
+	if(pos < size) {
+		this->zerosToArchive(size - pos, outArchives);
+	}
+
+	log->loopDebug("DataTransfer::relayData(totalNbytes=>%d) end", totalNbytes);
+	return totalNbytes;
+}
+
+/**
+ * \brief Writes [len] zeros in all the given archives
+ */
+void DataTransfer::zerosToArchive(uint64_t len,
+		std::vector<struct archive*> &outArchives) throw(Exception) {
+	dcBuffSize size = this->getBufferSize(Doclone::BUFFER_ARCHIVE);
+	char *buf = this->acquireBuffer(size);
+	memset(buf, 0, size);
+
+	try {
+		while(len > 0) {
+			size_t n = len < static_cast<uint64_t>(size) ? len : size;
+			this->writeBuffer(buf, n, 0, 0, &outArchives);
+			len -= n;
+		}
+	} catch (const Exception &ex) {
+		this->releaseBuffer(buf);
+		throw;
+	}
+
+	this->releaseBuffer(buf);
+}
+
 /**
  * \brief Transfers all the data from fdin to all out file descriptors.
  *
@@ -296,27 +772,7 @@ uint64_t DataTransfer::copyData(int fdin, std::vector<int> &outFds) throw(Except
 	Logger *log = Logger::getInstance();
 	log->loopDebug("DataTransfer::copyData(fdin=>%d, outFds=>0x%x) start", fdin, &outFds);
 
-	char buf[Doclone::BUFFER_SIZE];
-	unsigned int nbytes = Doclone::BUFFER_SIZE;
-	unsigned int totalNbytes = 0;
-
-	while ((nbytes = (*this->getNbytes) (fdin, buf, Doclone::BUFFER_SIZE)) > 0) {
-		std::vector<int>::iterator it;
-		for(it = outFds.begin(); it != outFds.end(); ++it) {
-			(*this->putNbytes) (*it, buf, nbytes);
-		}
-
-		this->_transferredBytes += nbytes;
-		totalNbytes += nbytes;
-
-		// Notify the views if it crosses a notification point
-		if(this->_transferredBytes >
-			(this->_notificationPointSize * this->_transferNotificationsCount)) {
-			this->_transferNotificationsCount++;
-			this->notifyObservers(Doclone::TRANS_TRANSFERRED_BYTES,
-					this->_transferredBytes);
-		}
-	}
+	uint64_t totalNbytes = this->pipelinedCopy(fdin, &outFds, 0, 0);
 
 	log->loopDebug("DataTransfer::copyData(totalNbytes=>%d) end", totalNbytes);
 	return totalNbytes;
@@ -336,24 +792,10 @@ uint64_t DataTransfer::copyData(int fdin, int fdout) throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->loopDebug("DataTransfer::copyData(fdin=>%d, fdout=>%d) start", fdin, fdout);
 
-	char buf[Doclone::BUFFER_SIZE];
-	unsigned int nbytes = Doclone::BUFFER_SIZE;
-	unsigned int totalNbytes = 0;
-
-	while ((nbytes = (*this->getNbytes) (fdin, buf, Doclone::BUFFER_SIZE)) > 0) {
-		(*this->putNbytes) (fdout, buf, nbytes);
-
-		this->_transferredBytes += nbytes;
-		totalNbytes += nbytes;
+	std::vector<int> outFds;
+	outFds.push_back(fdout);
 
-		// Notify the views if it crosses a notification point
-		if(this->_transferredBytes >
-			(this->_notificationPointSize * this->_transferNotificationsCount)) {
-			this->_transferNotificationsCount++;
-			this->notifyObservers(Doclone::TRANS_TRANSFERRED_BYTES,
-					this->_transferredBytes);
-		}
-	}
+	uint64_t totalNbytes = this->pipelinedCopy(fdin, &outFds, 0, 0);
 
 	log->loopDebug("DataTransfer::copyData(totalNbytes=>%d) end", totalNbytes);
 	return totalNbytes;
@@ -405,6 +847,7 @@ ssize_t DataTransfer::readBytes (int s, void *buf, size_t len) throw (Exception)
 	Logger *log = Logger::getInstance();
 	log->loopDebug("DataTransfer::readBytes(s=>%d, buf=>0x%x, len=>%d) start", s, buf, len);
 
+	uint64_t startTime = Stats::now();
 	ssize_t nbytes = read(s, buf, len);
 
 	if(nbytes<0) {
@@ -412,6 +855,8 @@ ssize_t DataTransfer::readBytes (int s, void *buf, size_t len) throw (Exception)
 		throw ex;
 	}
 
+	Stats::getInstance()->addStage(Doclone::STAGE_READ, nbytes, startTime);
+
 	log->loopDebug("DataTransfer::readBytes(nbytes=>%d) end", nbytes);
 	return nbytes;
 }
@@ -434,6 +879,7 @@ ssize_t DataTransfer::recvData (int s, void *buf, size_t len) throw (Exception)
 	Logger *log = Logger::getInstance();
 	log->loopDebug("DataTransfer::recvData(s=>%d, buf=>0x%x, len=>%d) start", s, buf, len);
 
+	uint64_t startTime = Stats::now();
 	ssize_t nbytes = recv(s, buf, len, MSG_WAITALL);
 
 	if(nbytes<0) {
@@ -441,6 +887,8 @@ ssize_t DataTransfer::recvData (int s, void *buf, size_t len) throw (Exception)
 		throw ex;
 	}
 
+	Stats::getInstance()->addStage(Doclone::STAGE_RECEIVE, nbytes, startTime);
+
 	log->loopDebug("DataTransfer::recvData(nbytes=>%d) end", nbytes);
 	return nbytes;
 }
@@ -463,11 +911,23 @@ ssize_t DataTransfer::writeBytes (int s, const void *buf, size_t len) throw (Exc
 	Logger *log = Logger::getInstance();
 	log->loopDebug("DataTransfer::writeBytes(s=>%d, buf=>0x%x, len=>%d) start", s, buf, len);
 
-	ssize_t nbytes = write(s, buf, len);
+	ssize_t nbytes = 0;
+	ssize_t r;
 
-	if(nbytes<0) {
-		WriteDataException ex;
-		throw ex;
+	// write() may be interrupted before all the buffer is written
+	while(static_cast<size_t>(nbytes) < len) {
+		r = write(s, static_cast<const char *>(buf) + nbytes, len - nbytes);
+
+		if(r<0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			WriteDataException ex;
+			throw ex;
+		}
+
+		nbytes += r;
 	}
 
 	log->loopDebug("DataTransfer::writeBytes(nbytes=>%d) end", nbytes);
@@ -492,16 +952,27 @@ ssize_t DataTransfer::sendData (int s, const void *buf, size_t len) throw (Excep
 	Logger *log = Logger::getInstance();
 	log->loopDebug("DataTransfer::sendData(s=>%d, buf=>0x%x, len=>%d) start", s, buf, len);
 
-	ssize_t nbytes = send(s, buf, len, 0);
+	ssize_t nbytes = 0;
+	ssize_t r;
+	uint64_t startTime = Stats::now();
+
+	// send() may return before all the buffer is queued
+	while(static_cast<size_t>(nbytes) < len) {
+		r = send(s, static_cast<const char *>(buf) + nbytes, len - nbytes, 0);
 
-	if(nbytes<0) {
-		struct sockaddr_in addr;
-		socklen_t addr_size = sizeof(struct sockaddr_in);
-		getsockname(s, (struct sockaddr *)&addr, &addr_size);
-		SendDataException ex(inet_ntoa(addr.sin_addr));
-		throw ex;
+		if(r<0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			throwSendError(s);
+		}
+
+		nbytes += r;
 	}
 
+	Stats::getInstance()->addStage(Doclone::STAGE_SEND, nbytes, startTime);
+
 	log->loopDebug("DataTransfer::sendData(nbytes=>%d) end", nbytes);
 	return nbytes;
 }
@@ -528,15 +999,7 @@ ssize_t DataTransfer::sendData (std::vector<int> &fds, const void *buf,
 	ssize_t nbytes = 0;
 	std::vector<int>::iterator it;
 	for(it = fds.begin(); it != fds.end(); ++it) {
-		nbytes = send(*it, buf, len, 0);
-
-		if(nbytes<0) {
-			struct sockaddr_in addr;
-			socklen_t addr_size = sizeof(struct sockaddr_in);
-			getsockname(*it, (struct sockaddr *)&addr, &addr_size);
-			SendDataException ex(inet_ntoa(addr.sin_addr));
-			throw ex;
-		}
+		nbytes = DataTransfer::sendData(*it, buf, len);
 	}
 
 	log->loopDebug("DataTransfer::sendData(nbytes=>%d) end", nbytes);
@@ -544,12 +1007,1463 @@ ssize_t DataTransfer::sendData (std::vector<int> &fds, const void *buf,
 }
 
 /**
- * \brief This setter calls notify()
+ * \brief Gets a page-aligned buffer from the pool
+ *
+ * If there is no free buffer of the requested size, a new one is allocated.
+ * The buffer must be returned with releaseBuffer().
+ *
+ * \param size
+ * 		Size of the buffer in bytes
+ *
+ * \return Pointer to the buffer
  */
-void DataTransfer::setTotalSize(uint64_t size) {
-	this->_totalSize = size;
+char *DataTransfer::acquireBuffer(dcBuffSize size) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("DataTransfer::acquireBuffer(size=>%d) start", size);
+
+	char *buf = 0;
+
+	pthread_mutex_lock(&this->_poolMutex);
+
+	std::multimap<dcBuffSize, char *>::iterator it =
+			this->_bufferPool.find(size);
+	if(it != this->_bufferPool.end()) {
+		buf = it->second;
+		this->_bufferPool.erase(it);
+	} else {
+		void *mem = 0;
+		long pageSize = sysconf(_SC_PAGESIZE);
+
+		// Free the unused buffers if the new one doesn't fit in the limit
+		if(this->_poolLimit > 0
+				&& this->_poolAllocated + size > this->_poolLimit) {
+			this->trimPool();
+		}
+
+		if((this->_poolLimit > 0
+				&& this->_poolAllocated + size > this->_poolLimit)
+				|| pageSize <= 0
+				|| posix_memalign(&mem, pageSize, size) != 0) {
+			pthread_mutex_unlock(&this->_poolMutex);
+
+			AllocateBufferException ex;
+			throw ex;
+		}
+
+		buf = static_cast<char *>(mem);
+		this->_allocatedBuffers[buf] = size;
+		this->_poolAllocated += size;
+	}
+
+	pthread_mutex_unlock(&this->_poolMutex);
+
+	log->loopDebug("DataTransfer::acquireBuffer(buf=>0x%x) end", buf);
+	return buf;
+}
+
+/**
+ * \brief Returns a buffer to the pool
+ *
+ * \param buf
+ * 		Buffer obtained from acquireBuffer()
+ */
+void DataTransfer::releaseBuffer(char *buf) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("DataTransfer::releaseBuffer(buf=>0x%x) start", buf);
+
+	pthread_mutex_lock(&this->_poolMutex);
+
+	std::map<char *, dcBuffSize>::iterator it =
+			this->_allocatedBuffers.find(buf);
+	if(it != this->_allocatedBuffers.end()) {
+		this->_bufferPool.insert(std::make_pair(it->second, buf));
+	}
+
+	pthread_mutex_unlock(&this->_poolMutex);
+
+	log->loopDebug("DataTransfer::releaseBuffer() end");
+}
+
+/**
+ * \brief Frees a buffer instead of returning it to the pool
+ *
+ * For the buffers that the kernel may still be sending, whose data would be
+ * overwritten if they were reused.
+ *
+ * \param buf
+ * 		Buffer obtained from acquireBuffer()
+ */
+void DataTransfer::discardBuffer(char *buf) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("DataTransfer::discardBuffer(buf=>0x%x) start", buf);
+
+	pthread_mutex_lock(&this->_poolMutex);
+
+	std::map<char *, dcBuffSize>::iterator it =
+			this->_allocatedBuffers.find(buf);
+	if(it != this->_allocatedBuffers.end()) {
+		this->_poolAllocated -= it->second;
+		this->_allocatedBuffers.erase(it);
+		free(buf);
+	}
+
+	pthread_mutex_unlock(&this->_poolMutex);
+
+	log->loopDebug("DataTransfer::discardBuffer() end");
+}
+
+/**
+ * \brief Sets the size of the buffers used in one of the I/O paths
+ *
+ * \param path
+ * 		The I/O path
+ * \param mib
+ * 		Size in mebibytes. A value of 0 is ignored
+ */
+void DataTransfer::setBufferSize(dcBufferPath path, unsigned int mib) {
+	Logger *log = Logger::getInstance();
+	log->debug("DataTransfer::setBufferSize(path=>%d, mib=>%d) start", path, mib);
+
+	if(mib > 0) {
+		this->_bufferSizes[path] = mib * Doclone::MIB;
+	}
+
+	log->debug("DataTransfer::setBufferSize() end");
+}
+
+/**
+ * \brief Gets the size of the buffers used in one of the I/O paths
+ *
+ * \param path
+ * 		The I/O path
+ *
+ * \return Size in bytes
+ */
+dcBuffSize DataTransfer::getBufferSize(dcBufferPath path) const {
+	std::map<dcBufferPath, dcBuffSize>::const_iterator it =
+			this->_bufferSizes.find(path);
+
+	dcBuffSize size =
+			it != this->_bufferSizes.end() ? it->second : Doclone::BUFFER_SIZE;
+
+	// With a limited pool, all the buffers of a copy must fit in it
+	if(this->_poolLimit > 0) {
+		dcBuffSize maxSize = this->_poolLimit / Doclone::POOL_BUFFERS;
+		if(maxSize < Doclone::BUFFER_SIZE) {
+			maxSize = Doclone::BUFFER_SIZE;
+		}
+
+		if(size > maxSize) {
+			size = maxSize;
+		}
+	}
+
+	return size;
+}
+
+/**
+ * \brief Limits the memory used by the pool of buffers
+ *
+ * \param limit
+ * 		Maximum number of bytes allocated by the pool. 0 means no limit
+ */
+void DataTransfer::setPoolLimit(uint64_t limit) {
+	Logger *log = Logger::getInstance();
+	log->debug("DataTransfer::setPoolLimit(limit=>%d) start", limit);
+
+	pthread_mutex_lock(&this->_poolMutex);
+
+	this->_poolLimit = limit;
+
+	// The buffers allocated before may have the wrong size now
+	this->trimPool();
+
+	pthread_mutex_unlock(&this->_poolMutex);
+
+	log->debug("DataTransfer::setPoolLimit() end");
+}
+
+uint64_t DataTransfer::getPoolLimit() const {
+	return this->_poolLimit;
+}
+
+/**
+ * \brief Frees all the buffers of the pool that are not in use
+ *
+ * this->_poolMutex must be locked by the caller.
+ */
+void DataTransfer::trimPool() {
+	std::multimap<dcBuffSize, char *>::iterator it;
+	for(it = this->_bufferPool.begin(); it != this->_bufferPool.end(); ++it) {
+		this->_allocatedBuffers.erase(it->second);
+		this->_poolAllocated -= it->first;
+		free(it->second);
+	}
+
+	this->_bufferPool.clear();
+}
+
+/**
+ * \brief Adds bytes to the transferred count and notifies the views if a
+ * notification point is crossed
+ *
+ * The counters are updated with atomic operations, so the threads that read
+ * them don't stop the transfers, see Stats.
+ *
+ * \param nbytes
+ * 		Number of bytes just transferred
+ */
+void DataTransfer::countBytes(uint64_t nbytes) {
+	uint64_t transferredBytes = __atomic_add_fetch(&this->_transferredBytes,
+			nbytes, __ATOMIC_RELAXED);
+
+	// Notify the views if it crosses a notification point. Only the thread
+	// that moves the count of notifications forward does it
+	bool notify = false;
+	uint32_t count = __atomic_load_n(&this->_transferNotificationsCount,
+			__ATOMIC_RELAXED);
+	while(!notify && transferredBytes >
+			static_cast<uint64_t>(this->_notificationPointSize) * count) {
+		notify = __atomic_compare_exchange_n(
+				&this->_transferNotificationsCount, &count, count + 1, false,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	}
+
+	if(notify) {
+		this->notifyObservers(Doclone::TRANS_TRANSFERRED_BYTES,
+				transferredBytes);
+	}
+}
+
+/**
+ * \brief Writes a buffer in all the given destinations
+ *
+ * \param buf
+ * 		Buffer of data
+ * \param len
+ * 		Number of bytes to write
+ * \param crc
+ * 		CRC32C of each CHECKSUM_CHUNK_SIZE piece of buf, or NULL to compute
+ * 		them if a destination needs them
+ * \param outFds
+ * 		Destination descriptors, or NULL
+ * \param outArchives
+ * 		Destination archives, or NULL
+ *
+ * The sockets with zero-copy sends may still be reading buf when this method
+ * returns, see waitZeroCopy().
+ */
+void DataTransfer::writeBuffer(const char *buf, size_t len,
+		const uint32_t *crc, std::vector<int> *outFds,
+		std::vector<struct archive*> *outArchives) throw(Exception) {
+	Stats *stats = Stats::getInstance();
+
+	if(outFds != 0) {
+		std::vector<int>::iterator it;
+		for(it = outFds->begin(); it != outFds->end(); ++it) {
+			std::map<int, dcChecksumState>::iterator state =
+					this->_checksumStates.find(*it);
+			std::map<int, dcZeroCopyState>::iterator zeroCopy =
+					this->_zeroCopyStates.find(*it);
+			dcZeroCopyState *zeroCopyState =
+					zeroCopy != this->_zeroCopyStates.end()
+					? &zeroCopy->second : 0;
+
+			if(state != this->_checksumStates.end()) {
+				this->writeChunks(*it, state->second, buf, len, crc,
+						zeroCopyState);
+			} else if(zeroCopyState != 0 && len >= ZEROCOPY_MIN_SIZE) {
+				this->sendZeroCopy(*it, *zeroCopyState, buf, len);
+			} else {
+				(*this->putNbytes) (*it, buf, len);
+			}
+
+			stats->countReceiverBytes(*it, len);
+		}
+	}
+
+	if(outArchives != 0) {
+		uint64_t startTime = Stats::now();
+
+		std::vector<struct archive*>::iterator it;
+		for(it = outArchives->begin(); it != outArchives->end(); ++it) {
+			if (archive_write_data(*it, buf, len) < 0) {
+				WriteDataException ex;
+				throw ex;
+			}
+		}
+
+		stats->addStage(Doclone::STAGE_COMPRESS, len, startTime);
+	}
+}
+
+/**
+ * \brief Writes data in a checksummed stream, split in chunks
+ *
+ * \param fd
+ * 		Destination descriptor
+ * \param state
+ * 		State of the stream of fd
+ * \param buf
+ * 		Buffer of data
+ * \param len
+ * 		Number of bytes to write
+ * \param crc
+ * 		CRC32C of each CHECKSUM_CHUNK_SIZE piece of buf, or NULL to compute
+ * 		them here
+ * \param zeroCopy
+ * 		State of the zero-copy sends of fd, or NULL to copy the data
+ */
+void DataTransfer::writeChunks(int fd, dcChecksumState &state,
+		const char *buf, size_t len, const uint32_t *crc,
+		dcZeroCopyState *zeroCopy) throw(Exception) {
+	size_t i = 0;
+
+	for(size_t pos = 0; pos < len; pos += Doclone::CHECKSUM_CHUNK_SIZE) {
+		size_t chunkLen = len - pos;
+		if(chunkLen > static_cast<size_t>(Doclone::CHECKSUM_CHUNK_SIZE)) {
+			chunkLen = Doclone::CHECKSUM_CHUNK_SIZE;
+		}
+
+		uint32_t chunkCrc = crc != 0 ? crc[i]
+				: Crc32c::compute(buf + pos, chunkLen);
+
+		// The type of the data chunks is FRAME_DATA, 0
+		uint32_t header[2];
+		header[0] = htonl(chunkLen);
+		header[1] = htonl(chunkCrc);
+
+		(*this->putNbytes) (fd, header, sizeof(header));
+		if(zeroCopy != 0 && chunkLen >= ZEROCOPY_MIN_SIZE) {
+			this->sendZeroCopy(fd, *zeroCopy, buf + pos, chunkLen);
+		} else {
+			(*this->putNbytes) (fd, buf + pos, chunkLen);
+		}
+
+		state.chunks++;
+		state.offset += chunkLen;
+		i++;
+
+		if(state.version > 0) {
+			state.crc = Crc32c::combine(state.crc, chunkCrc, chunkLen);
+			this->writePeriodicFrames(fd, state);
+		}
+	}
+}
+
+/**
+ * \brief Writes a frame that is not FRAME_DATA in a framed stream
+ *
+ * \param fd
+ * 		Destination descriptor
+ * \param type
+ * 		Type of the frame
+ * \param payload
+ * 		Payload of the frame
+ * \param len
+ * 		Length of the payload, up to FRAME_MAX_PAYLOAD
+ */
+void DataTransfer::writeFrame(int fd, dcFrameType type, const char *payload,
+		size_t len) throw(Exception) {
+	uint32_t header[2];
+	header[0] = htonl((static_cast<uint32_t>(type) << 24) | len);
+	header[1] = htonl(Crc32c::compute(payload, len));
+
+	(*this->putNbytes) (fd, header, sizeof(header));
+	(*this->putNbytes) (fd, payload, len);
+}
+
+/**
+ * \brief Writes the optional frames of a framed stream that are due
+ *
+ * \param fd
+ * 		Destination descriptor
+ * \param state
+ * 		State of the stream of fd
+ */
+void DataTransfer::writePeriodicFrames(int fd, dcChecksumState &state)
+		throw(Exception) {
+	if((state.caps & Doclone::FRAME_CAP_CHECKSUM)
+			&& state.offset - state.checkedOffset
+				>= Doclone::FRAME_CHECKSUM_INTERVAL) {
+		char payload[12];
+		uint64_t offset = htobe64(state.offset);
+		uint32_t crc = htonl(state.crc);
+		memcpy(payload, &offset, sizeof(offset));
+		memcpy(payload + 8, &crc, sizeof(crc));
+
+		this->writeFrame(fd, Doclone::FRAME_CHECKSUM, payload,
+				sizeof(payload));
+		state.checkedOffset = state.offset;
+	}
+
+	if(state.caps & Doclone::FRAME_CAP_STATS) {
+		time_t now = time(0);
+
+		if(now - state.statsTime >= Doclone::FRAME_STATS_INTERVAL) {
+			char payload[16];
+			uint64_t offset = htobe64(state.offset);
+			uint64_t seconds = htobe64(now - state.started);
+			memcpy(payload, &offset, sizeof(offset));
+			memcpy(payload + 8, &seconds, sizeof(seconds));
+
+			this->writeFrame(fd, Doclone::FRAME_STATS, payload,
+					sizeof(payload));
+			state.statsTime = now;
+		}
+	}
+}
+
+/**
+ * \brief Reads and checks a frame that is not FRAME_DATA
+ *
+ * \param fd
+ * 		Origin descriptor
+ * \param state
+ * 		State of the stream of fd
+ * \param type
+ * 		Type of the frame
+ * \param len
+ * 		Length of its payload
+ * \param crc
+ * 		CRC32C of its payload
+ *
+ * \return true if the frame ends the stream
+ */
+bool DataTransfer::readFrame(int fd, dcChecksumState &state,
+		dcFrameType type, size_t len, uint32_t crc) throw(Exception) {
+	Logger *log = Logger::getInstance();
+
+	char payload[Doclone::FRAME_MAX_PAYLOAD];
+
+	if(len > Doclone::FRAME_MAX_PAYLOAD) {
+		CorruptedChunkException ex(state.chunks, state.offset, len);
+		throw ex;
+	}
+
+	if(readFully(this->getNbytes, fd, payload, len) != len) {
+		ReceiveDataException ex;
+		throw ex;
+	}
+
+	if(Crc32c::compute(payload, len) != crc) {
+		CorruptedChunkException ex(state.chunks, state.offset, len);
+		throw ex;
+	}
+
+	uint64_t offset;
+	uint64_t value;
+	uint32_t streamCrc;
+
+	switch(type) {
+	case Doclone::FRAME_CHECKSUM: {
+		if(len < 12) {
+			CorruptedChunkException ex(state.chunks, state.offset, len);
+			throw ex;
+		}
+
+		memcpy(&offset, payload, sizeof(offset));
+		memcpy(&streamCrc, payload + 8, sizeof(streamCrc));
+
+		// A chunk has been lost or repeated since the last checksum
+		if(be64toh(offset) != state.offset || ntohl(streamCrc) != state.crc) {
+			CorruptedChunkException ex(state.chunks, state.checkedOffset,
+					state.offset - state.checkedOffset);
+			throw ex;
+		}
+
+		state.checkedOffset = state.offset;
+		break;
+	}
+	case Doclone::FRAME_STATS: {
+		if(len >= 16) {
+			memcpy(&offset, payload, sizeof(offset));
+			memcpy(&value, payload + 8, sizeof(value));
+
+			log->debug("The sender has sent %llu bytes in %llu seconds",
+					be64toh(offset), be64toh(value));
+		}
+		break;
+	}
+	case Doclone::FRAME_END: {
+		if(len < 20) {
+			CorruptedChunkException ex(state.chunks, state.offset, len);
+			throw ex;
+		}
+
+		memcpy(&offset, payload, sizeof(offset));
+		memcpy(&value, payload + 8, sizeof(value));
+		memcpy(&streamCrc, payload + 16, sizeof(streamCrc));
+
+		if(be64toh(offset) != state.offset || be64toh(value) != state.chunks
+				|| ntohl(streamCrc) != state.crc) {
+			CorruptedChunkException ex(state.chunks, state.checkedOffset,
+					state.offset - state.checkedOffset);
+			throw ex;
+		}
+
+		state.finished = true;
+		return true;
+	}
+	default:
+		// Control frames, and the types of newer versions, are ignored
+		break;
+	}
+
+	return false;
+}
+
+/**
+ * \brief Reads the next chunk of a checksummed stream and verifies it
+ *
+ * \param fd
+ * 		Origin descriptor
+ * \param state
+ * 		State of the stream of fd
+ * \param [out] buf
+ * 		Buffer of at least CHECKSUM_CHUNK_SIZE bytes
+ *
+ * \return Number of data bytes of the chunk, 0 at the end of the stream
+ */
+size_t DataTransfer::readChunkData(int fd, dcChecksumState &state,
+		char *buf) throw(Exception) {
+	uint32_t header[2];
+	size_t len;
+	uint32_t crc;
+
+	while(true) {
+		if(readFully(this->getNbytes, fd, reinterpret_cast<char *>(header),
+				sizeof(header)) != sizeof(header)) {
+			// The stream was cut before its end
+			ReceiveDataException ex;
+			throw ex;
+		}
+
+		len = ntohl(header[0]);
+		crc = ntohl(header[1]);
+
+		if(state.version == 0) {
+			break;
+		}
+
+		dcFrameType type = static_cast<dcFrameType>(len >> 24);
+		len &= 0xFFFFFF;
+
+		if(type == Doclone::FRAME_DATA) {
+			break;
+		}
+
+		if(this->readFrame(fd, state, type, len, crc)) {
+			return 0;
+		}
+	}
+
+	if(len == 0) {
+		// A framed stream only ends with a FRAME_END
+		if(state.version > 0) {
+			CorruptedChunkException ex(state.chunks, state.offset, len);
+			throw ex;
+		}
+
+		state.finished = true;
+		return 0;
+	}
+
+	if(len > static_cast<size_t>(Doclone::CHECKSUM_CHUNK_SIZE)) {
+		CorruptedChunkException ex(state.chunks, state.offset, len);
+		throw ex;
+	}
+
+	if(readFully(this->getNbytes, fd, buf, len) != len) {
+		ReceiveDataException ex;
+		throw ex;
+	}
+
+	if(Crc32c::compute(buf, len) != crc) {
+		CorruptedChunkException ex(state.chunks, state.offset, len);
+		throw ex;
+	}
+
+	state.chunks++;
+	state.offset += len;
+
+	if(state.version > 0) {
+		state.crc = Crc32c::combine(state.crc, crc, len);
+	}
+
+	return len;
+}
+
+/**
+ * \brief Writes a range of data over a file, only in the blocks that differ
+ *
+ * \param fd
+ * 		Descriptor of the file
+ * \param data
+ * 		The new data, or NULL for zeros. The zeros beyond the end of the file
+ * 		are not written
+ * \param len
+ * 		Number of bytes of the range
+ * \param offset
+ * 		Position of the range in the file
+ * \param diskBuf
+ * 		Buffer where the file is read
+ * \param bufSize
+ * 		Size of diskBuf
+ *
+ * \return Number of bytes written in the file
+ */
+uint64_t DataTransfer::patchRange(int fd, const char *data, uint64_t len,
+		uint64_t offset, char *diskBuf, dcBuffSize bufSize) throw(Exception) {
+	uint64_t written = 0;
+
+	while(len > 0) {
+		size_t n = len < static_cast<uint64_t>(bufSize) ? len : bufSize;
+
+		ssize_t nread = pread(fd, diskBuf, n, offset);
+		if(nread < 0) {
+			ReadDataException ex;
+			throw ex;
+		}
+
+		size_t compared = data != 0 ? n : nread;
+		for(size_t i = 0; i < compared; i += DELTA_BLOCK_SIZE) {
+			size_t blockLen = compared - i < static_cast<size_t>(DELTA_BLOCK_SIZE)
+					? compared - i : DELTA_BLOCK_SIZE;
+			const char *block = diskBuf + i;
+
+			if(data != 0) {
+				if(i + blockLen <= static_cast<size_t>(nread)
+						&& !memcmp(diskBuf + i, data + i, blockLen)) {
+					continue;
+				}
+
+				block = data + i;
+			} else {
+				if(diskBuf[i] == 0
+						&& !memcmp(diskBuf + i, diskBuf + i + 1, blockLen - 1)) {
+					continue;
+				}
+
+				memset(diskBuf + i, 0, blockLen);
+			}
+
+			if(pwrite(fd, block, blockLen, offset + i)
+					!= static_cast<ssize_t>(blockLen)) {
+				WriteDataException ex;
+				throw ex;
+			}
+
+			written += blockLen;
+		}
+
+		// The rest of the zeros are beyond the end of the file
+		if(data == 0 && static_cast<size_t>(nread) < n) {
+			break;
+		}
+
+		if(data != 0) {
+			data += n;
+		}
+		offset += n;
+		len -= n;
+	}
+
+	return written;
+}
+
+/**
+ * \brief Reads data from a descriptor, verifying its checksums if it has
+ * them enabled
+ *
+ * \param fd
+ * 		Origin descriptor
+ * \param [out] buf
+ * 		Buffer of data
+ * \param len
+ * 		Maximum number of bytes to read
+ *
+ * \return Number of bytes read, 0 at the end of the data
+ */
+ssize_t DataTransfer::readData(int fd, void *buf, size_t len) throw(Exception) {
+	std::map<int, dcChecksumState>::iterator it =
+			this->_checksumStates.find(fd);
+	if(it == this->_checksumStates.end()) {
+		return (*this->getNbytes) (fd, buf, len);
+	}
+
+	dcChecksumState &state = it->second;
+
+	// Whole chunks are verified directly in the buffer of the caller
+	if(state.stagePos == state.stageLen && !state.finished
+			&& len >= static_cast<size_t>(Doclone::CHECKSUM_CHUNK_SIZE)) {
+		return this->readChunkData(fd, state, static_cast<char *>(buf));
+	}
+
+	const void *chunk;
+	ssize_t nbytes = this->readChunk(fd, &chunk);
+	if(static_cast<size_t>(nbytes) > len) {
+		nbytes = len;
+	}
+
+	memcpy(buf, chunk, nbytes);
+	state.stagePos += nbytes;
+
+	return nbytes;
+}
+
+/**
+ * \brief Gets the verified data of a checksummed stream not read yet, without
+ * copying it
+ *
+ * The data is valid until the next read from fd.
+ *
+ * \param fd
+ * 		Origin descriptor, with checksums enabled
+ * \param [out] buf
+ * 		Pointer to the data
+ *
+ * \return Number of bytes available in buf, 0 at the end of the data
+ */
+ssize_t DataTransfer::readChunk(int fd, const void **buf) throw(Exception) {
+	std::map<int, dcChecksumState>::iterator it =
+			this->_checksumStates.find(fd);
+	if(it == this->_checksumStates.end()) {
+		ReadDataException ex;
+		throw ex;
+	}
+
+	dcChecksumState &state = it->second;
+
+	if(state.stagePos == state.stageLen) {
+		state.stageLen = state.stagePos = 0;
+
+		if(!state.finished) {
+			if(state.stage == 0) {
+				state.stage = this->acquireBuffer(Doclone::CHECKSUM_CHUNK_SIZE);
+			}
+
+			state.stageLen = this->readChunkData(fd, state, state.stage);
+		}
+	}
+
+	*buf = state.stage + state.stagePos;
+
+	return state.stageLen - state.stagePos;
+}
+
+/**
+ * \brief Writes data in a descriptor, adding the checksums if it has them
+ * enabled
+ *
+ * \param fd
+ * 		Destination descriptor
+ * \param buf
+ * 		Buffer of data
+ * \param len
+ * 		Number of bytes to write
+ *
+ * \return Number of bytes written
+ */
+ssize_t DataTransfer::writeData(int fd, const void *buf, size_t len)
+		throw(Exception) {
+	std::map<int, dcChecksumState>::iterator it =
+			this->_checksumStates.find(fd);
+	if(it == this->_checksumStates.end()) {
+		return (*this->putNbytes) (fd, buf, len);
+	}
+
+	this->writeChunks(fd, it->second, static_cast<const char *>(buf), len, 0,
+			0);
+
+	return len;
+}
+
+/**
+ * \brief Starts a checksummed stream on a descriptor
+ *
+ * Both ends of the connection must enable it, with the same version and
+ * optional frames.
+ *
+ * \param fd
+ * 		The descriptor
+ * \param version
+ * 		Version of the framed stream, 0 for plain chunks
+ * \param caps
+ * 		Optional frames sent in the stream
+ */
+void DataTransfer::enableChecksums(int fd, uint8_t version, dcFrameCaps caps) {
+	Logger *log = Logger::getInstance();
+	log->debug("DataTransfer::enableChecksums(fd=>%d, version=>%d, caps=>%d) "
+			"start", fd, version, caps);
+
+	this->disableChecksums(fd);
+
+	dcChecksumState state;
+	state.chunks = 0;
+	state.offset = 0;
+	state.version = version;
+	state.caps = caps;
+	state.crc = 0;
+	state.checkedOffset = 0;
+	state.started = state.statsTime = time(0);
+	state.stage = 0;
+	state.stageLen = 0;
+	state.stagePos = 0;
+	state.finished = false;
+
+	this->_checksumStates[fd] = state;
+
+	log->debug("DataTransfer::enableChecksums() end");
+}
+
+/**
+ * \brief Forgets the checksummed stream of a descriptor, if it has one
+ *
+ * \param fd
+ * 		The descriptor
+ */
+void DataTransfer::disableChecksums(int fd) {
+	Logger *log = Logger::getInstance();
+	log->debug("DataTransfer::disableChecksums(fd=>%d) start", fd);
+
+	std::map<int, dcChecksumState>::iterator it =
+			this->_checksumStates.find(fd);
+	if(it != this->_checksumStates.end()) {
+		if(it->second.stage != 0) {
+			this->releaseBuffer(it->second.stage);
+		}
+
+		this->_checksumStates.erase(it);
+	}
+
+	log->debug("DataTransfer::disableChecksums() end");
+}
+
+bool DataTransfer::hasChecksums(int fd) const {
+	return this->_checksumStates.find(fd) != this->_checksumStates.end();
+}
+
+/**
+ * \brief Sends the end of the checksummed stream of a descriptor and forgets
+ * it
+ *
+ * Does nothing if the descriptor has no checksums enabled.
+ *
+ * \param fd
+ * 		The descriptor
+ */
+void DataTransfer::finishChecksums(int fd) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("DataTransfer::finishChecksums(fd=>%d) start", fd);
+
+	std::map<int, dcChecksumState>::iterator it =
+			this->_checksumStates.find(fd);
+	if(it != this->_checksumStates.end()) {
+		dcChecksumState &state = it->second;
+
+		if(state.version > 0) {
+			char payload[20];
+			uint64_t offset = htobe64(state.offset);
+			uint64_t chunks = htobe64(state.chunks);
+			uint32_t crc = htonl(state.crc);
+			memcpy(payload, &offset, sizeof(offset));
+			memcpy(payload + 8, &chunks, sizeof(chunks));
+			memcpy(payload + 16, &crc, sizeof(crc));
+
+			this->writeFrame(fd, Doclone::FRAME_END, payload,
+					sizeof(payload));
+		} else {
+			uint32_t header[2] = {0, 0};
+			(*this->putNbytes) (fd, header, sizeof(header));
+		}
+
+		this->disableChecksums(fd);
+	}
+
+	log->debug("DataTransfer::finishChecksums() end");
+}
+
+/**
+ * \brief Sends the end of the checksummed streams of many descriptors
+ *
+ * \param fds
+ * 		The descriptors
+ */
+void DataTransfer::finishChecksums(std::vector<int> &fds) throw(Exception) {
+	std::vector<int>::iterator it;
+	for(it = fds.begin(); it != fds.end(); ++it) {
+		this->finishChecksums(*it);
+	}
+}
+
+/**
+ * \brief Makes copyData() send the data buffers to a socket with
+ * MSG_ZEROCOPY
+ *
+ * \param fd
+ * 		The socket
+ *
+ * \return false if the socket doesn't support it, then it copies the data
+ * as usual
+ */
+bool DataTransfer::enableZeroCopy(int fd) {
+	Logger *log = Logger::getInstance();
+	log->debug("DataTransfer::enableZeroCopy(fd=>%d) start", fd);
+
+	bool enabled = false;
+
+#ifdef DC_ZEROCOPY
+	int one = 1;
+	if(setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0) {
+		dcZeroCopyState state;
+		state.issued = 0;
+		state.completed = 0;
+		state.copied = 0;
+
+		this->_zeroCopyStates[fd] = state;
+		enabled = true;
+	}
+#endif
+
+	if(!enabled) {
+		log->warn("The socket %d can't send without copying the data", fd);
+	}
+
+	log->debug("DataTransfer::enableZeroCopy(enabled=>%d) end", enabled);
+	return enabled;
+}
+
+/**
+ * \brief Forgets the zero-copy sends of a socket, if it has them
+ *
+ * Must be called before the socket is closed, since its descriptor can be
+ * reused by another one.
+ *
+ * \param fd
+ * 		The socket
+ */
+void DataTransfer::disableZeroCopy(int fd) {
+	Logger *log = Logger::getInstance();
+	log->debug("DataTransfer::disableZeroCopy(fd=>%d) start", fd);
+
+	std::map<int, dcZeroCopyState>::iterator it =
+			this->_zeroCopyStates.find(fd);
+	if(it != this->_zeroCopyStates.end()) {
+		// Loopback and some NICs make the kernel copy the data anyway
+		if(it->second.copied > 0) {
+			log->info("The kernel copied %d of %d zero-copy sends",
+					it->second.copied, it->second.completed);
+		}
+
+		this->_zeroCopyStates.erase(it);
+	}
+
+	log->debug("DataTransfer::disableZeroCopy() end");
+}
+
+bool DataTransfer::hasZeroCopy(int fd) const {
+	return this->_zeroCopyStates.find(fd) != this->_zeroCopyStates.end();
+}
+
+/**
+ * \brief Sends data with MSG_ZEROCOPY
+ *
+ * buf can't be modified until waitZeroCopy() returns.
+ *
+ * \param fd
+ * 		Destination socket
+ * \param state
+ * 		State of the zero-copy sends of fd
+ * \param buf
+ * 		Buffer of data
+ * \param len
+ * 		Number of bytes to send
+ */
+void DataTransfer::sendZeroCopy(int fd, dcZeroCopyState &state,
+		const char *buf, size_t len) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("DataTransfer::sendZeroCopy(fd=>%d, buf=>0x%x, len=>%d) start", fd, buf, len);
+
+#ifdef DC_ZEROCOPY
+	size_t nbytes = 0;
+	uint64_t startTime = Stats::now();
+
+	while(nbytes < len) {
+		ssize_t r = send(fd, buf + nbytes, len - nbytes, MSG_ZEROCOPY);
+
+		if(r < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			// The pinned pages exceed the optmem_max of the socket
+			if(errno == ENOBUFS && state.completed != state.issued) {
+				this->waitZeroCopy(fd, state, state.completed + 1);
+				continue;
+			}
+
+			throwSendError(fd);
+		}
+
+		// The kernel numbers every send that succeeds
+		state.issued++;
+		nbytes += r;
+	}
+
+	Stats::getInstance()->addStage(Doclone::STAGE_SEND, nbytes, startTime);
+#else
+	DataTransfer::sendData(fd, buf, len);
+#endif
+
+	log->loopDebug("DataTransfer::sendZeroCopy() end");
+}
+
+/**
+ * \brief Reads the notifications of zero-copy sends queued in a socket,
+ * without blocking
+ *
+ * \param fd
+ * 		The socket
+ * \param state
+ * 		State of the zero-copy sends of fd
+ *
+ * \return true if any notification has been read
+ */
+bool DataTransfer::reapZeroCopy(int fd, dcZeroCopyState &state)
+		throw(Exception) {
+	bool reaped = false;
+
+#ifdef DC_ZEROCOPY
+	while(true) {
+		char control[128];
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if(recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+			if(errno == EINTR) {
+				continue;
+			} else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+
+			throwSendError(fd);
+		}
+
+		struct cmsghdr *cm;
+		for(cm = CMSG_FIRSTHDR(&msg); cm != 0; cm = CMSG_NXTHDR(&msg, cm)) {
+			if(!(cm->cmsg_level == IPPROTO_IP && cm->cmsg_type == IP_RECVERR)
+					&& !(cm->cmsg_level == IPPROTO_IPV6
+						&& cm->cmsg_type == IPV6_RECVERR)) {
+				continue;
+			}
+
+			const struct sock_extended_err *err =
+					reinterpret_cast<const struct sock_extended_err *>(
+							CMSG_DATA(cm));
+			if(err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+				continue;
+			}
+
+			// The range of sends from ee_info to ee_data, both included
+			uint32_t count = err->ee_data - err->ee_info + 1;
+			state.completed += count;
+			if(err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+				state.copied += count;
+			}
+
+			reaped = true;
+		}
+	}
+#endif
+
+	return reaped;
+}
+
+/**
+ * \brief Waits until the kernel has notified a number of zero-copy sends of
+ * a socket
+ *
+ * \param fd
+ * 		The socket
+ * \param state
+ * 		State of the zero-copy sends of fd
+ * \param mark
+ * 		Number of sends, see markZeroCopy()
+ */
+void DataTransfer::waitZeroCopy(int fd, dcZeroCopyState &state,
+		uint32_t mark) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("DataTransfer::waitZeroCopy(fd=>%d, mark=>%d) start", fd, mark);
+
+	// The counters wrap around
+	while(static_cast<int32_t>(state.completed - mark) < 0) {
+		if(this->reapZeroCopy(fd, state)) {
+			continue;
+		}
+
+		// An error of the connection also wakes up poll()
+		int error = 0;
+		socklen_t errorSize = sizeof(error);
+		if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorSize) < 0
+				|| error != 0) {
+			throwSendError(fd);
+		}
+
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = 0;
+		pfd.revents = 0;
+
+		int r = poll(&pfd, 1, -1);
+		if((r < 0 && errno != EINTR)
+				|| (r > 0 && !(pfd.revents & POLLERR))) {
+			throwSendError(fd);
+		}
+	}
+
+	log->loopDebug("DataTransfer::waitZeroCopy() end");
+}
+
+/**
+ * \brief Gets the number of zero-copy sends made until now to each socket
+ *
+ * \param fds
+ * 		The sockets
+ * \param [out] marks
+ * 		Number of sends of each socket, 0 for the ones without zero-copy sends
+ */
+void DataTransfer::markZeroCopy(const std::vector<int> &fds,
+		std::vector<uint32_t> &marks) const {
+	marks.assign(fds.size(), 0);
+
+	for(size_t i = 0; i < fds.size(); i++) {
+		std::map<int, dcZeroCopyState>::const_iterator it =
+				this->_zeroCopyStates.find(fds[i]);
+		if(it != this->_zeroCopyStates.end()) {
+			marks[i] = it->second.issued;
+		}
+	}
+}
+
+/**
+ * \brief Waits until the kernel has notified the zero-copy sends of many
+ * sockets
+ *
+ * \param fds
+ * 		The sockets
+ * \param marks
+ * 		Number of sends of each socket, given by markZeroCopy(), or NULL to
+ * 		wait for all of them
+ */
+void DataTransfer::waitZeroCopy(const std::vector<int> &fds,
+		const std::vector<uint32_t> *marks) throw(Exception) {
+	for(size_t i = 0; i < fds.size(); i++) {
+		std::map<int, dcZeroCopyState>::iterator it =
+				this->_zeroCopyStates.find(fds[i]);
+		if(it != this->_zeroCopyStates.end()) {
+			this->waitZeroCopy(fds[i], it->second,
+					marks != 0 ? (*marks)[i] : it->second.issued);
+		}
+	}
+}
+
+/**
+ * \brief Waits for the zero-copy sends of many sockets after a failed copy
+ *
+ * \param fds
+ * 		The sockets
+ *
+ * \return false if a socket has failed, so its sends may never be notified
+ */
+bool DataTransfer::drainZeroCopy(const std::vector<int> &fds) {
+	try {
+		this->waitZeroCopy(fds, 0);
+	} catch (const Exception &ex) {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Copies all the data from fdin to the destinations, reading the next
+ * buffer while the current one is being written
+ *
+ * Small inputs, which fit in a single buffer, are copied without starting
+ * the reading thread. If any destination has checksums, the reading thread
+ * computes them too. If any destination has zero-copy sends, each buffer is
+ * given back to the reading thread after the next one has been sent, when
+ * the kernel has notified all the sends of it.
+ *
+ * \param fdin
+ * 		Origin descriptor
+ * \param outFds
+ * 		Destination descriptors, or NULL
+ * \param outArchives
+ * 		Destination archives, or NULL
+ * \param [out] digest
+ * 		If not NULL, the CRC32C of all the data is stored here
+ *
+ * \return Number of bytes copied
+ */
+uint64_t DataTransfer::pipelinedCopy(int fdin, std::vector<int> *outFds,
+		std::vector<struct archive*> *outArchives, uint32_t *digest)
+		throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("DataTransfer::pipelinedCopy(fdin=>%d) start", fdin);
+
+	Doclone::writeFunction sendFunction = DataTransfer::sendData;
+	bool socket = (this->getNbytes == DataTransfer::recvData
+			|| this->putNbytes == sendFunction);
+	dcBuffSize size = this->getBufferSize(
+			socket ? Doclone::BUFFER_SOCKET : Doclone::BUFFER_DISK);
+
+	uint64_t totalNbytes = 0;
+
+	dcReadAhead ra;
+	ra.fd = fdin;
+	ra.trns = this;
+	ra.job = Job::getCurrent();
+	ra.size = size;
+	ra.buffers[0] = this->acquireBuffer(size);
+	ra.buffers[1] = 0;
+	ra.lengths[0] = ra.lengths[1] = 0;
+	ra.full[0] = ra.full[1] = false;
+	ra.failed[0] = ra.failed[1] = false;
+	ra.checksum = false;
+	ra.corrupted = false;
+	ra.badChunk = ra.badOffset = ra.badLength = 0;
+	ra.digest = (digest != 0);
+	ra.digestCrc = 0;
+	ra.stop = false;
+
+	bool zeroCopy = false;
+	if(outFds != 0) {
+		std::vector<int>::iterator it;
+		for(it = outFds->begin(); it != outFds->end(); ++it) {
+			ra.checksum = ra.checksum || this->hasChecksums(*it);
+			zeroCopy = zeroCopy || this->hasZeroCopy(*it);
+		}
+	}
+
+	if(ra.checksum) {
+		size_t nCrcs = (size + Doclone::CHECKSUM_CHUNK_SIZE - 1)
+				/ Doclone::CHECKSUM_CHUNK_SIZE;
+		ra.crcs[0].resize(nCrcs);
+		ra.crcs[1].resize(nCrcs);
+	}
+
+	// The first buffer is read in this thread
+	try {
+		ra.lengths[0] = fillBuffer(this, fdin, ra.buffers[0], size);
+	} catch (const Exception &ex) {
+		this->releaseBuffer(ra.buffers[0]);
+		throw;
+	}
+
+	if(ra.digest) {
+		ra.digestCrc = Crc32c::update(0, ra.buffers[0], ra.lengths[0]);
+	}
+
+	if(ra.lengths[0] < size) {
+		try {
+			this->writeBuffer(ra.buffers[0], ra.lengths[0], 0, outFds,
+					outArchives);
+
+			if(zeroCopy) {
+				this->waitZeroCopy(*outFds, 0);
+			}
+		} catch (const Exception &ex) {
+			// The kernel may still be reading the buffer
+			if(!zeroCopy || this->drainZeroCopy(*outFds)) {
+				this->releaseBuffer(ra.buffers[0]);
+			} else {
+				this->discardBuffer(ra.buffers[0]);
+			}
+			throw;
+		}
+
+		totalNbytes += ra.lengths[0];
+		this->countBytes(ra.lengths[0]);
+		this->releaseBuffer(ra.buffers[0]);
+
+		if(digest != 0) {
+			*digest = ra.digestCrc;
+		}
+
+		log->loopDebug("DataTransfer::pipelinedCopy(totalNbytes=>%d) end", totalNbytes);
+		return totalNbytes;
+	}
+
+	if(ra.checksum) {
+		computeCrcs(ra.buffers[0], ra.lengths[0], ra.crcs[0]);
+	}
+
+	try {
+		ra.buffers[1] = this->acquireBuffer(size);
+	} catch (const Exception &ex) {
+		this->releaseBuffer(ra.buffers[0]);
+		throw;
+	}
+
+	ra.full[0] = true;
+	pthread_mutex_init(&ra.mutex, 0);
+	pthread_cond_init(&ra.cond, 0);
+
+	pthread_t reader;
+	bool threaded = (pthread_create(&reader, 0, readAheadThread, &ra) == 0);
+	int slot = 0;
+
+	// Zero-copy sends of each buffer, and whether the other one is in flight
+	std::vector<uint32_t> marks[2];
+	bool inFlight = false;
+
+	try {
+		while(true) {
+			if(threaded) {
+				pthread_mutex_lock(&ra.mutex);
+				while(!ra.full[slot]) {
+					pthread_cond_wait(&ra.cond, &ra.mutex);
+				}
+				pthread_mutex_unlock(&ra.mutex);
+			} else if(!ra.full[slot]) {
+				// Could not start the thread: read synchronously
+				try {
+					ra.lengths[slot] = fillBuffer(this, fdin,
+							ra.buffers[slot], size);
+
+					if(ra.checksum) {
+						computeCrcs(ra.buffers[slot], ra.lengths[slot],
+								ra.crcs[slot]);
+					}
+
+					if(ra.digest) {
+						ra.digestCrc = Crc32c::update(ra.digestCrc,
+								ra.buffers[slot], ra.lengths[slot]);
+					}
+				} catch (const CorruptedChunkException &ex) {
+					ra.failed[slot] = ra.corrupted = true;
+					ra.badChunk = ex.getChunk();
+					ra.badOffset = ex.getOffset();
+					ra.badLength = ex.getLength();
+				} catch (const Exception &ex) {
+					ra.failed[slot] = true;
+				}
+				ra.full[slot] = true;
+			}
+
+			if(ra.failed[slot]) {
+				if(ra.corrupted) {
+					CorruptedChunkException ex(ra.badChunk, ra.badOffset,
+							ra.badLength);
+					throw ex;
+				} else if(this->getNbytes == DataTransfer::recvData) {
+					ReceiveDataException ex;
+					throw ex;
+				} else {
+					ReadDataException ex;
+					throw ex;
+				}
+			}
+
+			ssize_t nbytes = ra.lengths[slot];
+			this->writeBuffer(ra.buffers[slot], nbytes,
+					ra.checksum ? &ra.crcs[slot][0] : 0, outFds, outArchives);
+
+			totalNbytes += nbytes;
+			this->countBytes(nbytes);
+
+			int freeSlot = slot;
+			if(zeroCopy) {
+				// The kernel may still be reading it, free the other one
+				this->markZeroCopy(*outFds, marks[slot]);
+
+				freeSlot = -1;
+				if(inFlight) {
+					this->waitZeroCopy(*outFds, &marks[slot ^ 1]);
+					freeSlot = slot ^ 1;
+				}
+				inFlight = true;
+			}
+
+			if(freeSlot >= 0) {
+				pthread_mutex_lock(&ra.mutex);
+				ra.full[freeSlot] = false;
+				pthread_cond_broadcast(&ra.cond);
+				pthread_mutex_unlock(&ra.mutex);
+			}
+
+			if(nbytes < size) {
+				if(zeroCopy) {
+					this->waitZeroCopy(*outFds, 0);
+				}
+
+				break;
+			}
+
+			slot ^= 1;
+		}
+	} catch (const Exception &ex) {
+		if(threaded) {
+			pthread_mutex_lock(&ra.mutex);
+			ra.stop = true;
+			pthread_cond_broadcast(&ra.cond);
+			pthread_mutex_unlock(&ra.mutex);
+
+			// Wake up the reading thread if it is blocked in the descriptor
+			shutdown(fdin, SHUT_RD);
+			pthread_join(reader, 0);
+		}
+
+		pthread_cond_destroy(&ra.cond);
+		pthread_mutex_destroy(&ra.mutex);
+
+		// The kernel may still be reading the buffers
+		if(!zeroCopy || this->drainZeroCopy(*outFds)) {
+			this->releaseBuffer(ra.buffers[0]);
+			this->releaseBuffer(ra.buffers[1]);
+		} else {
+			this->discardBuffer(ra.buffers[0]);
+			this->discardBuffer(ra.buffers[1]);
+		}
+		throw;
+	}
+
+	if(threaded) {
+		pthread_join(reader, 0);
+	}
+
+	pthread_cond_destroy(&ra.cond);
+	pthread_mutex_destroy(&ra.mutex);
+	this->releaseBuffer(ra.buffers[0]);
+	this->releaseBuffer(ra.buffers[1]);
+
+	if(digest != 0) {
+		*digest = ra.digestCrc;
+	}
+
+	log->loopDebug("DataTransfer::pipelinedCopy(totalNbytes=>%d) end", totalNbytes);
+	return totalNbytes;
+}
+
+/**
+ * \brief This setter calls notify()
+ */
+void DataTransfer::setTotalSize(uint64_t size) {
+	__atomic_store_n(&this->_totalSize, size, __ATOMIC_RELAXED);
+
+	this->notifyObservers(Doclone::TRANS_TOTAL_SIZE, size);
+}
+
+uint64_t DataTransfer::getTotalSize() const {
+	return __atomic_load_n(&this->_totalSize, __ATOMIC_RELAXED);
+}
 
-	this->notifyObservers(Doclone::TRANS_TOTAL_SIZE, this->_totalSize);
+uint64_t DataTransfer::getTransferredBytes() const {
+	return __atomic_load_n(&this->_transferredBytes, __ATOMIC_RELAXED);
 }
 
 }
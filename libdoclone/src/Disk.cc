@@ -421,9 +421,11 @@ void Disk::writePartitions() const throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("Disk::writePartitions() start");
 
+	Clone *dcl = Clone::getInstance();
+	dcl->markStarted(Doclone::OP_MAKE_DISKLABEL, this->_path);
+
 	this->makeLabel();
 
-	Clone *dcl = Clone::getInstance();
 	dcl->markCompleted(Doclone::OP_MAKE_DISKLABEL, this->_path);
 
 	for (unsigned int i = 0; i< this->_partitions.size(); i++) {
@@ -433,6 +435,10 @@ void Disk::writePartitions() const throw(Exception) {
 			continue;
 		}
 
+		std::stringstream target;
+		target << this->_path << ", #" << (i+1);
+		dcl->markStarted(Doclone::OP_CREATE_PARTITION, target.str());
+
 		this->writePartitionToDisk(part);
 
 		if(part->getType() != Doclone::PARTITION_EXTENDED) {
@@ -440,8 +446,6 @@ void Disk::writePartitions() const throw(Exception) {
 			part->clearSignatures();
 		}
 
-		std::stringstream target;
-		target << this->_path << ", #" << (i+1);
 		dcl->markCompleted(Doclone::OP_CREATE_PARTITION, target.str());
 	}
 
@@ -0,0 +1,357 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <doclone/FilePrefetcher.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <doclone/Crc32c.h>
+#include <doclone/Job.h>
+#include <doclone/Logger.h>
+#include <doclone/Stats.h>
+
+namespace Doclone {
+
+/**
+ * \brief Initializes the attributes
+ *
+ * \param memoryLimit
+ * 		Bytes of data the prefetched files can hold at the same time
+ */
+FilePrefetcher::FilePrefetcher(uint64_t memoryLimit)
+	: _files(), _pending(), _done(false), _threads(),
+	  _memoryLimit(memoryLimit), _memoryUsage(0), _job(Job::getCurrent()) {
+	pthread_mutex_init(&this->_mutex, 0);
+	pthread_cond_init(&this->_notEmpty, 0);
+	pthread_cond_init(&this->_fileDone, 0);
+}
+
+/**
+ * \brief Stops the threads and frees the files that have not been taken
+ */
+FilePrefetcher::~FilePrefetcher() {
+	pthread_mutex_lock(&this->_mutex);
+	this->_done = true;
+	pthread_cond_broadcast(&this->_notEmpty);
+	pthread_mutex_unlock(&this->_mutex);
+
+	std::vector<pthread_t>::iterator it;
+	for(it = this->_threads.begin(); it != this->_threads.end(); ++it) {
+		pthread_join(*it, 0);
+	}
+
+	std::list<dcPrefetchedFile>::iterator file;
+	for(file = this->_files.begin(); file != this->_files.end(); ++file) {
+		if(file->fd >= 0) {
+			close(file->fd);
+		}
+
+		if(file->entry != 0) {
+			archive_entry_free(file->entry);
+		}
+	}
+
+	pthread_cond_destroy(&this->_fileDone);
+	pthread_cond_destroy(&this->_notEmpty);
+	pthread_mutex_destroy(&this->_mutex);
+}
+
+/**
+ * \brief Starts the prefetching threads
+ *
+ * If none can be started, submit() refuses all the files, so they are read
+ * by the archiving thread.
+ */
+void FilePrefetcher::start() {
+	Logger *log = Logger::getInstance();
+	log->debug("FilePrefetcher::start() start");
+
+	for(unsigned int i = 0; i < PREFETCH_THREADS; i++) {
+		pthread_t thread;
+		if(pthread_create(&thread, 0, FilePrefetcher::workerThread,
+				this) != 0) {
+			break;
+		}
+
+		this->_threads.push_back(thread);
+	}
+
+	if(this->_threads.empty()) {
+		log->warn("Can't start the threads that prefetch the files");
+	}
+
+	log->debug("FilePrefetcher::start(threads=>%d) end", this->_threads.size());
+}
+
+/**
+ * \brief Queues a file to be prefetched
+ *
+ * \param path
+ * 		Path of the file in the filesystem
+ * \param relPath
+ * 		Path of the file in the image
+ *
+ * \return false if the file can't be queued now. It must be read by the
+ * caller then
+ */
+bool FilePrefetcher::submit(const std::string &path,
+		const std::string &relPath) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("FilePrefetcher::submit(path=>%s) start", path.c_str());
+
+	bool submitted = false;
+
+	pthread_mutex_lock(&this->_mutex);
+
+	if(!this->_threads.empty() && this->_files.size() < PREFETCH_DEPTH) {
+		dcPrefetchedFile file;
+		file.path = path;
+		file.relPath = relPath;
+		file.done = false;
+		file.error = 0;
+		file.fd = -1;
+		file.entry = 0;
+		file.loaded = false;
+		file.crc = 0;
+
+		this->_files.push_back(file);
+		this->_pending.push_back(&this->_files.back());
+		pthread_cond_signal(&this->_notEmpty);
+
+		submitted = true;
+	}
+
+	pthread_mutex_unlock(&this->_mutex);
+
+	log->loopDebug("FilePrefetcher::submit(submitted=>%d) end", submitted);
+	return submitted;
+}
+
+/**
+ * \brief Takes a submitted file, waiting until it is prefetched
+ *
+ * The caller gets the descriptor and the entry of the file, and must close
+ * and free them.
+ *
+ * \param path
+ * 		Path of the file in the filesystem, as it was submitted
+ * \param [out] file
+ * 		The prefetched file
+ *
+ * \return false if the file has not been submitted
+ */
+bool FilePrefetcher::take(const std::string &path, dcPrefetchedFile &file) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("FilePrefetcher::take(path=>%s) start", path.c_str());
+
+	bool found = false;
+
+	pthread_mutex_lock(&this->_mutex);
+
+	std::list<dcPrefetchedFile>::iterator it;
+	for(it = this->_files.begin(); it != this->_files.end(); ++it) {
+		if(it->path == path) {
+			found = true;
+			break;
+		}
+	}
+
+	if(found) {
+		while(!it->done) {
+			pthread_cond_wait(&this->_fileDone, &this->_mutex);
+		}
+
+		this->_memoryUsage -= it->data.length();
+
+		// The data is moved, not copied
+		std::string data;
+		data.swap(it->data);
+		file = *it;
+		file.data.swap(data);
+
+		this->_files.erase(it);
+	}
+
+	pthread_mutex_unlock(&this->_mutex);
+
+	log->loopDebug("FilePrefetcher::take(found=>%d) end", found);
+	return found;
+}
+
+/**
+ * \brief Takes a submitted file that won't be archived, and frees it
+ *
+ * \param path
+ * 		Path of the file in the filesystem, as it was submitted
+ */
+void FilePrefetcher::discard(const std::string &path) {
+	dcPrefetchedFile file;
+
+	if(this->take(path, file)) {
+		if(file.fd >= 0) {
+			close(file.fd);
+		}
+
+		if(file.entry != 0) {
+			archive_entry_free(file.entry);
+		}
+	}
+}
+
+/**
+ * \brief Body of the prefetching threads
+ *
+ * \param arg
+ * 		Pointer to the FilePrefetcher
+ */
+void *FilePrefetcher::workerThread(void *arg) {
+	FilePrefetcher *prefetcher = static_cast<FilePrefetcher *>(arg);
+
+	prefetcher->work();
+
+	return 0;
+}
+
+/**
+ * \brief Prefetches the submitted files until the prefetcher is destroyed
+ *
+ * Each thread has its own disk archive, since they can't be shared.
+ */
+void FilePrefetcher::work() {
+	this->_job->bind();
+
+	struct archive *disk = archive_read_disk_new();
+	archive_read_disk_set_symlink_physical(disk);
+
+	pthread_mutex_lock(&this->_mutex);
+
+	while(true) {
+		while(this->_pending.empty() && !this->_done) {
+			pthread_cond_wait(&this->_notEmpty, &this->_mutex);
+		}
+
+		if(this->_done) {
+			break;
+		}
+
+		// The elements of a list stay in place while others are removed
+		dcPrefetchedFile *file = this->_pending.front();
+		this->_pending.pop_front();
+		pthread_mutex_unlock(&this->_mutex);
+
+		this->prefetch(disk, *file);
+
+		pthread_mutex_lock(&this->_mutex);
+		file->done = true;
+		pthread_cond_broadcast(&this->_fileDone);
+	}
+
+	pthread_mutex_unlock(&this->_mutex);
+
+	archive_read_free(disk);
+
+	Job::unbind();
+}
+
+/**
+ * \brief Does what the archiving thread would do with a file before
+ * archiving it
+ *
+ * Only the regular files are opened. The other ones only get lstat().
+ *
+ * \param disk
+ * 		Disk archive of the calling thread
+ * \param file
+ * 		The file
+ */
+void FilePrefetcher::prefetch(struct archive *disk, dcPrefetchedFile &file) {
+	if(lstat(file.path.c_str(), &file.filestat) < 0) {
+		file.error = errno;
+		return;
+	}
+
+	if(!S_ISREG(file.filestat.st_mode)) {
+		return;
+	}
+
+	file.fd = open(file.path.c_str(), O_RDONLY);
+
+	file.entry = archive_entry_new();
+	archive_entry_update_pathname_utf8(file.entry, file.relPath.c_str());
+	archive_read_disk_entry_from_file(disk, file.entry, file.fd,
+			&file.filestat);
+
+	uint64_t size = file.filestat.st_size;
+	if(file.fd < 0 || size == 0 || size > PREFETCH_FILE_SIZE
+			|| !this->reserve(size)) {
+		return;
+	}
+
+	// pread() leaves the offset at 0 for the archiving thread
+	uint64_t startTime = Stats::now();
+	file.data.resize(size);
+	uint64_t nbytes = 0;
+	ssize_t r;
+	while(nbytes < size
+			&& (r = pread(file.fd, &file.data[nbytes], size - nbytes,
+					nbytes)) > 0) {
+		nbytes += r;
+	}
+
+	Stats::getInstance()->addStage(Doclone::STAGE_READ, nbytes, startTime);
+
+	if(nbytes == size) {
+		file.crc = Crc32c::compute(file.data.data(), size);
+		file.loaded = true;
+	} else {
+		// The file has changed or can't be read: the caller reads it again
+		std::string().swap(file.data);
+		this->unreserve(size);
+	}
+}
+
+/**
+ * \brief Reserves memory for the data of a file
+ *
+ * \return false if it doesn't fit in the limit
+ */
+bool FilePrefetcher::reserve(uint64_t size) {
+	pthread_mutex_lock(&this->_mutex);
+
+	bool fits = this->_memoryUsage + size <= this->_memoryLimit;
+	if(fits) {
+		this->_memoryUsage += size;
+	}
+
+	pthread_mutex_unlock(&this->_mutex);
+
+	return fits;
+}
+
+/**
+ * \brief Gives back the memory reserved for the data of a file
+ */
+void FilePrefetcher::unreserve(uint64_t size) {
+	pthread_mutex_lock(&this->_mutex);
+	this->_memoryUsage -= size;
+	pthread_mutex_unlock(&this->_mutex);
+}
+
+}
@@ -142,6 +142,7 @@ void Grub::install() throw(Exception) {
 	Operation *installGrubOp = new Operation(
 			Doclone::OP_GRUB_INSTALL, this->_disk->getPath());
 	dcl->addOperation(installGrubOp);
+	dcl->markStarted(Doclone::OP_GRUB_INSTALL, this->_disk->getPath());
 
 	std::map<unsigned int, std::string>::iterator it;
 	for (it = this->_grubParts.begin(); it != this->_grubParts.end(); ++it ) {
@@ -0,0 +1,239 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <doclone/HardLinkResolver.h>
+
+#include <unistd.h>
+
+#include <doclone/Util.h>
+#include <doclone/Logger.h>
+#include <doclone/exception/WriteDataException.h>
+#include <doclone/exception/ReadDataException.h>
+
+namespace Doclone {
+
+/**
+ * \brief Initializes the attributes
+ *
+ * \param memoryLimit
+ * 		Bytes the index can use in memory before spilling to disk. 0 means
+ * 		no limit
+ */
+HardLinkResolver::HardLinkResolver(uint64_t memoryLimit)
+	: _links(), _memoryUsage(0), _memoryLimit(memoryLimit), _spillFile(0),
+	  _spillFailed(false), _spilledEntries(0), _spillSize(0), _buckets() {
+}
+
+/**
+ * \brief Closes and removes the spill file
+ */
+HardLinkResolver::~HardLinkResolver() {
+	if(this->_spillFile != 0) {
+		fclose(this->_spillFile);
+	}
+}
+
+/**
+ * \brief Makes [entry] a hard link to the first entry of the same file, if
+ * it has been archived before
+ *
+ * In that case, the size of [entry] is set to 0, so its data is not archived
+ * again.
+ *
+ * \param entry
+ * 		The libarchive entry of the file being archived
+ */
+void HardLinkResolver::linkify(struct archive_entry *entry) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("HardLinkResolver::linkify(entry=>0x%x) start", entry);
+
+	if(archive_entry_nlink(entry) <= 1) {
+		log->loopDebug("HardLinkResolver::linkify() end");
+		return;
+	}
+
+	dcFileId id(archive_entry_dev(entry), archive_entry_ino64(entry));
+	std::string firstPath;
+	bool found = false;
+
+	std::map<dcFileId, std::pair<std::string, unsigned int> >::iterator it =
+			this->_links.find(id);
+	if(it != this->_links.end()) {
+		firstPath = it->second.first;
+		found = true;
+
+		// Forget the file when all its links have been archived
+		if(--it->second.second == 0) {
+			this->_memoryUsage -=
+					LINK_ENTRY_OVERHEAD + it->second.first.length();
+			this->_links.erase(it);
+		}
+	} else if(this->_spilledEntries > 0) {
+		found = this->findInSpill(id, firstPath);
+	}
+
+	if(found) {
+		archive_entry_copy_hardlink(entry, firstPath.c_str());
+		archive_entry_set_size(entry, 0);
+	} else {
+		std::string path = archive_entry_pathname(entry);
+		uint64_t entrySize = LINK_ENTRY_OVERHEAD + path.length();
+
+		// The buckets of the spill file take a part of the limit
+		bool spilled = this->_memoryLimit > 0 && !this->_spillFailed
+				&& this->_memoryUsage + entrySize > this->_memoryLimit
+						- this->_memoryLimit / LINK_BUCKETS_QUOTIENT
+				&& this->spill(id, path);
+
+		if(!spilled) {
+			this->_links[id] = std::make_pair(path,
+					archive_entry_nlink(entry) - 1);
+			this->_memoryUsage += entrySize;
+		}
+	}
+
+	log->loopDebug("HardLinkResolver::linkify() end");
+}
+
+/**
+ * \brief Looks for a file in the spill file
+ *
+ * \param id
+ * 		Device and inode of the file
+ * \param [out] path
+ * 		Path of the first entry of the file, if it is found
+ *
+ * \return true if the file is in the spill file
+ */
+bool HardLinkResolver::findInSpill(const dcFileId &id, std::string &path)
+		throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("HardLinkResolver::findInSpill(dev=>%d, ino=>%d) start", id.first, id.second);
+
+	bool found = false;
+
+	// The records are appended through the buffer of the stream
+	if(fflush(this->_spillFile) != 0) {
+		ReadDataException ex;
+		throw ex;
+	}
+
+	int fd = fileno(this->_spillFile);
+	uint64_t next = this->_buckets[this->getBucket(id)];
+
+	while(next != 0 && !found) {
+		// Record: device, inode, previous record of the bucket, path length
+		uint64_t header[3];
+		uint32_t length;
+		off_t offset = next - 1;
+
+		if(pread(fd, header, sizeof(header), offset) != sizeof(header)
+				|| pread(fd, &length, sizeof(length), offset + sizeof(header))
+						!= sizeof(length)) {
+			ReadDataException ex;
+			throw ex;
+		}
+
+		if(header[0] == static_cast<uint64_t>(id.first)
+				&& header[1] == static_cast<uint64_t>(id.second)) {
+			path.resize(length);
+			if(length > 0 && pread(fd, &path[0], length,
+					offset + sizeof(header) + sizeof(length)) != length) {
+				ReadDataException ex;
+				throw ex;
+			}
+
+			found = true;
+		}
+
+		next = header[2];
+	}
+
+	log->loopDebug("HardLinkResolver::findInSpill(found=>%d) end", found);
+	return found;
+}
+
+/**
+ * \brief Appends a file to the spill file, creating it if needed
+ *
+ * \param id
+ * 		Device and inode of the file
+ * \param path
+ * 		Path of the first entry of the file
+ *
+ * \return false if the spill file can't be created, then the index is kept
+ * in memory from now on
+ */
+bool HardLinkResolver::spill(const dcFileId &id, const std::string &path)
+		throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("HardLinkResolver::spill(path=>%s) start", path.c_str());
+
+	if(this->_spillFile == 0) {
+		this->_spillFile = Util::createTempFile("doclone-links");
+
+		if(this->_spillFile == 0) {
+			log->warn("Can't create the spill file for hard links");
+			this->_spillFailed = true;
+
+			log->loopDebug("HardLinkResolver::spill(spilled=>0) end");
+			return false;
+		}
+
+		size_t buckets = this->_memoryLimit / LINK_BUCKETS_QUOTIENT
+				/ sizeof(uint64_t);
+		this->_buckets.assign(buckets > LINK_MIN_BUCKETS
+				? buckets : LINK_MIN_BUCKETS, 0);
+	}
+
+	uint64_t &bucket = this->_buckets[this->getBucket(id)];
+	uint64_t header[3] = {static_cast<uint64_t>(id.first),
+			static_cast<uint64_t>(id.second), bucket};
+	uint32_t length = path.length();
+
+	if(fseeko(this->_spillFile, this->_spillSize, SEEK_SET) != 0
+			|| fwrite(header, sizeof(header), 1, this->_spillFile) != 1
+			|| fwrite(&length, sizeof(length), 1, this->_spillFile) != 1
+			|| fwrite(path.c_str(), 1, length, this->_spillFile) != length) {
+		WriteDataException ex;
+		throw ex;
+	}
+
+	bucket = this->_spillSize + 1;
+	this->_spillSize += sizeof(header) + sizeof(length) + length;
+	this->_spilledEntries++;
+
+	log->loopDebug("HardLinkResolver::spill(spilled=>1) end");
+	return true;
+}
+
+/**
+ * \brief Gets the bucket of the spill file where a file is
+ */
+size_t HardLinkResolver::getBucket(const dcFileId &id) const {
+	uint64_t hash = (static_cast<uint64_t>(id.second) * 0x9E3779B97F4A7C15ULL)
+			^ static_cast<uint64_t>(id.first);
+
+	return (hash ^ (hash >> 29)) % this->_buckets.size();
+}
+
+uint64_t HardLinkResolver::getMemoryUsage() const {
+	return this->_memoryUsage + this->_buckets.size() * sizeof(uint64_t);
+}
+
+}
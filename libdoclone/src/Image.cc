@@ -19,9 +19,11 @@
 #include <doclone/Image.h>
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <endian.h>
 #include <time.h>
 #include <dirent.h>
@@ -40,6 +42,12 @@
 #include <doclone/Logger.h>
 #include <doclone/Operation.h>
 #include <doclone/DataTransfer.h>
+#include <doclone/BaseImageIndex.h>
+#include <doclone/ChunkStore.h>
+#include <doclone/FilePrefetcher.h>
+#include <doclone/HardLinkResolver.h>
+#include <doclone/Stats.h>
+#include <doclone/Verifier.h>
 #include <doclone/DlFactory.h>
 #include <doclone/FsFactory.h>
 #include <doclone/xml/XMLDocument.h>
@@ -65,15 +73,25 @@
 #include <doclone/exception/SendDataException.h>
 #include <doclone/exception/WriteDataException.h>
 #include <doclone/exception/ReceiveDataException.h>
+#include <doclone/exception/NoManifestException.h>
+#include <doclone/exception/VerifyDataException.h>
+#include <doclone/exception/NoBaseImageException.h>
+#include <doclone/exception/WrongBaseImageException.h>
+#include <doclone/exception/NoRepositoryException.h>
+#include <doclone/exception/SyncLayoutException.h>
 
 namespace Doclone {
 
 /**
  * \brief Initializes attributes
  */
-Image::Image(): _size(), _type(), _disk(), _archiveIn(), _archivesOut() {
+Image::Image(): _size(), _type(), _disk(), _archiveIn(), _archivesOut(),
+		_manifest(), _baseIndex(), _incremental(), _baseId(), _removed(),
+		_store(), _chunked(), _sync(), _synced(), _keptBytes(), _deletedFiles(),
+		_directory() {
 	Clone *dcl = Clone::getInstance();
 	this->_noData = dcl->getEmpty();
+	this->_sync = dcl->getSync();
 }
 
 /**
@@ -81,6 +99,12 @@ Image::Image(): _size(), _type(), _disk(), _archiveIn(), _archivesOut() {
  */
 Image::~Image() {
 	delete this->_disk;
+	delete this->_baseIndex;
+	delete this->_store;
+
+	if(this->_manifest != 0) {
+		fclose(this->_manifest);
+	}
 }
 
 /**
@@ -114,6 +138,85 @@ bool Image::isValid() const throw(Exception) {
 	return retValue;
 }
 
+/**
+ * \brief Creates the libarchive entry of a regular file generated by doclone,
+ * like the header or the manifest
+ *
+ * \param path
+ * 		Path of the file in the image
+ * \param size
+ * 		Size of the file
+ *
+ * \return The entry, to be freed with archive_entry_free()
+ */
+static struct archive_entry *newImageEntry(const char *path, int64_t size) {
+	time_t timeNow = time(0);
+
+	struct archive_entry *entry = archive_entry_new();
+	archive_entry_set_pathname(entry, path);
+	archive_entry_set_filetype(entry, AE_IFREG);
+	archive_entry_set_size(entry, size);
+	archive_entry_set_perm(entry, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	archive_entry_set_atime(entry, timeNow, 0);
+	archive_entry_set_birthtime(entry, timeNow, 0);
+	archive_entry_set_ctime(entry, timeNow, 0);
+	archive_entry_set_mtime(entry, timeNow, 0);
+
+	return entry;
+}
+
+/**
+ * \brief libarchive read callback for descriptors with checksums
+ *
+ * \param client
+ * 		The descriptor, stored in the pointer
+ */
+static ssize_t checksumRead(struct archive *arch, void *client,
+		const void **buf) {
+	int fd = static_cast<int>(reinterpret_cast<intptr_t>(client));
+
+	try {
+		return DataTransfer::getInstance()->readChunk(fd, buf);
+	} catch (const Exception &ex) {
+		ex.logMsg();
+		archive_set_error(arch, EIO, "%s", ex.what());
+		return -1;
+	}
+}
+
+/**
+ * \brief libarchive write callback for descriptors with checksums
+ *
+ * \param client
+ * 		The descriptor, stored in the pointer
+ */
+static ssize_t checksumWrite(struct archive *arch, void *client,
+		const void *buf, size_t len) {
+	int fd = static_cast<int>(reinterpret_cast<intptr_t>(client));
+
+	try {
+		return DataTransfer::getInstance()->writeData(fd, buf, len);
+	} catch (const Exception &ex) {
+		ex.logMsg();
+		archive_set_error(arch, EIO, "%s", ex.what());
+		return -1;
+	}
+}
+
+/**
+ * \brief Opens a write archive on a descriptor, through the checksums of
+ * DataTransfer if it has them enabled
+ */
+static int openFdWrite(struct archive *arch, int fd) {
+	if(DataTransfer::getInstance()->hasChecksums(fd)) {
+		return archive_write_open(arch,
+				reinterpret_cast<void *>(static_cast<intptr_t>(fd)), 0,
+				checksumWrite, 0);
+	}
+
+	return archive_write_open_fd(arch, fd);
+}
+
 /**
  * \brief Makes this->_archiveIn be a disk read archive
  */
@@ -138,8 +241,19 @@ void Image::initFdReadArchive(const int fdin) throw(Exception) {
 	archive_read_support_format_tar(this->_archiveIn);
 	archive_read_support_filter_gzip(this->_archiveIn);
 
-	if(archive_read_open_fd(this->_archiveIn,
-			fdin, Doclone::BUFFER_SIZE) != ARCHIVE_OK) {
+	DataTransfer *trns = DataTransfer::getInstance();
+	size_t blockSize = trns->getBufferSize(Doclone::BUFFER_ARCHIVE);
+
+	int r;
+	if(trns->hasChecksums(fdin)) {
+		r = archive_read_open(this->_archiveIn,
+				reinterpret_cast<void *>(static_cast<intptr_t>(fdin)), 0,
+				checksumRead, 0);
+	} else {
+		r = archive_read_open_fd(this->_archiveIn, fdin, blockSize);
+	}
+
+	if(r != ARCHIVE_OK) {
 		InitializationException ex;
 		throw ex;
 	}
@@ -180,11 +294,16 @@ void Image::initFdWriteArchive(const int fdout) throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("Image::initFdWrite(fdout=>%d) start", fdout);
 
+	DataTransfer *trns = DataTransfer::getInstance();
+	int blockSize = trns->getBufferSize(Doclone::BUFFER_ARCHIVE);
+
 	struct archive *arch = archive_write_new();
 	archive_write_add_filter_gzip(arch);
 	archive_write_set_format_pax(arch);
+	archive_write_set_bytes_per_block(arch, blockSize);
+	archive_write_set_bytes_in_last_block(arch, 1);
 
-	if(archive_write_open_fd(arch, fdout) != ARCHIVE_OK) {
+	if(openFdWrite(arch, fdout) != ARCHIVE_OK) {
 		InitializationException ex;
 		throw ex;
 	}
@@ -204,13 +323,18 @@ void Image::initFdWriteArchive(std::vector<int> &fds) throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("Image::initFdWrite(fds=>0x%x) start", &fds);
 
+	DataTransfer *trns = DataTransfer::getInstance();
+	int blockSize = trns->getBufferSize(Doclone::BUFFER_ARCHIVE);
+
 	std::vector<int>::iterator it;
 	for(it = fds.begin(); it != fds.end(); ++it) {
 		struct archive *arch = archive_write_new();
 		archive_write_add_filter_gzip(arch);
 		archive_write_set_format_pax(arch);
+		archive_write_set_bytes_per_block(arch, blockSize);
+		archive_write_set_bytes_in_last_block(arch, 1);
 
-		if(archive_write_open_fd(arch, *it) != ARCHIVE_OK) {
+		if(openFdWrite(arch, *it) != ARCHIVE_OK) {
 			InitializationException ex;
 			throw ex;
 		}
@@ -221,6 +345,38 @@ void Image::initFdWriteArchive(std::vector<int> &fds) throw(Exception) {
 	log->debug("Image::initFdWrite() end");
 }
 
+/**
+ * \brief For each descriptor in [fds], create an uncompressed write archive
+ *
+ * The data is not blocked either, every entry is written to the descriptors
+ * as soon as it is given. It is meant for pipes read by other Images in this
+ * process.
+ *
+ * \param fds
+ * 		Vector of descriptors
+ */
+void Image::initRawWriteArchive(std::vector<int> &fds) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::initRawWrite(fds=>0x%x) start", &fds);
+
+	std::vector<int>::iterator it;
+	for(it = fds.begin(); it != fds.end(); ++it) {
+		struct archive *arch = archive_write_new();
+		archive_write_add_filter_none(arch);
+		archive_write_set_format_pax(arch);
+		archive_write_set_bytes_per_block(arch, 0);
+
+		if(archive_write_open_fd(arch, *it) != ARCHIVE_OK) {
+			InitializationException ex;
+			throw ex;
+		}
+
+		this->_archivesOut.push_back(arch);
+	}
+
+	log->debug("Image::initRawWrite() end");
+}
+
 /**
  * \brief Free allocated memory for read archive
  */
@@ -284,6 +440,12 @@ void Image::loadImageSizeFromHeader() throw(Exception) {
 		throw ex;
 	}
 
+	if(archive_entry_size(entry) > static_cast<int64_t>(Doclone::MAX_HEADER_SIZE)) {
+		InvalidImageException ex;
+		throw ex;
+	}
+
+	xmlText.reserve(archive_entry_size(entry));
 	trns->archiveToBuf(this->_archiveIn, xmlText);
 	XMLDocument doc;
 	doc.openFromMem(xmlText.c_str());
@@ -313,6 +475,12 @@ void Image::loadImageHeader() throw(Exception) {
 		throw ex;
 	}
 
+	if(archive_entry_size(entry) > static_cast<int64_t>(Doclone::MAX_HEADER_SIZE)) {
+		InvalidImageException ex;
+		throw ex;
+	}
+
+	xmlText.reserve(archive_entry_size(entry));
 	trns->archiveToBuf(this->_archiveIn, xmlText);
 	XMLDocument doc;
 	doc.openFromMem(xmlText.c_str());
@@ -326,6 +494,14 @@ void Image::loadImageHeader() throw(Exception) {
 	this->_type = static_cast<Doclone::imageType>(
 			doc.getElementValueU8(rootElement, "imageType"));
 
+	this->_chunked = doc.getElementValueU8(rootElement, "chunked") != 0;
+
+	const char *baseImage = doc.getElementValueCString(rootElement, "baseImage");
+	if(baseImage != 0) {
+		this->_incremental = true;
+		this->_baseId = strtoul(baseImage, 0, 16);
+	}
+
 	diskLabelType dLabel =
 			static_cast<Doclone::diskLabelType>(doc.getElementValueU8(rootElement, "diskType"));
 	this->_disk = DlFactory::createDiskLabel(dLabel);
@@ -436,6 +612,17 @@ void Image::saveImageHeader() throw(Exception) {
 	doc.createElement(rootElem, "numPartitions", numPartitions);
 	doc.createElement(rootElem, "imageSize", imageSize);
 	doc.createElement(rootElem, "imageType", static_cast<uint8_t>(this->_type));
+	doc.createElement(rootElem, "createTime", static_cast<uint64_t>(time(0)));
+
+	if(this->_store != 0) {
+		doc.createElement(rootElem, "chunked", static_cast<uint8_t>(1));
+	}
+
+	if(this->_baseIndex != 0) {
+		char baseId[9];
+		snprintf(baseId, sizeof(baseId), "%08x", this->_baseIndex->getBaseId());
+		doc.createElement(rootElem, "baseImage", baseId);
+	}
 
 	doc.createBinaryElement(rootElem, "bootCode",
 			reinterpret_cast<const uint8_t*>(this->_disk->getBootCode()), Doclone::MBR_SIZE);
@@ -477,17 +664,8 @@ void Image::saveImageHeader() throw(Exception) {
 	std::string xmlSer;
 	doc.serialize(xmlSer);
 
-	time_t timeNow = time(0);
-
-	struct archive_entry *headerEntry = archive_entry_new();
-	archive_entry_set_pathname(headerEntry, "_header.xml");
-	archive_entry_set_filetype(headerEntry, AE_IFREG);
-	archive_entry_set_size(headerEntry, xmlSer.length());
-	archive_entry_set_perm(headerEntry, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
-	archive_entry_set_atime(headerEntry, timeNow, 0);
-	archive_entry_set_birthtime(headerEntry, timeNow, 0);
-	archive_entry_set_ctime(headerEntry, timeNow, 0);
-	archive_entry_set_mtime(headerEntry, timeNow, 0);
+	struct archive_entry *headerEntry =
+			newImageEntry("_header.xml", xmlSer.length());
 
 	DataTransfer *trns = DataTransfer::getInstance();
 	trns->copyHeader(headerEntry, this->_archivesOut);
@@ -505,8 +683,10 @@ void Image::saveImageHeader() throw(Exception) {
  * This function is called for first time on the root path of the partition and
  * is recursively called to read all the data in the directory tree.
  *
- * \param lResolv
- * 		Libarchive link resolver for handling hard links logic
+ * \param resolver
+ * 		Resolver for handling hard links logic
+ * \param prefetcher
+ * 		Prefetcher of the files of the partition
 * \param path
 * 		Path in the FS of the folder to be read
 * \param imgRootDir
@@ -515,49 +695,111 @@ void Image::saveImageHeader() throw(Exception) {
 * \param mPointLength
 * 		Size of the path to the current mount point of the partition
  */
-void Image::readDataFromDisk(struct archive_entry_linkresolver *lResolv,
-		const std::string &path, const std::string &imgRootDir,
-		size_t mPointLength) throw(Exception) {
+void Image::readDataFromDisk(HardLinkResolver &resolver,
+		FilePrefetcher &prefetcher, const std::string &path,
+		const std::string &imgRootDir, size_t mPointLength)
+		throw(Exception) {
 	Logger *log = Logger::getInstance();
-	log->loopDebug("Image::readDataFromDisk(lResolv=>0x%x, path=>%s, imgRootDir=>%s, mPointLength=>%d) start",
-			lResolv, path.c_str(), imgRootDir.c_str(), mPointLength);
+	log->loopDebug("Image::readDataFromDisk(resolver=>0x%x, prefetcher=>0x%x, path=>%s, imgRootDir=>%s, mPointLength=>%d) start",
+			&resolver, &prefetcher, path.c_str(), imgRootDir.c_str(),
+			mPointLength);
 
 	DIR *directory;
 	struct dirent *d_file; // a file in *directory
 	struct archive_entry *entry;
 	bool errors = false;
 	DataTransfer *trns = DataTransfer::getInstance();
+	Stats *stats = Stats::getInstance();
 
 	if ((directory = opendir (path.c_str())) == 0) {
 		FileNotFoundException ex(path);
 		throw ex;
 	}
 
+	// The names are read first, so the next files can be prefetched
+	std::vector<std::pair<std::string, unsigned char> > names;
 	while ((d_file = readdir (directory)) != 0) {
+		names.push_back(std::make_pair(std::string(d_file->d_name),
+				d_file->d_type));
+	}
+
+	closedir (directory);
+
+	// The files submitted to the prefetcher and not taken yet
+	std::vector<bool> submitted(names.size(), false);
+	size_t next = 0;
+
+	for(size_t i = 0; i < names.size(); i++) {
+		uint64_t startTime = Stats::now();
+		const char *name = names[i].first.c_str();
 		struct stat filestat;
 		std::string abPath;
 
 		abPath = path;
-		abPath.append(d_file->d_name);
+		abPath.append(name);
 
 		//Path of the file in the image
 		std::string relPath = imgRootDir + "/" + abPath.substr(mPointLength);
 
-		if (lstat (abPath.c_str(), &filestat) < 0) {
+		/*
+		 * Keep the next files in flight, up to the next directory, whose
+		 * files are archived before the ones after it.
+		 */
+		while(next < names.size() && names[next].second != DT_DIR) {
+			std::string nextPath = path + names[next].first;
+			if(!prefetcher.submit(nextPath,
+					imgRootDir + "/" + nextPath.substr(mPointLength))) {
+				break;
+			}
+
+			submitted[next++] = true;
+		}
+
+		if(next == i) {
+			next++;
+		}
+
+		dcPrefetchedFile prefetched;
+		bool isPrefetched = submitted[i] && prefetcher.take(abPath, prefetched);
+		submitted[i] = false;
+
+		bool found = isPrefetched ? prefetched.error == 0
+				: lstat (abPath.c_str(), &filestat) == 0;
+		if(isPrefetched && found) {
+			filestat = prefetched.filestat;
+		}
+
+		if(!found) {
+			// Nobody will take the next files submitted
+			for(size_t j = i + 1; j < next; j++) {
+				if(submitted[j]) {
+					prefetcher.discard(path + names[j].first);
+				}
+			}
+
 			FileNotFoundException ex(abPath);
 			throw ex;
 		}
 
 		try {
-			int fdin = open (abPath.c_str(), O_RDONLY);
+			int fdin;
+
+			if(isPrefetched && prefetched.entry != 0) {
+				fdin = prefetched.fd;
+				entry = prefetched.entry;
+			} else {
+				fdin = open (abPath.c_str(), O_RDONLY);
+
+				entry = archive_entry_new();
+				archive_entry_update_pathname_utf8(entry, relPath.c_str());
+				archive_read_disk_entry_from_file(this->_archiveIn, entry, fdin, &filestat);
+			}
 
-			entry = archive_entry_new();
-			archive_entry_update_pathname_utf8(entry, relPath.c_str());
-			archive_read_disk_entry_from_file(this->_archiveIn, entry, fdin, &filestat);
+			stats->addStage(Doclone::STAGE_WALK, 0, startTime);
 
 			switch (archive_entry_filetype(entry)) {
 			case AE_IFDIR: {
-				if (strcmp (".", d_file->d_name) && strcmp ("..", d_file->d_name)) {
+				if (strcmp (".", name) && strcmp ("..", name)) {
 
 					trns->copyHeader(entry, this->_archivesOut);
 
@@ -572,8 +814,8 @@ void Image::readDataFromDisk(struct archive_entry_linkresolver *lResolv,
 					}
 
 					abPath.push_back('/');
-					this->readDataFromDisk(lResolv, abPath.c_str(), imgRootDir,
-							mPointLength);
+					this->readDataFromDisk(resolver, prefetcher, abPath.c_str(),
+							imgRootDir, mPointLength);
 				}
 				break;
 			}
@@ -597,14 +839,57 @@ void Image::readDataFromDisk(struct archive_entry_linkresolver *lResolv,
 			case AE_IFCHR:
 			case AE_IFBLK:
 			case AE_IFREG: {
-				struct archive_entry *sparse;
-				if(archive_entry_nlink(entry) > 1) {
-					archive_entry_linkify(lResolv, &entry, &sparse);
+				// Unchanged files are restored from the base image
+				if(this->_baseIndex != 0
+						&& this->_baseIndex->keep(relPath, filestat)) {
+					uint32_t crc;
+					if(this->_baseIndex->getChecksum(relPath, crc)) {
+						this->addToManifest(relPath, filestat.st_size, crc);
+					}
+					break;
 				}
-				if(entry != 0) {
-					trns->copyHeader(entry, this->_archivesOut);
+
+				resolver.linkify(entry);
+
+				uint32_t crc = 0;
+				uint64_t size = archive_entry_size(entry);
+
+				// In a repository, the data is replaced by its chunk list
+				std::string chunkList;
+				bool chunked = this->_store != 0 && size > 0
+						&& archive_entry_filetype(entry) == AE_IFREG
+						&& !Util::isLiveFile(abPath.c_str());
+				if(chunked) {
+					size = this->_store->storeFile(fdin, chunkList, crc);
+					archive_entry_set_size(entry, chunkList.length());
+				}
+
+				/*
+				 * Only the data regions of a sparse file are read and
+				 * stored. Its holes are restored as holes.
+				 */
+				std::vector<dcDataRegion> regions;
+				bool sparse = !chunked && size > 0
+						&& archive_entry_filetype(entry) == AE_IFREG
+						&& !Util::isLiveFile(abPath.c_str())
+						&& DataTransfer::getDataRegions(fdin, size, regions);
+
+				archive_entry_sparse_clear(entry);
+				if(sparse) {
+					std::vector<dcDataRegion>::const_iterator it;
+					for(it = regions.begin(); it != regions.end(); ++it) {
+						archive_entry_sparse_add_entry(entry, it->first,
+								it->second);
+					}
+
+					// A file without data needs an empty region at its end
+					if(regions.empty()) {
+						archive_entry_sparse_add_entry(entry, size, 0);
+					}
 				}
 
+				trns->copyHeader(entry, this->_archivesOut);
+
 				/*
 				 * If the current file is a virtual one, bypass
 				 */
@@ -613,8 +898,23 @@ void Image::readDataFromDisk(struct archive_entry_linkresolver *lResolv,
 				}
 
 				// else
-				if(archive_entry_size(entry) > 0) {
-					trns->fdToArchive(fdin, this->_archivesOut);
+				if(chunked) {
+					trns->bufToArchive(chunkList, this->_archivesOut);
+				} else if(sparse) {
+					trns->sparseToArchive(fdin, regions, size,
+							this->_archivesOut, &crc);
+				} else if(isPrefetched && prefetched.loaded
+						&& prefetched.data.length() == size) {
+					trns->bufToArchive(prefetched.data, this->_archivesOut);
+					crc = prefetched.crc;
+				} else if(size > 0) {
+					trns->fdToArchive(fdin, this->_archivesOut, &crc);
+				}
+
+				// The hard links are verified through their first entry
+				if(archive_entry_filetype(entry) == AE_IFREG
+						&& archive_entry_hardlink(entry) == 0) {
+					this->addToManifest(relPath, size, crc);
 				}
 
 				break;
@@ -631,8 +931,6 @@ void Image::readDataFromDisk(struct archive_entry_linkresolver *lResolv,
 		}
 	}
 
-	closedir (directory);
-
 	if(errors) {
 		ReadErrorsInDirectoryException ex(path);
 		ex.logMsg();
@@ -649,34 +947,57 @@ void Image::readDataFromDisk(struct archive_entry_linkresolver *lResolv,
  * files in the archive are written in the corresponding mount point. This way
  * of restoring let us restore a Doclone image that has been modified by other
  * tools.
+ *
+ * When restoring an incremental image, it is called again for its base,
+ * whose files that are not regular or are in the list of removed files are
+ * skipped.
+ *
+ * In sync mode, the regular files that are already on the disk are not
+ * written, the ones that have changed are patched and the paths of all the
+ * files are kept to delete the others later.
+ *
+ * \param fromBase
+ * 		If this->_archiveIn is the base of the image
  */
-void Image::writeDataToDisk() throw(Exception) {
+void Image::writeDataToDisk(bool fromBase) throw(Exception) {
 	Logger *log = Logger::getInstance();
-	log->loopDebug("Image::writeDataToDisk() start");
+	log->loopDebug("Image::writeDataToDisk(fromBase=>%d) start", fromBase);
 
 	struct archive_entry *entry;
 	DataTransfer *trns = DataTransfer::getInstance();
 
+	std::vector<std::pair<std::string, std::string> > roots;
+	this->getRoots(roots);
+
 	//Won't keep restoring partitions with errors
-	uint8_t numPartitions = this->_disk->getPartitions().size();
-	bool errorPartitions[numPartitions];
-	memset(errorPartitions, false, numPartitions);
+	std::vector<bool> errorPartitions(roots.size(), false);
 
 	while(archive_read_next_header(this->_archiveIn, &entry) == ARCHIVE_OK) {
 		std::string abPath = archive_entry_pathname(entry);
 
-		for(int i = 0;i<numPartitions
-			&& this->_disk->getPartitions().at(i)->getUsedPart() != 0; i++) {
+		if(fromBase) {
+			if(archive_entry_filetype(entry) != AE_IFREG
+					|| this->_removed.count(abPath) != 0) {
+				continue;
+			}
+		} else if(this->_incremental && abPath == Doclone::REMOVED_ENTRY) {
+			this->loadRemovedList();
+			continue;
+		}
+
+		if(this->_sync) {
+			this->_synced.insert(abPath);
+		}
+
+		for(size_t i = 0; i < roots.size(); i++) {
 
 			try {
-				Partition *part = this->_disk->getPartitions().at(i);
+				const std::string &rootDir = roots[i].first;
+				const std::string &mountPoint = roots[i].second;
 
-				if(part->isMounted()
-						&& abPath.find(part->getRootDir().c_str()) == 0
-						&& !errorPartitions[i]) {
+				if(abPath.find(rootDir) == 0 && !errorPartitions[i]) {
 
-					abPath.replace(0,part->getRootDir().length(),
-									part->getMountPoint().c_str());
+					abPath.replace(0, rootDir.length(), mountPoint);
 
 					archive_entry_update_pathname_utf8(entry, abPath.c_str());
 
@@ -685,15 +1006,25 @@ void Image::writeDataToDisk() throw(Exception) {
 
 							std::string hardLinkPath =
 									archive_entry_hardlink(entry);
-							hardLinkPath.replace(0, part->getRootDir().length(),
-									part->getMountPoint().c_str());
+							hardLinkPath.replace(0, rootDir.length(),
+									mountPoint);
 
 							archive_entry_update_hardlink_utf8(entry,
 									hardLinkPath.c_str());
 					}
 
-					trns->copyHeader(entry, this->_archivesOut);
-					trns->copyData(this->_archiveIn, this->_archivesOut);
+					if(this->_chunked && !fromBase
+							&& archive_entry_filetype(entry) == AE_IFREG
+							&& archive_entry_size(entry) > 0) {
+						this->writeChunkedFile(entry);
+					} else if(this->_sync && this->isOnDisk(entry)) {
+						// libarchive skips its data when reading the next entry
+						this->_keptBytes += archive_entry_size(entry);
+						trns->countBytes(archive_entry_size(entry));
+					} else if(!this->_sync || !this->patchFile(entry)) {
+						trns->copyHeader(entry, this->_archivesOut);
+						trns->copyData(this->_archiveIn, this->_archivesOut);
+					}
 				}
 			} catch(const WarningException &e) {
 				errorPartitions[i] = true;
@@ -706,6 +1037,180 @@ void Image::writeDataToDisk() throw(Exception) {
 	log->loopDebug("Image::writeDataToDisk() end");
 }
 
+/**
+ * \brief Copies all the entries of the read archive to the write archives,
+ * header included
+ *
+ * The image is decoded once, and the write archives get the same entries
+ * without compression.
+ */
+void Image::relayImage() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::relayImage() start");
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	struct archive_entry *entry;
+	int r;
+
+	while((r = archive_read_next_header(this->_archiveIn, &entry))
+			== ARCHIVE_OK) {
+		trns->copyHeader(entry, this->_archivesOut);
+		trns->relayData(this->_archiveIn, this->_archivesOut,
+				archive_entry_size(entry));
+	}
+
+	if(r != ARCHIVE_EOF) {
+		ReadDataException ex;
+		throw ex;
+	}
+
+	log->debug("Image::relayImage() end");
+}
+
+/**
+ * \brief Reads and transfers all the data of a directory tree
+ *
+ * It is what is done with the mount point of each partition.
+ *
+ * \param dir
+ * 		Root of the tree
+ * \param imgRootDir
+ * 		Path into the image file where the data of the tree is written
+ */
+void Image::readTree(const std::string &dir, const std::string &imgRootDir)
+		throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::readTree(dir=>%s, imgRootDir=>%s) start",
+			dir.c_str(), imgRootDir.c_str());
+
+	Clone *dcl = Clone::getInstance();
+	uint64_t memoryLimit =
+			static_cast<uint64_t>(dcl->getMemoryLimit()) * Doclone::MIB;
+	HardLinkResolver resolver(memoryLimit / Doclone::LINK_INDEX_QUOTIENT);
+
+	std::string root = dir;
+	if(root[root.length()-1]!='/') {
+		root.push_back('/');
+	}
+
+	// It is destroyed on return, closing the files it keeps
+	FilePrefetcher prefetcher(memoryLimit > 0
+			? memoryLimit / Doclone::PREFETCH_QUOTIENT
+			: Doclone::PREFETCH_MEMORY);
+	prefetcher.start();
+
+	this->readDataFromDisk(resolver, prefetcher, root, imgRootDir,
+			root.length());
+
+	log->debug("Image::readTree() end");
+}
+
+/**
+ * \brief Reads all the data of a directory, like readPartitionsData() does
+ * with the partitions of a device
+ *
+ * The image has the tree at its root, and the manifest. It works without a
+ * device, as the benchmarks do.
+ *
+ * \param dir
+ * 		Root of the tree
+ */
+void Image::readDirectoryData(const std::string &dir) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::readDirectoryData(dir=>%s) start", dir.c_str());
+
+	this->openManifest();
+	this->readTree(dir, "");
+	this->saveManifest();
+	this->saveRemovedList();
+
+	log->debug("Image::readDirectoryData() end");
+}
+
+/**
+ * \brief Restores an image of readDirectoryData() into a directory, like
+ * writePartitionsData() does into the partitions of a device
+ *
+ * The entries go through writeDataToDisk(), with the directory as the only
+ * root. The write archive must be the one of initDiskWriteArchive().
+ *
+ * \param dir
+ * 		Directory the tree is restored in
+ */
+void Image::writeDirectoryData(const std::string &dir) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::writeDirectoryData(dir=>%s) start", dir.c_str());
+
+	if(this->_chunked && this->_store == 0) {
+		Clone *dcl = Clone::getInstance();
+		this->_store = new ChunkStore(dcl->getRepository());
+	}
+
+	this->_directory = dir;
+	this->writeDataToDisk();
+
+	if(this->_incremental) {
+		this->writeBaseDataToDisk();
+	}
+
+	if(this->_sync) {
+		this->deleteExtraneous(dir, "");
+
+		log->info("Sync: %llu bytes already on the directory, %llu files deleted",
+				static_cast<unsigned long long>(this->_keptBytes),
+				static_cast<unsigned long long>(this->_deletedFiles));
+	}
+
+	log->debug("Image::writeDirectoryData() end");
+}
+
+/**
+ * \brief Gets where each root of the image is restored
+ *
+ * \param [out] roots
+ * 		The path in the image and the path on the disk of each root: the
+ * 		partitions mounted, or the directory of writeDirectoryData()
+ */
+void Image::getRoots(std::vector<std::pair<std::string, std::string> > &roots)
+		throw(Exception) {
+	if(!this->_directory.empty()) {
+		std::string root = this->_directory;
+		if(root[root.length()-1]!='/') {
+			root.push_back('/');
+		}
+
+		roots.push_back(std::make_pair(std::string("/"), root));
+		return;
+	}
+
+	// The partitions are mounted before restoring, and stay so until the end
+	for(unsigned int i = 0; i < this->_disk->getPartitions().size()
+			&& this->_disk->getPartitions().at(i)->getUsedPart() != 0; i++) {
+		Partition *part = this->_disk->getPartitions().at(i);
+
+		if(part->isMounted()) {
+			roots.push_back(std::make_pair(part->getRootDir(),
+					part->getMountPoint()));
+		}
+	}
+}
+
+/**
+ * \brief Creates the temporary file the manifest is written in while
+ * creating an image
+ */
+void Image::openManifest() {
+	Logger *log = Logger::getInstance();
+
+	if(!this->_noData) {
+		this->_manifest = Util::createTempFile("doclone-manifest");
+
+		if(this->_manifest == 0) {
+			log->warn("Can't create the manifest, the image won't be verifiable");
+		}
+	}
+}
+
 /**
  * \brief Reads and transfers all the data of a partition
  *
@@ -720,19 +1225,11 @@ void Image::readPartition(int index) throw(Exception) {
 	Clone *dcl = Clone::getInstance();
 
 	if(!this->_noData) {
-		struct archive_entry_linkresolver *lResolv =
-				archive_entry_linkresolver_new();
-		archive_entry_linkresolver_set_strategy(lResolv, ARCHIVE_FORMAT_TAR);
+		dcl->markStarted(Doclone::OP_READ_DATA, part->getPath());
 
 		part->doMount();
 		try {
-			std::string mountPoint = part->getMountPoint();
-			if(mountPoint[mountPoint.length()-1]!='/') {
-				mountPoint.push_back('/');
-			}
-
-			this->readDataFromDisk(lResolv, mountPoint, part->getRootDir(),
-					mountPoint.length());
+			this->readTree(part->getMountPoint(), part->getRootDir());
 		} catch (const CancelException &ex) {
 			part->doUmount();
 			throw;
@@ -745,16 +1242,6 @@ void Image::readPartition(int index) throw(Exception) {
 		}
 		part->doUmount();
 
-		struct archive_entry *sparse;
-		struct archive_entry *entryLink = 0;
-
-		archive_entry_linkify(lResolv, &entryLink, &sparse);
-		while(entryLink != 0) {
-				archive_entry_linkify(lResolv, &entryLink, &sparse);
-		}
-
-		archive_entry_linkresolver_free(lResolv);
-
 		dcl->markCompleted(Doclone::OP_READ_DATA, part->getPath());
 	}
 
@@ -768,6 +1255,8 @@ void Image::readPartitionsData() throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("Image::readPartitionsData() start");
 
+	this->openManifest();
+
 	for(unsigned int i = 0;i<this->_disk->getPartitions().size(); i++) {
 		try {
 			this->readPartition(i);
@@ -780,6 +1269,16 @@ void Image::readPartitionsData() throw(Exception) {
 		}
 	}
 
+	this->saveManifest();
+	this->saveRemovedList();
+
+	if(this->_store != 0) {
+		log->info("Repository: %llu bytes of new chunks, %llu reused, %llu written",
+				static_cast<unsigned long long>(this->_store->getNewBytes()),
+				static_cast<unsigned long long>(this->_store->getReusedBytes()),
+				static_cast<unsigned long long>(this->_store->getWrittenBytes()));
+	}
+
 	log->debug("Image::readPartitionsData() end");
 }
 
@@ -790,7 +1289,14 @@ void Image::writePartitionsData(const std::string &device) throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("Image::writePartitionsData() start");
 
+	Clone::getInstance()->markStarted(Doclone::OP_WRITE_DATA, device);
+
 	if(!this->_noData) {
+		if(this->_chunked && this->_store == 0) {
+			Clone *dcl = Clone::getInstance();
+			this->_store = new ChunkStore(dcl->getRepository());
+		}
+
 		try {
 			for(unsigned int i = 0;i<this->_disk->getPartitions().size(); i++) {
 				if(this->_disk->getPartitions().at(i)->getMinSize() != 0) {
@@ -806,6 +1312,25 @@ void Image::writePartitionsData(const std::string &device) throw(Exception) {
 
 			this->writeDataToDisk();
 
+			if(this->_incremental) {
+				this->writeBaseDataToDisk();
+			}
+
+			if(this->_sync) {
+				for(unsigned int i = 0;i<this->_disk->getPartitions().size(); i++) {
+					Partition *part = this->_disk->getPartitions().at(i);
+
+					if(part->getMinSize() != 0 && part->isMounted()) {
+						this->deleteExtraneous(part->getMountPoint(),
+								part->getRootDir());
+					}
+				}
+
+				log->info("Sync: %llu bytes already on the device, %llu files deleted",
+						static_cast<unsigned long long>(this->_keptBytes),
+						static_cast<unsigned long long>(this->_deletedFiles));
+			}
+
 		} catch (const Exception &ex) {
 			for(unsigned int i = 0;i<this->_disk->getPartitions().size(); i++) {
 				if(this->_disk->getPartitions().at(i)->getMinSize() != 0) {
@@ -834,14 +1359,695 @@ void Image::writePartitionsData(const std::string &device) throw(Exception) {
 }
 
 /**
- * \brief Reads the partition table and fills the vector of Partition*
+ * \brief Adds a regular file to the manifest of the image being created
  *
- * \param device
- * 		The device which we must read.
+ * \param path
+ * 		Path of the file in the image
+ * \param size
+ * 		Size of the file
+ * \param crc
+ * 		CRC32C of the data of the file
  */
-void Image::readPartitionTable(const std::string &device) throw(Exception) {
+void Image::addToManifest(const std::string &path, uint64_t size,
+		uint32_t crc) throw(Exception) {
+	// Paths with line breaks can't be stored in the manifest
+	if(this->_manifest == 0 || path.find('\n') != std::string::npos) {
+		return;
+	}
+
+	if(fprintf(this->_manifest, "%08x %llu %s\n", crc,
+			static_cast<unsigned long long>(size), path.c_str()) < 0) {
+		WriteDataException ex;
+		throw ex;
+	}
+}
+
+/**
+ * \brief Writes the manifest at the end of the image
+ */
+void Image::saveManifest() throw(Exception) {
 	Logger *log = Logger::getInstance();
-	log->debug("Image::readPartitionTable(device=>%s) start", device.c_str());
+	log->debug("Image::saveManifest() start");
+
+	if(this->_manifest == 0) {
+		log->debug("Image::saveManifest() end");
+		return;
+	}
+
+	this->saveTempFile(this->_manifest, Doclone::MANIFEST_ENTRY);
+
+	fclose(this->_manifest);
+	this->_manifest = 0;
+
+	log->debug("Image::saveManifest() end");
+}
+
+/**
+ * \brief Writes the list of files of the base image that must not be
+ * restored at the end of an incremental image
+ */
+void Image::saveRemovedList() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::saveRemovedList() start");
+
+	if(this->_baseIndex == 0) {
+		log->debug("Image::saveRemovedList() end");
+		return;
+	}
+
+	FILE *removed = Util::createTempFile("doclone-removed");
+	if(removed == 0) {
+		WriteDataException ex;
+		throw ex;
+	}
+
+	try {
+		this->_baseIndex->writeRemoved(removed);
+		this->saveTempFile(removed, Doclone::REMOVED_ENTRY);
+	} catch (const Exception &ex) {
+		fclose(removed);
+		throw;
+	}
+
+	fclose(removed);
+
+	log->debug("Image::saveRemovedList() end");
+}
+
+/**
+ * \brief Reads the list of files of the base image that must not be restored
+ */
+void Image::loadRemovedList() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::loadRemovedList() start");
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	std::string list;
+	trns->archiveToBuf(this->_archiveIn, list);
+
+	size_t start = 0;
+	size_t end;
+	while((end = list.find('\n', start)) != std::string::npos) {
+		this->_removed.insert(list.substr(start, end - start));
+		start = end + 1;
+	}
+
+	log->debug("Image::loadRemovedList() end");
+}
+
+/**
+ * \brief Appends a temporary file at the end of the image
+ *
+ * \param file
+ * 		The temporary file
+ * \param path
+ * 		Path of the file in the image
+ */
+void Image::saveTempFile(FILE *file, const char *path) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::saveTempFile(file=>0x%x, path=>%s) start", file, path);
+
+	off_t size;
+	if(fflush(file) != 0
+			|| (size = ftello(file)) < 0
+			|| lseek(fileno(file), 0, SEEK_SET) < 0) {
+		WriteDataException ex;
+		throw ex;
+	}
+
+	struct archive_entry *tempEntry = newImageEntry(path, size);
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	try {
+		trns->copyHeader(tempEntry, this->_archivesOut);
+		trns->fdToArchive(fileno(file), this->_archivesOut);
+	} catch (const Exception &ex) {
+		archive_entry_free(tempEntry);
+		throw;
+	}
+
+	archive_entry_free(tempEntry);
+
+	log->debug("Image::saveTempFile() end");
+}
+
+/**
+ * \brief Makes the image being created an incremental image of [base]
+ *
+ * It must be called before saving the header of the image.
+ *
+ * \param base
+ * 		Path of a full image of the same device
+ */
+void Image::loadBaseImage(const std::string &base) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::loadBaseImage(base=>%s) start", base.c_str());
+
+	BaseImageIndex *index = new BaseImageIndex();
+
+	try {
+		index->load(base);
+	} catch (const Exception &ex) {
+		delete index;
+		throw;
+	}
+
+	delete this->_baseIndex;
+	this->_baseIndex = index;
+	this->_incremental = true;
+	this->_baseId = index->getBaseId();
+
+	log->debug("Image::loadBaseImage() end");
+}
+
+/**
+ * \brief Makes the files of the image being created be stored in a
+ * repository
+ *
+ * It must be called before saving the header of the image.
+ *
+ * \param dir
+ * 		Directory of the repository, which is created if it doesn't exist
+ */
+void Image::openRepository(const std::string &dir) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::openRepository(dir=>%s) start", dir.c_str());
+
+	ChunkStore *store = new ChunkStore(dir);
+
+	try {
+		store->open();
+	} catch (const Exception &ex) {
+		delete store;
+		throw;
+	}
+
+	delete this->_store;
+	this->_store = store;
+	this->_chunked = true;
+
+	log->debug("Image::openRepository() end");
+}
+
+/**
+ * \brief Writes a file whose data is in the repository
+ *
+ * \param entry
+ * 		The entry of the file, whose data is its chunk list
+ */
+void Image::writeChunkedFile(struct archive_entry *entry) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("Image::writeChunkedFile(entry=>0x%x) start", entry);
+
+	DataTransfer *trns = DataTransfer::getInstance();
+
+	std::string chunkList;
+	trns->archiveToBuf(this->_archiveIn, chunkList);
+
+	std::vector<dcChunkRef> chunks;
+	archive_entry_set_size(entry, ChunkStore::parseList(chunkList, chunks));
+
+	if(this->_sync && this->isOnDisk(entry)) {
+		this->_keptBytes += archive_entry_size(entry);
+
+		log->loopDebug("Image::writeChunkedFile() end");
+		return;
+	}
+
+	trns->copyHeader(entry, this->_archivesOut);
+	this->_store->writeFile(chunkList, this->_archivesOut);
+
+	log->loopDebug("Image::writeChunkedFile() end");
+}
+
+/**
+ * \brief Checks if a regular file of the image is already on the disk
+ *
+ * The file is considered the same if its size, modification time, mode and
+ * owner are equal, like rsync does by default.
+ *
+ * \param entry
+ * 		The entry of the file, with its path on the disk
+ *
+ * \return true if the file doesn't need to be written
+ */
+bool Image::isOnDisk(struct archive_entry *entry) const {
+	if(archive_entry_filetype(entry) != AE_IFREG
+			|| archive_entry_hardlink(entry) != 0) {
+		return false;
+	}
+
+	struct stat filestat;
+	if(lstat(archive_entry_pathname(entry), &filestat) < 0) {
+		return false;
+	}
+
+	return S_ISREG(filestat.st_mode)
+			&& static_cast<int64_t>(filestat.st_size) ==
+					archive_entry_size(entry)
+			&& filestat.st_mtim.tv_sec == archive_entry_mtime(entry)
+			&& filestat.st_mtim.tv_nsec == archive_entry_mtime_nsec(entry)
+			&& filestat.st_mode == archive_entry_mode(entry)
+			&& static_cast<int64_t>(filestat.st_uid) == archive_entry_uid(entry)
+			&& static_cast<int64_t>(filestat.st_gid) == archive_entry_gid(entry);
+}
+
+/**
+ * \brief Writes a changed regular file of the image over the one on the disk
+ *
+ * Only the blocks whose content differs are written, which saves most of
+ * the writes when a big file has changed a little. The owner, mode and times
+ * of the entry are set after the data. Its extended attributes and ACLs are
+ * left as they are on the disk.
+ *
+ * \param entry
+ * 		The entry of the file, with its path on the disk
+ *
+ * \return false if the file can't be patched and must be written from
+ * scratch: it isn't a regular file, or has more hard links
+ */
+bool Image::patchFile(struct archive_entry *entry) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("Image::patchFile(entry=>0x%x) start", entry);
+
+	const char *path = archive_entry_pathname(entry);
+	struct stat filestat;
+
+	if(archive_entry_filetype(entry) != AE_IFREG
+			|| archive_entry_hardlink(entry) != 0
+			|| lstat(path, &filestat) < 0
+			|| !S_ISREG(filestat.st_mode) || filestat.st_nlink != 1) {
+		log->loopDebug("Image::patchFile(retValue=>0) end");
+		return false;
+	}
+
+	int fd = open(path, O_RDWR);
+	if(fd < 0) {
+		log->loopDebug("Image::patchFile(retValue=>0) end");
+		return false;
+	}
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	uint64_t size = archive_entry_size(entry);
+	uint64_t written;
+
+	try {
+		written = trns->patchData(this->_archiveIn, fd, size);
+	} catch (const Exception &ex) {
+		close(fd);
+		throw;
+	}
+
+	struct timespec times[2];
+	if(archive_entry_atime_is_set(entry)) {
+		times[0].tv_sec = archive_entry_atime(entry);
+		times[0].tv_nsec = archive_entry_atime_nsec(entry);
+	} else {
+		times[0].tv_sec = 0;
+		times[0].tv_nsec = UTIME_OMIT;
+	}
+	times[1].tv_sec = archive_entry_mtime(entry);
+	times[1].tv_nsec = archive_entry_mtime_nsec(entry);
+
+	// The owner goes first, changing it clears the setuid bits
+	if(ftruncate(fd, size) < 0
+			|| fchown(fd, archive_entry_uid(entry), archive_entry_gid(entry)) < 0
+			|| fchmod(fd, archive_entry_mode(entry) & 07777) < 0
+			|| futimens(fd, times) < 0) {
+		close(fd);
+		WriteDataException ex;
+		throw ex;
+	}
+
+	close(fd);
+
+	this->_keptBytes += size - written;
+
+	log->loopDebug("Image::patchFile(retValue=>1) end");
+	return true;
+}
+
+/**
+ * \brief Deletes the files of a directory of the disk that aren't in the
+ * image
+ *
+ * \param path
+ * 		Path of the directory on the disk
+ * \param imgPath
+ * 		Path of the directory in the image
+ */
+void Image::deleteExtraneous(const std::string &path,
+		const std::string &imgPath) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("Image::deleteExtraneous(path=>%s, imgPath=>%s) start",
+			path.c_str(), imgPath.c_str());
+
+	DIR *directory;
+	struct dirent *d_file;
+
+	if ((directory = opendir (path.c_str())) == 0) {
+		FileNotFoundException ex(path);
+		throw ex;
+	}
+
+	while ((d_file = readdir (directory)) != 0) {
+		if(!strcmp (".", d_file->d_name) || !strcmp ("..", d_file->d_name)) {
+			continue;
+		}
+
+		std::string abPath = path + "/" + d_file->d_name;
+		std::string relPath = imgPath + "/" + d_file->d_name;
+
+		struct stat filestat;
+		if (lstat (abPath.c_str(), &filestat) < 0) {
+			continue;
+		}
+
+		if(S_ISDIR(filestat.st_mode)) {
+			if(Util::isMountPoint(abPath)) {
+				continue;
+			}
+
+			// Nothing inside a directory that isn't in the image is in it
+			this->deleteExtraneous(abPath, relPath);
+
+			if(this->_synced.count(relPath) == 0) {
+				if(rmdir(abPath.c_str()) < 0) {
+					log->warn("Can't delete %s", abPath.c_str());
+				} else {
+					this->_deletedFiles++;
+				}
+			}
+		} else if(this->_synced.count(relPath) == 0) {
+			if(unlink(abPath.c_str()) < 0) {
+				log->warn("Can't delete %s", abPath.c_str());
+			} else {
+				this->_deletedFiles++;
+			}
+		}
+	}
+
+	closedir (directory);
+
+	log->loopDebug("Image::deleteExtraneous() end");
+}
+
+/**
+ * \brief Writes the unchanged files of the base of an incremental image
+ *
+ * All the partitions have been mounted and the incremental image has been
+ * read to its end before calling it.
+ */
+void Image::writeBaseDataToDisk() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::writeBaseDataToDisk() start");
+
+	Clone *dcl = Clone::getInstance();
+	int fd = Util::openFile(dcl->getBase());
+
+	struct archive *increment = this->_archiveIn;
+	this->_archiveIn = 0;
+
+	try {
+		this->initFdReadArchive(fd);
+
+		if(BaseImageIndex::readHeader(this->_archiveIn) != this->_baseId) {
+			WrongBaseImageException ex;
+			throw ex;
+		}
+
+		this->writeDataToDisk(true);
+	} catch (const Exception &ex) {
+		if(this->_archiveIn != 0) {
+			this->freeReadArchive();
+		}
+		this->_archiveIn = increment;
+		Util::closeFile(fd);
+		throw;
+	}
+
+	this->freeReadArchive();
+	this->_archiveIn = increment;
+	Util::closeFile(fd);
+
+	log->debug("Image::writeBaseDataToDisk() end");
+}
+
+/**
+ * \brief Compares the data of the partitions of a restored device with the
+ * manifest of the image
+ *
+ * The files are read in parallel by a Verifier, while the image is read to
+ * its end, where the manifest is.
+ *
+ * \param device
+ * 		The restored device
+ */
+void Image::verifyPartitionsData(const std::string &device) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::verifyPartitionsData(device=>%s) start", device.c_str());
+
+	Clone::getInstance()->markStarted(Doclone::OP_VERIFY_DATA, device);
+
+	if(!this->_noData) {
+		this->mapTargetPartitions();
+
+		try {
+			for(unsigned int i = 0;i<this->_disk->getPartitions().size(); i++) {
+				if(this->_disk->getPartitions().at(i)->getMinSize() != 0
+						&& !this->_disk->getPartitions().at(i)->getPath().empty()) {
+					try {
+						this->_disk->getPartitions().at(i)->doMount();
+					} catch(WarningException &ex) {
+						//Ignore it, this partition just won't be verified
+					}
+				}
+			}
+
+			this->verifyDataOnDisk();
+
+		} catch (const Exception &ex) {
+			for(unsigned int i = 0;i<this->_disk->getPartitions().size(); i++) {
+				if(this->_disk->getPartitions().at(i)->getMinSize() != 0) {
+					this->_disk->getPartitions().at(i)->doUmount();
+				}
+			}
+			throw;
+		}
+
+		for(unsigned int i = 0;i<this->_disk->getPartitions().size(); i++) {
+			if(this->_disk->getPartitions().at(i)->getMinSize() != 0) {
+				this->_disk->getPartitions().at(i)->doUmount();
+			}
+		}
+	}
+
+	Clone *dcl = Clone::getInstance();
+	dcl->markCompleted(Doclone::OP_VERIFY_DATA, device);
+
+	log->debug("Image::verifyPartitionsData() end");
+}
+
+/**
+ * \brief Gives to the partitions of the image the paths of the partitions of
+ * the device where it was restored
+ *
+ * The partitions are restored in the same order they are in the image.
+ *
+ * \param sameLayout
+ * 		If the device must have a partition with the same filesystem for
+ * 		each partition of the image with data
+ */
+void Image::mapTargetPartitions(bool sameLayout) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::mapTargetPartitions(sameLayout=>%d) start", sameLayout);
+
+	Clone *dcl = Clone::getInstance();
+
+	if(this->_type == Doclone::IMAGE_DISK) {
+		DiskLabel *target = DlFactory::createDiskLabel();
+
+		try {
+			target->readPartitions();
+		} catch (const Exception &ex) {
+			delete target;
+			throw;
+		}
+
+		std::vector<Partition*> &parts = this->_disk->getPartitions();
+		std::vector<Partition*> &targetParts = target->getPartitions();
+
+		for(unsigned int i = 0; i < parts.size(); i++) {
+			if(i >= targetParts.size()
+					|| (sameLayout && parts[i]->getMinSize() != 0
+							&& parts[i]->getFileSystem()->getCode() !=
+								targetParts[i]->getFileSystem()->getCode())) {
+				if(sameLayout) {
+					delete target;
+					SyncLayoutException ex(dcl->getDevice());
+					throw ex;
+				}
+
+				break;
+			}
+
+			parts[i]->setPath(targetParts[i]->getPath());
+			parts[i]->setPartNum(targetParts[i]->getPartNum());
+		}
+
+		delete target;
+	} else if(sameLayout) {
+		Partition target;
+		target.initFromPath(dcl->getDevice());
+
+		Partition *part = this->_disk->getPartitions()[0];
+		if(part->getMinSize() != 0 && part->getFileSystem()->getCode() !=
+				target.getFileSystem()->getCode()) {
+			SyncLayoutException ex(dcl->getDevice());
+			throw ex;
+		}
+	}
+
+	log->debug("Image::mapTargetPartitions() end");
+}
+
+/**
+ * \brief Reads the image until the manifest and verifies all the files in it
+ *
+ * All the partitions have been mounted before calling it.
+ */
+void Image::verifyDataOnDisk() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::verifyDataOnDisk() start");
+
+	// Where the root folder of each partition in the image is mounted
+	std::vector<std::pair<std::string, std::string> > roots;
+	for(unsigned int i = 0;i<this->_disk->getPartitions().size(); i++) {
+		Partition *part = this->_disk->getPartitions().at(i);
+
+		if(part->getUsedPart() != 0 && part->isMounted()) {
+			roots.push_back(std::make_pair(part->getRootDir(),
+					part->getMountPoint()));
+		}
+	}
+
+	Verifier verifier;
+	verifier.start();
+
+	struct archive_entry *entry;
+	bool found = false;
+	int r;
+
+	while((r = archive_read_next_header(this->_archiveIn, &entry))
+			== ARCHIVE_OK) {
+		if(strcmp(archive_entry_pathname(entry), Doclone::MANIFEST_ENTRY) == 0) {
+			found = true;
+			this->readManifest(verifier, roots);
+		}
+	}
+
+	verifier.finish();
+
+	if(r != ARCHIVE_EOF) {
+		ReadDataException ex;
+		throw ex;
+	}
+
+	if(!found) {
+		NoManifestException ex;
+		throw ex;
+	}
+
+	log->info("%llu files verified, %llu don't match",
+			static_cast<unsigned long long>(verifier.getVerifiedFiles()),
+			static_cast<unsigned long long>(verifier.getMismatches()));
+
+	if(verifier.getMismatches() > 0) {
+		VerifyDataException ex;
+		throw ex;
+	}
+
+	log->debug("Image::verifyDataOnDisk() end");
+}
+
+/**
+ * \brief Reads the manifest from the image and queues its files in the
+ * verifier
+ *
+ * \param verifier
+ * 		The started verifier
+ * \param roots
+ * 		Root folder in the image and mount point of each mounted partition
+ */
+void Image::readManifest(Verifier &verifier,
+		const std::vector<std::pair<std::string, std::string> > &roots)
+		throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::readManifest() start");
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	dcBuffSize size = trns->getBufferSize(Doclone::BUFFER_ARCHIVE);
+	char *buf = trns->acquireBuffer(size);
+
+	std::string pending;
+	ssize_t nbytes;
+
+	while((nbytes = archive_read_data(this->_archiveIn, buf, size)) > 0) {
+		pending.append(buf, nbytes);
+
+		size_t start = 0;
+		size_t end;
+		while((end = pending.find('\n', start)) != std::string::npos) {
+			std::string line = pending.substr(start, end - start);
+			start = end + 1;
+
+			unsigned int crc;
+			unsigned long long fileSize;
+			int pathPos = 0;
+			if(sscanf(line.c_str(), "%8x %llu %n", &crc, &fileSize,
+					&pathPos) < 2 || pathPos == 0) {
+				log->warn("Invalid line in the manifest: %s", line.c_str());
+				continue;
+			}
+
+			std::string path = line.substr(pathPos);
+
+			std::vector<std::pair<std::string, std::string> >::const_iterator it;
+			for(it = roots.begin(); it != roots.end(); ++it) {
+				if(path.compare(0, it->first.length(), it->first) == 0) {
+					dcVerifyFile file;
+					file.path = path.replace(0, it->first.length(), it->second);
+					file.size = fileSize;
+					file.crc = crc;
+
+					verifier.addFile(file);
+					break;
+				}
+			}
+		}
+
+		pending.erase(0, start);
+	}
+
+	trns->releaseBuffer(buf);
+
+	if(nbytes < 0) {
+		ReadDataException ex;
+		throw ex;
+	}
+
+	log->debug("Image::readManifest() end");
+}
+
+/**
+ * \brief Reads the partition table and fills the vector of Partition*
+ *
+ * \param device
+ * 		The device which we must read.
+ */
+void Image::readPartitionTable(const std::string &device) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Image::readPartitionTable(device=>%s) start", device.c_str());
 
 	this->_disk = DlFactory::createDiskLabel();
 	if(this->_type == Doclone::IMAGE_DISK) {
@@ -868,6 +2074,14 @@ void Image::writePartitionTable(const std::string &device) throw(Exception) {
 
 	Clone *dcl = Clone::getInstance();
 
+	// In sync mode, the partitions and filesystems of the device are kept
+	if(this->_sync) {
+		this->mapTargetPartitions(true);
+
+		log->debug("Image::writePartitionTable() end");
+		return;
+	}
+
 	if(this->_type == Doclone::IMAGE_DISK) {
 
 		this->_disk->writePartitions();
@@ -884,6 +2098,7 @@ void Image::writePartitionTable(const std::string &device) throw(Exception) {
 			target << device << ", #" << (i+1);
 
 			try {
+				dcl->markStarted(Doclone::OP_FORMAT_PARTITION, target.str());
 				part->format();
 				dcl->markCompleted(Doclone::OP_FORMAT_PARTITION,
 						target.str());
@@ -897,6 +2112,7 @@ void Image::writePartitionTable(const std::string &device) throw(Exception) {
 			}
 
 			try {
+				dcl->markStarted(Doclone::OP_WRITE_PARTITION_FLAGS, target.str());
 				part->writeFlags();
 				dcl->markCompleted(Doclone::OP_WRITE_PARTITION_FLAGS,
 						target.str());
@@ -910,6 +2126,7 @@ void Image::writePartitionTable(const std::string &device) throw(Exception) {
 
 
 			try {
+				dcl->markStarted(Doclone::OP_WRITE_FS_LABEL, target.str());
 				part->writeLabel();
 				dcl->markCompleted(Doclone::OP_WRITE_FS_LABEL,
 						target.str());
@@ -922,6 +2139,7 @@ void Image::writePartitionTable(const std::string &device) throw(Exception) {
 			}
 
 			try {
+				dcl->markStarted(Doclone::OP_WRITE_FS_UUID, target.str());
 				part->writeUUID();
 				dcl->markCompleted(Doclone::OP_WRITE_FS_UUID,
 						target.str());
@@ -942,6 +2160,7 @@ void Image::writePartitionTable(const std::string &device) throw(Exception) {
 		target << device;
 
 		try {
+			dcl->markStarted(Doclone::OP_FORMAT_PARTITION, target.str());
 			this->_disk->getPartitions()[0]->format();
 			dcl->markCompleted(Doclone::OP_FORMAT_PARTITION, target.str());
 		} catch (const WarningException &ex) {
@@ -954,6 +2173,7 @@ void Image::writePartitionTable(const std::string &device) throw(Exception) {
 		}
 
 		try {
+			dcl->markStarted(Doclone::OP_WRITE_PARTITION_FLAGS, target.str());
 			this->_disk->getPartitions()[0]->writeFlags();
 			dcl->markCompleted(Doclone::OP_WRITE_PARTITION_FLAGS,
 					target.str());
@@ -966,6 +2186,7 @@ void Image::writePartitionTable(const std::string &device) throw(Exception) {
 		}
 
 		try {
+			dcl->markStarted(Doclone::OP_WRITE_FS_LABEL, target.str());
 			this->_disk->getPartitions()[0]->writeLabel();
 			dcl->markCompleted(Doclone::OP_WRITE_FS_LABEL, target.str());
 		} catch (const WarningException &ex) {
@@ -977,6 +2198,7 @@ void Image::writePartitionTable(const std::string &device) throw(Exception) {
 		}
 
 		try {
+			dcl->markStarted(Doclone::OP_WRITE_FS_UUID, target.str());
 			this->_disk->getPartitions()[0]->writeUUID();
 			dcl->markCompleted(Doclone::OP_WRITE_FS_UUID, target.str());
 		} catch (const WarningException &ex) {
@@ -1064,6 +2286,19 @@ bool Image::canRestoreCheck(const std::string &device) const throw(Exception) {
 	bool retValue = true;
 
 	try {
+		Clone *dcl = Clone::getInstance();
+		if(this->_incremental && dcl->getBase().empty()) {
+			NoBaseImageException ex;
+			ex.logMsg();
+			throw ex;
+		}
+
+		if(this->_chunked && dcl->getRepository().empty()) {
+			NoRepositoryException ex;
+			ex.logMsg();
+			throw ex;
+		}
+
 		switch(this->_type) {
 			case Doclone::IMAGE_DISK: {
 				if(!Util::isDisk(device)) {
@@ -1124,7 +2359,7 @@ bool Image::canRestoreCheck(const std::string &device) const throw(Exception) {
 			}
 
 			Filesystem *fs = part->getFileSystem();
-			if(fs->getCode() != Doclone::FS_NOFS) {
+			if(fs->getCode() != Doclone::FS_NOFS && !this->_sync) {
 				bool formatSupport = fs->getFormatSupport();
 				bool labelSupport = fs->getLabelSupport();
 				bool uuidSupport = fs->getUUIDSupport();
@@ -1212,7 +2447,10 @@ void Image::initRestoreOperations(const std::string &device) const throw(Excepti
 	uint8_t numPartitions = this->_disk->getPartitions().size();
 	std::string target = device;
 
-	if(this->_type == Doclone::IMAGE_DISK) {
+	// In sync mode, only the data is written
+	if(this->_sync) {
+		numPartitions = 0;
+	} else if(this->_type == Doclone::IMAGE_DISK) {
 		Operation *diskLabelOp = new Operation(Doclone::OP_MAKE_DISKLABEL,
 				target);
 		dcl->addOperation(diskLabelOp);
@@ -1273,6 +2511,14 @@ uint64_t Image::getSize() const {
 	return this->_size;
 }
 
+bool Image::isIncremental() const {
+	return this->_incremental;
+}
+
+bool Image::isChunked() const {
+	return this->_chunked;
+}
+
 Doclone::imageType Image::getType() const {
 	return this->_type;
 }
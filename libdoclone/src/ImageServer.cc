@@ -0,0 +1,614 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <doclone/ImageServer.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <endian.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+
+#include <doclone/Clone.h>
+#include <doclone/Logger.h>
+#include <doclone/Operation.h>
+#include <doclone/exception/ConnectionException.h>
+
+namespace Doclone {
+
+/**
+ * \brief Initializes the attributes
+ */
+ImageServer::ImageServer()
+	: _nodesNum(0), _listenFd(-1), _epollFd(-1), _clients(), _sizes(),
+	  _stats() {
+	Clone *dcl = Clone::getInstance();
+
+	this->_nodesNum = dcl->getNodesNumber();
+}
+
+/**
+ * \brief Disconnects the remaining clients and stops listening
+ */
+ImageServer::~ImageServer() {
+	while(!this->_clients.empty()) {
+		this->dropClient(this->_clients.begin()->second, false);
+	}
+
+	if(this->_epollFd >= 0) {
+		close(this->_epollFd);
+	}
+
+	if(this->_listenFd >= 0) {
+		close(this->_listenFd);
+	}
+}
+
+/**
+ * \brief Serves the images of the library to the clients that ask for them
+ *
+ * Returns when the number of nodes of the job have been attended, or never
+ * if it is 0.
+ */
+void ImageServer::serve() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("ImageServer::serve() start");
+
+	Clone *dcl = Clone::getInstance();
+
+	Operation *waitOp = new Operation(
+			Doclone::OP_WAIT_CLIENTS, "");
+	dcl->addOperation(waitOp);
+	dcl->markStarted(Doclone::OP_WAIT_CLIENTS, "");
+
+	/*
+	 * A client that goes away makes sendfile() raise SIGPIPE, whose handler
+	 * would stop the server. It's blocked, and the error is handled for that
+	 * client only.
+	 */
+	sigset_t pipeSet;
+	sigset_t oldSet;
+	sigemptyset(&pipeSet);
+	sigaddset(&pipeSet, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipeSet, &oldSet);
+
+	try {
+		this->listenClients();
+
+		this->_stats.start = time(0);
+		time_t lastStats = this->_stats.start;
+
+		while(this->_nodesNum == 0
+				|| this->_stats.servedClients + this->_stats.failedClients
+					< this->_nodesNum) {
+			epoll_event events[Doclone::SERVER_MAX_EVENTS];
+			int n = epoll_wait(this->_epollFd, events,
+					Doclone::SERVER_MAX_EVENTS,
+					Doclone::SERVER_STATS_INTERVAL * 1000);
+
+			if(n < 0 && errno != EINTR) {
+				ConnectionException ex;
+				throw ex;
+			}
+
+			for(int i = 0; i < n; i++) {
+				if(events[i].data.fd == this->_listenFd) {
+					this->acceptClients();
+					continue;
+				}
+
+				std::map<int, dcServedClient *>::iterator it =
+						this->_clients.find(events[i].data.fd);
+				if(it != this->_clients.end()) {
+					this->attendClient(it->second, events[i].events);
+				}
+			}
+
+			if(time(0) - lastStats >= Doclone::SERVER_STATS_INTERVAL) {
+				this->logStats();
+				lastStats = time(0);
+			}
+		}
+	} catch(const Exception &ex) {
+		pthread_sigmask(SIG_SETMASK, &oldSet, 0);
+		throw;
+	}
+
+	// Discard the SIGPIPE of the clients that went away
+	sigset_t pending;
+	sigpending(&pending);
+	if(sigismember(&pending, SIGPIPE)) {
+		int sig;
+		sigwait(&pipeSet, &sig);
+	}
+	pthread_sigmask(SIG_SETMASK, &oldSet, 0);
+
+	this->logStats();
+
+	dcl->markCompleted(Doclone::OP_WAIT_CLIENTS, "");
+
+	log->debug("ImageServer::serve() end");
+}
+
+const dcServerStats &ImageServer::getStats() const {
+	return this->_stats;
+}
+
+/**
+ * \brief Creates the listening socket and the epoll instance
+ */
+void ImageServer::listenClients() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("ImageServer::listenClients() start");
+
+	sockaddr_in host_server = {};
+	host_server.sin_family = AF_INET;
+	host_server.sin_port = htons (Doclone::PORT_SERVE);
+	host_server.sin_addr.s_addr = INADDR_ANY;
+
+	if ((this->_listenFd = socket (AF_INET,
+			SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+		ConnectionException ex;
+		throw ex;
+	}
+
+	// Connect even in TIME_WAIT state
+	int iSetOption = 1;
+	setsockopt(this->_listenFd, SOL_SOCKET, SO_REUSEADDR,
+			&iSetOption, sizeof(iSetOption));
+
+	if ((bind (this->_listenFd, reinterpret_cast<sockaddr*>(&host_server),
+			sizeof(host_server))) < 0) {
+		ConnectionException ex;
+		throw ex;
+	}
+
+	if ((listen (this->_listenFd, SOMAXCONN)) < 0) {
+		ConnectionException ex;
+		throw ex;
+	}
+
+	if ((this->_epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		ConnectionException ex;
+		throw ex;
+	}
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = this->_listenFd;
+	if (epoll_ctl(this->_epollFd, EPOLL_CTL_ADD, this->_listenFd,
+			&event) < 0) {
+		ConnectionException ex;
+		throw ex;
+	}
+
+	log->info("Serving the images of %s", this->_image.c_str());
+
+	log->debug("ImageServer::listenClients() end");
+}
+
+/**
+ * \brief Accepts all the pending connections
+ */
+void ImageServer::acceptClients() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("ImageServer::acceptClients() start");
+
+	Clone *dcl = Clone::getInstance();
+
+	while(true) {
+		sockaddr_in host_client;
+		socklen_t size = sizeof(host_client);
+
+		int fd = accept4(this->_listenFd,
+				reinterpret_cast<sockaddr*>(&host_client), &size,
+				SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+		if(fd < 0) {
+			// EAGAIN when there are no more, or an error of that client
+			break;
+		}
+
+		dcServedClient *client = new dcServedClient();
+		client->fd = fd;
+		client->address = inet_ntoa (host_client.sin_addr);
+		client->state = Doclone::CLIENT_REQUEST;
+		client->requestLength = 0;
+		client->responseSent = 0;
+		client->imageFd = -1;
+		client->fileSize = 0;
+		client->offset = 0;
+		client->start = time(0);
+
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.fd = fd;
+		if (epoll_ctl(this->_epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+			close(fd);
+			delete client;
+
+			ConnectionException ex;
+			throw ex;
+		}
+
+		this->_clients[fd] = client;
+		this->_stats.activeClients++;
+
+		// Notify the views
+		dcl->triggerEvent(Doclone::EVT_NEW_CONNECION, client->address);
+	}
+
+	log->loopDebug("ImageServer::acceptClients() end");
+}
+
+/**
+ * \brief Advances the connection of a client as far as its socket allows
+ *
+ * \param client
+ * 		The client
+ * \param events
+ * 		The epoll events of its socket
+ */
+void ImageServer::attendClient(dcServedClient *client, uint32_t events)
+		throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("ImageServer::attendClient(fd=>%d) start", client->fd);
+
+	bool ok = !(events & EPOLLERR);
+
+	if(ok && client->state == Doclone::CLIENT_REQUEST) {
+		ok = this->readRequest(client);
+
+		if(ok && client->state == Doclone::CLIENT_RESPONSE) {
+			this->watchClient(client, EPOLLOUT);
+		}
+	}
+
+	// The response usually fits in the socket, so it's sent right now
+	if(ok && client->state == Doclone::CLIENT_RESPONSE) {
+		ok = this->sendResponse(client);
+	}
+
+	if(ok && client->state == Doclone::CLIENT_DATA) {
+		ok = this->sendImage(client);
+	}
+
+	if(!ok) {
+		this->dropClient(client, false);
+	} else if(client->state == Doclone::CLIENT_DATA
+			&& client->offset == client->fileSize) {
+		this->dropClient(client, true);
+	}
+
+	log->loopDebug("ImageServer::attendClient() end");
+}
+
+/**
+ * \brief Reads the available bytes of the request of a client
+ *
+ * When the request is complete, the image is opened and the client goes to
+ * the CLIENT_RESPONSE state.
+ *
+ * \return false if the client must be dropped
+ */
+bool ImageServer::readRequest(dcServedClient *client) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("ImageServer::readRequest(fd=>%d) start", client->fd);
+
+	const size_t header = sizeof(dcCommand) + sizeof(uint16_t);
+	size_t needed = header;
+
+	while(client->requestLength < needed) {
+		ssize_t r = recv(client->fd, client->request + client->requestLength,
+				needed - client->requestLength, 0);
+
+		if(r < 0 && errno == EINTR) {
+			continue;
+		} else if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			log->loopDebug("ImageServer::readRequest() end");
+			return true;
+		} else if(r <= 0) {
+			log->loopDebug("ImageServer::readRequest() end");
+			return false;
+		}
+
+		client->requestLength += r;
+
+		// Other kinds of clients, like the ones of Unicast, are not served
+		dcCommand command = client->request[0];
+		if(!(command & Doclone::C_RECEIVER_OK)
+				|| !(command & Doclone::C_IMAGE_REQUEST)) {
+			log->loopDebug("ImageServer::readRequest() end");
+			return false;
+		}
+
+		if(client->requestLength >= header) {
+			uint16_t length;
+			memcpy(&length, client->request + sizeof(dcCommand),
+					sizeof(length));
+			length = be16toh(length);
+
+			if(length > Doclone::MAX_IMAGE_NAME) {
+				log->loopDebug("ImageServer::readRequest() end");
+				return false;
+			}
+
+			needed = header + length;
+		}
+	}
+
+	client->image.assign(client->request + header, needed - header);
+	this->openImage(client);
+	client->state = Doclone::CLIENT_RESPONSE;
+
+	log->loopDebug("ImageServer::readRequest() end");
+	return true;
+}
+
+/**
+ * \brief Opens the image requested by a client, and prepares the response
+ *
+ * Only the regular files just inside the library can be requested.
+ *
+ * \return false if the image can't be served
+ */
+bool ImageServer::openImage(dcServedClient *client) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("ImageServer::openImage(image=>%s) start",
+			client->image.c_str());
+
+	const std::string &name = client->image;
+	uint64_t size = 0;
+
+	if(!name.empty() && name[0] != '.'
+			&& name.find('/') == std::string::npos) {
+		std::string path = this->_image + "/" + name;
+		client->imageFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	}
+
+	struct stat st;
+	if(client->imageFd >= 0
+			&& (fstat(client->imageFd, &st) < 0 || !S_ISREG(st.st_mode))) {
+		close(client->imageFd);
+		client->imageFd = -1;
+	}
+
+	if(client->imageFd >= 0) {
+		std::map<std::string, std::pair<time_t, uint64_t> >::iterator it =
+				this->_sizes.find(name);
+
+		if(it != this->_sizes.end() && it->second.first == st.st_mtime) {
+			size = it->second.second;
+		} else {
+			try {
+				size = this->getImageSize(client->imageFd);
+				this->_sizes[name] = std::make_pair(st.st_mtime, size);
+			} catch(const Exception &ex) {
+				close(client->imageFd);
+				client->imageFd = -1;
+			}
+		}
+	}
+
+	dcCommand response = 0;
+	if(client->imageFd >= 0) {
+		response = Doclone::C_SERVER_OK;
+		client->fileSize = st.st_size;
+	} else {
+		log->info("Image %s requested by %s can't be served", name.c_str(),
+				client->address.c_str());
+	}
+
+	/*
+	 * The checksums are not offered, the image goes from the file to the
+	 * socket without passing through the server
+	 */
+	uint64_t tmpSize = htobe64(size);
+	memcpy(client->response, &response, sizeof(response));
+	memcpy(client->response + sizeof(response), &tmpSize, sizeof(tmpSize));
+
+	bool retVal = client->imageFd >= 0;
+	log->debug("ImageServer::openImage(retVal=>%d) end", retVal);
+	return retVal;
+}
+
+/**
+ * \brief Sends the remaining bytes of the response to a client
+ *
+ * When all of them are sent, the client goes to the CLIENT_DATA state.
+ *
+ * \return false if the client must be dropped
+ */
+bool ImageServer::sendResponse(dcServedClient *client) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("ImageServer::sendResponse(fd=>%d) start", client->fd);
+
+	while(client->responseSent < sizeof(client->response)) {
+		ssize_t r = ::send(client->fd, client->response + client->responseSent,
+				sizeof(client->response) - client->responseSent,
+				MSG_NOSIGNAL);
+
+		if(r < 0 && errno == EINTR) {
+			continue;
+		} else if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			log->loopDebug("ImageServer::sendResponse() end");
+			return true;
+		} else if(r < 0) {
+			log->loopDebug("ImageServer::sendResponse() end");
+			return false;
+		}
+
+		client->responseSent += r;
+	}
+
+	// The client has been told that its image can't be served
+	if(client->imageFd < 0) {
+		log->loopDebug("ImageServer::sendResponse() end");
+		return false;
+	}
+
+	client->state = Doclone::CLIENT_DATA;
+
+	log->loopDebug("ImageServer::sendResponse() end");
+	return true;
+}
+
+/**
+ * \brief Sends a client as much of its image as its socket allows, up to
+ * SERVER_SENDFILE_CHUNK bytes
+ *
+ * \return false if the client must be dropped
+ */
+bool ImageServer::sendImage(dcServedClient *client) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("ImageServer::sendImage(fd=>%d) start", client->fd);
+
+	size_t sent = 0;
+
+	while(client->offset < client->fileSize
+			&& sent < Doclone::SERVER_SENDFILE_CHUNK) {
+		size_t count = Doclone::SERVER_SENDFILE_CHUNK - sent;
+		if(static_cast<off_t>(count) > client->fileSize - client->offset) {
+			count = client->fileSize - client->offset;
+		}
+
+		ssize_t r = sendfile(client->fd, client->imageFd, &client->offset,
+				count);
+
+		if(r < 0 && errno == EINTR) {
+			continue;
+		} else if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		} else if(r <= 0) {
+			// The image has been truncated, or the client went away
+			log->loopDebug("ImageServer::sendImage() end");
+			return false;
+		}
+
+		sent += r;
+		this->_stats.sentBytes += r;
+	}
+
+	log->loopDebug("ImageServer::sendImage() end");
+	return true;
+}
+
+/**
+ * \brief Changes the epoll events a client is waiting for
+ */
+void ImageServer::watchClient(dcServedClient *client, uint32_t events)
+		throw(Exception) {
+	epoll_event event = {};
+	event.events = events;
+	event.data.fd = client->fd;
+
+	if (epoll_ctl(this->_epollFd, EPOLL_CTL_MOD, client->fd, &event) < 0) {
+		ConnectionException ex;
+		throw ex;
+	}
+}
+
+/**
+ * \brief Closes the connection of a client
+ *
+ * \param client
+ * 		The client, which is freed
+ * \param served
+ * 		Whether the client got its whole image
+ */
+void ImageServer::dropClient(dcServedClient *client, bool served) {
+	Logger *log = Logger::getInstance();
+	log->debug("ImageServer::dropClient(fd=>%d, served=>%d) start",
+			client->fd, served);
+
+	time_t elapsed = time(0) - client->start;
+	if(elapsed == 0) {
+		elapsed = 1;
+	}
+
+	if(served) {
+		this->_stats.servedClients++;
+		log->info("Image %s sent to %s: %llu bytes in %ld s, %llu bytes/s",
+				client->image.c_str(), client->address.c_str(),
+				static_cast<unsigned long long>(client->offset),
+				static_cast<long>(elapsed),
+				static_cast<unsigned long long>(client->offset / elapsed));
+	} else {
+		this->_stats.failedClients++;
+		log->info("Connection of %s closed after %llu bytes",
+				client->address.c_str(),
+				static_cast<unsigned long long>(client->offset));
+	}
+
+	epoll_ctl(this->_epollFd, EPOLL_CTL_DEL, client->fd, 0);
+	close(client->fd);
+
+	if(client->imageFd >= 0) {
+		close(client->imageFd);
+	}
+
+	this->_clients.erase(client->fd);
+	this->_stats.activeClients--;
+	delete client;
+
+	log->debug("ImageServer::dropClient() end");
+}
+
+/**
+ * \brief Logs the progress of each client and the throughput of the server
+ */
+void ImageServer::logStats() const {
+	Logger *log = Logger::getInstance();
+
+	std::map<int, dcServedClient *>::const_iterator it;
+	for(it = this->_clients.begin(); it != this->_clients.end(); ++it) {
+		const dcServedClient *client = it->second;
+
+		if(client->state == Doclone::CLIENT_DATA && client->fileSize > 0) {
+			log->info("%s: %s, %llu of %llu bytes (%d%%)",
+					client->address.c_str(), client->image.c_str(),
+					static_cast<unsigned long long>(client->offset),
+					static_cast<unsigned long long>(client->fileSize),
+					static_cast<int>(client->offset * 100 / client->fileSize));
+		}
+	}
+
+	time_t elapsed = time(0) - this->_stats.start;
+	if(elapsed == 0) {
+		elapsed = 1;
+	}
+
+	log->info("%u clients active, %llu served, %llu failed, "
+			"%llu bytes sent, %llu bytes/s",
+			this->_stats.activeClients,
+			static_cast<unsigned long long>(this->_stats.servedClients),
+			static_cast<unsigned long long>(this->_stats.failedClients),
+			static_cast<unsigned long long>(this->_stats.sentBytes),
+			static_cast<unsigned long long>(this->_stats.sentBytes / elapsed));
+}
+
+}
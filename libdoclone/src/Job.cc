@@ -0,0 +1,133 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <doclone/Job.h>
+
+#include <doclone/Clone.h>
+#include <doclone/DataTransfer.h>
+#include <doclone/PartedDevice.h>
+#include <doclone/Stats.h>
+#include <doclone/Tracer.h>
+
+namespace Doclone {
+
+/// Key of the job bound to each thread
+static pthread_key_t jobKey;
+
+/// Creates jobKey only once
+static pthread_once_t jobKeyOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * \brief Creates the objects of the job
+ */
+Job::Job(): _clone(0), _transfer(0), _partedDevice(0), _stats(0),
+		_tracer(0) {
+	this->_clone = new Clone();
+	this->_transfer = new DataTransfer();
+	this->_partedDevice = new PartedDevice();
+	this->_stats = new Stats(this->_transfer);
+	this->_tracer = new Tracer(this->_stats);
+}
+
+/**
+ * \brief Destroys the objects of the job
+ *
+ * The job must not be bound to any thread.
+ */
+Job::~Job() {
+	delete this->_tracer;
+	delete this->_stats;
+	delete this->_partedDevice;
+	delete this->_transfer;
+	delete this->_clone;
+}
+
+/**
+ * \brief Gets the job bound to the calling thread
+ *
+ * \return The job, or the default one if the thread has none
+ */
+Job *Job::getCurrent() {
+	pthread_once(&jobKeyOnce, Job::createKey);
+
+	Job *job = static_cast<Job *>(pthread_getspecific(jobKey));
+
+	return job != 0 ? job : Job::getDefault();
+}
+
+/**
+ * \brief Binds the job to the calling thread
+ */
+void Job::bind() {
+	pthread_once(&jobKeyOnce, Job::createKey);
+
+	pthread_setspecific(jobKey, this);
+}
+
+/**
+ * \brief Unbinds the job of the calling thread, which gets the default one
+ */
+void Job::unbind() {
+	pthread_once(&jobKeyOnce, Job::createKey);
+
+	pthread_setspecific(jobKey, 0);
+}
+
+Clone *Job::getClone() const {
+	return this->_clone;
+}
+
+DataTransfer *Job::getDataTransfer() const {
+	return this->_transfer;
+}
+
+PartedDevice *Job::getPartedDevice() const {
+	return this->_partedDevice;
+}
+
+Stats *Job::getStats() const {
+	return this->_stats;
+}
+
+Tracer *Job::getTracer() const {
+	return this->_tracer;
+}
+
+/**
+ * \brief Gets the job of the threads that have none bound
+ */
+Job *Job::getDefault() {
+	static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+	pthread_mutex_lock(&mutex);
+
+	static Job instance;
+
+	pthread_mutex_unlock(&mutex);
+
+	return &instance;
+}
+
+/**
+ * \brief Creates the key of the job bound to each thread
+ */
+void Job::createKey() {
+	pthread_key_create(&jobKey, 0);
+}
+
+}
@@ -34,6 +34,8 @@
 #include <doclone/Image.h>
 #include <doclone/DiskLabel.h>
 #include <doclone/DlFactory.h>
+#include <doclone/Stats.h>
+#include <doclone/Stripes.h>
 #include <doclone/exception/Exception.h>
 #include <doclone/exception/CancelException.h>
 #include <doclone/exception/ConnectionException.h>
@@ -51,7 +53,7 @@ namespace Doclone {
 /**
  * \brief Initializes attributes
  */
-Link::Link(): _fdin(), _fdout(), _dstIP() {
+Link::Link(): _fdin(), _fdout(), _stripesIn(0), _stripesOut(0), _dstIP() {
 	Clone *dcl = Clone::getInstance();
 
 	unsigned int nodes = dcl->getNodesNumber();
@@ -72,9 +74,14 @@ Link::Link(): _fdin(), _fdout(), _dstIP() {
  * This function is executed in each link and communicates with the function
  * netScan of the server.
  *
+ * \param [out] checksums
+ * 		Whether the data of the chain will be checksummed
+ * \param [out] stripes
+ * 		Whether the data of the chain will be striped
+ *
  * \return The IP of the next link in integer format
  */
-int Link::answer() const throw(Exception) {
+int Link::answer(bool &checksums, bool &stripes) const throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("Link::answer() start");
 
@@ -129,7 +136,9 @@ int Link::answer() const throw(Exception) {
 	// Leaving the broadcast group
 	setsockopt (sock_udp, IPPROTO_IP, IP_DROP_MEMBERSHIP, &mReq, sizeof(mReq));
 
-	dcCommand response = Doclone::C_LINK_CLIENT_OK;
+	// Support checksums and stripes only if the sender does
+	dcCommand response = Doclone::C_LINK_CLIENT_OK
+			| (srvRequest & (Doclone::C_CHECKSUMS | Doclone::C_STRIPES));
 	if ((sendto (sock_udp, &response, sizeof(response), 0,
 			reinterpret_cast<sockaddr*>(&udp), addrlen)) < 0) {
 		ConnectionException ex;
@@ -146,6 +155,8 @@ int Link::answer() const throw(Exception) {
 		}
 
 		if(srvCommand & Doclone::C_NEXT_LINK_IP) {
+			checksums = (srvCommand & Doclone::C_CHECKSUMS);
+			stripes = (srvCommand & Doclone::C_STRIPES);
 			break;
 		}
 	}
@@ -172,9 +183,16 @@ int Link::answer() const throw(Exception) {
  *
  * This function communicates with the function answer of the links.
  *
+ * \param [out] checksums
+ * 		Whether the data of the chain will be checksummed. Only if all the
+ * 		links support it
+ * \param [out] stripes
+ * 		Whether the data of the chain will be striped. Only if the job sets
+ * 		many streams and all the links support it
+ *
  * \return The IP address of the first link in the chain.
  */
-int Link::netScan() const throw(Exception) {
+int Link::netScan(bool &checksums, bool &stripes) const throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("Link::netScan() start");
 
@@ -200,7 +218,10 @@ int Link::netScan() const throw(Exception) {
 		setsockopt(sock_udp, IPPROTO_IP, IP_MULTICAST_IF, (char *)&localInterface, sizeof(localInterface));
 	}
 
-	dcCommand request = Doclone::C_LINK_SERVER_OK;
+	dcCommand request = Doclone::C_LINK_SERVER_OK | Doclone::C_CHECKSUMS;
+	if(Stripes::getStreams() > 1) {
+		request |= Doclone::C_STRIPES;
+	}
 	if ((sendto (sock_udp, &request, sizeof(request), 0,
 			reinterpret_cast<sockaddr*>(&udp), addrlen)) < 0) {
 		ConnectionException ex;
@@ -210,6 +231,9 @@ int Link::netScan() const throw(Exception) {
 	FD_ZERO (&readSet);
 	FD_SET (sock_udp, &readSet);
 
+	checksums = true;
+	stripes = (request & Doclone::C_STRIPES);
+
 	unsigned int i = 0;
 	while (select (sock_udp + 1, &readSet, 0, 0, &timeout) > 0) {
 		if(FD_ISSET(sock_udp, &readSet)) {
@@ -227,6 +251,9 @@ int Link::netScan() const throw(Exception) {
 					continue;
 				}
 
+				checksums = checksums && (response & Doclone::C_CHECKSUMS);
+				stripes = stripes && (response & Doclone::C_STRIPES);
+
 				links[i] = tmpSock.sin_addr.s_addr;
 			}
 			else {
@@ -247,6 +274,12 @@ int Link::netScan() const throw(Exception) {
 		uint32_t next_link = htonl(links[j + 1]);
 
 		dcCommand command = Doclone::C_NEXT_LINK_IP;
+		if(checksums) {
+			command |= Doclone::C_CHECKSUMS;
+		}
+		if(stripes) {
+			command |= Doclone::C_STRIPES;
+		}
 		if ((sendto (sock_udp, &command, sizeof(command), 0,
 				reinterpret_cast<sockaddr*>(&udp), addrlen)) < 0) {
 			ConnectionException ex;
@@ -281,13 +314,16 @@ void Link::linkServer() throw(Exception) {
 
 	host_receiver.sin_family = AF_INET;
 	host_receiver.sin_port = htons (Doclone::PORT_DATA);
-	host_receiver.sin_addr.s_addr = this->netScan();
+	bool checksums;
+	bool stripes;
+	host_receiver.sin_addr.s_addr = this->netScan(checksums, stripes);
 
 	int fdd;
 	if ((fdd = socket (AF_INET, SOCK_STREAM, 0)) < 0) {
 		ConnectionException ex;
 		throw ex;
 	}
+	Stripes::setBufferSize(fdd);
 	sleep (1);
 
 	if ((connect (fdd, reinterpret_cast<sockaddr*>(&host_receiver), size)) < 0) {
@@ -299,6 +335,20 @@ void Link::linkServer() throw(Exception) {
 	this->_fdout = fdd;
 	this->_dstIP = inet_ntoa (host_receiver.sin_addr);
 
+	if(stripes) {
+		this->stripeOut(Stripes::getStreams());
+	}
+
+	if(checksums) {
+		DataTransfer::getInstance()->enableChecksums(this->_fdout);
+	}
+
+	if(Clone::getInstance()->getZeroCopy()) {
+		DataTransfer::getInstance()->enableZeroCopy(this->_fdout);
+	}
+
+	Stats::getInstance()->addReceiver(this->_fdout, this->_dstIP);
+
 	log->debug("Link::linkServer() end");
 }
 
@@ -317,7 +367,15 @@ void Link::linkClient() throw(Exception) {
 	sockaddr_in host_receiver;
 	socklen_t size = sizeof (sockaddr);
 
-	ip_next_link = this->answer();
+	bool checksums;
+	bool stripes;
+	ip_next_link = this->answer(checksums, stripes);
+
+	// Ready before the previous link connects
+	int stripeFd = -1;
+	if(stripes) {
+		stripeFd = Stripes::listenStripes();
+	}
 
 	host_sender.sin_family = AF_INET;
 	host_sender.sin_port = htons (Doclone::PORT_DATA);
@@ -333,6 +391,8 @@ void Link::linkClient() throw(Exception) {
 	setsockopt(sock_sender, SOL_SOCKET, SO_REUSEADDR,
 			&iSetOption, sizeof(iSetOption));
 
+	Stripes::setBufferSize(sock_sender);
+
 	if ((bind (sock_sender,
 			reinterpret_cast<sockaddr*>(&host_sender), size)) < 0) {
 		ConnectionException ex;
@@ -355,6 +415,26 @@ void Link::linkClient() throw(Exception) {
 	this->_fdin = fdi;
 	this->_srcIP = inet_ntoa (host_sender.sin_addr);
 
+	// The next link is sent the same number of connections
+	unsigned int count = 0;
+	if(stripes) {
+		uint64_t token;
+		count = Stripes::readOffer(fdi, token);
+
+		std::vector<int> connections;
+		bool accepted = Stripes::acceptStripes(stripeFd, token, count,
+				connections);
+		close(stripeFd);
+
+		if(!accepted) {
+			ConnectionException ex;
+			throw ex;
+		}
+
+		this->_stripesIn = new Stripes(fdi, connections, false);
+		this->_fdin = this->_stripesIn->getFd();
+	}
+
 	// Notify the views
 	Clone *dcl = Clone::getInstance();
 	dcl->triggerEvent(Doclone::EVT_NEW_CONNECION, this->_srcIP);
@@ -371,6 +451,7 @@ void Link::linkClient() throw(Exception) {
 			throw ex;
 		}
 
+		Stripes::setBufferSize(fdd);
 		sleep (1);
 
 		if ((connect (fdd,
@@ -383,11 +464,56 @@ void Link::linkClient() throw(Exception) {
 		// Set the destination descriptor and IP
 		this->_fdout = fdd;
 		this->_dstIP = inet_ntoa (host_receiver.sin_addr);
+
+		if(stripes) {
+			this->stripeOut(count);
+		}
+	}
+
+	if(checksums) {
+		DataTransfer *trns = DataTransfer::getInstance();
+		trns->enableChecksums(this->_fdin);
+
+		if(this->_fdout != 0) {
+			trns->enableChecksums(this->_fdout);
+		}
+	}
+
+	if(this->_fdout != 0 && dcl->getZeroCopy()) {
+		DataTransfer::getInstance()->enableZeroCopy(this->_fdout);
+	}
+
+	if(this->_fdout != 0) {
+		Stats::getInstance()->addReceiver(this->_fdout, this->_dstIP);
 	}
 
 	log->debug("Link::linkClient() end");
 }
 
+/**
+ * \brief Stripes the connection to the next link
+ *
+ * The offer is sent on _fdout, which is replaced by the local socket of the
+ * stripes.
+ *
+ * \param count
+ * 		Number of connections
+ */
+void Link::stripeOut(unsigned int count) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Link::stripeOut(count=>%d) start", count);
+
+	uint64_t token = Stripes::offer(this->_fdout, count);
+
+	std::vector<int> connections;
+	Stripes::connectStripes(this->_fdout, token, count, connections);
+
+	this->_stripesOut = new Stripes(this->_fdout, connections, true);
+	this->_fdout = this->_stripesOut->getFd();
+
+	log->debug("Link::stripeOut() end");
+}
+
 /**
  * \brief Sends an image to the chain.
  *
@@ -403,6 +529,7 @@ void Link::sendFromImage() throw(Exception) {
 
 	Clone *dcl = Clone::getInstance();
 	dcl->addOperation(waitOp);
+	dcl->markStarted(Doclone::OP_WAIT_CLIENTS, "");
 
 	this->linkServer();
 
@@ -414,6 +541,7 @@ void Link::sendFromImage() throw(Exception) {
 			Doclone::OP_TRANSFER_DATA, "");
 
 	dcl->addOperation(transferOp);
+	dcl->markStarted(Doclone::OP_TRANSFER_DATA, "");
 
 	/*
 	 * Before sending the data, it sends its size. So the client/s can
@@ -430,6 +558,11 @@ void Link::sendFromImage() throw(Exception) {
 			static_cast<size_t>(sizeof(uint64_t)));
 
 	trns->copyData(fd, this->_fdout);
+	trns->finishChecksums(this->_fdout);
+
+	if(this->_stripesOut != 0) {
+		this->_stripesOut->finish();
+	}
 
 	dcl->markCompleted(Doclone::OP_TRANSFER_DATA, "");
 
@@ -458,6 +591,7 @@ void Link::sendFromDevice() throw(Exception) {
 
 	Clone *dcl = Clone::getInstance();
 	dcl->addOperation(waitOp);
+	dcl->markStarted(Doclone::OP_WAIT_CLIENTS, "");
 
 	this->linkServer();
 
@@ -483,6 +617,7 @@ void Link::sendFromDevice() throw(Exception) {
 			Doclone::OP_READ_PARTITION_TABLE, target);
 
 	dcl->addOperation(readPartTableOp);
+	dcl->markStarted(Doclone::OP_READ_PARTITION_TABLE, target);
 
 	image.readPartitionTable(this->_device);
 
@@ -524,6 +659,12 @@ void Link::sendFromDevice() throw(Exception) {
 	image.freeWriteArchive();
 	image.freeReadArchive();
 
+	trns->finishChecksums(this->_fdout);
+
+	if(this->_stripesOut != 0) {
+		this->_stripesOut->finish();
+	}
+
 	this->closeConnection();
 
 	log->debug("Link::sendFromDevice() end");
@@ -578,6 +719,7 @@ void Link::receiveToImage() throw(Exception) {
 
 	Clone *dcl = Clone::getInstance();
 	dcl->addOperation(waitOp);
+	dcl->markStarted(Doclone::OP_WAIT_SERVER, "");
 
 	this->linkClient();
 
@@ -590,6 +732,7 @@ void Link::receiveToImage() throw(Exception) {
 			Doclone::OP_TRANSFER_DATA, "");
 
 	dcl->addOperation(transferOp);
+	dcl->markStarted(Doclone::OP_TRANSFER_DATA, "");
 
 	// Receive the total amount of bytes to be transferred
 	uint64_t totalSize;
@@ -615,6 +758,11 @@ void Link::receiveToImage() throw(Exception) {
 		fdsOut.push_back(this->_fdout);
 	}
 	trns->copyData(this->_fdin, fdsOut);
+	trns->finishChecksums(this->_fdout);
+
+	if(this->_stripesOut != 0) {
+		this->_stripesOut->finish();
+	}
 
 	dcl->markCompleted(Doclone::OP_TRANSFER_DATA, "");
 
@@ -643,6 +791,7 @@ void Link::receiveToDevice() throw(Exception) {
 
 	Clone *dcl = Clone::getInstance();
 	dcl->addOperation(waitOp);
+	dcl->markStarted(Doclone::OP_WAIT_SERVER, "");
 
 	this->linkClient();
 
@@ -736,15 +885,29 @@ void Link::closeConnection() throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("Link::closeConnection() start");
 
+	DataTransfer *trns = DataTransfer::getInstance();
+
 	if(this->_fdin) {
-		if(close(this->_fdin)<0) {
+		trns->disableChecksums(this->_fdin);
+
+		if(this->_stripesIn != 0) {
+			delete this->_stripesIn;
+			this->_stripesIn = 0;
+		} else if(close(this->_fdin)<0) {
 			CloseConnectionException ex;
 			ex.logMsg();
 		}
 	}
 
 	if(this->_fdout) {
-		if(close(this->_fdout)<0) {
+		trns->disableChecksums(this->_fdout);
+		trns->disableZeroCopy(this->_fdout);
+		Stats::getInstance()->removeReceiver(this->_fdout);
+
+		if(this->_stripesOut != 0) {
+			delete this->_stripesOut;
+			this->_stripesOut = 0;
+		} else if(close(this->_fdout)<0) {
 			CloseConnectionException ex;
 			ex.logMsg();
 		}
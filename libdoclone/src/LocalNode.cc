@@ -26,12 +26,341 @@
 #include <doclone/DlFactory.h>
 #include <doclone/DataTransfer.h>
 #include <doclone/Util.h>
+#include <doclone/Job.h>
 #include <doclone/exception/NoBlockDeviceException.h>
+#include <doclone/exception/SameDeviceException.h>
+#include <doclone/exception/InitializationException.h>
 #include <doclone/exception/CreateImageException.h>
 #include <doclone/exception/RestoreImageException.h>
 
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include <vector>
+
 namespace Doclone {
 
+/**
+ * \struct dcCloneGroup
+ * \brief State shared by the threads that restore a local clone on its
+ * targets
+ */
+struct dcCloneGroup {
+	/// Gives a thread the device of the job, while it writes its partitions
+	pthread_mutex_t deviceMutex;
+	/// Protects pending and the failed flags of the targets
+	pthread_mutex_t mutex;
+	/// Signals the change of pending
+	pthread_cond_t cond;
+	/// Number of targets whose partitions are not written yet
+	unsigned int pending;
+	/// Job of the thread that started the clone
+	Job *job;
+};
+
+/**
+ * \struct dcCloneTarget
+ * \brief A target of a local clone, and the thread that restores it
+ */
+struct dcCloneTarget {
+	/// Target device
+	std::string device;
+	/// Read end of the pipe with the image
+	int fd;
+	/// Whether the restore failed
+	bool failed;
+	/// Whether the thread is running
+	bool started;
+	/// The restoring thread
+	pthread_t thread;
+	/// State shared with the other targets
+	dcCloneGroup *group;
+};
+
+/**
+ * \brief Whether two devices overlap: they are the same, or one is a disk
+ * and the other one is in it
+ */
+static bool devicesOverlap(const std::string &dev1, const std::string &dev2)
+		throw(Exception) {
+	return Util::getDiskPath(dev1) == Util::getDiskPath(dev2)
+			&& (dev1 == dev2 || Util::isDisk(dev1) || Util::isDisk(dev2));
+}
+
+/**
+ * \brief Checks that the targets are devices and don't overlap the source
+ * or each other
+ *
+ * \param source
+ * 		Device read, or empty if it is an image
+ * \param targets
+ * 		Devices written
+ */
+static void checkTargets(const std::string &source,
+		const std::vector<std::string> &targets) throw(Exception) {
+	for(unsigned int i = 0; i < targets.size(); i++) {
+		if(!Util::isBlockDevice(targets[i])) {
+			NoBlockDeviceException ex;
+			throw ex;
+		}
+
+		bool overlap = !source.empty() && devicesOverlap(source, targets[i]);
+		for(unsigned int j = 0; j < i && !overlap; j++) {
+			overlap = devicesOverlap(targets[j], targets[i]);
+		}
+
+		if(overlap) {
+			SameDeviceException ex;
+			throw ex;
+		}
+	}
+}
+
+/**
+ * \brief Updates the state of a target
+ *
+ * \param ct
+ * 		The target
+ * \param ready
+ * 		Whether the target has just finished writing its partitions, or has
+ * 		failed before it
+ * \param failed
+ * 		Whether the restore failed
+ */
+static void setTargetState(dcCloneTarget *ct, bool ready, bool failed) {
+	dcCloneGroup *group = ct->group;
+
+	pthread_mutex_lock(&group->mutex);
+
+	if(ready) {
+		group->pending--;
+	}
+	ct->failed = ct->failed || failed;
+
+	pthread_cond_broadcast(&group->cond);
+	pthread_mutex_unlock(&group->mutex);
+}
+
+/**
+ * \brief Restores the image read from the pipe on the target device
+ *
+ * The partitions of the targets are written one after another, since they
+ * use the device of the job. Their data is written at the same time.
+ *
+ * If it fails, the rest of the pipe is read and discarded, so the thread
+ * that writes in it can go on with the other targets.
+ */
+static void *cloneTargetThread(void *arg) {
+	dcCloneTarget *ct = static_cast<dcCloneTarget *>(arg);
+	dcCloneGroup *group = ct->group;
+
+	group->job->bind();
+
+	Image image;
+	bool readOpen = false;
+	bool writeOpen = false;
+	bool locked = false;
+	bool ready = false;
+
+	try {
+		image.initFdReadArchive(ct->fd);
+		readOpen = true;
+		image.initDiskWriteArchive();
+		writeOpen = true;
+
+		pthread_mutex_lock(&group->deviceMutex);
+		locked = true;
+
+		PartedDevice *pDevice = PartedDevice::getInstance();
+		pDevice->initialize(Util::getDiskPath(ct->device));
+		Clone *dcl = Clone::getInstance();
+		dcl->setDevice(ct->device);
+
+		image.loadImageHeader();
+
+		if(image.canRestoreCheck(ct->device) == false) {
+			RestoreImageException ex;
+			throw ex;
+		}
+
+		image.initRestoreOperations(ct->device);
+
+		image.writePartitionTable(ct->device);
+
+		pthread_mutex_unlock(&group->deviceMutex);
+		locked = false;
+
+		setTargetState(ct, true, false);
+		ready = true;
+
+		image.writePartitionsData(ct->device);
+	} catch (const Exception &ex) {
+		if(locked) {
+			pthread_mutex_unlock(&group->deviceMutex);
+		}
+
+		ex.logMsg();
+		setTargetState(ct, !ready, true);
+
+		char buf[BUFFER_SIZE];
+		while(read(ct->fd, buf, sizeof(buf)) > 0);
+	}
+
+	if(writeOpen) {
+		image.freeWriteArchive();
+	}
+
+	if(readOpen) {
+		image.freeReadArchive();
+	}
+
+	return 0;
+}
+
+/**
+ * \brief Closes the pipes of the targets and waits for their threads
+ *
+ * \param targets
+ * 		The targets
+ * \param fds
+ * 		Write ends of the pipes
+ * \param group
+ * 		State shared by the targets
+ *
+ * \return Whether any target failed
+ */
+static bool finishTargets(std::vector<dcCloneTarget> &targets,
+		std::vector<int> &fds, dcCloneGroup &group) {
+	Logger *log = Logger::getInstance();
+	bool failed = false;
+
+	for(unsigned int i = 0; i < fds.size(); i++) {
+		close(fds[i]);
+	}
+
+	for(unsigned int i = 0; i < targets.size(); i++) {
+		if(targets[i].started) {
+			pthread_join(targets[i].thread, 0);
+		}
+
+		close(targets[i].fd);
+
+		if(targets[i].failed) {
+			log->warn("%s has not been cloned", targets[i].device.c_str());
+			failed = true;
+		}
+	}
+
+	pthread_cond_destroy(&group.cond);
+	pthread_mutex_destroy(&group.mutex);
+	pthread_mutex_destroy(&group.deviceMutex);
+
+	return failed;
+}
+
+/**
+ * \brief Creates a pipe and a restoring thread for each target
+ *
+ * \param devices
+ * 		Target devices
+ * \param [out] fds
+ * 		Write ends of the pipes
+ * \param [out] targets
+ * 		The targets
+ * \param [out] group
+ * 		State shared by the targets
+ */
+static void startTargets(const std::vector<std::string> &devices,
+		std::vector<int> &fds, std::vector<dcCloneTarget> &targets,
+		dcCloneGroup &group) throw(Exception) {
+	Logger *log = Logger::getInstance();
+
+	pthread_mutex_init(&group.deviceMutex, 0);
+	pthread_mutex_init(&group.mutex, 0);
+	pthread_cond_init(&group.cond, 0);
+	group.pending = devices.size();
+	group.job = Job::getCurrent();
+
+	targets.resize(devices.size());
+
+	bool error = false;
+	for(unsigned int i = 0; i < devices.size() && !error; i++) {
+		int pipeFds[2];
+		if(pipe(pipeFds) < 0) {
+			targets.resize(i);
+			error = true;
+			continue;
+		}
+
+		/*
+		 * The targets read the header one after another, while it is written
+		 * to all of them, so it must fit in the pipe. Otherwise the targets
+		 * waiting for the device would stop the one that has it.
+		 */
+		int pipeSize = fcntl(pipeFds[1], F_SETPIPE_SZ,
+				2 * Doclone::MAX_HEADER_SIZE);
+		if(pipeSize < static_cast<int>(2 * Doclone::MAX_HEADER_SIZE)) {
+			log->warn("The pipes can't hold the header of the image, raise "
+					"/proc/sys/fs/pipe-max-size to %llu",
+					static_cast<unsigned long long>(
+							2 * Doclone::MAX_HEADER_SIZE));
+
+			close(pipeFds[0]);
+			close(pipeFds[1]);
+			targets.resize(i);
+			error = true;
+			continue;
+		}
+
+		fds.push_back(pipeFds[1]);
+
+		dcCloneTarget &ct = targets[i];
+		ct.device = devices[i];
+		ct.fd = pipeFds[0];
+		ct.failed = false;
+		ct.group = &group;
+		ct.started =
+				pthread_create(&ct.thread, 0, cloneTargetThread, &ct) == 0;
+
+		if(!ct.started) {
+			targets.resize(i + 1);
+			error = true;
+		}
+	}
+
+	if(error) {
+		finishTargets(targets, fds, group);
+
+		InitializationException ex;
+		throw ex;
+	}
+}
+
+/**
+ * \brief Waits until all the targets have written their partitions
+ *
+ * \return Whether any target can still be written
+ */
+static bool waitTargets(std::vector<dcCloneTarget> &targets,
+		dcCloneGroup &group) {
+	bool alive = false;
+
+	pthread_mutex_lock(&group.mutex);
+
+	while(group.pending > 0) {
+		pthread_cond_wait(&group.cond, &group.mutex);
+	}
+
+	for(unsigned int i = 0; i < targets.size(); i++) {
+		alive = alive || !targets[i].failed;
+	}
+
+	pthread_mutex_unlock(&group.mutex);
+
+	return alive;
+}
+
 /**
  * \brief Creates a doclone image.
  */
@@ -68,6 +397,7 @@ void LocalNode::create() const throw(Exception) {
 	Clone *dcl = Clone::getInstance();
 	dcl->addOperation(readPartTableOp);
 
+	dcl->markStarted(Doclone::OP_READ_PARTITION_TABLE, target);
 	image.readPartitionTable(this->_device);
 
 	// Mark the operation to read partition table as completed
@@ -80,6 +410,14 @@ void LocalNode::create() const throw(Exception) {
 
 	image.initCreateOperations();
 
+	if(!dcl->getBase().empty()) {
+		image.loadBaseImage(dcl->getBase());
+	}
+
+	if(!dcl->getRepository().empty()) {
+		image.openRepository(dcl->getRepository());
+	}
+
 	image.saveImageHeader();
 
 	// Initialize the counter of progress
@@ -140,4 +478,207 @@ void LocalNode::restore() const throw(Exception) {
 	log->debug("Local::restore() end");
 }
 
+/**
+ * \brief Verifies the data of a device against the image
+ *
+ * The image must have been created with a manifest of its files.
+ */
+void LocalNode::verify() const throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Local::verify() start");
+
+	if(!Util::isBlockDevice(this->_device)) {
+		NoBlockDeviceException ex;
+		throw ex;
+	}
+
+	int fd = Util::openFile(this->_image);
+
+	Image image;
+
+	image.initFdReadArchive(fd);
+
+	image.loadImageHeader();
+
+	Clone *dcl = Clone::getInstance();
+	Operation *verifyOp = new Operation(Doclone::OP_VERIFY_DATA,
+			this->_device);
+	dcl->addOperation(verifyOp);
+
+	image.verifyPartitionsData(this->_device);
+
+	image.freeReadArchive();
+
+	Util::closeFile(fd);
+
+	log->debug("Local::verify() end");
+}
+
+/**
+ * \brief Clones the device in the target devices, without an image file
+ *
+ * This thread reads the device once and writes an uncompressed image in a
+ * pipe for each target, while another thread restores it on that target.
+ * The partitions of the targets are written before the data starts to flow.
+ */
+void LocalNode::localClone() const throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Local::localClone() start");
+
+	Clone *dcl = Clone::getInstance();
+	const std::vector<std::string> &devices = dcl->getTargets();
+
+	if(!Util::isBlockDevice(this->_device)) {
+		NoBlockDeviceException ex;
+		throw ex;
+	}
+
+	checkTargets(this->_device, devices);
+
+	Image image;
+
+	image.initDiskReadArchive();
+
+	if(Util::isDisk(this->_device)) {
+		image.setType(Doclone::IMAGE_DISK);
+	}
+	else {
+		image.setType(Doclone::IMAGE_PARTITION);
+	}
+
+	PartedDevice *pDevice = PartedDevice::getInstance();
+	std::string source = pDevice->getPath();
+
+	Operation *readPartTableOp = new Operation(
+			Doclone::OP_READ_PARTITION_TABLE, source);
+	dcl->addOperation(readPartTableOp);
+
+	dcl->markStarted(Doclone::OP_READ_PARTITION_TABLE, source);
+	image.readPartitionTable(this->_device);
+
+	dcl->markCompleted(Doclone::OP_READ_PARTITION_TABLE, source);
+
+	if(image.canCreateCheck() == false) {
+		CreateImageException ex;
+		throw ex;
+	}
+
+	image.initCreateOperations();
+
+	// The data is counted when it is read and when each target writes it
+	DataTransfer *trns = DataTransfer::getInstance();
+	trns->setTotalSize(image.getSize() * (devices.size() + 1));
+
+	dcCloneGroup group;
+	std::vector<dcCloneTarget> targets;
+	std::vector<int> fds;
+
+	startTargets(devices, fds, targets, group);
+
+	bool failed;
+	try {
+		image.initRawWriteArchive(fds);
+		image.saveImageHeader();
+
+		if(waitTargets(targets, group)) {
+			image.readPartitionsData();
+		}
+	} catch (const Exception &ex) {
+		image.freeWriteArchive();
+		finishTargets(targets, fds, group);
+		image.freeReadArchive();
+
+		dcl->setDevice(this->_device);
+		throw;
+	}
+
+	image.freeWriteArchive();
+	failed = finishTargets(targets, fds, group);
+	image.freeReadArchive();
+
+	// The targets have changed the device of the job
+	dcl->setDevice(this->_device);
+
+	if(failed) {
+		RestoreImageException ex;
+		throw ex;
+	}
+
+	log->debug("Local::localClone() end");
+}
+
+/**
+ * \brief Restores an image in all the target devices at once
+ *
+ * The image is read and decompressed once, by this thread, and its entries
+ * are written uncompressed in a pipe for each target, while another thread
+ * restores them on that target.
+ */
+void LocalNode::duplicate() const throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Local::duplicate() start");
+
+	Clone *dcl = Clone::getInstance();
+	const std::vector<std::string> &devices = dcl->getTargets();
+
+	checkTargets("", devices);
+
+	// Initialize the counter of progress, each target counts its data
+	Image header;
+	int fd = Util::openFile(this->_image);
+	header.initFdReadArchive(fd);
+	header.loadImageSizeFromHeader();
+	header.freeReadArchive();
+	Util::closeFile(fd);
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	trns->setTotalSize(header.getSize() * devices.size());
+
+	fd = Util::openFile(this->_image);
+
+	Image image;
+	image.initFdReadArchive(fd);
+
+	dcCloneGroup group;
+	std::vector<dcCloneTarget> targets;
+	std::vector<int> fds;
+
+	try {
+		startTargets(devices, fds, targets, group);
+	} catch (const Exception &ex) {
+		image.freeReadArchive();
+		Util::closeFile(fd);
+		throw;
+	}
+
+	bool failed;
+	try {
+		image.initRawWriteArchive(fds);
+		image.relayImage();
+	} catch (const Exception &ex) {
+		image.freeWriteArchive();
+		finishTargets(targets, fds, group);
+		image.freeReadArchive();
+		Util::closeFile(fd);
+
+		dcl->setDevice(this->_device);
+		throw;
+	}
+
+	image.freeWriteArchive();
+	failed = finishTargets(targets, fds, group);
+	image.freeReadArchive();
+	Util::closeFile(fd);
+
+	// The targets have changed the device of the job
+	dcl->setDevice(this->_device);
+
+	if(failed) {
+		RestoreImageException ex;
+		throw ex;
+	}
+
+	log->debug("Local::duplicate() end");
+}
+
 }
@@ -19,19 +19,33 @@
 #include <doclone/Logger.h>
 
 #include <stdarg.h>
+#include <sched.h>
 #include <pthread.h>
 
 #include <config.h>
 
 #include <log4cpp/BasicLayout.hh>
+#include <log4cpp/LoggingEvent.hh>
+#include <log4cpp/TimeStamp.hh>
 
 namespace Doclone {
 
+/// The logger of all the jobs
+static Logger *loggerInstance = 0;
+
+/// Creates loggerInstance only once
+static pthread_once_t loggerOnce = PTHREAD_ONCE_INIT;
+
 /**
  * \brief Initializes the logger, the priority of the messages is established
  * in the flags of compilation.
  */
-Logger::Logger() : _app(0), _layout(0), _cat(0), _backTrace() {
+Logger::Logger() : _app(0), _layout(0), _cat(0), _priority(0), _records(0),
+		_enqueuePos(0), _dequeuePos(0), _writer(), _writerMutex(),
+		_writerCond(), _drainedCond(), _writerSleeping(false),
+		_stopping(false), _backTrace(), _btMutex() {
+	pthread_mutex_init(&this->_btMutex, 0);
+
 #ifdef LOGDIR
 	std::string log_file(LOGDIR);
 	log_file.append("/libdoclone.log");
@@ -65,13 +79,39 @@ Logger::Logger() : _app(0), _layout(0), _cat(0), _backTrace() {
 #endif
 
 	this->_cat->setAppender(this->_app);
+	this->_priority = this->_cat->getPriority();
+
+	// The ring of records, each one tells the position it's filled for
+	this->_records = new dcLogRecord[Doclone::LOG_RING_SIZE];
+	for(unsigned int i = 0; i < Doclone::LOG_RING_SIZE; i++) {
+		this->_records[i].sequence = i;
+	}
+
+	pthread_mutex_init(&this->_writerMutex, 0);
+	pthread_cond_init(&this->_writerCond, 0);
+	pthread_cond_init(&this->_drainedCond, 0);
+	pthread_create(&this->_writer, 0, Logger::writerThread, this);
 }
 
 /**
  * \brief Destructor
  */
 Logger::~Logger() {
+	// The writer thread writes the records left and exits
+	pthread_mutex_lock(&this->_writerMutex);
+	this->_stopping = true;
+	pthread_cond_signal(&this->_writerCond);
+	pthread_mutex_unlock(&this->_writerMutex);
+
+	pthread_join(this->_writer, 0);
+
+	pthread_cond_destroy(&this->_drainedCond);
+	pthread_cond_destroy(&this->_writerCond);
+	pthread_mutex_destroy(&this->_writerMutex);
+	delete[] this->_records;
+
 	this->_backTrace.clear();
+	pthread_mutex_destroy(&this->_btMutex);
 
 	log4cpp::Category::shutdown();
 }
@@ -82,15 +122,10 @@ Logger::~Logger() {
  * \return Logger* object
  */
 Logger* Logger::getInstance() {
-	static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-
-	pthread_mutex_lock(&mutex);
-
-	static Logger instance;
+	// Without locks, the functions called by loops get it for every buffer
+	pthread_once(&loggerOnce, Logger::createInstance);
 
-	pthread_mutex_unlock(&mutex);
-
-	return &instance;
+	return loggerInstance;
 }
 
 /**
@@ -104,17 +139,18 @@ Logger* Logger::getInstance() {
  * \param ...
  * 		Possible parameters to build the message string, like in printf().
  */
-void Logger::loopDebug(const std::string &msg, ...) const {
-	char tmpStr[1024];
+#ifdef DEBUG_LOOP
+void Logger::loopDebug(const char *msg, ...) {
+	if(!this->isEnabled(Doclone::LOOP_DEBUG)) {
+		return;
+	}
 
 	va_list vl;
 	va_start(vl, msg);
-	vsnprintf (tmpStr, sizeof(tmpStr), msg.c_str(), vl);
-	va_end (vl);
-
-	std::string str = tmpStr;
-	this->_cat->log(750, str);
+	this->enqueue(Doclone::LOOP_DEBUG, msg, vl);
+	va_end(vl);
 }
+#endif
 
 /**
  * \brief Traces a message with loopDebug priority
@@ -127,16 +163,15 @@ void Logger::loopDebug(const std::string &msg, ...) const {
  * \param ...
  * 		Possible parameters to build the message string, like in printf().
  */
-void Logger::debug(const std::string &msg, ...) const {
-	char tmpStr[1024];
+void Logger::debug(const char *msg, ...) {
+	if(!this->isEnabled(log4cpp::Priority::DEBUG)) {
+		return;
+	}
 
 	va_list vl;
 	va_start(vl, msg);
-	vsnprintf (tmpStr, sizeof(tmpStr), msg.c_str(), vl);
-	va_end (vl);
-
-	std::string str = tmpStr;
-	this->_cat->debug(str);
+	this->enqueue(log4cpp::Priority::DEBUG, msg, vl);
+	va_end(vl);
 }
 
 /**
@@ -150,16 +185,15 @@ void Logger::debug(const std::string &msg, ...) const {
  * \param ...
  * 		Possible parameters to build the message string, like in printf().
  */
-void Logger::info(const std::string &msg, ...) const {
-	char tmpStr[1024];
+void Logger::info(const char *msg, ...) {
+	if(!this->isEnabled(log4cpp::Priority::INFO)) {
+		return;
+	}
 
 	va_list vl;
 	va_start(vl, msg);
-	vsnprintf (tmpStr, sizeof(tmpStr), msg.c_str(), vl);
-	va_end (vl);
-
-	std::string str = tmpStr;
-	this->_cat->info(str);
+	this->enqueue(log4cpp::Priority::INFO, msg, vl);
+	va_end(vl);
 }
 
 /**
@@ -181,8 +215,9 @@ void Logger::warn(const std::string &msg, ...) {
 	vsnprintf (tmpStr, sizeof(tmpStr), msg.c_str(), vl);
 	va_end (vl);
 
-	// Append to log
+	// Append to log, after the records queued before
 	std::string str = tmpStr;
+	this->flushRecords();
 	this->_cat->warn(str);
 
 	// Notify the views
@@ -211,8 +246,9 @@ void Logger::error(const std::string &msg, ...) {
 	vsnprintf (tmpStr, sizeof(tmpStr), msg.c_str(), vl);
 	va_end (vl);
 
-	// Append to log
+	// Append to log, after the records queued before
 	std::string str = tmpStr;
+	this->flushRecords();
 	this->_cat->error(str);
 
 	// Notify the views
@@ -241,8 +277,9 @@ void Logger::fatal(const std::string &msg, ...) {
 	vsnprintf (tmpStr, sizeof(tmpStr), msg.c_str(), vl);
 	va_end (vl);
 
-	// Append to log
+	// Append to log, after the records queued before
 	std::string str = tmpStr;
+	this->flushRecords();
 	this->_cat->fatal(str);
 
 	// Notify the views
@@ -259,11 +296,187 @@ void Logger::fatal(const std::string &msg, ...) {
  * 		The message string.
  */
 void Logger::pushBT(const std::string &msg) {
+	pthread_mutex_lock(&this->_btMutex);
 	this->_backTrace.push_back(msg);
+	pthread_mutex_unlock(&this->_btMutex);
 }
 
-std::vector<std::string> &Logger::getBT() {
-	return this->_backTrace;
+/**
+ * \brief Gets a copy of the backtrace, taken while no message is added
+ */
+std::vector<std::string> Logger::getBT() {
+	pthread_mutex_lock(&this->_btMutex);
+	std::vector<std::string> backTrace = this->_backTrace;
+	pthread_mutex_unlock(&this->_btMutex);
+
+	return backTrace;
+}
+
+/**
+ * \brief Creates the logger, which is destroyed at the exit of the program
+ */
+void Logger::createInstance() {
+	static Logger instance;
+
+	loggerInstance = &instance;
+}
+
+/**
+ * \brief Starts the writer thread
+ */
+void *Logger::writerThread(void *arg) {
+	static_cast<Logger *>(arg)->runWriter();
+
+	return 0;
+}
+
+/**
+ * \brief Formats a message in the next free record of the ring
+ *
+ * Any thread can enqueue at the same time. If the ring is full, the thread
+ * waits until the writer frees a record, so no message is lost.
+ *
+ * \param priority
+ * 		Priority of the message
+ * \param msg
+ * 		The message, with the printf() syntax
+ * \param vl
+ * 		Parameters to build the message
+ */
+void Logger::enqueue(int priority, const char *msg, va_list vl) {
+	uint64_t pos = __atomic_load_n(&this->_enqueuePos, __ATOMIC_RELAXED);
+	dcLogRecord *record;
+
+	// A record is free for the position it holds in sequence
+	for(;;) {
+		record = &this->_records[pos & (Doclone::LOG_RING_SIZE - 1)];
+		uint64_t sequence = __atomic_load_n(&record->sequence,
+				__ATOMIC_ACQUIRE);
+
+		if(sequence == pos) {
+			if(__atomic_compare_exchange_n(&this->_enqueuePos, &pos, pos + 1,
+					true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if(sequence < pos) {
+			// Full, the writer hasn't written this record yet
+			this->wakeWriter();
+			sched_yield();
+			pos = __atomic_load_n(&this->_enqueuePos, __ATOMIC_RELAXED);
+		} else {
+			pos = __atomic_load_n(&this->_enqueuePos, __ATOMIC_RELAXED);
+		}
+	}
+
+	record->priority = priority;
+	gettimeofday(&record->time, 0);
+	vsnprintf(record->message, sizeof(record->message), msg, vl);
+
+	// Paired with the store of _writerSleeping in runWriter()
+	__atomic_store_n(&record->sequence, pos + 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&this->_writerSleeping, __ATOMIC_SEQ_CST)) {
+		this->wakeWriter();
+	}
+}
+
+/**
+ * \brief Whether the next record to write is filled
+ */
+bool Logger::hasRecord() const {
+	const dcLogRecord *record =
+			&this->_records[this->_dequeuePos & (Doclone::LOG_RING_SIZE - 1)];
+
+	return __atomic_load_n(&record->sequence, __ATOMIC_SEQ_CST)
+			== this->_dequeuePos + 1;
+}
+
+/**
+ * \brief Writes the next record, from the writer thread
+ *
+ * \return false if it isn't filled yet
+ */
+bool Logger::writeRecord() {
+	if(!this->hasRecord()) {
+		return false;
+	}
+
+	dcLogRecord *record =
+			&this->_records[this->_dequeuePos & (Doclone::LOG_RING_SIZE - 1)];
+
+	// Written with the time it was logged at, not the current one
+	log4cpp::LoggingEvent event(this->_cat->getName(), record->message, "",
+			record->priority);
+	event.timeStamp = log4cpp::TimeStamp(record->time.tv_sec,
+			record->time.tv_usec);
+	this->_cat->callAppenders(event);
+
+	// Free for the position of the next round of the ring
+	__atomic_store_n(&record->sequence,
+			this->_dequeuePos + Doclone::LOG_RING_SIZE, __ATOMIC_RELEASE);
+	__atomic_store_n(&this->_dequeuePos, this->_dequeuePos + 1,
+			__ATOMIC_RELEASE);
+
+	return true;
+}
+
+/**
+ * \brief Wakes up the writer thread
+ */
+void Logger::wakeWriter() {
+	pthread_mutex_lock(&this->_writerMutex);
+	pthread_cond_signal(&this->_writerCond);
+	pthread_mutex_unlock(&this->_writerMutex);
+}
+
+/**
+ * \brief Waits until the records queued before are written
+ */
+void Logger::flushRecords() {
+	if(pthread_equal(pthread_self(), this->_writer)) {
+		return;
+	}
+
+	uint64_t target = __atomic_load_n(&this->_enqueuePos, __ATOMIC_ACQUIRE);
+
+	pthread_mutex_lock(&this->_writerMutex);
+	while(__atomic_load_n(&this->_dequeuePos, __ATOMIC_ACQUIRE) < target) {
+		pthread_cond_signal(&this->_writerCond);
+		pthread_cond_wait(&this->_drainedCond, &this->_writerMutex);
+	}
+	pthread_mutex_unlock(&this->_writerMutex);
+}
+
+/**
+ * \brief Writes the records until the logger is destroyed
+ */
+void Logger::runWriter() {
+	for(;;) {
+		// A full ring at most, so the flushes don't wait forever
+		unsigned int written = 0;
+		while(written < Doclone::LOG_RING_SIZE && this->writeRecord()) {
+			written++;
+		}
+
+		pthread_mutex_lock(&this->_writerMutex);
+
+		pthread_cond_broadcast(&this->_drainedCond);
+
+		if(written == 0) {
+			// Paired with the load of _writerSleeping in enqueue()
+			__atomic_store_n(&this->_writerSleeping, true, __ATOMIC_SEQ_CST);
+			if(!this->hasRecord()) {
+				if(this->_stopping) {
+					pthread_mutex_unlock(&this->_writerMutex);
+					break;
+				}
+
+				pthread_cond_wait(&this->_writerCond, &this->_writerMutex);
+			}
+			__atomic_store_n(&this->_writerSleeping, false, __ATOMIC_RELAXED);
+		}
+
+		pthread_mutex_unlock(&this->_writerMutex);
+	}
 }
 
 }
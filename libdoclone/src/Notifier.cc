@@ -0,0 +1,327 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <doclone/observer/Notifier.h>
+
+#include <time.h>
+
+#include <doclone/observer/AbstractSubject.h>
+#include <doclone/Stats.h>
+
+namespace Doclone {
+
+/// The notifier of all the jobs
+static Notifier *notifierInstance = 0;
+
+/// Creates notifierInstance only once
+static pthread_once_t notifierOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * \brief Initializes the queue, with an empty notification as its tail
+ */
+Notifier::Notifier(): _head(0), _tail(0), _deferred(),
+		_maxRate(Doclone::DEFAULT_EVENT_RATE), _thread(), _mutex(), _cond(),
+		_flushedCond(), _sleeping(false) {
+	this->_head = new dcNotification();
+	this->_tail = this->_head;
+
+	pthread_mutex_init(&this->_mutex, 0);
+
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&this->_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	pthread_cond_init(&this->_flushedCond, 0);
+}
+
+/**
+ * \brief Gets the notifier, and starts its thread the first time
+ *
+ * It is never destroyed, the subjects that live until the exit of the
+ * program need it in their destructors.
+ *
+ * \return The notifier
+ */
+Notifier *Notifier::getInstance() {
+	pthread_once(&notifierOnce, Notifier::createInstance);
+
+	return notifierInstance;
+}
+
+/**
+ * \brief Queues a notification
+ *
+ * \param notification
+ * 		A notification allocated with new, which the notifier deletes
+ */
+void Notifier::post(dcNotification *notification) {
+	this->push(notification);
+
+	// Paired with the store of _sleeping in run()
+	if(__atomic_load_n(&this->_sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&this->_mutex);
+		pthread_cond_signal(&this->_cond);
+		pthread_mutex_unlock(&this->_mutex);
+	}
+}
+
+/**
+ * \brief Queues the progress of a subject
+ *
+ * The amount of bytes is read from the subject when it is delivered.
+ *
+ * \param subject
+ * 		The subject whose progress has changed
+ */
+void Notifier::postProgress(AbstractSubject *subject) {
+	dcNotification *notification = new dcNotification();
+	notification->kind = NOTIF_PROGRESS;
+	notification->subject = subject;
+
+	this->post(notification);
+}
+
+/**
+ * \brief Waits until all the notifications queued before are delivered
+ *
+ * It does nothing if called by an observer, from the notifier thread.
+ */
+void Notifier::flush() {
+	if(pthread_equal(pthread_self(), this->_thread)) {
+		return;
+	}
+
+	bool done = false;
+
+	dcNotification *notification = new dcNotification();
+	notification->kind = NOTIF_FLUSH;
+	notification->done = &done;
+
+	this->post(notification);
+
+	pthread_mutex_lock(&this->_mutex);
+	while(!done) {
+		pthread_cond_wait(&this->_flushedCond, &this->_mutex);
+	}
+	pthread_mutex_unlock(&this->_mutex);
+}
+
+unsigned int Notifier::getMaxRate() const {
+	return __atomic_load_n(&this->_maxRate, __ATOMIC_RELAXED);
+}
+
+/**
+ * \brief Sets how many progress events of each subject are delivered per
+ * second
+ *
+ * \param maxRate
+ * 		Events per second, 0 for no limit
+ */
+void Notifier::setMaxRate(unsigned int maxRate) {
+	__atomic_store_n(&this->_maxRate, maxRate, __ATOMIC_RELAXED);
+}
+
+/**
+ * \brief Starts the notifier thread
+ */
+void *Notifier::notifierThread(void *arg) {
+	static_cast<Notifier *>(arg)->run();
+
+	return 0;
+}
+
+/**
+ * \brief Creates the notifier and starts its thread
+ */
+void Notifier::createInstance() {
+	notifierInstance = new Notifier();
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_create(&notifierInstance->_thread, &attr, Notifier::notifierThread,
+			notifierInstance);
+	pthread_attr_destroy(&attr);
+}
+
+/**
+ * \brief Appends a notification to the queue, without locks
+ *
+ * Any thread can push at the same time.
+ */
+void Notifier::push(dcNotification *notification) {
+	notification->next = 0;
+
+	dcNotification *prev = __atomic_exchange_n(&this->_head, notification,
+			__ATOMIC_SEQ_CST);
+	__atomic_store_n(&prev->next, notification, __ATOMIC_RELEASE);
+}
+
+/**
+ * \brief Takes the oldest notification of the queue
+ *
+ * Only called by the notifier thread. The notification returned becomes the
+ * tail of the queue, so it is deleted by the next pop().
+ *
+ * \return The notification, or 0 if there is none or the thread that pushes
+ * it hasn't finished yet
+ */
+dcNotification *Notifier::pop() {
+	dcNotification *tail = this->_tail;
+	dcNotification *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+	if(next == 0) {
+		return 0;
+	}
+
+	this->_tail = next;
+	delete tail;
+
+	return next;
+}
+
+/**
+ * \brief Whether there are no notifications pushed, even partially
+ */
+bool Notifier::isEmpty() const {
+	return __atomic_load_n(&this->_head, __ATOMIC_SEQ_CST) == this->_tail;
+}
+
+/**
+ * \brief Delivers the notifications until the end of the program
+ */
+void Notifier::run() {
+	for(;;) {
+		dcNotification *notification = this->pop();
+		if(notification != 0) {
+			this->dispatch(notification);
+			continue;
+		}
+
+		uint64_t wait = this->deliverDeferred(false);
+
+		pthread_mutex_lock(&this->_mutex);
+
+		// Paired with the load of _sleeping in post()
+		__atomic_store_n(&this->_sleeping, true, __ATOMIC_SEQ_CST);
+		if(this->isEmpty()) {
+			if(wait == 0) {
+				pthread_cond_wait(&this->_cond, &this->_mutex);
+			} else {
+				struct timespec ts;
+				clock_gettime(CLOCK_MONOTONIC, &ts);
+				uint64_t nsec = ts.tv_nsec + wait;
+				ts.tv_sec += nsec / 1000000000ULL;
+				ts.tv_nsec = nsec % 1000000000ULL;
+
+				pthread_cond_timedwait(&this->_cond, &this->_mutex, &ts);
+			}
+		}
+		__atomic_store_n(&this->_sleeping, false, __ATOMIC_RELAXED);
+
+		pthread_mutex_unlock(&this->_mutex);
+	}
+}
+
+/**
+ * \brief Delivers a notification popped from the queue
+ *
+ * The observers may raise new events, which are queued after the rest. It
+ * doesn't trace anything: the Logger is a subject, and it is destroyed at the
+ * exit of the program while the notifier thread still runs.
+ */
+void Notifier::dispatch(dcNotification *notification) {
+	switch(notification->kind) {
+	case NOTIF_PROGRESS: {
+		AbstractSubject *subject = notification->subject;
+		unsigned int maxRate = this->getMaxRate();
+		uint64_t now = Stats::now();
+
+		if(maxRate == 0
+				|| now - subject->_lastProgress >= 1000000000ULL / maxRate) {
+			subject->dispatchProgress(now);
+		} else {
+			this->_deferred.push_back(subject);
+		}
+
+		break;
+	}
+	case NOTIF_FLUSH: {
+		this->deliverDeferred(true);
+
+		pthread_mutex_lock(&this->_mutex);
+		*notification->done = true;
+		pthread_cond_broadcast(&this->_flushedCond);
+		pthread_mutex_unlock(&this->_mutex);
+
+		notification->done = 0;
+
+		break;
+	}
+	default: {
+		// The views get the progress before anything that follows it
+		this->deliverDeferred(true);
+		notification->subject->dispatch(*notification);
+		notification->text.clear();
+
+		break;
+	}
+	}
+}
+
+/**
+ * \brief Delivers the progress that waits for the rate limit
+ *
+ * \param all
+ * 		Deliver all of them, not only the ones whose time has come
+ *
+ * \return Nanoseconds until the next one has to be delivered, 0 if none
+ * waits
+ */
+uint64_t Notifier::deliverDeferred(bool all) {
+	if(this->_deferred.empty()) {
+		return 0;
+	}
+
+	unsigned int maxRate = this->getMaxRate();
+	uint64_t interval = maxRate == 0 ? 0 : 1000000000ULL / maxRate;
+	uint64_t now = Stats::now();
+	uint64_t wait = 0;
+
+	std::vector<AbstractSubject *>::iterator it = this->_deferred.begin();
+	while(it != this->_deferred.end()) {
+		uint64_t due = (*it)->_lastProgress + interval;
+
+		if(all || now >= due) {
+			(*it)->dispatchProgress(now);
+			it = this->_deferred.erase(it);
+		} else {
+			if(wait == 0 || due - now < wait) {
+				wait = due - now;
+			}
+			++it;
+		}
+	}
+
+	return wait;
+}
+
+}
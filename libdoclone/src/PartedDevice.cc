@@ -20,11 +20,11 @@
 
 #include <errno.h>
 #include <unistd.h>
-#include <pthread.h>
 
 #include <parted/parted.h>
 
 #include <doclone/Logger.h>
+#include <doclone/Job.h>
 #include <doclone/exception/CommitException.h>
 #include <doclone/exception/NoAccessToDeviceException.h>
 
@@ -55,20 +55,12 @@ PartedDevice::~PartedDevice() {
 }
 
 /**
- * \brief Singleton stuff
+ * \brief Gets the PartedDevice of the job of the calling thread
  *
  * \return A PartedDevice object
  */
 PartedDevice* PartedDevice::getInstance() {
-	static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-
-	pthread_mutex_lock(&mutex);
-
-	static PartedDevice instance;
-
-	pthread_mutex_unlock(&mutex);
-
-	return &instance;
+	return Job::getCurrent()->getPartedDevice();
 }
 
 std::string PartedDevice::getPath() {
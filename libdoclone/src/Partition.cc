@@ -37,6 +37,8 @@
 #include <doclone/PartedDevice.h>
 #include <doclone/FsFactory.h>
 #include <doclone/Util.h>
+#include <doclone/Stats.h>
+#include <doclone/Tracer.h>
 #include <doclone/exception/CancelException.h>
 #include <doclone/exception/ReadDataException.h>
 #include <doclone/exception/WriteDataException.h>
@@ -485,6 +487,8 @@ void Partition::doMount() throw(Exception) {
 		return;
 	}
 
+	uint64_t startTime = Stats::now();
+
 	if(this->_fs->getMountType() == Doclone::MOUNT_EXTERNAL) {
 		// perform external doMount
 		this->externalMount();
@@ -513,6 +517,8 @@ void Partition::doMount() throw(Exception) {
 	Util::addMtabEntry(this->_path, this->_mountPoint,
 		this->_fs->getMountName(), this->_fs->getMountOptions());
 
+	Tracer::getInstance()->addSpan("mount", "mount", startTime, this->_path);
+
 	log->debug("Partition::doMount() end");
 }
 
@@ -533,7 +539,9 @@ void Partition::doUmount() throw(Exception) {
 		return;
 	}
 
+	uint64_t startTime = Stats::now();
 	sync();
+	Stats::getInstance()->addStage(Doclone::STAGE_FSYNC, 0, startTime);
 
 	if(umount2(this->_mountPoint.c_str(), MNT_DETACH)<0) {
 		UmountException ex(this->_mountPoint.c_str());
@@ -545,6 +553,8 @@ void Partition::doUmount() throw(Exception) {
 	// After unmounting, we must delete the entry of /etc/mtab
 	Util::updateMtab(this->_path);
 
+	Tracer::getInstance()->addSpan("mount", "umount", startTime, this->_path);
+
 	log->debug("Partition::doUmount() end");
 }
 
@@ -0,0 +1,219 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <doclone/Sha256.h>
+
+#include <string.h>
+
+namespace Doclone {
+
+/// Round constants of SHA-256
+static const uint32_t SHA256_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr(uint32_t x, int n) {
+	return (x >> n) | (x << (32 - n));
+}
+
+/**
+ * \brief Starts a new digest
+ */
+Sha256::Sha256() : _blockLength(0), _length(0) {
+	this->_state[0] = 0x6a09e667;
+	this->_state[1] = 0xbb67ae85;
+	this->_state[2] = 0x3c6ef372;
+	this->_state[3] = 0xa54ff53a;
+	this->_state[4] = 0x510e527f;
+	this->_state[5] = 0x9b05688c;
+	this->_state[6] = 0x1f83d9ab;
+	this->_state[7] = 0x5be0cd19;
+}
+
+/**
+ * \brief Adds data to the digest
+ *
+ * \param buf
+ * 		The data
+ * \param len
+ * 		Number of bytes of data
+ */
+void Sha256::update(const void *buf, size_t len) {
+	const uint8_t *data = static_cast<const uint8_t *>(buf);
+	this->_length += len;
+
+	if(this->_blockLength > 0) {
+		size_t fill = 64 - this->_blockLength;
+		if(fill > len) {
+			fill = len;
+		}
+
+		memcpy(this->_block + this->_blockLength, data, fill);
+		this->_blockLength += fill;
+		data += fill;
+		len -= fill;
+
+		if(this->_blockLength < 64) {
+			return;
+		}
+
+		this->transform(this->_block);
+		this->_blockLength = 0;
+	}
+
+	while(len >= 64) {
+		this->transform(data);
+		data += 64;
+		len -= 64;
+	}
+
+	memcpy(this->_block, data, len);
+	this->_blockLength = len;
+}
+
+/**
+ * \brief Finishes the digest
+ *
+ * The object can't be updated after calling it.
+ *
+ * \param [out] digest
+ * 		The SHA-256 of all the data
+ */
+void Sha256::final(uint8_t digest[SHA256_SIZE]) {
+	uint64_t bits = this->_length * 8;
+
+	uint8_t pad[72] = { 0x80 };
+	size_t padLength = (this->_blockLength < 56 ? 56 : 120)
+			- this->_blockLength;
+	for(int i = 0; i < 8; i++) {
+		pad[padLength + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+	}
+
+	uint64_t length = this->_length;
+	this->update(pad, padLength + 8);
+	this->_length = length;
+
+	for(int i = 0; i < 8; i++) {
+		digest[4 * i] = static_cast<uint8_t>(this->_state[i] >> 24);
+		digest[4 * i + 1] = static_cast<uint8_t>(this->_state[i] >> 16);
+		digest[4 * i + 2] = static_cast<uint8_t>(this->_state[i] >> 8);
+		digest[4 * i + 3] = static_cast<uint8_t>(this->_state[i]);
+	}
+}
+
+/**
+ * \brief Computes the SHA-256 of a buffer
+ *
+ * \param buf
+ * 		The data
+ * \param len
+ * 		Number of bytes of data
+ *
+ * \return The digest in lowercase hexadecimal
+ */
+std::string Sha256::hexDigest(const void *buf, size_t len) {
+	static const char hexChars[] = "0123456789abcdef";
+
+	Sha256 sha;
+	sha.update(buf, len);
+
+	uint8_t digest[SHA256_SIZE];
+	sha.final(digest);
+
+	std::string hex;
+	hex.reserve(2 * SHA256_SIZE);
+	for(unsigned int i = 0; i < SHA256_SIZE; i++) {
+		hex.push_back(hexChars[digest[i] >> 4]);
+		hex.push_back(hexChars[digest[i] & 0x0F]);
+	}
+
+	return hex;
+}
+
+/**
+ * \brief Processes a block of 64 bytes
+ */
+void Sha256::transform(const uint8_t *block) {
+	uint32_t w[64];
+
+	for(int i = 0; i < 16; i++) {
+		w[i] = (static_cast<uint32_t>(block[4 * i]) << 24)
+			| (static_cast<uint32_t>(block[4 * i + 1]) << 16)
+			| (static_cast<uint32_t>(block[4 * i + 2]) << 8)
+			| static_cast<uint32_t>(block[4 * i + 3]);
+	}
+
+	for(int i = 16; i < 64; i++) {
+		uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = this->_state[0];
+	uint32_t b = this->_state[1];
+	uint32_t c = this->_state[2];
+	uint32_t d = this->_state[3];
+	uint32_t e = this->_state[4];
+	uint32_t f = this->_state[5];
+	uint32_t g = this->_state[6];
+	uint32_t h = this->_state[7];
+
+	for(int i = 0; i < 64; i++) {
+		uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+		uint32_t ch = (e & f) ^ (~e & g);
+		uint32_t t1 = h + s1 + ch + SHA256_K[i] + w[i];
+		uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+		uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t t2 = s0 + maj;
+
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	this->_state[0] += a;
+	this->_state[1] += b;
+	this->_state[2] += c;
+	this->_state[3] += d;
+	this->_state[4] += e;
+	this->_state[5] += f;
+	this->_state[6] += g;
+	this->_state[7] += h;
+}
+
+}
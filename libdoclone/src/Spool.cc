@@ -0,0 +1,642 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <doclone/Spool.h>
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <string>
+
+#include <doclone/Clone.h>
+#include <doclone/DataTransfer.h>
+#include <doclone/Job.h>
+#include <doclone/Logger.h>
+#include <doclone/NetNode.h>
+#include <doclone/Stats.h>
+#include <doclone/Stripes.h>
+#include <doclone/Unicast.h>
+#include <doclone/Util.h>
+#include <doclone/exception/InitializationException.h>
+#include <doclone/exception/ReadDataException.h>
+#include <doclone/exception/WriteDataException.h>
+
+namespace Doclone {
+
+/**
+ * \brief Creates the input socket and the spool file
+ *
+ * \param listenFd
+ * 		Listening socket of the server. The spool closes it
+ * \param stripeFd
+ * 		Socket of Stripes::listenStripes(), or -1 if the streams aren't
+ * 		striped. The spool closes it
+ * \param nodesNum
+ * 		Receivers that must receive the whole stream
+ */
+Spool::Spool(int listenFd, int stripeFd, unsigned int nodesNum)
+		throw(Exception)
+	: _nodesNum(nodesNum), _listenFd(listenFd), _stripeFd(stripeFd),
+	  _input(-1), _output(-1),
+	  _file(0), _session(Util::randomId()), _job(Job::getCurrent()), _poolLimit(0), _spooling(false),
+	  _accepting(false), _threads(), _spooled(0), _complete(false),
+	  _failed(false), _done(false), _completed(0), _connections() {
+	Logger *log = Logger::getInstance();
+	log->debug("Spool::Spool(listenFd=>%d, nodesNum=>%d) start", listenFd,
+			nodesNum);
+
+	int sockets[2];
+	if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) < 0) {
+		InitializationException ex;
+		throw ex;
+	}
+
+	this->_input = sockets[0];
+	this->_output = sockets[1];
+
+	if((this->_file = Util::createTempFile("doclone-spool")) == 0) {
+		close(this->_input);
+		close(this->_output);
+
+		WriteDataException ex;
+		throw ex;
+	}
+
+	// The memory budget of the job is shared by the receivers
+	DataTransfer *trns = DataTransfer::getInstance();
+	this->_poolLimit = trns->getPoolLimit() / this->_nodesNum;
+
+	pthread_mutex_init(&this->_mutex, 0);
+	pthread_cond_init(&this->_changed, 0);
+
+	log->debug("Spool::Spool() end");
+}
+
+/**
+ * \brief Interrupts the streams being sent and removes the spool file
+ *
+ * The input socket is not closed, the server closes it with its other
+ * connections.
+ */
+Spool::~Spool() {
+	this->stop();
+
+	close(this->_listenFd);
+	if(this->_stripeFd >= 0) {
+		close(this->_stripeFd);
+	}
+	close(this->_output);
+	fclose(this->_file);
+
+	pthread_cond_destroy(&this->_changed);
+	pthread_mutex_destroy(&this->_mutex);
+}
+
+/**
+ * \brief Gets the socket the server writes the stream to
+ */
+int Spool::getInput() const {
+	return this->_input;
+}
+
+uint64_t Spool::getSession() const {
+	return this->_session;
+}
+
+/**
+ * \brief Starts sending the stream to a receiver
+ *
+ * SIGINT and SIGPIPE are blocked in its thread, so a receiver that fails
+ * doesn't interrupt the server.
+ *
+ * \param fd
+ * 		Socket connected to the receiver, after the handshake. The spool
+ * 		closes it, and the other connections of the handshake
+ * \param handshake
+ * 		What the receiver and the server have agreed
+ * \param address
+ * 		Address of the receiver, for the Stats of the server
+ */
+void Spool::addReceiver(int fd, const dcHandshake &handshake,
+		const std::string &address) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Spool::addReceiver(fd=>%d, offset=>%d) start", fd,
+			handshake.offset);
+
+	pthread_mutex_lock(&this->_mutex);
+
+	if(this->_done) {
+		pthread_mutex_unlock(&this->_mutex);
+		Spool::closeReceiver(fd, handshake);
+
+		log->debug("Spool::addReceiver() end");
+		return;
+	}
+
+	dcSpoolReceiver *receiver = new dcSpoolReceiver();
+	receiver->spool = this;
+	receiver->fd = fd;
+	receiver->handshake = handshake;
+
+	Stats *stats = this->_job->getStats();
+	stats->addReceiver(fd, address);
+
+	sigset_t set;
+	sigset_t oldSet;
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &set, &oldSet);
+
+	pthread_t thread;
+	int error = pthread_create(&thread, 0, Spool::receiverThread, receiver);
+
+	pthread_sigmask(SIG_SETMASK, &oldSet, 0);
+
+	if(error != 0) {
+		pthread_mutex_unlock(&this->_mutex);
+		stats->removeReceiver(fd);
+		delete receiver;
+		Spool::closeReceiver(fd, handshake);
+
+		InitializationException ex;
+		throw ex;
+	}
+
+	this->_threads.push_back(thread);
+	this->_connections.insert(fd);
+
+	pthread_mutex_unlock(&this->_mutex);
+
+	log->debug("Spool::addReceiver() end");
+}
+
+/**
+ * \brief Closes the connections of a receiver that isn't sent the stream
+ *
+ * \param fd
+ * 		Socket connected to the receiver
+ * \param handshake
+ * 		What the receiver and the server have agreed
+ */
+void Spool::closeReceiver(int fd, const dcHandshake &handshake) {
+	close(fd);
+
+	std::vector<int>::const_iterator it;
+	for(it = handshake.stripes.begin(); it != handshake.stripes.end(); ++it) {
+		close(*it);
+	}
+}
+
+/**
+ * \brief Starts writing the stream to the spool file and accepting the late
+ * receivers
+ */
+void Spool::start() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Spool::start() start");
+
+	sigset_t set;
+	sigset_t oldSet;
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &set, &oldSet);
+
+	if(pthread_create(&this->_spoolThread, 0, Spool::spoolThread, this) == 0) {
+		this->_spooling = true;
+	}
+
+	if(this->_spooling && pthread_create(&this->_acceptThread, 0,
+			Spool::acceptThread, this) == 0) {
+		this->_accepting = true;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &oldSet, 0);
+
+	if(!this->_accepting) {
+		this->stop();
+
+		InitializationException ex;
+		throw ex;
+	}
+
+	log->debug("Spool::start() end");
+}
+
+/**
+ * \brief Waits until the number of nodes have received the whole stream
+ *
+ * It must be called after writing the whole stream to the input. The
+ * receivers still being sent the stream then, if any, are interrupted.
+ */
+void Spool::finish() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Spool::finish() start");
+
+	shutdown(this->_input, SHUT_WR);
+
+	// The accepting thread returns when the session has finished
+	pthread_join(this->_acceptThread, 0);
+	this->_accepting = false;
+
+	pthread_mutex_lock(&this->_mutex);
+	bool failed = this->_failed;
+	pthread_mutex_unlock(&this->_mutex);
+
+	this->stop();
+
+	if(failed) {
+		WriteDataException ex;
+		throw ex;
+	}
+
+	log->debug("Spool::finish() end");
+}
+
+/**
+ * \brief Finishes the session and waits for all the threads
+ */
+void Spool::stop() {
+	Logger *log = Logger::getInstance();
+	log->debug("Spool::stop() start");
+
+	pthread_mutex_lock(&this->_mutex);
+	this->_done = true;
+
+	std::set<int>::iterator it;
+	for(it = this->_connections.begin(); it != this->_connections.end();
+			++it) {
+		shutdown(*it, SHUT_RDWR);
+	}
+
+	pthread_cond_broadcast(&this->_changed);
+	pthread_mutex_unlock(&this->_mutex);
+
+	// The threads that add receivers must finish first
+	if(this->_accepting) {
+		pthread_join(this->_acceptThread, 0);
+		this->_accepting = false;
+	}
+
+	if(this->_spooling) {
+		shutdown(this->_output, SHUT_RDWR);
+		pthread_join(this->_spoolThread, 0);
+		this->_spooling = false;
+	}
+
+	std::vector<pthread_t>::iterator itThread;
+	for(itThread = this->_threads.begin(); itThread != this->_threads.end();
+			++itThread) {
+		pthread_join(*itThread, 0);
+	}
+	this->_threads.clear();
+
+	log->debug("Spool::stop() end");
+}
+
+/**
+ * \brief Body of the spooling thread
+ *
+ * \param arg
+ * 		Pointer to the Spool
+ */
+void *Spool::spoolThread(void *arg) {
+	static_cast<Spool *>(arg)->spoolStream();
+
+	return 0;
+}
+
+/**
+ * \brief Writes the stream of the server to the spool file, until the server
+ * shuts down the input
+ *
+ * If the file can't be written, the input is shut down too, so the server
+ * fails instead of waiting.
+ */
+void Spool::spoolStream() {
+	Logger *log = Logger::getInstance();
+	log->debug("Spool::spoolStream() start");
+
+	std::vector<char> buf(Doclone::SPOOL_BUFFER_SIZE);
+	int fileFd = fileno(this->_file);
+	uint64_t offset = 0;
+	bool failed = false;
+
+	while(!failed) {
+		ssize_t nbytes = recv(this->_output, &buf[0], buf.size(), 0);
+
+		if(nbytes < 0 && errno == EINTR) {
+			continue;
+		} else if(nbytes <= 0) {
+			failed = (nbytes < 0);
+			break;
+		}
+
+		ssize_t written = 0;
+		while(written < nbytes) {
+			ssize_t r = pwrite(fileFd, &buf[written], nbytes - written,
+					offset + written);
+
+			if(r < 0 && errno == EINTR) {
+				continue;
+			} else if(r <= 0) {
+				failed = true;
+				break;
+			}
+
+			written += r;
+		}
+
+		offset += written;
+
+		pthread_mutex_lock(&this->_mutex);
+		this->_spooled = offset;
+		pthread_cond_broadcast(&this->_changed);
+		pthread_mutex_unlock(&this->_mutex);
+	}
+
+	pthread_mutex_lock(&this->_mutex);
+	if(failed) {
+		this->_failed = true;
+	} else if(!this->_done) {
+		// The input was shut down by finish(), not by stop()
+		this->_complete = true;
+	}
+	pthread_cond_broadcast(&this->_changed);
+	pthread_mutex_unlock(&this->_mutex);
+
+	if(failed) {
+		log->warn("Can't write the spool file");
+		shutdown(this->_output, SHUT_RDWR);
+	}
+
+	log->debug("Spool::spoolStream(offset=>%d) end", offset);
+}
+
+/**
+ * \brief Body of the accepting thread
+ *
+ * \param arg
+ * 		Pointer to the Spool
+ */
+void *Spool::acceptThread(void *arg) {
+	static_cast<Spool *>(arg)->acceptReceivers();
+
+	return 0;
+}
+
+/**
+ * \brief Accepts the receivers that connect after the server has started
+ * sending, until the number of nodes have received the whole stream
+ *
+ * The thread is bound to the Job of the server, so the views are notified of
+ * the new connections.
+ */
+void Spool::acceptReceivers() {
+	this->_job->bind();
+
+	Logger *log = Logger::getInstance();
+	log->debug("Spool::acceptReceivers() start");
+
+	Clone *dcl = Clone::getInstance();
+
+	pollfd pfd;
+	pfd.fd = this->_listenFd;
+	pfd.events = POLLIN;
+
+	while(true) {
+		pthread_mutex_lock(&this->_mutex);
+		bool finished = this->_done || this->_failed
+				|| this->_completed >= this->_nodesNum;
+		pthread_mutex_unlock(&this->_mutex);
+
+		if(finished) {
+			break;
+		}
+
+		pfd.revents = 0;
+		if(poll(&pfd, 1, Doclone::SPOOL_ACCEPT_TIMEOUT) <= 0) {
+			continue;
+		}
+
+		try {
+			dcHandshake handshake;
+			std::string address;
+			int fd = Unicast::acceptReceiver(this->_listenFd,
+					this->_stripeFd, this->_session, handshake, address);
+
+			if(fd < 0) {
+				continue;
+			}
+
+			if(handshake.offset > 0) {
+				log->info("The receiver %s resumes the session at %llu bytes",
+						address.c_str(), handshake.offset);
+			} else {
+				log->info("The receiver %s joins the session",
+						address.c_str());
+			}
+
+			this->addReceiver(fd, handshake, address);
+
+			// Notify the views
+			dcl->triggerEvent(Doclone::EVT_NEW_CONNECION, address);
+		} catch(const Exception &ex) {
+			ex.logMsg();
+		}
+	}
+
+	log->debug("Spool::acceptReceivers() end");
+
+	Job::unbind();
+}
+
+/**
+ * \brief Body of the threads sending the stream to the receivers
+ *
+ * \param arg
+ * 		Pointer to a dcSpoolReceiver, which is freed here
+ */
+void *Spool::receiverThread(void *arg) {
+	dcSpoolReceiver *receiver = static_cast<dcSpoolReceiver *>(arg);
+	Spool *spool = receiver->spool;
+	int fd = receiver->fd;
+	dcHandshake handshake = receiver->handshake;
+	delete receiver;
+
+	spool->sendStream(fd, handshake);
+
+	return 0;
+}
+
+/**
+ * \brief Sends the whole stream from the spool file to a receiver, waiting
+ * for the data not spooled yet
+ *
+ * Each receiver has its own Job, so its checksums don't mix with the other
+ * ones. If it fails, it's dropped, and it can connect again. A striped stream
+ * is written to the local socket of its Stripes.
+ *
+ * \param fd
+ * 		Socket connected to the receiver
+ * \param handshake
+ * 		What the receiver and the server have agreed. If the receiver already
+ * 		has some data, the stream is sent after it, without the size of the
+ * 		data
+ */
+void Spool::sendStream(int fd, const dcHandshake &handshake) {
+	Job job;
+	job.bind();
+
+	Logger *log = Logger::getInstance();
+	log->debug("Spool::sendStream(fd=>%d, offset=>%d) start", fd,
+			handshake.offset);
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	trns->initSocketWrite();
+	trns->setPoolLimit(this->_poolLimit);
+
+	// The receiver is measured in the Stats of the server
+	Stats *stats = this->_job->getStats();
+
+	Stripes *stripes = 0;
+	int dataFd = fd;
+	char *buf = 0;
+	bool received = false;
+
+	try {
+		if(!handshake.stripes.empty()) {
+			stripes = new Stripes(fd, handshake.stripes, true);
+			dataFd = stripes->getFd();
+		}
+
+		if(handshake.checksums) {
+			trns->enableChecksums(dataFd, handshake.frameVersion,
+					handshake.frameCaps);
+		}
+
+		dcBuffSize size = trns->getBufferSize(Doclone::BUFFER_SOCKET);
+		buf = trns->acquireBuffer(size);
+
+		int fileFd = fileno(this->_file);
+		uint64_t offset = handshake.offset > 0
+				? sizeof(uint64_t) + handshake.offset : 0;
+		uint64_t available = 0;
+
+		while(this->waitData(offset, available)) {
+			if(available == 0) {
+				trns->finishChecksums(dataFd);
+				if(stripes != 0) {
+					stripes->finish();
+				}
+				received = true;
+				break;
+			}
+
+			size_t len = available < static_cast<uint64_t>(size)
+					? available : size;
+			if(pread(fileFd, buf, len, offset)
+					!= static_cast<ssize_t>(len)) {
+				ReadDataException ex;
+				throw ex;
+			}
+
+			// The size of the stream is sent without checksums, see Unicast
+			size_t header = 0;
+			if(offset < sizeof(uint64_t)) {
+				header = sizeof(uint64_t) - offset;
+				header = header < len ? header : len;
+
+				DataTransfer::sendData(dataFd, buf, header);
+			}
+
+			if(len > header) {
+				trns->writeData(dataFd, buf + header, len - header);
+			}
+
+			stats->countReceiverBytes(fd, len);
+			offset += len;
+		}
+	} catch(const Exception &ex) {
+		ex.logMsg();
+	}
+
+	if(!received) {
+		log->info("A receiver has been dropped, it can connect again");
+	}
+
+	if(buf != 0) {
+		trns->releaseBuffer(buf);
+	}
+	trns->disableChecksums(dataFd);
+	stats->removeReceiver(fd);
+
+	pthread_mutex_lock(&this->_mutex);
+	this->_connections.erase(fd);
+	if(stripes != 0) {
+		delete stripes;
+	} else {
+		close(fd);
+	}
+
+	if(received) {
+		this->_completed++;
+	}
+	pthread_mutex_unlock(&this->_mutex);
+
+	log->debug("Spool::sendStream(received=>%d) end", received);
+
+	Job::unbind();
+}
+
+/**
+ * \brief Waits until there is data in the spool file after an offset, or the
+ * whole stream has been spooled
+ *
+ * \param offset
+ * 		Bytes of the stream already sent
+ * \param [out] available
+ * 		Bytes that can be read after the offset, 0 at the end of the stream
+ *
+ * \return false if the session has been interrupted
+ */
+bool Spool::waitData(uint64_t offset, uint64_t &available) {
+	pthread_mutex_lock(&this->_mutex);
+
+	while(offset >= this->_spooled && !this->_complete && !this->_done
+			&& !this->_failed) {
+		pthread_cond_wait(&this->_changed, &this->_mutex);
+	}
+
+	// A receiver can't have more data than the whole stream
+	bool interrupted = this->_done || this->_failed
+			|| offset > this->_spooled;
+	available = interrupted ? 0 : this->_spooled - offset;
+
+	pthread_mutex_unlock(&this->_mutex);
+
+	return !interrupted;
+}
+
+}
@@ -0,0 +1,295 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <doclone/Stats.h>
+
+#include <string.h>
+#include <time.h>
+
+#include <doclone/DataTransfer.h>
+#include <doclone/Job.h>
+
+namespace Doclone {
+
+/**
+ * \brief Initializes the attributes
+ *
+ * \param transfer
+ * 		Transfers of the job
+ */
+Stats::Stats(const DataTransfer *transfer)
+	: _transfer(transfer), _startTime(0), _finishTime(0), _receiversCount(0),
+	  _sampleTime(0), _sampleBytes(0), _rate(0) {
+	memset(this->_stages, 0, sizeof(this->_stages));
+	memset(this->_receivers, 0, sizeof(this->_receivers));
+
+	pthread_mutex_init(&this->_receiversMutex, 0);
+	pthread_mutex_init(&this->_sampleMutex, 0);
+}
+
+Stats::~Stats() {
+	pthread_mutex_destroy(&this->_sampleMutex);
+	pthread_mutex_destroy(&this->_receiversMutex);
+}
+
+/**
+ * \brief Gets the Stats of the job of the calling thread
+ *
+ * \return Pointer to a Stats object
+ */
+Stats *Stats::getInstance() {
+	return Job::getCurrent()->getStats();
+}
+
+/**
+ * \brief Gets the time of the monotonic clock
+ *
+ * \return Nanoseconds since an arbitrary point
+ */
+uint64_t Stats::now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * \brief Clears the counters and starts measuring the time of a job
+ *
+ * No thread of the job may be running.
+ */
+void Stats::start() {
+	for(unsigned int i = 0; i < STATS_STAGES; i++) {
+		__atomic_store_n(&this->_stages[i].bytes, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&this->_stages[i].nanoseconds, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&this->_stages[i].calls, 0, __ATOMIC_RELAXED);
+	}
+
+	pthread_mutex_lock(&this->_receiversMutex);
+	__atomic_store_n(&this->_receiversCount, 0, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&this->_receiversMutex);
+
+	pthread_mutex_lock(&this->_sampleMutex);
+	this->_sampleTime = 0;
+	this->_sampleBytes = 0;
+	this->_rate = 0;
+	pthread_mutex_unlock(&this->_sampleMutex);
+
+	__atomic_store_n(&this->_finishTime, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&this->_startTime, Stats::now(), __ATOMIC_RELEASE);
+}
+
+/**
+ * \brief Stops measuring the time of the job
+ */
+void Stats::finish() {
+	__atomic_store_n(&this->_finishTime, Stats::now(), __ATOMIC_RELEASE);
+}
+
+/**
+ * \brief Adds some work to a stage
+ *
+ * \param stage
+ * 		The stage
+ * \param bytes
+ * 		Bytes processed
+ * \param startTime
+ * 		When the work started, from now()
+ */
+void Stats::addStage(dcStage stage, uint64_t bytes, uint64_t startTime) {
+	dcStageCounters &counters = this->_stages[stage];
+
+	__atomic_fetch_add(&counters.bytes, bytes, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&counters.nanoseconds, Stats::now() - startTime,
+			__ATOMIC_RELAXED);
+	__atomic_fetch_add(&counters.calls, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * \brief Starts measuring what is sent to a receiver
+ *
+ * \param fd
+ * 		Descriptor the receiver is sent the data on
+ * \param address
+ * 		Address of the receiver
+ */
+void Stats::addReceiver(int fd, const std::string &address) {
+	pthread_mutex_lock(&this->_receiversMutex);
+
+	unsigned int count = this->_receiversCount;
+	if(count < STATS_MAX_RECEIVERS) {
+		dcReceiverCounters &receiver = this->_receivers[count];
+
+		strncpy(receiver.address, address.c_str(),
+				sizeof(receiver.address) - 1);
+		receiver.address[sizeof(receiver.address) - 1] = '\0';
+		receiver.connectedTime = Stats::now();
+		receiver.closedTime = 0;
+		receiver.sampleBytes = 0;
+		receiver.rate = 0;
+		receiver.bytes = 0;
+		receiver.fd = fd;
+
+		// The slot is complete before the readers can see it
+		__atomic_store_n(&this->_receiversCount, count + 1, __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_unlock(&this->_receiversMutex);
+}
+
+/**
+ * \brief Stops measuring what is sent to a receiver, which keeps its totals
+ *
+ * \param fd
+ * 		Descriptor the receiver was sent the data on
+ */
+void Stats::removeReceiver(int fd) {
+	unsigned int count = __atomic_load_n(&this->_receiversCount,
+			__ATOMIC_ACQUIRE);
+
+	for(unsigned int i = 0; i < count; i++) {
+		dcReceiverCounters &receiver = this->_receivers[i];
+
+		if(__atomic_load_n(&receiver.fd, __ATOMIC_RELAXED) == fd) {
+			__atomic_store_n(&receiver.closedTime, Stats::now(),
+					__ATOMIC_RELAXED);
+			__atomic_store_n(&receiver.fd, -1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+}
+
+/**
+ * \brief Adds the bytes sent on a descriptor to its receiver, if it has one
+ *
+ * \param fd
+ * 		The descriptor
+ * \param bytes
+ * 		Bytes sent
+ */
+void Stats::countReceiverBytes(int fd, uint64_t bytes) {
+	unsigned int count = __atomic_load_n(&this->_receiversCount,
+			__ATOMIC_ACQUIRE);
+
+	for(unsigned int i = 0; i < count; i++) {
+		dcReceiverCounters &receiver = this->_receivers[i];
+
+		if(__atomic_load_n(&receiver.fd, __ATOMIC_RELAXED) == fd) {
+			__atomic_fetch_add(&receiver.bytes, bytes, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+}
+
+/**
+ * \brief Takes a snapshot of the counters
+ *
+ * It can be called from any thread, even one that isn't bound to the job.
+ *
+ * \param [out] stats
+ * 		The snapshot
+ */
+void Stats::getSnapshot(dcStats &stats) {
+	uint64_t now = Stats::now();
+	uint64_t startTime = __atomic_load_n(&this->_startTime, __ATOMIC_ACQUIRE);
+	uint64_t finishTime = __atomic_load_n(&this->_finishTime,
+			__ATOMIC_ACQUIRE);
+	uint64_t endTime = finishTime != 0 ? finishTime : now;
+
+	stats.totalSize = this->_transfer->getTotalSize();
+	stats.transferredBytes = this->_transfer->getTransferredBytes();
+	stats.elapsed = startTime != 0 && endTime > startTime
+			? (endTime - startTime) / 1e9 : 0;
+	stats.averageRate = stats.elapsed > 0
+			? stats.transferredBytes / stats.elapsed : 0;
+	stats.finished = (finishTime != 0);
+
+	for(unsigned int i = 0; i < STATS_STAGES; i++) {
+		stats.stages[i].bytes = __atomic_load_n(&this->_stages[i].bytes,
+				__ATOMIC_RELAXED);
+		stats.stages[i].seconds = __atomic_load_n(
+				&this->_stages[i].nanoseconds, __ATOMIC_RELAXED) / 1e9;
+		stats.stages[i].calls = __atomic_load_n(&this->_stages[i].calls,
+				__ATOMIC_RELAXED);
+	}
+
+	unsigned int count = __atomic_load_n(&this->_receiversCount,
+			__ATOMIC_ACQUIRE);
+
+	pthread_mutex_lock(&this->_sampleMutex);
+
+	// A new sample if the last one is old enough
+	bool sample = (now - this->_sampleTime >= STATS_RATE_INTERVAL);
+	double interval = (now - this->_sampleTime) / 1e9;
+	bool first = (this->_sampleTime == 0);
+
+	if(sample) {
+		this->_rate = first ? stats.averageRate
+				: (stats.transferredBytes - this->_sampleBytes) / interval;
+		this->_sampleTime = now;
+		this->_sampleBytes = stats.transferredBytes;
+	}
+
+	stats.rate = stats.finished ? 0 : this->_rate;
+
+	stats.receivers.resize(count);
+	for(unsigned int i = 0; i < count; i++) {
+		dcReceiverCounters &counters = this->_receivers[i];
+		dcReceiverStats &receiver = stats.receivers[i];
+
+		uint64_t bytes = __atomic_load_n(&counters.bytes, __ATOMIC_RELAXED);
+		uint64_t closedTime = __atomic_load_n(&counters.closedTime,
+				__ATOMIC_RELAXED);
+		uint64_t receiverEnd = closedTime != 0 ? closedTime : endTime;
+		double receiverElapsed = receiverEnd > counters.connectedTime
+				? (receiverEnd - counters.connectedTime) / 1e9 : 0;
+
+		receiver.address = counters.address;
+		receiver.bytes = bytes;
+		receiver.averageRate = receiverElapsed > 0
+				? bytes / receiverElapsed : 0;
+		receiver.connected = (closedTime == 0);
+
+		if(sample) {
+			counters.rate = first || counters.sampleBytes == 0
+					? receiver.averageRate
+					: (bytes - counters.sampleBytes) / interval;
+			counters.sampleBytes = bytes;
+		}
+
+		receiver.rate = receiver.connected && !stats.finished
+				? counters.rate : 0;
+	}
+
+	pthread_mutex_unlock(&this->_sampleMutex);
+
+	// The instantaneous rate, or the average one until there is a sample
+	double rate = stats.rate > 0 ? stats.rate : stats.averageRate;
+	if(stats.finished) {
+		stats.eta = 0;
+	} else if(stats.totalSize == 0 || rate <= 0) {
+		stats.eta = -1;
+	} else if(stats.transferredBytes >= stats.totalSize) {
+		stats.eta = 0;
+	} else {
+		stats.eta = (stats.totalSize - stats.transferredBytes) / rate;
+	}
+}
+
+}
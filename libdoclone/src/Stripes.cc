@@ -0,0 +1,947 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <doclone/Stripes.h>
+
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <endian.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <doclone/Clone.h>
+#include <doclone/DataTransfer.h>
+#include <doclone/Logger.h>
+#include <doclone/NetNode.h>
+#include <doclone/Util.h>
+#include <doclone/exception/ConnectionException.h>
+#include <doclone/exception/InitializationException.h>
+#include <doclone/exception/SendDataException.h>
+
+namespace Doclone {
+
+/**
+ * \brief Creates the local socket and starts the threads that send or
+ * receive the stream
+ *
+ * \param fd
+ * 		The connection of the offer. It's closed by the stripes, unless this
+ * 		constructor fails
+ * \param stripes
+ * 		The other connections. The stripes close them, even if this
+ * 		constructor fails
+ * \param sending
+ * 		Whether the stream is sent or received
+ */
+Stripes::Stripes(int fd, const std::vector<int> &stripes, bool sending)
+		throw(Exception)
+	: _sending(sending), _sockets(), _fd(-1), _end(-1), _threads(),
+	  _window(0), _queue(), _pending(), _free(), _next(0), _total(0), _ended(0),
+	  _eof(false), _failed(false) {
+	Logger *log = Logger::getInstance();
+	log->debug("Stripes::Stripes(fd=>%d, stripes=>%d, sending=>%d) start",
+			fd, stripes.size(), sending);
+
+	this->_sockets.push_back(fd);
+	this->_sockets.insert(this->_sockets.end(), stripes.begin(),
+			stripes.end());
+
+	this->_window = this->_sockets.size() * Doclone::STRIPE_WINDOW;
+
+	// The chunks take their part of the memory limit of the job
+	uint64_t poolLimit = DataTransfer::getInstance()->getPoolLimit();
+	if(poolLimit > 0) {
+		uint64_t chunks = poolLimit / Doclone::STRIPE_POOL_QUOTIENT
+				/ Doclone::STRIPE_CHUNK_SIZE;
+		if(chunks < this->_sockets.size()) {
+			chunks = this->_sockets.size();
+		}
+
+		if(chunks < this->_window) {
+			this->_window = chunks;
+		}
+	}
+
+	pthread_mutex_init(&this->_mutex, 0);
+	pthread_cond_init(&this->_changed, 0);
+
+	int sockets[2];
+	bool started = (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0,
+			sockets) == 0);
+
+	if(started) {
+		this->_fd = sockets[0];
+		this->_end = sockets[1];
+
+		// SIGINT and SIGPIPE are left to the thread of the user
+		sigset_t set;
+		sigset_t oldSet;
+		sigemptyset(&set);
+		sigaddset(&set, SIGINT);
+		sigaddset(&set, SIGPIPE);
+		pthread_sigmask(SIG_BLOCK, &set, &oldSet);
+
+		void *(*body)(void *) = sending ? Stripes::sendThread
+				: Stripes::recvThread;
+
+		std::vector<int>::iterator it;
+		for(it = this->_sockets.begin();
+				started && it != this->_sockets.end(); ++it) {
+			dcStripe *stripe = new dcStripe();
+			stripe->stripes = this;
+			stripe->fd = *it;
+
+			pthread_t thread;
+			if(pthread_create(&thread, 0, body, stripe) == 0) {
+				this->_threads.push_back(thread);
+			} else {
+				delete stripe;
+				started = false;
+			}
+		}
+
+		pthread_t thread;
+		if(started && pthread_create(&thread, 0, sending
+				? Stripes::splitThread : Stripes::joinThread, this) == 0) {
+			this->_threads.push_back(thread);
+		} else {
+			started = false;
+		}
+
+		pthread_sigmask(SIG_SETMASK, &oldSet, 0);
+	}
+
+	if(!started) {
+		this->stop();
+
+		for(unsigned int i = 1; i < this->_sockets.size(); i++) {
+			close(this->_sockets[i]);
+		}
+
+		if(this->_fd >= 0) {
+			close(this->_fd);
+			close(this->_end);
+		}
+
+		pthread_cond_destroy(&this->_changed);
+		pthread_mutex_destroy(&this->_mutex);
+
+		InitializationException ex;
+		throw ex;
+	}
+
+	log->debug("Stripes::Stripes() end");
+}
+
+/**
+ * \brief Interrupts the stream, if it hasn't finished, and closes all the
+ * connections
+ */
+Stripes::~Stripes() {
+	this->stop();
+
+	std::vector<int>::iterator it;
+	for(it = this->_sockets.begin(); it != this->_sockets.end(); ++it) {
+		close(*it);
+	}
+
+	close(this->_fd);
+	close(this->_end);
+
+	std::deque<dcStripeChunk>::iterator itQueue;
+	for(itQueue = this->_queue.begin(); itQueue != this->_queue.end();
+			++itQueue) {
+		delete[] itQueue->data;
+	}
+
+	std::map<uint64_t, dcStripeChunk>::iterator itPending;
+	for(itPending = this->_pending.begin();
+			itPending != this->_pending.end(); ++itPending) {
+		delete[] itPending->second.data;
+	}
+
+	std::vector<char *>::iterator itFree;
+	for(itFree = this->_free.begin(); itFree != this->_free.end();
+			++itFree) {
+		delete[] *itFree;
+	}
+
+	pthread_cond_destroy(&this->_changed);
+	pthread_mutex_destroy(&this->_mutex);
+}
+
+/**
+ * \brief Gets the local socket the stream is written to, or read from
+ *
+ * It's closed by the stripes.
+ */
+int Stripes::getFd() const {
+	return this->_fd;
+}
+
+/**
+ * \brief Waits until the whole stream has been sent
+ *
+ * It must be called by the sender after writing the whole stream.
+ */
+void Stripes::finish() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Stripes::finish() start");
+
+	shutdown(this->_fd, SHUT_WR);
+
+	std::vector<pthread_t>::iterator it;
+	for(it = this->_threads.begin(); it != this->_threads.end(); ++it) {
+		pthread_join(*it, 0);
+	}
+	this->_threads.clear();
+
+	pthread_mutex_lock(&this->_mutex);
+	bool failed = this->_failed;
+	pthread_mutex_unlock(&this->_mutex);
+
+	if(failed) {
+		sockaddr_in address = {};
+		socklen_t size = sizeof(address);
+		getpeername(this->_sockets[0], reinterpret_cast<sockaddr*>(&address),
+				&size);
+
+		SendDataException ex(inet_ntoa(address.sin_addr));
+		throw ex;
+	}
+
+	log->debug("Stripes::finish() end");
+}
+
+/**
+ * \brief Interrupts the stream and waits for all the threads
+ */
+void Stripes::stop() {
+	this->fail();
+
+	std::vector<pthread_t>::iterator it;
+	for(it = this->_threads.begin(); it != this->_threads.end(); ++it) {
+		pthread_join(*it, 0);
+	}
+	this->_threads.clear();
+}
+
+/**
+ * \brief Interrupts the stream, waking up all the threads
+ *
+ * The user gets an error, or the end of the stream, on the local socket.
+ */
+void Stripes::fail() {
+	pthread_mutex_lock(&this->_mutex);
+	bool failed = this->_failed;
+	this->_failed = true;
+	pthread_cond_broadcast(&this->_changed);
+	pthread_mutex_unlock(&this->_mutex);
+
+	if(failed) {
+		return;
+	}
+
+	std::vector<int>::iterator it;
+	for(it = this->_sockets.begin(); it != this->_sockets.end(); ++it) {
+		shutdown(*it, SHUT_RDWR);
+	}
+
+	if(this->_end >= 0) {
+		shutdown(this->_end, SHUT_RDWR);
+	}
+}
+
+/**
+ * \brief Gets a buffer for a chunk, reusing the ones already sent or written
+ *
+ * It must be called with the mutex locked.
+ */
+char *Stripes::acquireChunk() {
+	if(this->_free.empty()) {
+		return new char[Doclone::STRIPE_CHUNK_SIZE];
+	}
+
+	char *buf = this->_free.back();
+	this->_free.pop_back();
+
+	return buf;
+}
+
+/**
+ * \brief Writes a whole buffer to a socket
+ *
+ * \return false if the socket fails
+ */
+bool Stripes::sendAll(int fd, const void *buf, size_t len) {
+	const char *data = static_cast<const char *>(buf);
+
+	while(len > 0) {
+		ssize_t nbytes = send(fd, data, len, MSG_NOSIGNAL);
+
+		if(nbytes < 0 && errno == EINTR) {
+			continue;
+		} else if(nbytes <= 0) {
+			return false;
+		}
+
+		data += nbytes;
+		len -= nbytes;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Reads a whole buffer from a socket
+ *
+ * \return false if the socket fails or is closed before
+ */
+bool Stripes::recvAll(int fd, void *buf, size_t len) {
+	char *data = static_cast<char *>(buf);
+
+	while(len > 0) {
+		ssize_t nbytes = recv(fd, data, len, 0);
+
+		if(nbytes < 0 && errno == EINTR) {
+			continue;
+		} else if(nbytes <= 0) {
+			return false;
+		}
+
+		data += nbytes;
+		len -= nbytes;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Body of the thread splitting the stream into chunks
+ *
+ * \param arg
+ * 		Pointer to the Stripes
+ */
+void *Stripes::splitThread(void *arg) {
+	static_cast<Stripes *>(arg)->splitStream();
+
+	return 0;
+}
+
+/**
+ * \brief Reads the stream of the user in chunks and queues them, until the
+ * user shuts down the local socket
+ */
+void Stripes::splitStream() {
+	Logger *log = Logger::getInstance();
+	log->debug("Stripes::splitStream() start");
+
+	uint64_t seq = 0;
+
+	while(true) {
+		pthread_mutex_lock(&this->_mutex);
+		while(this->_queue.size() >= this->_window && !this->_failed) {
+			pthread_cond_wait(&this->_changed, &this->_mutex);
+		}
+
+		if(this->_failed) {
+			pthread_mutex_unlock(&this->_mutex);
+			break;
+		}
+
+		char *buf = this->acquireChunk();
+		pthread_mutex_unlock(&this->_mutex);
+
+		// Full chunks, but the last one
+		size_t len = 0;
+		bool error = false;
+		while(len < Doclone::STRIPE_CHUNK_SIZE) {
+			ssize_t nbytes = recv(this->_end, buf + len,
+					Doclone::STRIPE_CHUNK_SIZE - len, 0);
+
+			if(nbytes < 0 && errno == EINTR) {
+				continue;
+			} else if(nbytes <= 0) {
+				error = (nbytes < 0);
+				break;
+			}
+
+			len += nbytes;
+		}
+
+		pthread_mutex_lock(&this->_mutex);
+		if(error || len == 0) {
+			this->_free.push_back(buf);
+		} else {
+			dcStripeChunk chunk = { seq++, static_cast<uint32_t>(len), buf };
+			this->_queue.push_back(chunk);
+		}
+
+		if(!error && len == 0) {
+			this->_eof = true;
+			this->_total = seq;
+		}
+		pthread_cond_broadcast(&this->_changed);
+		pthread_mutex_unlock(&this->_mutex);
+
+		if(error) {
+			this->fail();
+			break;
+		} else if(len == 0) {
+			break;
+		}
+	}
+
+	log->debug("Stripes::splitStream(chunks=>%d) end", seq);
+}
+
+/**
+ * \brief Body of the threads sending the chunks on each connection
+ *
+ * \param arg
+ * 		Pointer to a dcStripe, which is freed here
+ */
+void *Stripes::sendThread(void *arg) {
+	dcStripe *stripe = static_cast<dcStripe *>(arg);
+	Stripes *stripes = stripe->stripes;
+	int fd = stripe->fd;
+	delete stripe;
+
+	stripes->sendStripe(fd);
+
+	return 0;
+}
+
+/**
+ * \brief Sends the queued chunks on a connection, and ends it when the whole
+ * stream has been sent
+ *
+ * \param fd
+ * 		The connection
+ */
+void Stripes::sendStripe(int fd) {
+	Logger *log = Logger::getInstance();
+	log->debug("Stripes::sendStripe(fd=>%d) start", fd);
+
+	bool ended = false;
+
+	while(!ended) {
+		pthread_mutex_lock(&this->_mutex);
+		while(this->_queue.empty() && !this->_eof && !this->_failed) {
+			pthread_cond_wait(&this->_changed, &this->_mutex);
+		}
+
+		if(this->_failed) {
+			pthread_mutex_unlock(&this->_mutex);
+			break;
+		}
+
+		// The end of the stripe has no data, and the number of chunks
+		dcStripeChunk chunk = { this->_total, 0, 0 };
+		if(!this->_queue.empty()) {
+			chunk = this->_queue.front();
+			this->_queue.pop_front();
+			pthread_cond_broadcast(&this->_changed);
+		}
+		pthread_mutex_unlock(&this->_mutex);
+
+		char header[sizeof(uint64_t) + sizeof(uint32_t)];
+		uint64_t seq = htobe64(chunk.seq);
+		uint32_t length = htobe32(chunk.length);
+		memcpy(header, &seq, sizeof(seq));
+		memcpy(header + sizeof(seq), &length, sizeof(length));
+
+		bool sent = Stripes::sendAll(fd, header, sizeof(header))
+				&& Stripes::sendAll(fd, chunk.data, chunk.length);
+
+		pthread_mutex_lock(&this->_mutex);
+		if(chunk.data != 0) {
+			this->_free.push_back(chunk.data);
+		} else if(sent) {
+			this->_ended++;
+			ended = true;
+		}
+		pthread_mutex_unlock(&this->_mutex);
+
+		if(!sent) {
+			this->fail();
+			break;
+		}
+	}
+
+	if(ended) {
+		shutdown(fd, SHUT_WR);
+	}
+
+	log->debug("Stripes::sendStripe(ended=>%d) end", ended);
+}
+
+/**
+ * \brief Body of the threads receiving the chunks of each connection
+ *
+ * \param arg
+ * 		Pointer to a dcStripe, which is freed here
+ */
+void *Stripes::recvThread(void *arg) {
+	dcStripe *stripe = static_cast<dcStripe *>(arg);
+	Stripes *stripes = stripe->stripes;
+	int fd = stripe->fd;
+	delete stripe;
+
+	stripes->recvStripe(fd);
+
+	return 0;
+}
+
+/**
+ * \brief Receives the chunks of a connection, until it ends
+ *
+ * A chunk too far ahead of the ones written is waited to be read, so a slow
+ * connection makes the others slow down instead of filling the memory. It
+ * can't block the stream: the next chunk is never behind it in its
+ * connection.
+ *
+ * \param fd
+ * 		The connection
+ */
+void Stripes::recvStripe(int fd) {
+	Logger *log = Logger::getInstance();
+	log->debug("Stripes::recvStripe(fd=>%d) start", fd);
+
+	bool ended = false;
+
+	while(!ended) {
+		char header[sizeof(uint64_t) + sizeof(uint32_t)];
+		if(!Stripes::recvAll(fd, header, sizeof(header))) {
+			this->fail();
+			break;
+		}
+
+		uint64_t seq;
+		uint32_t length;
+		memcpy(&seq, header, sizeof(seq));
+		memcpy(&length, header + sizeof(seq), sizeof(length));
+		seq = be64toh(seq);
+		length = be32toh(length);
+
+		if(length > Doclone::STRIPE_CHUNK_SIZE) {
+			this->fail();
+			break;
+		}
+
+		pthread_mutex_lock(&this->_mutex);
+		if(length == 0) {
+			this->_total = seq;
+			this->_ended++;
+			pthread_cond_broadcast(&this->_changed);
+			pthread_mutex_unlock(&this->_mutex);
+
+			ended = true;
+			break;
+		}
+
+		while(seq >= this->_next + this->_window && !this->_failed) {
+			pthread_cond_wait(&this->_changed, &this->_mutex);
+		}
+
+		if(this->_failed) {
+			pthread_mutex_unlock(&this->_mutex);
+			break;
+		}
+
+		char *buf = this->acquireChunk();
+		pthread_mutex_unlock(&this->_mutex);
+
+		bool received = Stripes::recvAll(fd, buf, length);
+
+		// A chunk received twice means a broken stream
+		bool duplicated = false;
+
+		pthread_mutex_lock(&this->_mutex);
+		if(received) {
+			dcStripeChunk chunk = { seq, length, buf };
+			duplicated = seq < this->_next || !this->_pending.insert(
+					std::make_pair(seq, chunk)).second;
+		}
+
+		if(received && !duplicated) {
+			pthread_cond_broadcast(&this->_changed);
+		} else {
+			this->_free.push_back(buf);
+		}
+		pthread_mutex_unlock(&this->_mutex);
+
+		if(duplicated) {
+			log->warn("A striped stream has received a chunk twice");
+		}
+
+		if(!received || duplicated) {
+			this->fail();
+			break;
+		}
+	}
+
+	log->debug("Stripes::recvStripe(ended=>%d) end", ended);
+}
+
+/**
+ * \brief Body of the thread joining the chunks
+ *
+ * \param arg
+ * 		Pointer to the Stripes
+ */
+void *Stripes::joinThread(void *arg) {
+	static_cast<Stripes *>(arg)->joinStream();
+
+	return 0;
+}
+
+/**
+ * \brief Writes the chunks received to the local socket in order, and shuts
+ * it down when all the connections have ended
+ *
+ * If a chunk is missing then, the stream is interrupted.
+ */
+void Stripes::joinStream() {
+	Logger *log = Logger::getInstance();
+	log->debug("Stripes::joinStream() start");
+
+	while(true) {
+		pthread_mutex_lock(&this->_mutex);
+		while(!this->_failed && this->_ended < this->_sockets.size()
+				&& (this->_pending.empty()
+						|| this->_pending.begin()->first != this->_next)) {
+			pthread_cond_wait(&this->_changed, &this->_mutex);
+		}
+
+		if(this->_failed) {
+			pthread_mutex_unlock(&this->_mutex);
+			break;
+		}
+
+		if(this->_pending.empty()
+				|| this->_pending.begin()->first != this->_next) {
+			bool complete = this->_pending.empty()
+					&& this->_next == this->_total;
+			pthread_mutex_unlock(&this->_mutex);
+
+			if(complete) {
+				shutdown(this->_end, SHUT_WR);
+			} else {
+				log->warn("A striped stream has ended without all its data");
+				this->fail();
+			}
+			break;
+		}
+
+		dcStripeChunk chunk = this->_pending.begin()->second;
+		this->_pending.erase(this->_pending.begin());
+		pthread_mutex_unlock(&this->_mutex);
+
+		bool written = Stripes::sendAll(this->_end, chunk.data, chunk.length);
+
+		pthread_mutex_lock(&this->_mutex);
+		this->_free.push_back(chunk.data);
+		this->_next++;
+		pthread_cond_broadcast(&this->_changed);
+		pthread_mutex_unlock(&this->_mutex);
+
+		if(!written) {
+			this->fail();
+			break;
+		}
+	}
+
+	log->debug("Stripes::joinStream(chunks=>%d) end", this->_next);
+}
+
+/**
+ * \brief Gets the number of connections of the streams sent by the job
+ */
+unsigned int Stripes::getStreams() {
+	Clone *dcl = Clone::getInstance();
+	unsigned int streams = dcl->getStreams();
+
+	if(streams == 0) {
+		return 1;
+	} else if(streams > Doclone::MAX_STRIPES) {
+		return Doclone::MAX_STRIPES;
+	}
+
+	return streams;
+}
+
+/**
+ * \brief Sets the size of the buffers of a socket to the one of the job, if
+ * it has been set
+ *
+ * It must be called before connecting the socket, or before listening on it,
+ * so the window of TCP can grow to it. The kernel limits it to the
+ * net.core.wmem_max and net.core.rmem_max sysctls.
+ *
+ * \param fd
+ * 		The socket
+ */
+void Stripes::setBufferSize(int fd) {
+	Clone *dcl = Clone::getInstance();
+	unsigned int socketBuffer = dcl->getSocketBuffer();
+
+	if(socketBuffer == 0) {
+		return;
+	}
+
+	int size = socketBuffer * 1024;
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+/**
+ * \brief Creates the socket where the connections of the striped streams
+ * are accepted
+ *
+ * \return The listening socket
+ */
+int Stripes::listenStripes() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Stripes::listenStripes() start");
+
+	int fd;
+	if((fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+		ConnectionException ex;
+		throw ex;
+	}
+
+	// Connect even in TIME_WAIT state
+	int iSetOption = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &iSetOption,
+			sizeof(iSetOption));
+
+	Stripes::setBufferSize(fd);
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(Doclone::PORT_STRIPE);
+	address.sin_addr.s_addr = INADDR_ANY;
+
+	if(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+			|| listen(fd, SOMAXCONN) < 0) {
+		close(fd);
+
+		ConnectionException ex;
+		throw ex;
+	}
+
+	log->debug("Stripes::listenStripes(fd=>%d) end", fd);
+	return fd;
+}
+
+/**
+ * \brief Offers a striped stream on a connection
+ *
+ * \param fd
+ * 		The connection
+ * \param count
+ * 		Number of connections of the stream, this one included
+ *
+ * \return The token the other connections must send
+ */
+uint64_t Stripes::offer(int fd, unsigned int count) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Stripes::offer(fd=>%d, count=>%d) start", fd, count);
+
+	uint8_t tmpCount = count;
+	uint64_t token = Util::randomId();
+	uint64_t tmpToken = htobe64(token);
+
+	DataTransfer::sendData(fd, &tmpCount, sizeof(tmpCount));
+	DataTransfer::sendData(fd, &tmpToken, sizeof(tmpToken));
+
+	log->debug("Stripes::offer() end");
+	return token;
+}
+
+/**
+ * \brief Reads the offer of a striped stream
+ *
+ * \param fd
+ * 		The connection
+ * \param [out] token
+ * 		The token the other connections must send
+ *
+ * \return Number of connections of the stream, this one included
+ */
+unsigned int Stripes::readOffer(int fd, uint64_t &token) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Stripes::readOffer(fd=>%d) start", fd);
+
+	uint8_t count;
+	DataTransfer::recvData(fd, &count, sizeof(count));
+	DataTransfer::recvData(fd, &token, sizeof(token));
+	token = be64toh(token);
+
+	if(count == 0 || count > Doclone::MAX_STRIPES) {
+		ConnectionException ex;
+		throw ex;
+	}
+
+	log->debug("Stripes::readOffer(count=>%d) end", count);
+	return count;
+}
+
+/**
+ * \brief Accepts the other connections of a striped stream
+ *
+ * The connections with another token are closed.
+ *
+ * \param listenFd
+ * 		The socket of listenStripes()
+ * \param token
+ * 		The token of the offer
+ * \param count
+ * 		Number of connections of the stream, the one of the offer included
+ * \param [out] stripes
+ * 		The connections accepted
+ *
+ * \return false if they don't connect in STRIPE_ACCEPT_TIMEOUT
+ */
+bool Stripes::acceptStripes(int listenFd, uint64_t token, unsigned int count,
+		std::vector<int> &stripes) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Stripes::acceptStripes(listenFd=>%d, count=>%d) start",
+			listenFd, count);
+
+	pollfd pfd;
+	pfd.fd = listenFd;
+	pfd.events = POLLIN;
+
+	// A connection that doesn't send its token doesn't block the others
+	timeval timeout;
+	timeout.tv_sec = Doclone::STRIPE_ACCEPT_TIMEOUT / 1000;
+	timeout.tv_usec = 0;
+	timeval noTimeout = { 0, 0 };
+
+	bool accepted = true;
+	while(stripes.size() + 1 < count) {
+		pfd.revents = 0;
+		int ready = poll(&pfd, 1, Doclone::STRIPE_ACCEPT_TIMEOUT);
+
+		if(ready < 0 && errno == EINTR) {
+			continue;
+		} else if(ready <= 0) {
+			accepted = false;
+			break;
+		}
+
+		int fd = accept(listenFd, 0, 0);
+		if(fd < 0) {
+			continue;
+		}
+
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		uint64_t clnToken;
+		uint8_t index;
+		if(Stripes::recvAll(fd, &clnToken, sizeof(clnToken))
+				&& Stripes::recvAll(fd, &index, sizeof(index))
+				&& be64toh(clnToken) == token && index > 0 && index < count) {
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &noTimeout,
+					sizeof(noTimeout));
+			stripes.push_back(fd);
+		} else {
+			close(fd);
+		}
+	}
+
+	if(!accepted) {
+		std::vector<int>::iterator it;
+		for(it = stripes.begin(); it != stripes.end(); ++it) {
+			close(*it);
+		}
+		stripes.clear();
+	}
+
+	log->debug("Stripes::acceptStripes(accepted=>%d) end", accepted);
+	return accepted;
+}
+
+/**
+ * \brief Opens the other connections of a striped stream, to the host of
+ * the connection of the offer
+ *
+ * \param fd
+ * 		The connection of the offer
+ * \param token
+ * 		The token of the offer
+ * \param count
+ * 		Number of connections of the stream, the one of the offer included
+ * \param [out] stripes
+ * 		The connections opened
+ */
+void Stripes::connectStripes(int fd, uint64_t token, unsigned int count,
+		std::vector<int> &stripes) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Stripes::connectStripes(fd=>%d, count=>%d) start", fd,
+			count);
+
+	sockaddr_in address = {};
+	socklen_t size = sizeof(address);
+	bool connected = (getpeername(fd, reinterpret_cast<sockaddr*>(&address),
+			&size) == 0);
+	address.sin_port = htons(Doclone::PORT_STRIPE);
+
+	uint64_t tmpToken = htobe64(token);
+
+	for(unsigned int i = 1; connected && i < count; i++) {
+		int stripe;
+		if((stripe = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+			connected = false;
+			break;
+		}
+
+		stripes.push_back(stripe);
+		Stripes::setBufferSize(stripe);
+
+		uint8_t index = i;
+		connected = connect(stripe, reinterpret_cast<sockaddr*>(&address),
+				sizeof(address)) == 0
+				&& Stripes::sendAll(stripe, &tmpToken, sizeof(tmpToken))
+				&& Stripes::sendAll(stripe, &index, sizeof(index));
+	}
+
+	if(!connected) {
+		std::vector<int>::iterator it;
+		for(it = stripes.begin(); it != stripes.end(); ++it) {
+			close(*it);
+		}
+		stripes.clear();
+
+		ConnectionException ex;
+		throw ex;
+	}
+
+	log->debug("Stripes::connectStripes() end");
+}
+
+}
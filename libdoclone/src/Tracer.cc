@@ -0,0 +1,468 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <doclone/Tracer.h>
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+
+#include <doclone/Job.h>
+#include <doclone/Logger.h>
+
+namespace Doclone {
+
+/// Names of the operations in the traces, indexed by dcOperationType
+static const char *operationNames[] = {
+	"none", "read partition table", "make disklabel", "create partition",
+	"format partition", "write partition flags", "write filesystem label",
+	"write filesystem UUID", "read data", "write data", "install GRUB",
+	"transfer data", "wait for the server", "wait for the clients",
+	"verify data"
+};
+
+/// Names of the stages in the traces, indexed by dcStage
+static const char *stageNames[] = {
+	"walk", "read", "compress", "send", "receive", "extract", "fsync"
+};
+
+/**
+ * \brief Quotes a string for JSON
+ */
+static std::string jsonString(const std::string &str) {
+	std::string quoted = "\"";
+
+	for(std::string::const_iterator it = str.begin(); it != str.end(); ++it) {
+		unsigned char c = *it;
+
+		if(c == '"' || c == '\\') {
+			quoted += '\\';
+			quoted += c;
+		} else if(c < 0x20) {
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			quoted += escaped;
+		} else {
+			quoted += c;
+		}
+	}
+
+	quoted += '"';
+
+	return quoted;
+}
+
+/**
+ * \brief Initializes the attributes
+ *
+ * \param stats
+ * 		Counters of the job
+ */
+Tracer::Tracer(Stats *stats)
+	: _stats(stats), _path(), _enabled(false), _events(), _operations(),
+	  _eventsMutex(), _sampler(), _samplerStarted(false), _stopping(false),
+	  _samplerMutex(), _samplerCond() {
+	pthread_mutex_init(&this->_eventsMutex, 0);
+	pthread_mutex_init(&this->_samplerMutex, 0);
+
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&this->_samplerCond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+Tracer::~Tracer() {
+	this->finish();
+
+	pthread_cond_destroy(&this->_samplerCond);
+	pthread_mutex_destroy(&this->_samplerMutex);
+	pthread_mutex_destroy(&this->_eventsMutex);
+}
+
+/**
+ * \brief Gets the Tracer of the job of the calling thread
+ *
+ * \return Pointer to a Tracer object
+ */
+Tracer *Tracer::getInstance() {
+	return Job::getCurrent()->getTracer();
+}
+
+/**
+ * \brief Starts recording the job
+ *
+ * \param path
+ * 		File the trace is written in when the job finishes, empty to record
+ * 		nothing
+ */
+void Tracer::start(const std::string &path) {
+	Logger *log = Logger::getInstance();
+	log->debug("Tracer::start(path=>%s) start", path.c_str());
+
+	if(path.empty()) {
+		log->debug("Tracer::start() end");
+		return;
+	}
+
+	pthread_mutex_lock(&this->_eventsMutex);
+	this->_path = path;
+	this->_events.clear();
+	this->_operations.clear();
+	pthread_mutex_unlock(&this->_eventsMutex);
+
+	__atomic_store_n(&this->_enabled, true, __ATOMIC_RELEASE);
+
+	this->_stopping = false;
+	this->_samplerStarted = (pthread_create(&this->_sampler, 0,
+			Tracer::samplerThread, this) == 0);
+
+	log->debug("Tracer::start() end");
+}
+
+/**
+ * \brief Stops recording and writes the trace
+ *
+ * The operations still pending end at this moment.
+ */
+void Tracer::finish() {
+	if(!this->isEnabled()) {
+		return;
+	}
+
+	Logger *log = Logger::getInstance();
+	log->debug("Tracer::finish() start");
+
+	if(this->_samplerStarted) {
+		pthread_mutex_lock(&this->_samplerMutex);
+		this->_stopping = true;
+		pthread_cond_signal(&this->_samplerCond);
+		pthread_mutex_unlock(&this->_samplerMutex);
+
+		pthread_join(this->_sampler, 0);
+		this->_samplerStarted = false;
+	}
+
+	__atomic_store_n(&this->_enabled, false, __ATOMIC_RELEASE);
+
+	this->write(Stats::now());
+
+	log->debug("Tracer::finish() end");
+}
+
+/**
+ * \brief Whether the events are recorded
+ */
+bool Tracer::isEnabled() const {
+	return __atomic_load_n(&this->_enabled, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * \brief Records a span that ends now, in the calling thread
+ *
+ * \param category
+ * 		Category of the span, like "command" or "mount"
+ * \param name
+ * 		Name of the span
+ * \param startTime
+ * 		When it started, see Stats::now()
+ * \param detail
+ * 		What it worked with, like a command line or a device
+ */
+void Tracer::addSpan(const std::string &category, const std::string &name,
+		uint64_t startTime, const std::string &detail) {
+	if(!this->isEnabled()) {
+		return;
+	}
+
+	dcTraceEvent event;
+	event.phase = 'X';
+	event.category = category;
+	event.name = name;
+	event.start = startTime;
+	event.duration = Stats::now() - startTime;
+	event.thread = Tracer::getThreadId();
+	event.args = "\"detail\":" + jsonString(detail);
+
+	pthread_mutex_lock(&this->_eventsMutex);
+	this->_events.push_back(event);
+	pthread_mutex_unlock(&this->_eventsMutex);
+}
+
+/**
+ * \brief Records that an operation is queued, see Clone::addOperation()
+ */
+void Tracer::queueOperation(dcOperationType type, const std::string &target) {
+	if(!this->isEnabled()) {
+		return;
+	}
+
+	dcTracedOperation operation;
+	operation.start = 0;
+	operation.thread = 0;
+
+	pthread_mutex_lock(&this->_eventsMutex);
+	this->_operations[std::make_pair(static_cast<int>(type), target)] =
+			operation;
+	pthread_mutex_unlock(&this->_eventsMutex);
+}
+
+/**
+ * \brief Records when an operation begins, and in which thread, see
+ * Clone::markStarted()
+ */
+void Tracer::beginOperation(dcOperationType type, const std::string &target) {
+	if(!this->isEnabled()) {
+		return;
+	}
+
+	uint64_t startTime = Stats::now();
+
+	pthread_mutex_lock(&this->_eventsMutex);
+
+	std::map<std::pair<int, std::string>, dcTracedOperation>::iterator it =
+			this->_operations.find(std::make_pair(static_cast<int>(type),
+					target));
+	if(it != this->_operations.end() && it->second.start == 0) {
+		it->second.start = startTime;
+		it->second.thread = Tracer::getThreadId();
+	}
+
+	pthread_mutex_unlock(&this->_eventsMutex);
+}
+
+/**
+ * \brief Records the span of an operation, see Clone::markCompleted()
+ *
+ * An operation completed without beginning, like one that had nothing to
+ * do, gets no span.
+ */
+void Tracer::endOperation(dcOperationType type, const std::string &target) {
+	if(!this->isEnabled()) {
+		return;
+	}
+
+	uint64_t endTime = Stats::now();
+
+	pthread_mutex_lock(&this->_eventsMutex);
+
+	std::map<std::pair<int, std::string>, dcTracedOperation>::iterator it =
+			this->_operations.find(std::make_pair(static_cast<int>(type),
+					target));
+	if(it != this->_operations.end()) {
+		if(it->second.start != 0) {
+			dcTraceEvent event;
+			event.phase = 'X';
+			event.category = "operation";
+			event.name = operationNames[type];
+			event.start = it->second.start;
+			event.duration = endTime - it->second.start;
+			event.thread = it->second.thread;
+			event.args = "\"detail\":" + jsonString(target);
+
+			this->_events.push_back(event);
+		}
+
+		this->_operations.erase(it);
+	}
+
+	pthread_mutex_unlock(&this->_eventsMutex);
+}
+
+/**
+ * \brief Starts the sampler thread
+ */
+void *Tracer::samplerThread(void *arg) {
+	static_cast<Tracer *>(arg)->runSampler();
+
+	return 0;
+}
+
+/**
+ * \brief Id of the calling thread, as the kernel knows it
+ */
+long Tracer::getThreadId() {
+	return syscall(SYS_gettid);
+}
+
+/**
+ * \brief Samples the stages every TRACE_SAMPLE_INTERVAL until finish()
+ */
+void Tracer::runSampler() {
+	dcStats previous;
+	this->_stats->getSnapshot(previous);
+	uint64_t previousTime = Stats::now();
+
+	pthread_mutex_lock(&this->_samplerMutex);
+
+	while(!this->_stopping) {
+		uint64_t deadline = previousTime + Doclone::TRACE_SAMPLE_INTERVAL;
+
+		struct timespec ts;
+		ts.tv_sec = deadline / 1000000000ULL;
+		ts.tv_nsec = deadline % 1000000000ULL;
+
+		pthread_cond_timedwait(&this->_samplerCond, &this->_samplerMutex, &ts);
+
+		uint64_t time = Stats::now();
+		if(this->_stopping || time < deadline) {
+			continue;
+		}
+
+		pthread_mutex_unlock(&this->_samplerMutex);
+
+		dcStats current;
+		this->_stats->getSnapshot(current);
+		this->sample(time, current, previous,
+				(time - previousTime) / 1000000000.0);
+
+		previous = current;
+		previousTime = time;
+
+		pthread_mutex_lock(&this->_samplerMutex);
+	}
+
+	pthread_mutex_unlock(&this->_samplerMutex);
+}
+
+/**
+ * \brief Records the counters of the stages since the previous sample
+ *
+ * "throughput" gets the MiB per second of each stage and of the whole
+ * transfer, and "busy threads" the seconds spent in each stage per second,
+ * which is above 1 when many threads work in it.
+ */
+void Tracer::sample(uint64_t time, const dcStats &stats,
+		const dcStats &previous, double seconds) {
+	std::string throughput;
+	std::string busy;
+
+	for(unsigned int i = 0; i < Doclone::STATS_STAGES; i++) {
+		char member[64];
+
+		snprintf(member, sizeof(member), "\"%s\":%.3f", stageNames[i],
+				(stats.stages[i].bytes - previous.stages[i].bytes)
+				/ seconds / 1048576);
+		throughput += member;
+		throughput += ",";
+
+		snprintf(member, sizeof(member), "\"%s\":%.3f", stageNames[i],
+				(stats.stages[i].seconds - previous.stages[i].seconds)
+				/ seconds);
+		busy += i > 0 ? "," : "";
+		busy += member;
+	}
+
+	char total[64];
+	snprintf(total, sizeof(total), "\"total\":%.3f",
+			(stats.transferredBytes - previous.transferredBytes)
+			/ seconds / 1048576);
+	throughput += total;
+
+	dcTraceEvent event;
+	event.phase = 'C';
+	event.category = "stage";
+	event.start = time;
+	event.duration = 0;
+	event.thread = Tracer::getThreadId();
+
+	pthread_mutex_lock(&this->_eventsMutex);
+
+	event.name = "throughput";
+	event.args = throughput;
+	this->_events.push_back(event);
+
+	event.name = "busy threads";
+	event.args = busy;
+	this->_events.push_back(event);
+
+	pthread_mutex_unlock(&this->_eventsMutex);
+}
+
+/**
+ * \brief Writes the events in the Trace Event Format
+ *
+ * \param endTime
+ * 		When the job finished, the end of the operations still pending
+ */
+void Tracer::write(uint64_t endTime) {
+	Logger *log = Logger::getInstance();
+
+	pthread_mutex_lock(&this->_eventsMutex);
+
+	// The operations that began and didn't complete, like the ones running
+	// when the job failed, last until its end
+	std::map<std::pair<int, std::string>, dcTracedOperation>::iterator op;
+	for(op = this->_operations.begin(); op != this->_operations.end(); ++op) {
+		if(op->second.start == 0) {
+			continue;
+		}
+
+		dcTraceEvent event;
+		event.phase = 'X';
+		event.category = "operation";
+		event.name = operationNames[op->first.first];
+		event.start = op->second.start;
+		event.duration = endTime - op->second.start;
+		event.thread = op->second.thread;
+		event.args = "\"detail\":" + jsonString(op->first.second)
+				+ ",\"unfinished\":true";
+
+		this->_events.push_back(event);
+	}
+	this->_operations.clear();
+
+	FILE *file = fopen(this->_path.c_str(), "w");
+	if(file == 0) {
+		log->warn("Can't write the trace in %s", this->_path.c_str());
+	} else {
+		int pid = getpid();
+
+		fprintf(file, "{\"traceEvents\":[\n"
+				"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+				"\"args\":{\"name\":\"doclone\"}}", pid);
+
+		std::vector<dcTraceEvent>::const_iterator it;
+		for(it = this->_events.begin(); it != this->_events.end(); ++it) {
+			fprintf(file, ",\n{\"name\":%s,\"cat\":%s,\"ph\":\"%c\","
+					"\"ts\":%.3f,", jsonString(it->name).c_str(),
+					jsonString(it->category).c_str(), it->phase,
+					it->start / 1000.0);
+			if(it->phase == 'X') {
+				fprintf(file, "\"dur\":%.3f,", it->duration / 1000.0);
+			}
+			fprintf(file, "\"pid\":%d,\"tid\":%ld,\"args\":{%s}}", pid,
+					it->thread, it->args.c_str());
+		}
+
+		fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+		if(fclose(file) != 0) {
+			log->warn("Can't write the trace in %s", this->_path.c_str());
+		}
+	}
+
+	this->_events.clear();
+
+	pthread_mutex_unlock(&this->_eventsMutex);
+}
+
+}
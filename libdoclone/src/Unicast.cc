@@ -21,6 +21,7 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <endian.h>
@@ -33,6 +34,9 @@
 #include <doclone/DiskLabel.h>
 #include <doclone/DlFactory.h>
 #include <doclone/Image.h>
+#include <doclone/Spool.h>
+#include <doclone/Stats.h>
+#include <doclone/Stripes.h>
 #include <doclone/exception/Exception.h>
 #include <doclone/exception/ConnectionException.h>
 #include <doclone/exception/ReadDataException.h>
@@ -52,7 +56,7 @@ namespace Doclone {
  *
  * Initializes attributes.
  */
-Unicast::Unicast(): _fds() {
+Unicast::Unicast(): _fds(), _stripes(), _spool(0), _session(0) {
 	Clone *dcl = Clone::getInstance();
 
 	unsigned int nodes = dcl->getNodesNumber();
@@ -64,11 +68,21 @@ Unicast::Unicast(): _fds() {
 	}
 }
 
+/**
+ * \brief Interrupts the spool, if any
+ */
+Unicast::~Unicast() {
+	delete this->_spool;
+}
+
 /**
  * \brief This function is called by the server and waits for a connection from
  * the receivers.
  *
  * This function communicates with the function "tcpClient" of the receivers.
+ * If there is a quorum, it only waits for it, and the other receivers are
+ * accepted by the spool. If the job sets many streams, the other connections
+ * of the receivers are accepted too.
  */
 void Unicast::tcpServer() throw(Exception) {
 	Logger *log = Logger::getInstance();
@@ -92,63 +106,363 @@ void Unicast::tcpServer() throw(Exception) {
 	setsockopt(sock_tcp, SOL_SOCKET, SO_REUSEADDR,
 			&iSetOption, sizeof(iSetOption));
 
+	Stripes::setBufferSize(sock_tcp);
+
 	if ((bind (sock_tcp,
 			reinterpret_cast<sockaddr*>(&host_server), size)) < 0) {
 		ConnectionException ex;
 		throw ex;
 	}
 
-	if ((listen (sock_tcp, 1)) < 0) {
+	if ((listen (sock_tcp, SOMAXCONN)) < 0) {
 		ConnectionException ex;
 		throw ex;
 	}
 
-	for(unsigned int i = 0;i<this->_nodesNum;i++) {
-		while(1) {
-			int fd;
-			if ((fd =
-				 accept (sock_tcp,
-						 reinterpret_cast<sockaddr*>(&host_server),
-						 &size)) < 0) {
-				ConnectionException ex;
-				ex.logMsg();
-				throw ex;
-			}
+	int stripeFd = -1;
+	if(Stripes::getStreams() > 1) {
+		stripeFd = Stripes::listenStripes();
+	}
+
+	Clone *dcl = Clone::getInstance();
+	unsigned int waitFor = this->_nodesNum;
+
+	unsigned int quorum = dcl->getQuorum();
+	if(quorum > 0 && quorum < this->_nodesNum) {
+		// The spool closes the listening sockets
+		this->_spool = new Spool(sock_tcp, stripeFd, this->_nodesNum);
+		waitFor = quorum;
+	}
+
+	uint64_t session = this->_spool ? this->_spool->getSession() : 0;
 
-			dcCommand clnRequest = 0;
-			DataTransfer::recvData(fd, &clnRequest, sizeof(clnRequest));
+	for(unsigned int i = 0;i<waitFor;i++) {
+		int fd;
+		dcHandshake handshake;
+		std::string address;
 
-			if(clnRequest & Doclone::C_RECEIVER_OK) {
-				dcCommand response = Doclone::C_SERVER_OK;
-				DataTransfer::sendData(fd, &response, sizeof(response));
+		do {
+			fd = Unicast::acceptReceiver(sock_tcp, stripeFd, session,
+					handshake, address);
+		} while(fd < 0);
 
-				this->_fds.push_back(fd);
-				this->_srcIP = inet_ntoa (host_server.sin_addr);
+		if(this->_spool != 0) {
+			this->_spool->addReceiver(fd, handshake, address);
+		} else {
+			this->_fds.push_back(fd);
+
+			if(!handshake.stripes.empty()) {
+				this->stripeConnection(handshake.stripes, true);
+			}
 
-				// Notify the views
-				Clone *dcl = Clone::getInstance();
-				dcl->triggerEvent(Doclone::EVT_NEW_CONNECION,
-						inet_ntoa (host_server.sin_addr));
+			if(handshake.checksums) {
+				DataTransfer::getInstance()->enableChecksums(
+						this->_fds.back(), handshake.frameVersion,
+						handshake.frameCaps);
+			}
 
-				break;
+			if(dcl->getZeroCopy()) {
+				DataTransfer::getInstance()->enableZeroCopy(
+						this->_fds.back());
 			}
+
+			Stats::getInstance()->addReceiver(this->_fds.back(), address);
 		}
+
+		this->_srcIP = address;
+
+		// Notify the views
+		dcl->triggerEvent(Doclone::EVT_NEW_CONNECION, address);
 	}
 
-	close(sock_tcp);
+	if(this->_spool != 0) {
+		log->info("Sending to %d receivers, %d more can join later", quorum,
+				this->_nodesNum - quorum);
+
+		this->_spool->start();
+		this->_fds.push_back(this->_spool->getInput());
+	} else {
+		close(sock_tcp);
+
+		if(stripeFd >= 0) {
+			close(stripeFd);
+		}
+	}
 
 	log->debug("Unicast::tcpServer() end");
 }
 
+/**
+ * \brief Accepts a connection and answers to the request of a receiver
+ *
+ * \param listenFd
+ * 		The listening socket
+ * \param stripeFd
+ * 		Socket of Stripes::listenStripes(), where the other connections of a
+ * 		striped stream are accepted, or -1 to send it on one connection
+ * \param session
+ * 		Session of the server, or 0 if it can't be resumed
+ * \param [out] handshake
+ * 		What the receiver and the server have agreed. The checksums must be
+ * 		enabled on the socket by the caller. The offset is 0 if the receiver
+ * 		must be sent the whole stream. If the stream is striped, the other
+ * 		connections are accepted too
+ * \param [out] address
+ * 		Address of the receiver
+ *
+ * \return The socket connected to the receiver, or -1 if the connection
+ * isn't from a receiver
+ */
+int Unicast::acceptReceiver(int listenFd, int stripeFd, uint64_t session,
+		dcHandshake &handshake, std::string &address) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Unicast::acceptReceiver(listenFd=>%d) start", listenFd);
+
+	sockaddr_in host_client;
+	socklen_t size = sizeof(host_client);
+
+	int fd;
+	if ((fd =
+		 accept (listenFd,
+				 reinterpret_cast<sockaddr*>(&host_client),
+				 &size)) < 0) {
+		ConnectionException ex;
+		ex.logMsg();
+		throw ex;
+	}
+
+	dcCommand clnRequest = 0;
+	DataTransfer::recvData(fd, &clnRequest, sizeof(clnRequest));
+
+	if(!(clnRequest & Doclone::C_RECEIVER_OK)) {
+		close(fd);
+
+		log->debug("Unicast::acceptReceiver(fd=>-1) end");
+		return -1;
+	}
+
+	dcCommand response = Doclone::C_SERVER_OK;
+	handshake.frameVersion = 0;
+	handshake.frameCaps = 0;
+	handshake.offset = 0;
+	handshake.stripes.clear();
+
+	// Old clients don't ask for checksums
+	if(clnRequest & Doclone::C_CHECKSUMS) {
+		response |= Doclone::C_CHECKSUMS;
+	}
+
+	if(clnRequest & Doclone::C_RESUME) {
+		uint64_t clnSession;
+		uint64_t clnOffset;
+		DataTransfer::recvData(fd, &clnSession, sizeof(clnSession));
+		DataTransfer::recvData(fd, &clnOffset, sizeof(clnOffset));
+
+		if(session != 0) {
+			response |= Doclone::C_RESUME;
+
+			if(be64toh(clnSession) == session) {
+				handshake.offset = be64toh(clnOffset);
+			}
+		}
+	}
+
+	if(clnRequest & Doclone::C_FRAMES) {
+		uint8_t clnVersion;
+		dcFrameCaps clnCaps;
+		DataTransfer::recvData(fd, &clnVersion, sizeof(clnVersion));
+		DataTransfer::recvData(fd, &clnCaps, sizeof(clnCaps));
+
+		// The frames are chunks of a checksummed stream
+		if((response & Doclone::C_CHECKSUMS) && clnVersion > 0) {
+			response |= Doclone::C_FRAMES;
+
+			handshake.frameVersion = clnVersion < Doclone::FRAME_VERSION
+					? clnVersion : Doclone::FRAME_VERSION;
+			handshake.frameCaps = be32toh(clnCaps) & Doclone::FRAME_CAPS;
+		}
+	}
+
+	if((clnRequest & Doclone::C_STRIPES) && stripeFd >= 0) {
+		response |= Doclone::C_STRIPES;
+	}
+
+	DataTransfer::sendData(fd, &response, sizeof(response));
+
+	if(response & Doclone::C_RESUME) {
+		uint64_t tmpSession = htobe64(session);
+		DataTransfer::sendData(fd, &tmpSession, sizeof(tmpSession));
+	}
+
+	if(response & Doclone::C_FRAMES) {
+		dcFrameCaps tmpCaps = htobe32(handshake.frameCaps);
+		DataTransfer::sendData(fd, &handshake.frameVersion,
+				sizeof(handshake.frameVersion));
+		DataTransfer::sendData(fd, &tmpCaps, sizeof(tmpCaps));
+	}
+
+	address = inet_ntoa (host_client.sin_addr);
+
+	if(response & Doclone::C_STRIPES) {
+		unsigned int count = Stripes::getStreams();
+		uint64_t token = Stripes::offer(fd, count);
+
+		if(!Stripes::acceptStripes(stripeFd, token, count,
+				handshake.stripes)) {
+			log->warn("The connections of the receiver %s haven't arrived",
+					address.c_str());
+			close(fd);
+
+			log->debug("Unicast::acceptReceiver(fd=>-1) end");
+			return -1;
+		}
+	}
+
+	handshake.checksums = (response & Doclone::C_CHECKSUMS);
+
+	log->debug("Unicast::acceptReceiver(fd=>%d) end", fd);
+	return fd;
+}
+
 /**
  * \brief This function is called for the receivers and establishes a connection
  * with the server, who should be listening.
  *
- * This function communicates with the function "tcpServer" of the server.
+ * This function communicates with the function "tcpServer" of the server, or
+ * with an ImageServer if a remote image has been set.
+ *
+ * \param offset
+ * 		Bytes of data already received in the current session, 0 to join a
+ * 		new one
+ *
+ * \return true if the server resumes the session after [offset], false if
+ * it sends the whole stream
+ */
+bool Unicast::tcpClient(uint64_t offset) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Unicast::tcpClient(offset=>%d) start", offset);
+
+	Clone *dcl = Clone::getInstance();
+	const std::string &remoteImage = dcl->getRemoteImage();
+
+	dcCommand request = Doclone::C_RECEIVER_OK | Doclone::C_CHECKSUMS;
+	int fd;
+
+	if(remoteImage.empty()) {
+		fd = this->connectServer(Doclone::PORT_DATA);
+		request |= Doclone::C_RESUME | Doclone::C_FRAMES | Doclone::C_STRIPES;
+	} else {
+		fd = this->connectServer(Doclone::PORT_SERVE);
+		request |= Doclone::C_IMAGE_REQUEST;
+	}
+
+	this->_fds.push_back(fd);
+
+	this->sendRequest(fd, request, remoteImage);
+
+	if(request & Doclone::C_RESUME) {
+		uint64_t tmpSession = htobe64(this->_session);
+		uint64_t tmpOffset = htobe64(offset);
+		DataTransfer::sendData(fd, &tmpSession, sizeof(tmpSession));
+		DataTransfer::sendData(fd, &tmpOffset, sizeof(tmpOffset));
+	}
+
+	if(request & Doclone::C_FRAMES) {
+		uint8_t version = Doclone::FRAME_VERSION;
+		dcFrameCaps caps = htobe32(Doclone::FRAME_CAPS);
+		DataTransfer::sendData(fd, &version, sizeof(version));
+		DataTransfer::sendData(fd, &caps, sizeof(caps));
+	}
+
+	bool resumed = false;
+	dcCommand response = this->readResponse(fd);
+
+	// Old servers, and the ones without a spool, can't resume the session
+	if(response & Doclone::C_RESUME) {
+		uint64_t session;
+		DataTransfer::recvData(fd, &session, sizeof(session));
+		session = be64toh(session);
+
+		resumed = (offset > 0 && session == this->_session);
+		this->_session = session;
+	} else {
+		this->_session = 0;
+	}
+
+	// Old servers send plain chunks
+	uint8_t version = 0;
+	dcFrameCaps caps = 0;
+	if(response & Doclone::C_FRAMES) {
+		DataTransfer::recvData(fd, &version, sizeof(version));
+		DataTransfer::recvData(fd, &caps, sizeof(caps));
+		caps = be32toh(caps);
+	}
+
+	DataTransfer *trns = DataTransfer::getInstance();
+
+	// The checksums cover the stream once joined
+	if(response & Doclone::C_STRIPES) {
+		uint64_t token;
+		unsigned int count = Stripes::readOffer(fd, token);
+
+		std::vector<int> stripes;
+		Stripes::connectStripes(fd, token, count, stripes);
+
+		trns->disableChecksums(fd);
+		this->stripeConnection(stripes, false);
+		fd = this->_fds.back();
+	}
+
+	if(response & Doclone::C_CHECKSUMS) {
+		trns->enableChecksums(fd, version, caps);
+	}
+
+	log->debug("Unicast::tcpClient(resumed=>%d) end", resumed);
+	return resumed;
+}
+
+/**
+ * \brief This function is called by the sender when an address is set, and
+ * establishes a connection with a collector, who should be listening.
+ *
+ * The image is named after the remote image, if it is set, or after the host
+ * name otherwise.
+ */
+void Unicast::tcpCollector() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Unicast::tcpCollector() start");
+
+	Clone *dcl = Clone::getInstance();
+	this->_srcIP = dcl->getAddress();
+
+	std::string name = dcl->getRemoteImage();
+	if(name.empty()) {
+		char host[Doclone::MAX_IMAGE_NAME + 1] = {};
+		gethostname(host, sizeof(host) - 1);
+		name = host;
+	}
+
+	int fd = this->connectServer(Doclone::PORT_COLLECT);
+
+	this->sendRequest(fd, Doclone::C_SENDER_OK | Doclone::C_CHECKSUMS, name);
+	this->readResponse(fd);
+
+	this->_fds.push_back(fd);
+
+	log->debug("Unicast::tcpCollector() end");
+}
+
+/**
+ * \brief Connects to a port of the server
+ *
+ * \param port
+ * 		The port
+ *
+ * \return The socket
  */
-void Unicast::tcpClient() throw(Exception) {
+int Unicast::connectServer(dcPort port) throw(Exception) {
 	Logger *log = Logger::getInstance();
-	log->debug("Unicast::tcpClient() start");
+	log->debug("Unicast::connectServer(port=>%d) start", port);
 
 	int fd;
 	if ((fd = socket (AF_INET, SOCK_STREAM, 0)) < 0) {
@@ -160,7 +474,9 @@ void Unicast::tcpClient() throw(Exception) {
 	addrinfo hints = {};
 	hints.ai_family = AF_INET;
 	hints.ai_socktype = SOCK_STREAM;
-	std::string strPort = Util::intToString(Doclone::PORT_DATA);
+	std::string strPort = Util::intToString(port);
+
+	Stripes::setBufferSize(fd);
 
 	if(getaddrinfo (this->_srcIP.c_str(), strPort.c_str(), &hints, &res)) {
 		ConnectionException ex;
@@ -174,9 +490,42 @@ void Unicast::tcpClient() throw(Exception) {
 
 	freeaddrinfo(res);
 
-	dcCommand request = Doclone::C_RECEIVER_OK;
+	log->debug("Unicast::connectServer(fd=>%d) end", fd);
+	return fd;
+}
+
+/**
+ * \brief Sends a request to the server
+ *
+ * \param fd
+ * 		The socket
+ * \param request
+ * 		The request code
+ * \param name
+ * 		Name of an image, sent after the code if it isn't empty
+ */
+void Unicast::sendRequest(int fd, dcCommand request, const std::string &name)
+		throw(Exception) {
 	DataTransfer::sendData(fd, &request, sizeof(request));
 
+	if(!name.empty()) {
+		uint16_t length = htobe16(name.length());
+
+		DataTransfer::sendData(fd, &length, sizeof(length));
+		DataTransfer::sendData(fd, name.c_str(), name.length());
+	}
+}
+
+/**
+ * \brief Reads the response of the server, and enables the checksums if it
+ * supports them
+ *
+ * \param fd
+ * 		The socket
+ *
+ * \return The response
+ */
+dcCommand Unicast::readResponse(int fd) throw(Exception) {
 	dcCommand srvResponse = 0;
 	DataTransfer::recvData(fd, &srvResponse, sizeof(srvResponse));
 
@@ -185,9 +534,47 @@ void Unicast::tcpClient() throw(Exception) {
 		throw ex;
 	}
 
-	this->_fds.push_back(fd);
+	// Old servers don't answer with checksums
+	if(srvResponse & Doclone::C_CHECKSUMS) {
+		DataTransfer::getInstance()->enableChecksums(fd);
+	}
+
+	return srvResponse;
+}
+
+/**
+ * \brief Stripes the stream of the last connection opened
+ *
+ * Its socket in _fds is replaced by the local socket of the stripes.
+ *
+ * \param stripes
+ * 		The other connections of the stream
+ * \param sending
+ * 		Whether the stream is sent or received
+ */
+void Unicast::stripeConnection(const std::vector<int> &stripes,
+		bool sending) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Unicast::stripeConnection(stripes=>%d) start",
+			stripes.size());
 
-	log->debug("Unicast::tcpClient() end");
+	Stripes *striped = new Stripes(this->_fds.back(), stripes, sending);
+
+	int fd = striped->getFd();
+	this->_stripes[fd] = striped;
+	this->_fds.back() = fd;
+
+	log->debug("Unicast::stripeConnection(fd=>%d) end", fd);
+}
+
+/**
+ * \brief Waits until the striped streams have been sent
+ */
+void Unicast::finishStripes() throw(Exception) {
+	std::map<int, Stripes *>::iterator it;
+	for(it = this->_stripes.begin(); it != this->_stripes.end(); ++it) {
+		it->second->finish();
+	}
 }
 
 /**
@@ -205,8 +592,13 @@ void Unicast::sendFromImage() throw(Exception) {
 
 	Clone *dcl = Clone::getInstance();
 	dcl->addOperation(waitOp);
+	dcl->markStarted(Doclone::OP_WAIT_CLIENTS, "");
 
-	this->tcpServer();
+	if(dcl->getAddress().empty()) {
+		this->tcpServer();
+	} else {
+		this->tcpCollector();
+	}
 
 	dcl->markCompleted(Doclone::OP_WAIT_CLIENTS, "");
 
@@ -216,6 +608,7 @@ void Unicast::sendFromImage() throw(Exception) {
 			Doclone::OP_TRANSFER_DATA, "");
 
 	dcl->addOperation(transferOp);
+	dcl->markStarted(Doclone::OP_TRANSFER_DATA, "");
 
 	/*
 	 * Before sending the data, it sends its size. So the client/s can
@@ -232,6 +625,12 @@ void Unicast::sendFromImage() throw(Exception) {
 			static_cast<size_t>(sizeof(uint64_t)));
 
 	trns->copyData(fd, this->_fds);
+	trns->finishChecksums(this->_fds);
+	this->finishStripes();
+
+	if(this->_spool != 0) {
+		this->_spool->finish();
+	}
 
 	dcl->markCompleted(Doclone::OP_TRANSFER_DATA, "");
 
@@ -260,8 +659,13 @@ void Unicast::sendFromDevice() throw(Exception) {
 
 	Clone *dcl = Clone::getInstance();
 	dcl->addOperation(waitOp);
+	dcl->markStarted(Doclone::OP_WAIT_CLIENTS, "");
 
-	this->tcpServer();
+	if(dcl->getAddress().empty()) {
+		this->tcpServer();
+	} else {
+		this->tcpCollector();
+	}
 
 	dcl->markCompleted(Doclone::OP_WAIT_CLIENTS, "");
 
@@ -285,6 +689,7 @@ void Unicast::sendFromDevice() throw(Exception) {
 			Doclone::OP_READ_PARTITION_TABLE, target);
 
 	dcl->addOperation(readPartTableOp);
+	dcl->markStarted(Doclone::OP_READ_PARTITION_TABLE, target);
 
 	image.readPartitionTable(this->_device);
 
@@ -326,6 +731,13 @@ void Unicast::sendFromDevice() throw(Exception) {
 	image.freeWriteArchive();
 	image.freeReadArchive();
 
+	trns->finishChecksums(this->_fds);
+	this->finishStripes();
+
+	if(this->_spool != 0) {
+		this->_spool->finish();
+	}
+
 	this->closeConnection();
 
 	log->debug("Unicast::sendFromDevice() end");
@@ -378,8 +790,9 @@ void Unicast::receiveToImage() throw(Exception) {
 
 	Clone *dcl = Clone::getInstance();
 	dcl->addOperation(waitOp);
+	dcl->markStarted(Doclone::OP_WAIT_SERVER, "");
 
-	this->tcpClient();
+	this->tcpClient(0);
 
 	dcl->markCompleted(Doclone::OP_WAIT_SERVER, "");
 
@@ -390,10 +803,28 @@ void Unicast::receiveToImage() throw(Exception) {
 			Doclone::OP_TRANSFER_DATA, "");
 
 	dcl->addOperation(transferOp);
+	dcl->markStarted(Doclone::OP_TRANSFER_DATA, "");
 
-	/*
-	 * Get the size of the data, in order to calculate the completed percentage.
-	 */
+	uint64_t totalSize = this->receiveSize();
+
+	this->receiveResuming(fd, totalSize);
+
+	dcl->markCompleted(Doclone::OP_TRANSFER_DATA, "");
+
+	Util::closeFile(fd);
+
+	this->closeConnection();
+
+	log->debug("Unicast::receiveToImage() end");
+}
+
+/**
+ * \brief Receives the size of the data, in order to calculate the completed
+ * percentage
+ *
+ * \return The size
+ */
+uint64_t Unicast::receiveSize() throw(Exception) {
 	uint64_t totalSize;
 	DataTransfer::recvData(this->_fds[0], &totalSize,
 			static_cast<size_t>(sizeof(uint64_t)));
@@ -406,15 +837,113 @@ void Unicast::receiveToImage() throw(Exception) {
 	DataTransfer *trns = DataTransfer::getInstance();
 	trns->setTotalSize(tmpTotalSize);
 
-	trns->copyData(this->_fds[0], fd);
+	return tmpTotalSize;
+}
 
-	dcl->markCompleted(Doclone::OP_TRANSFER_DATA, "");
+/**
+ * \brief Receives the data of an image, resuming the session if the
+ * connection is lost
+ *
+ * The data written to the image is the checkpoint of the session: it's
+ * flushed to the disk and the server is asked for the data after it. If the
+ * server can't resume the session, the image is received again from the
+ * beginning.
+ *
+ * \param fd
+ * 		Descriptor of the image, where the data is written after the one
+ * 		already received
+ * \param totalSize
+ * 		Size of the data
+ */
+void Unicast::receiveResuming(int fd, uint64_t totalSize) throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Unicast::receiveResuming(fd=>%d, totalSize=>%d) start", fd,
+			totalSize);
 
-	Util::closeFile(fd);
+	DataTransfer *trns = DataTransfer::getInstance();
+	uint64_t checkpoint = 0;
+	unsigned int retries = 0;
+	bool connected = true;
+
+	while(true) {
+		if(!connected) {
+			if(retries++ == Doclone::RESUME_RETRIES) {
+				ReceiveDataException ex;
+				throw ex;
+			}
 
-	this->closeConnection();
+			sleep(Doclone::RESUME_DELAY);
+
+			bool resumed;
+			try {
+				resumed = this->tcpClient(checkpoint);
+			} catch (const ConnectionException &ex) {
+				this->closeConnection();
+				continue;
+			} catch (const ReceiveDataException &ex) {
+				this->closeConnection();
+				continue;
+			} catch (const SendDataException &ex) {
+				this->closeConnection();
+				continue;
+			}
 
-	log->debug("Unicast::receiveToImage() end");
+			connected = true;
+
+			if(!resumed) {
+				log->info("The server can't resume the session, receiving "
+						"the whole image again");
+
+				if(ftruncate(fd, 0) < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+					WriteDataException ex;
+					throw ex;
+				}
+
+				checkpoint = 0;
+				totalSize = this->receiveSize();
+			}
+		}
+
+		try {
+			trns->copyData(this->_fds[0], fd);
+		} catch (const ReceiveDataException &ex) {
+			if(this->_session == 0) {
+				throw;
+			}
+		}
+
+		off_t received = lseek(fd, 0, SEEK_CUR);
+		if(received < 0) {
+			WriteDataException ex;
+			throw ex;
+		}
+
+		// Without a session, a short stream is taken as it is
+		if(this->_session == 0
+				|| static_cast<uint64_t>(received) >= totalSize) {
+			break;
+		}
+
+		if(static_cast<uint64_t>(received) > checkpoint) {
+			retries = 0;
+		}
+
+		uint64_t startTime = Stats::now();
+		if(fdatasync(fd) < 0 && errno != EINVAL) {
+			WriteDataException ex;
+			throw ex;
+		}
+		Stats::getInstance()->addStage(Doclone::STAGE_FSYNC, 0, startTime);
+
+		checkpoint = received;
+		log->info("The connection has been lost, resuming the session at "
+				"%llu bytes", checkpoint);
+
+		this->closeConnection();
+		connected = false;
+	}
+
+	log->debug("Unicast::receiveResuming() end");
 }
 
 /**
@@ -435,8 +964,9 @@ void Unicast::receiveToDevice() throw(Exception) {
 
 	Clone *dcl = Clone::getInstance();
 	dcl->addOperation(waitOp);
+	dcl->markStarted(Doclone::OP_WAIT_SERVER, "");
 
-	this->tcpClient();
+	this->tcpClient(0);
 
 	dcl->markCompleted(Doclone::OP_WAIT_SERVER, "");
 
@@ -518,19 +1048,39 @@ void Unicast::receive() throw(Exception) {
 
 /**
  * \brief Closes the opened connections
+ *
+ * The spool is stopped before, so it doesn't take a closed input for the end
+ * of the stream. The striped streams close their connections.
  */
 void Unicast::closeConnection() throw(Exception) {
 	Logger *log = Logger::getInstance();
 	log->debug("Unicast::closeConnection() start");
 
+	delete this->_spool;
+	this->_spool = 0;
+
 	if(this->_fds.size() > 0) {
+		DataTransfer *trns = DataTransfer::getInstance();
+		Stats *stats = Stats::getInstance();
+
 		std::vector<int>::iterator it;
 		for(it = this->_fds.begin(); it != this->_fds.end(); ++it) {
-			if(close(*it)<0) {
+			trns->disableChecksums(*it);
+			trns->disableZeroCopy(*it);
+			stats->removeReceiver(*it);
+
+			std::map<int, Stripes *>::iterator itStripes =
+					this->_stripes.find(*it);
+			if(itStripes != this->_stripes.end()) {
+				delete itStripes->second;
+				this->_stripes.erase(itStripes);
+			} else if(close(*it)<0) {
 				CloseConnectionException ex;
 				ex.logMsg();
 			}
 		}
+
+		this->_fds.clear();
 	}
 
 	log->debug("Unicast::closeConnection() end");
@@ -24,8 +24,12 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
 #include <signal.h>
+#include <pthread.h>
 #include <string.h>
 #include <regex.h>
 
@@ -37,6 +41,8 @@
 
 #include <doclone/Logger.h>
 #include <doclone/Clone.h>
+#include <doclone/Stats.h>
+#include <doclone/Tracer.h>
 #include <doclone/exception/Exception.h>
 #include <doclone/exception/WriteDataException.h>
 #include <doclone/exception/NoAccessToDeviceException.h>
@@ -299,6 +305,9 @@ void Util::writeBinData(const std::string &file, const void *data, unsigned int
 	log->debug("Util::writeBinData() end");
 }
 
+/// Serializes the changes of /etc/mtab made by the threads of a job
+static pthread_mutex_t mtabMutex = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * \brief Adds a new line in /etc/mtab, called when the program mounts a
  * partition
@@ -316,8 +325,13 @@ void Util::addMtabEntry(const std::string &partPath, const std::string &mountPoi
 
 	struct mntent filesys;
 	FILE *f;
+
+	pthread_mutex_lock(&mtabMutex);
+
 	f = setmntent ("/etc/mtab", "a+");
 	if (!f) {
+		pthread_mutex_unlock(&mtabMutex);
+
 		FileNotFoundException ex("/etc/mtab");
 		throw ex;
 	}
@@ -332,6 +346,8 @@ void Util::addMtabEntry(const std::string &partPath, const std::string &mountPoi
 
 	endmntent (f);
 
+	pthread_mutex_unlock(&mtabMutex);
+
 	log->debug("Util::addMtabEntry() end");
 }
 
@@ -350,6 +366,8 @@ void Util::updateMtab(const std::string &partPath) throw(Exception) {
 	FILE *fp,*fp2;
 	struct mntent *tmp;
 
+	pthread_mutex_lock(&mtabMutex);
+
 	fp = setmntent("/etc/mtab","r");
 	fp2 = setmntent("/etc/mtab.temp","w");
 
@@ -377,6 +395,8 @@ void Util::updateMtab(const std::string &partPath) throw(Exception) {
 	remove("/etc/mtab");
 	rename("/etc/mtab.temp","/etc/mtab");
 
+	pthread_mutex_unlock(&mtabMutex);
+
 	log->debug("Util::updateMtab() end");
 }
 
@@ -853,6 +873,7 @@ void Util::spawn_command_line_sync(const std::string &command, int *exitValue, s
 	Logger *log = Logger::getInstance();
 	log->debug("Util::spawn_command_line_sync(command=>%s) start", command.c_str());
 
+	uint64_t startTime = Stats::now();
 	pid_t pid;
 	int status;
 	int fds[2]; //pipe ends
@@ -899,6 +920,10 @@ void Util::spawn_command_line_sync(const std::string &command, int *exitValue, s
 		} while(retVal == 4096);
 	}
 
+	// The span is named after the program, the whole command line is its detail
+	std::string program = command.substr(0, command.find(' '));
+	Tracer::getInstance()->addSpan("command", program, startTime, command);
+
 	log->debug("Util::spawn_command_line_sync() end");
 	return;
 }
@@ -956,4 +981,78 @@ double Util::stringToDouble(const char* str) {
 	return x;
 }
 
+/**
+ * \brief Gets the peak resident set size of the process
+ *
+ * \return Maximum number of bytes that the process has had in RAM
+ */
+uint64_t Util::getPeakMemory() {
+	struct rusage usage;
+
+	if(getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+
+	// Linux gives ru_maxrss in kilobytes
+	return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+/**
+ * \brief Creates a temporary file in $TMPDIR, which is removed when it is
+ * closed
+ *
+ * \param prefix
+ * 		Beginning of the name of the file
+ *
+ * \return The opened file, or NULL if it can't be created
+ */
+FILE *Util::createTempFile(const std::string &prefix) {
+	Logger *log = Logger::getInstance();
+	log->debug("Util::createTempFile(prefix=>%s) start", prefix.c_str());
+
+	const char *tmpDir = getenv("TMPDIR");
+	std::string name = tmpDir ? tmpDir : P_tmpdir;
+	name.append("/");
+	name.append(prefix);
+	name.append("-XXXXXX");
+
+	FILE *file = 0;
+	int fd = mkstemp(&name[0]);
+	if(fd >= 0) {
+		// The file is removed when it is closed
+		unlink(name.c_str());
+
+		if((file = fdopen(fd, "w+")) == 0) {
+			close(fd);
+		}
+	}
+
+	log->debug("Util::createTempFile(file=>0x%x) end", file);
+	return file;
+}
+
+/**
+ * \brief Creates a random identifier, never 0
+ *
+ * It's read from /dev/urandom, or made from the time and the pid if it
+ * can't be read.
+ */
+uint64_t Util::randomId() {
+	uint64_t id = 0;
+
+	int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+	if(fd >= 0) {
+		if(read(fd, &id, sizeof(id)) != sizeof(id)) {
+			id = 0;
+		}
+		close(fd);
+	}
+
+	if(id == 0) {
+		id = (static_cast<uint64_t>(time(0)) << 32) ^ getpid();
+	}
+
+	return id;
+}
+
 }
@@ -0,0 +1,282 @@
+/*
+ *  libdoclone - library for cloning GNU/Linux systems
+ *  Copyright (C) 2026 Joan Lledó <joanlluislledo@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <doclone/Verifier.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <doclone/Crc32c.h>
+#include <doclone/DataTransfer.h>
+#include <doclone/Job.h>
+#include <doclone/Logger.h>
+#include <doclone/exception/FileMismatchException.h>
+#include <doclone/exception/InitializationException.h>
+
+namespace Doclone {
+
+/**
+ * \brief Initializes the attributes
+ */
+Verifier::Verifier()
+	: _queue(), _done(false), _threads(), _job(0), _buffers(), _nextBuffer(0),
+	  _bufferSize(0), _verifiedFiles(0), _mismatches(0) {
+	pthread_mutex_init(&this->_mutex, 0);
+	pthread_cond_init(&this->_notEmpty, 0);
+	pthread_cond_init(&this->_notFull, 0);
+}
+
+/**
+ * \brief Waits for the threads, if they are still running
+ */
+Verifier::~Verifier() {
+	this->finish();
+
+	pthread_cond_destroy(&this->_notFull);
+	pthread_cond_destroy(&this->_notEmpty);
+	pthread_mutex_destroy(&this->_mutex);
+}
+
+/**
+ * \brief Starts the verifying threads
+ *
+ * There is one thread per processor, and at least VERIFY_MIN_THREADS. Each
+ * one gets a disk buffer from the pool of DataTransfer, so a limited pool
+ * reduces the number of threads.
+ */
+void Verifier::start() throw(Exception) {
+	Logger *log = Logger::getInstance();
+	log->debug("Verifier::start() start");
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	dcBuffSize size = trns->getBufferSize(Doclone::BUFFER_DISK);
+
+	this->_job = Job::getCurrent();
+
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int numThreads = cpus > VERIFY_MIN_THREADS ?
+			static_cast<unsigned int>(cpus) : VERIFY_MIN_THREADS;
+
+	if(trns->getPoolLimit() > 0 && numThreads > Doclone::POOL_BUFFERS) {
+		numThreads = Doclone::POOL_BUFFERS;
+	}
+
+	for(unsigned int i = 0; i < numThreads; i++) {
+		try {
+			this->_buffers.push_back(trns->acquireBuffer(size));
+		} catch (const Exception &ex) {
+			// Work with the buffers already allocated
+			if(this->_buffers.empty()) {
+				throw;
+			}
+
+			break;
+		}
+	}
+
+	this->_bufferSize = size;
+
+	for(unsigned int i = 0; i < this->_buffers.size(); i++) {
+		pthread_t thread;
+		if(pthread_create(&thread, 0, Verifier::workerThread, this) != 0) {
+			break;
+		}
+
+		this->_threads.push_back(thread);
+	}
+
+	if(this->_threads.empty()) {
+		InitializationException ex;
+		throw ex;
+	}
+
+	log->debug("Verifier::start(threads=>%d) end", this->_threads.size());
+}
+
+/**
+ * \brief Queues a file to be verified
+ *
+ * Waits while the queue is full.
+ *
+ * \param file
+ * 		The file and its checksum
+ */
+void Verifier::addFile(const dcVerifyFile &file) {
+	pthread_mutex_lock(&this->_mutex);
+
+	while(this->_queue.size() >= VERIFY_QUEUE_SIZE) {
+		pthread_cond_wait(&this->_notFull, &this->_mutex);
+	}
+
+	this->_queue.push_back(file);
+	pthread_cond_signal(&this->_notEmpty);
+
+	pthread_mutex_unlock(&this->_mutex);
+}
+
+/**
+ * \brief Waits until all the queued files are verified and stops the threads
+ */
+void Verifier::finish() {
+	Logger *log = Logger::getInstance();
+	log->debug("Verifier::finish() start");
+
+	pthread_mutex_lock(&this->_mutex);
+	this->_done = true;
+	pthread_cond_broadcast(&this->_notEmpty);
+	pthread_mutex_unlock(&this->_mutex);
+
+	std::vector<pthread_t>::iterator it;
+	for(it = this->_threads.begin(); it != this->_threads.end(); ++it) {
+		pthread_join(*it, 0);
+	}
+	this->_threads.clear();
+
+	DataTransfer *trns = DataTransfer::getInstance();
+	std::vector<char *>::iterator buf;
+	for(buf = this->_buffers.begin(); buf != this->_buffers.end(); ++buf) {
+		trns->releaseBuffer(*buf);
+	}
+	this->_buffers.clear();
+
+	log->debug("Verifier::finish() end");
+}
+
+/**
+ * \brief Body of the verifying threads
+ *
+ * \param arg
+ * 		Pointer to the Verifier
+ */
+void *Verifier::workerThread(void *arg) {
+	Verifier *verifier = static_cast<Verifier *>(arg);
+
+	verifier->_job->bind();
+	verifier->work();
+
+	return 0;
+}
+
+/**
+ * \brief Verifies the queued files until the queue is empty and finish() has
+ * been called
+ */
+void Verifier::work() {
+	pthread_mutex_lock(&this->_mutex);
+	char *buf = this->_buffers.at(this->_nextBuffer++);
+
+	while(true) {
+		while(this->_queue.empty() && !this->_done) {
+			pthread_cond_wait(&this->_notEmpty, &this->_mutex);
+		}
+
+		if(this->_queue.empty()) {
+			break;
+		}
+
+		dcVerifyFile file = this->_queue.front();
+		this->_queue.pop_front();
+		pthread_cond_signal(&this->_notFull);
+		pthread_mutex_unlock(&this->_mutex);
+
+		bool match = this->verifyFile(file, buf, this->_bufferSize);
+
+		pthread_mutex_lock(&this->_mutex);
+		this->_verifiedFiles++;
+
+		if(!match) {
+			this->_mismatches++;
+
+			// The views are notified one by one
+			FileMismatchException ex(file.path);
+			ex.logMsg();
+		}
+	}
+
+	pthread_mutex_unlock(&this->_mutex);
+}
+
+/**
+ * \brief Reads a file and compares its size and CRC32C with the expected ones
+ *
+ * \param file
+ * 		The file and its checksum
+ * \param buf
+ * 		Buffer for reading the file
+ * \param size
+ * 		Size of buf
+ *
+ * \return true if the file matches
+ */
+bool Verifier::verifyFile(const dcVerifyFile &file, char *buf, size_t size) {
+	Logger *log = Logger::getInstance();
+	log->loopDebug("Verifier::verifyFile(path=>%s) start", file.path.c_str());
+
+	int fd = open(file.path.c_str(), O_RDONLY);
+	if(fd < 0) {
+		log->loopDebug("Verifier::verifyFile(match=>0) end");
+		return false;
+	}
+
+	struct stat filestat;
+	if(fstat(fd, &filestat) < 0 || !S_ISREG(filestat.st_mode)
+			|| static_cast<uint64_t>(filestat.st_size) != file.size) {
+		close(fd);
+
+		log->loopDebug("Verifier::verifyFile(match=>0) end");
+		return false;
+	}
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	uint32_t crc = 0;
+	ssize_t nbytes;
+	bool readError = false;
+
+	while((nbytes = read(fd, buf, size)) != 0) {
+		if(nbytes < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			readError = true;
+			break;
+		}
+
+		crc = Crc32c::update(crc, buf, nbytes);
+	}
+
+	close(fd);
+
+	bool match = !readError && crc == file.crc;
+
+	log->loopDebug("Verifier::verifyFile(match=>%d) end", match);
+	return match;
+}
+
+uint64_t Verifier::getVerifiedFiles() const {
+	return this->_verifiedFiles;
+}
+
+uint64_t Verifier::getMismatches() const {
+	return this->_mismatches;
+}
+
+}
@@ -43,7 +43,9 @@ int libdoclone_is_present(void) {
  */
 dc_doclone *doclone_new() {
 	dc_doclone *dcObj = new dc_doclone();
-	dcObj->_observer = new DefaultObserver();
+	Doclone::Job *job = new Doclone::Job();
+	dcObj->_job = job;
+	dcObj->_observer = new DefaultObserver(job);
 
 	return dcObj;
 }
@@ -56,9 +58,21 @@ dc_doclone *doclone_new() {
  */
 void doclone_destroy(dc_doclone *dc_obj) {
 	delete reinterpret_cast<DefaultObserver *>(dc_obj->_observer);
+	delete reinterpret_cast<Doclone::Job *>(dc_obj->_job);
 	delete dc_obj;
 }
 
+/**
+ * \brief Binds the job of [dc_obj] to the calling thread
+ *
+ * \return The Clone object of the job
+ */
+static Doclone::Clone *bindJob(const dc_doclone *dc_obj) {
+	reinterpret_cast<Doclone::Job *>(dc_obj->_job)->bind();
+
+	return Doclone::Clone::getInstance();
+}
+
 /**
  * \ingroup CWrapperAPI
  * \brief Creates an image of a device.
@@ -68,13 +82,17 @@ void doclone_destroy(dc_doclone *dc_obj) {
  * \return 0 if the process has success, -1 if any error happen
  */
 int doclone_create(const dc_doclone *dc_obj) {
-	Doclone::Clone *dcl = Doclone::Clone::getInstance();
+	Doclone::Clone *dcl = bindJob(dc_obj);
 
 	int retVal = 0;
 
 	try {
 		dcl->setImage(dc_obj->_image);
 		dcl->setDevice(dc_obj->_device);
+		dcl->setMemoryLimit(dc_obj->_memoryLimit);
+		dcl->setTrace(dc_obj->_trace);
+		dcl->setBase(dc_obj->_base);
+		dcl->setRepository(dc_obj->_repository);
 
 		dcl->create();
 	} catch(const Doclone::Exception &ex) {
@@ -82,6 +100,8 @@ int doclone_create(const dc_doclone *dc_obj) {
 		retVal = -1;
 	}
 
+	Doclone::Job::unbind();
+
 	return retVal;
 }
 
@@ -94,13 +114,18 @@ int doclone_create(const dc_doclone *dc_obj) {
  * \return 0 if the process has success, -1 if any error happen
  */
 int doclone_restore(const dc_doclone *dc_obj) {
-	Doclone::Clone *dcl = Doclone::Clone::getInstance();
+	Doclone::Clone *dcl = bindJob(dc_obj);
 
 	int retVal = 0;
 
 	try {
 		dcl->setImage(dc_obj->_image);
 		dcl->setDevice(dc_obj->_device);
+		dcl->setMemoryLimit(dc_obj->_memoryLimit);
+		dcl->setTrace(dc_obj->_trace);
+		dcl->setBase(dc_obj->_base);
+		dcl->setRepository(dc_obj->_repository);
+		dcl->setSync(dc_obj->_sync);
 
 		dcl->restore();
 	} catch(const Doclone::Exception &ex) {
@@ -108,6 +133,113 @@ int doclone_restore(const dc_doclone *dc_obj) {
 		retVal = -1;
 	}
 
+	Doclone::Job::unbind();
+
+	return retVal;
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Verifies the data of a device against the image it was restored from.
+ *
+ * Both image and device path must be set before calling this function.
+ *
+ * \return 0 if the data matches the image, -1 if any error happen
+ */
+int doclone_verify(const dc_doclone *dc_obj) {
+	Doclone::Clone *dcl = bindJob(dc_obj);
+
+	int retVal = 0;
+
+	try {
+		dcl->setImage(dc_obj->_image);
+		dcl->setDevice(dc_obj->_device);
+		dcl->setMemoryLimit(dc_obj->_memoryLimit);
+		dcl->setTrace(dc_obj->_trace);
+
+		dcl->verify();
+	} catch(const Doclone::Exception &ex) {
+		ex.logMsg();
+		retVal = -1;
+	}
+
+	Doclone::Job::unbind();
+
+	return retVal;
+}
+
+/**
+ * \brief Passes the target devices of [dc_obj] to the library
+ */
+static void setTargets(Doclone::Clone *dcl, const dc_doclone *dc_obj) {
+
+	dcl->setTarget(dc_obj->_targets[0]);
+	for(unsigned int i = 1; i < dc_obj->_targetsNumber; i++) {
+		dcl->addTarget(dc_obj->_targets[i]);
+	}
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Clones a device to one or more devices of the same machine.
+ *
+ * Both device and target paths must be set before calling this function.
+ *
+ * \return 0 if the process has success, -1 if any error happen
+ */
+int doclone_local_clone(const dc_doclone *dc_obj) {
+	Doclone::Clone *dcl = bindJob(dc_obj);
+
+	int retVal = 0;
+
+	try {
+		dcl->setDevice(dc_obj->_device);
+		setTargets(dcl, dc_obj);
+		dcl->setMemoryLimit(dc_obj->_memoryLimit);
+		dcl->setTrace(dc_obj->_trace);
+		dcl->setSync(dc_obj->_sync);
+
+		dcl->localClone();
+	} catch(const Doclone::Exception &ex) {
+		ex.logMsg();
+		retVal = -1;
+	}
+
+	Doclone::Job::unbind();
+
+	return retVal;
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Restores an image in many devices of the same machine at once.
+ *
+ * Both image and target paths must be set before calling this function.
+ *
+ * \return 0 if the process has success, -1 if any error happen
+ */
+int doclone_duplicate(const dc_doclone *dc_obj) {
+	Doclone::Clone *dcl = bindJob(dc_obj);
+
+	int retVal = 0;
+
+	try {
+		dcl->setImage(dc_obj->_image);
+		setTargets(dcl, dc_obj);
+		dcl->setMemoryLimit(dc_obj->_memoryLimit);
+		dcl->setTrace(dc_obj->_trace);
+		dcl->setBase(dc_obj->_base);
+		dcl->setRepository(dc_obj->_repository);
+		dcl->setSync(dc_obj->_sync);
+
+		dcl->duplicate();
+	} catch(const Doclone::Exception &ex) {
+		ex.logMsg();
+		retVal = -1;
+	}
+
+	Doclone::Job::unbind();
+
 	return retVal;
 }
 
@@ -116,20 +248,29 @@ int doclone_restore(const dc_doclone *dc_obj) {
  * \brief Sends an image or a device to the network.
  *
  * The number of receivers and either image or device path must be set
- * before calling this function.
+ * before calling this function. If the address is set, the data is sent to
+ * the collector of that address instead.
  *
  * \return 0 if the process has success, -1 if any error happen
  */
 int doclone_send(const dc_doclone *dc_obj) {
-	Doclone::Clone *dcl = Doclone::Clone::getInstance();
+	Doclone::Clone *dcl = bindJob(dc_obj);
 
 	int retVal = 0;
 
 	try {
 		dcl->setImage(dc_obj->_image);
 		dcl->setDevice(dc_obj->_device);
+		dcl->setMemoryLimit(dc_obj->_memoryLimit);
+		dcl->setTrace(dc_obj->_trace);
 
 		dcl->setNodesNumber(dc_obj->_nodesNumber);
+		dcl->setAddress(dc_obj->_address);
+		dcl->setRemoteImage(dc_obj->_remoteImage);
+		dcl->setQuorum(dc_obj->_quorum);
+		dcl->setStreams(dc_obj->_streams);
+		dcl->setSocketBuffer(dc_obj->_socketBuffer);
+		dcl->setZeroCopy(dc_obj->_zeroCopy);
 
 		dcl->send();
 	} catch(const Doclone::Exception &ex) {
@@ -137,6 +278,8 @@ int doclone_send(const dc_doclone *dc_obj) {
 		retVal = -1;
 	}
 
+	Doclone::Job::unbind();
+
 	return retVal;
 }
 
@@ -150,14 +293,19 @@ int doclone_send(const dc_doclone *dc_obj) {
  * \return 0 if the process has success, -1 if any error happen
  */
 int doclone_receive(const dc_doclone *dc_obj) {
-	Doclone::Clone *dcl = Doclone::Clone::getInstance();
+	Doclone::Clone *dcl = bindJob(dc_obj);
 
 	int retVal = 0;
 
 	try {
 		dcl->setImage(dc_obj->_image);
 		dcl->setDevice(dc_obj->_device);
+		dcl->setMemoryLimit(dc_obj->_memoryLimit);
+		dcl->setTrace(dc_obj->_trace);
 		dcl->setAddress(dc_obj->_address);
+		dcl->setSync(dc_obj->_sync);
+		dcl->setRemoteImage(dc_obj->_remoteImage);
+		dcl->setSocketBuffer(dc_obj->_socketBuffer);
 
 		dcl->receive();
 	} catch(const Doclone::Exception &ex) {
@@ -165,6 +313,73 @@ int doclone_receive(const dc_doclone *dc_obj) {
 		retVal = -1;
 	}
 
+	Doclone::Job::unbind();
+
+	return retVal;
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Serves the images of a directory to the network.
+ *
+ * The image path must be set to the directory before calling this function.
+ * If the number of nodes is set, it returns after attending that number of
+ * clients.
+ *
+ * \return 0 if the server finishes with success, -1 if any error happen
+ */
+int doclone_serve(const dc_doclone *dc_obj) {
+	Doclone::Clone *dcl = bindJob(dc_obj);
+
+	int retVal = 0;
+
+	try {
+		dcl->setImage(dc_obj->_image);
+		dcl->setMemoryLimit(dc_obj->_memoryLimit);
+		dcl->setTrace(dc_obj->_trace);
+		dcl->setNodesNumber(dc_obj->_nodesNumber);
+
+		dcl->serve();
+	} catch(const Doclone::Exception &ex) {
+		ex.logMsg();
+		retVal = -1;
+	}
+
+	Doclone::Job::unbind();
+
+	return retVal;
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Receives the images of many senders at the same time.
+ *
+ * The image path must be set to the directory where the images are written
+ * before calling this function. If the number of nodes is set, it returns
+ * after receiving that number of images.
+ *
+ * \return 0 if the collector finishes with success, -1 if any error happen
+ */
+int doclone_collect(const dc_doclone *dc_obj) {
+	Doclone::Clone *dcl = bindJob(dc_obj);
+
+	int retVal = 0;
+
+	try {
+		dcl->setImage(dc_obj->_image);
+		dcl->setMemoryLimit(dc_obj->_memoryLimit);
+		dcl->setTrace(dc_obj->_trace);
+		dcl->setNodesNumber(dc_obj->_nodesNumber);
+		dcl->setWriters(dc_obj->_writers);
+
+		dcl->collect();
+	} catch(const Doclone::Exception &ex) {
+		ex.logMsg();
+		retVal = -1;
+	}
+
+	Doclone::Job::unbind();
+
 	return retVal;
 }
 
@@ -177,13 +392,18 @@ int doclone_receive(const dc_doclone *dc_obj) {
  * \return 0 if the process has success, -1 if any error happen
  */
 int doclone_chain_origin(const dc_doclone *dc_obj) {
-	Doclone::Clone *dcl = Doclone::Clone::getInstance();
+	Doclone::Clone *dcl = bindJob(dc_obj);
 
 	int retVal = 0;
 
 	try {
 		dcl->setImage(dc_obj->_image);
 		dcl->setDevice(dc_obj->_device);
+		dcl->setMemoryLimit(dc_obj->_memoryLimit);
+		dcl->setTrace(dc_obj->_trace);
+		dcl->setStreams(dc_obj->_streams);
+		dcl->setSocketBuffer(dc_obj->_socketBuffer);
+		dcl->setZeroCopy(dc_obj->_zeroCopy);
 
 		dcl->chainOrigin();
 	} catch(const Doclone::Exception &ex) {
@@ -191,6 +411,8 @@ int doclone_chain_origin(const dc_doclone *dc_obj) {
 		retVal = -1;
 	}
 
+	Doclone::Job::unbind();
+
 	return retVal;
 }
 
@@ -203,13 +425,18 @@ int doclone_chain_origin(const dc_doclone *dc_obj) {
  * \return 0 if the process has success, -1 if any error happen
  */
 int doclone_chain_link(const dc_doclone *dc_obj) {
-	Doclone::Clone *dcl = Doclone::Clone::getInstance();
+	Doclone::Clone *dcl = bindJob(dc_obj);
 
 		int retVal = 0;
 
 		try {
 			dcl->setImage(dc_obj->_image);
 			dcl->setDevice(dc_obj->_device);
+			dcl->setMemoryLimit(dc_obj->_memoryLimit);
+			dcl->setTrace(dc_obj->_trace);
+			dcl->setSync(dc_obj->_sync);
+			dcl->setSocketBuffer(dc_obj->_socketBuffer);
+			dcl->setZeroCopy(dc_obj->_zeroCopy);
 
 			dcl->chainLink();
 		} catch(const Doclone::Exception &ex) {
@@ -217,6 +444,8 @@ int doclone_chain_link(const dc_doclone *dc_obj) {
 			retVal = -1;
 		}
 
+		Doclone::Job::unbind();
+
 		return retVal;
 }
 
@@ -329,6 +558,236 @@ void doclone_set_force(dc_doclone *dc_obj, unsigned short force) {
 	dc_obj->_force = force;
 }
 
+/**
+ * \ingroup CWrapperAPI
+ * \brief Sets the memory budget of the given dc_doclone object
+ *
+ * \param memoryLimit
+ * 		Budget in MiB, 0 for no limit
+ */
+void doclone_set_memory_limit(dc_doclone *dc_obj, unsigned int memoryLimit) {
+	dc_obj->_memoryLimit = memoryLimit;
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Sets the base image path of the given dc_doclone object
+ *
+ * Useful only to create or restore incremental images
+ */
+void doclone_set_base(dc_doclone *dc_obj, const char *base) {
+	snprintf(dc_obj->_base, sizeof(dc_obj->_base), "%s", base);
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Sets the repository path of the given dc_doclone object
+ *
+ * Useful only to create or restore images with their data in a repository
+ */
+void doclone_set_repository(dc_doclone *dc_obj, const char *repository) {
+	snprintf(dc_obj->_repository, sizeof(dc_obj->_repository), "%s",
+			repository);
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Sets the sync flag of the given dc_doclone object
+ *
+ * Useful only to restore or receive an image, or to clone a device locally
+ */
+void doclone_set_sync(dc_doclone *dc_obj, unsigned short sync) {
+	dc_obj->_sync = sync;
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Sets the only target device path of the given dc_doclone object
+ *
+ * Useful only to clone a device or an image locally
+ */
+void doclone_set_target(dc_doclone *dc_obj, const char *target) {
+	snprintf(dc_obj->_targets[0], sizeof(dc_obj->_targets[0]), "%s", target);
+	dc_obj->_targetsNumber = 1;
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Adds a target device path to the given dc_doclone object
+ *
+ * Useful only to clone a device or an image locally. Up to DC_MAX_TARGETS
+ * devices can be added, the next ones are ignored.
+ */
+void doclone_add_target(dc_doclone *dc_obj, const char *target) {
+	if(dc_obj->_targetsNumber < DC_MAX_TARGETS) {
+		snprintf(dc_obj->_targets[dc_obj->_targetsNumber],
+				sizeof(dc_obj->_targets[0]), "%s", target);
+		dc_obj->_targetsNumber++;
+	}
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Sets the image requested to an image server by the given dc_doclone
+ * object
+ *
+ * Useful only to receive from an image server, see doclone_serve(), or to
+ * name the image sent to a collector, see doclone_collect()
+ */
+void doclone_set_remote_image(dc_doclone *dc_obj, const char *remoteImage) {
+	snprintf(dc_obj->_remoteImage, sizeof(dc_obj->_remoteImage), "%s",
+			remoteImage);
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Sets the number of images written at the same time by the given
+ * dc_doclone object
+ *
+ * Useful only to collect images, see doclone_collect()
+ */
+void doclone_set_writers(dc_doclone *dc_obj, unsigned int writers) {
+	dc_obj->_writers = writers;
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Sets the number of receivers the given dc_doclone object waits for
+ * before sending
+ *
+ * Useful only to send to many receivers, see doclone_send()
+ */
+void doclone_set_quorum(dc_doclone *dc_obj, unsigned int quorum) {
+	dc_obj->_quorum = quorum;
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Sets the number of TCP connections the given dc_doclone object sends
+ * the data on to each receiver
+ *
+ * Useful only to send to the network, see doclone_send() and
+ * doclone_chain_origin()
+ */
+void doclone_set_streams(dc_doclone *dc_obj, unsigned int streams) {
+	dc_obj->_streams = streams;
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Sets the size, in KiB, of the buffers of the sockets the given
+ * dc_doclone object transfers data on
+ *
+ * Useful only to work over the network
+ */
+void doclone_set_socket_buffer(dc_doclone *dc_obj,
+		unsigned int socketBuffer) {
+	dc_obj->_socketBuffer = socketBuffer;
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Sets the zero-copy flag of the given dc_doclone object
+ *
+ * Useful only to send a device to the network, see doclone_send(),
+ * doclone_chain_origin() and doclone_chain_link()
+ */
+void doclone_set_zero_copy(dc_doclone *dc_obj, unsigned short zeroCopy) {
+	dc_obj->_zeroCopy = zeroCopy;
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Sets the file the given dc_doclone object writes a timeline of its
+ * operations in
+ *
+ * The file can be opened with chrome://tracing or Perfetto. An empty path
+ * disables the trace.
+ */
+void doclone_set_trace(dc_doclone *dc_obj, const char *trace) {
+	snprintf(dc_obj->_trace, sizeof(dc_obj->_trace), "%s", trace);
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Sets how many transfer events per second the callbacks get
+ *
+ * It applies to all the dc_doclone objects.
+ *
+ * \param eventRate
+ * 		Events per second, 0 for no limit
+ */
+void doclone_set_event_rate(unsigned int eventRate) {
+	Doclone::Clone *dcl = Doclone::Clone::getInstance();
+
+	dcl->setEventRate(eventRate);
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Gets the peak memory used by the process until now
+ *
+ * \return Peak resident set size in bytes
+ */
+uint64_t doclone_get_peak_memory() {
+	Doclone::Clone *dcl = Doclone::Clone::getInstance();
+
+	return dcl->getPeakMemory();
+}
+
+/**
+ * \ingroup CWrapperAPI
+ * \brief Gets the progress of the job of the given dc_doclone object
+ *
+ * It can be called from any thread, while the job runs in another one, see
+ * Doclone::Stats.
+ *
+ * \param [out] stats
+ * 		The progress of the job
+ *
+ * \return 0, or -1 if an argument is NULL
+ */
+int doclone_get_stats(const dc_doclone *dc_obj, dc_stats *stats) {
+	if(dc_obj == 0 || stats == 0) {
+		return -1;
+	}
+
+	Doclone::Job *job = reinterpret_cast<Doclone::Job *>(dc_obj->_job);
+
+	Doclone::dcStats snapshot;
+	job->getStats()->getSnapshot(snapshot);
+
+	memset(stats, 0, sizeof(*stats));
+	stats->totalSize = snapshot.totalSize;
+	stats->transferredBytes = snapshot.transferredBytes;
+	stats->elapsed = snapshot.elapsed;
+	stats->rate = snapshot.rate;
+	stats->averageRate = snapshot.averageRate;
+	stats->eta = snapshot.eta;
+	stats->finished = snapshot.finished;
+
+	for(unsigned int i = 0; i < DC_STATS_STAGES; i++) {
+		stats->stages[i].bytes = snapshot.stages[i].bytes;
+		stats->stages[i].seconds = snapshot.stages[i].seconds;
+		stats->stages[i].calls = snapshot.stages[i].calls;
+	}
+
+	for(unsigned int i = 0; i < snapshot.receivers.size()
+			&& i < DC_STATS_MAX_RECEIVERS; i++) {
+		const Doclone::dcReceiverStats &receiver = snapshot.receivers[i];
+
+		strncpy(stats->receivers[i].address, receiver.address.c_str(),
+				sizeof(stats->receivers[i].address) - 1);
+		stats->receivers[i].bytes = receiver.bytes;
+		stats->receivers[i].rate = receiver.rate;
+		stats->receivers[i].averageRate = receiver.averageRate;
+		stats->receivers[i].connected = receiver.connected;
+		stats->receiversNumber++;
+	}
+
+	return 0;
+}
+
 /*
  * C wrapper for callback functions
  */
@@ -338,17 +797,27 @@ void doclone_set_force(dc_doclone *dc_obj, unsigned short force) {
  * \brief Initializes the attributes and subscribes itself for all the libdoclone
  * events
  */
-DefaultObserver::DefaultObserver(): _tCallback(), _oCallback(), _gCallback(),
-		_nCallback() {
+DefaultObserver::DefaultObserver(Doclone::Job *job): _tCallback(),
+		_oCallback(), _gCallback(), _nCallback(), _job(job) {
 	// We subscribe to all subjects
-	Doclone::Clone *dcl = Doclone::Clone::getInstance();
-	Doclone::DataTransfer *trans = Doclone::DataTransfer::getInstance();
+	Doclone::Clone *dcl = job->getClone();
+	Doclone::DataTransfer *trans = job->getDataTransfer();
 	Doclone::Logger *log = Doclone::Logger::getInstance();
 	trans->addObserver(this);
 	dcl->addObserver(this);
 	log->addObserver(this);
 }
 
+/**
+ * \ingroup CWrapperAPI
+ * \brief Unsubscribes itself from all the libdoclone events
+ */
+DefaultObserver::~DefaultObserver() {
+	this->_job->getDataTransfer()->removeObserver(this);
+	this->_job->getClone()->removeObserver(this);
+	Doclone::Logger::getInstance()->removeObserver(this);
+}
+
 /**
  * \ingroup CWrapperAPI
  * \brief Listens the transfer events and calls the user-defined C callback
@@ -397,6 +866,21 @@ void DefaultObserver::notify(const std::string &str) {
 	}
 }
 
+/**
+ * \ingroup CWrapperAPI
+ * \brief Listens the exception messages of the job of this observer
+ *
+ * The Logger is shared by all the jobs, and the messages are delivered in the
+ * thread of the Notifier, so the job is the one that raised each message.
+ */
+void DefaultObserver::notify(const std::string &str, Doclone::Job *job) {
+	if(job != this->_job) {
+		return;
+	}
+
+	this->notify(str);
+}
+
 /*
  * Setters for the callback functions
  */
@@ -39,7 +39,9 @@ XERCES_CPP_NAMESPACE_USE
  * Initializes the attributtes
  */
 XMLStringHandler::XMLStringHandler() throw(Exception):
-		_listXmlchData(), _listXmlByteData(), _listCStrings() {
+		_listXmlchData(), _listXmlByteData(), _listCStrings(), _listsMutex() {
+	pthread_mutex_init(&this->_listsMutex, 0);
+
 	// Initialize the XML4C2 system.
 	try {
 		XMLPlatformUtils::Initialize();
@@ -77,6 +79,8 @@ XMLStringHandler::~XMLStringHandler() {
 	}
 	this->_listCStrings.clear();
 
+	pthread_mutex_destroy(&this->_listsMutex);
+
 	//Release the XML4C2 system.
 	XMLPlatformUtils::Terminate();
 }
@@ -110,7 +114,10 @@ const XMLCh *XMLStringHandler::toXMLText(const char *c_str) {
 	log->debug("XMLDocument::toXMLText(c_str=>%s) start", c_str);
 
 	XMLCh *retVal = XMLString::transcode(c_str);
+
+	pthread_mutex_lock(&this->_listsMutex);
 	this->_listXmlchData.push_back(retVal);
+	pthread_mutex_unlock(&this->_listsMutex);
 
 	log->debug("XMLDocument::toXMLText(retVal=>0x%x) end", retVal);
 	return retVal;
@@ -133,7 +140,10 @@ const char *XMLStringHandler::toCString(const XMLCh *xmlch) {
 	char *retVal = new char[size+1];
 	memset(retVal, 0, size+1);
 	this->byteArrayToCString(data, retVal, size);
+
+	pthread_mutex_lock(&this->_listsMutex);
 	this->_listCStrings.push_back(retVal);
+	pthread_mutex_unlock(&this->_listsMutex);
 
 	log->debug("XMLDocument::toCString(retVal=>%s) end", retVal);
 	return retVal;
@@ -153,7 +163,9 @@ const XMLByte *XMLStringHandler::toXMLByteArray(const uint8_t *data, bool adopt)
 
 	const XMLByte *retVal = reinterpret_cast<const XMLByte *>(data);
 	if(adopt){
+		pthread_mutex_lock(&this->_listsMutex);
 		this->_listXmlByteData.push_back(data);
+		pthread_mutex_unlock(&this->_listsMutex);
 	}
 
 	log->debug("XMLDocument::toXMLByteArray(retVal=>0x%x) end", retVal);
@@ -174,7 +186,9 @@ const uint8_t *XMLStringHandler::toBinaryArray(const XMLByte *xmlbyte, bool adop
 
 	const uint8_t *retVal = reinterpret_cast<const uint8_t *>(xmlbyte);
 	if(adopt) {
+		pthread_mutex_lock(&this->_listsMutex);
 		this->_listXmlByteData.push_back(retVal);
+		pthread_mutex_unlock(&this->_listsMutex);
 	}
 
 	log->debug("XMLDocument::toCString(retVal=>%s) end", retVal);
@@ -24,6 +24,7 @@
 #include <math.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/time.h>
 
 #include <iostream>
 
@@ -157,6 +158,12 @@ void ConsoleView::notify(Doclone::dcOperationEvent event,
 
 		break;
 	}
+	case Doclone::OP_VERIFY_DATA: {
+		// TO TRANSLATORS: looks like Data verified on /dev/sdb
+		std::cout << _("Data verified on") << " " << target << std::endl;
+
+		break;
+	}
 	default: {
 		return;
 		break;
@@ -203,16 +210,24 @@ void ConsoleView::initView(int argc, char **argv) const {
 	std::string device="";
 	std::string address="";
 	std::string interface="";
+	std::string target="";
+	std::string statsPath="";
 	int nodesNumber = 0;
+	int memoryLimit = 0;
 
-	const char options_c[] = "hvcrSRsld:f:a:i:n:eF";
+	const char options_c[] = "hvcrVCDSRLksld:f:a:i:n:eFm:b:p:yt:I:w:q:P:B:Zj:E:T:";
 	const struct option options_l[] = {
 		{"help", 0, 0, 'h'},
 		{"version", 0, 0, 'v'},
 		{"create", 0, 0, 'c'},
 		{"restore", 0, 0, 'r'},
+		{"verify", 0, 0, 'V'},
+		{"clone", 0, 0, 'C'},
+		{"duplicate", 0, 0, 'D'},
 		{"send", 0, 0, 'S'},
 		{"receive", 0, 0, 'R'},
+		{"serve", 0, 0, 'L'},
+		{"collect", 0, 0, 'k'},
 		{"link-send", 0, 0, 's'},
 		{"link-receive", 0, 0, 'l'},
 		{"device", 1, 0, 'd'},
@@ -222,6 +237,20 @@ void ConsoleView::initView(int argc, char **argv) const {
 		{"nodes", 1, 0, 'n'},
 		{"empty", 0, 0, 'e'},
 		{"force", 0, 0, 'F'},
+		{"memory-limit", 1, 0, 'm'},
+		{"base", 1, 0, 'b'},
+		{"repository", 1, 0, 'p'},
+		{"sync", 0, 0, 'y'},
+		{"target", 1, 0, 't'},
+		{"remote-image", 1, 0, 'I'},
+		{"writers", 1, 0, 'w'},
+		{"quorum", 1, 0, 'q'},
+		{"streams", 1, 0, 'P'},
+		{"socket-buffer", 1, 0, 'B'},
+		{"zero-copy", 0, 0, 'Z'},
+		{"stats", 1, 0, 'j'},
+		{"event-rate", 1, 0, 'E'},
+		{"trace", 1, 0, 'T'},
 		{0, 0, 0, 0}
 	};
 
@@ -250,6 +279,24 @@ void ConsoleView::initView(int argc, char **argv) const {
 			function = CONSOLE_RESTORE;
 			break;
 		}
+		case 'V': {
+			if (function != CONSOLE_NONE)
+				usage (stderr, 1, cmd);
+			function = CONSOLE_VERIFY;
+			break;
+		}
+		case 'C': {
+			if (function != CONSOLE_NONE)
+				usage (stderr, 1, cmd);
+			function = CONSOLE_LOCAL_CLONE;
+			break;
+		}
+		case 'D': {
+			if (function != CONSOLE_NONE)
+				usage (stderr, 1, cmd);
+			function = CONSOLE_DUPLICATE;
+			break;
+		}
 		case 'S': {
 			if (function != CONSOLE_NONE)
 				usage (stderr, 1, cmd);
@@ -262,6 +309,18 @@ void ConsoleView::initView(int argc, char **argv) const {
 			function = CONSOLE_RECEIVE;
 			break;
 		}
+		case 'L': {
+			if (function != CONSOLE_NONE)
+				usage (stderr, 1, cmd);
+			function = CONSOLE_SERVE;
+			break;
+		}
+		case 'k': {
+			if (function != CONSOLE_NONE)
+				usage (stderr, 1, cmd);
+			function = CONSOLE_COLLECT;
+			break;
+		}
 		case 's': {
 			if (function != CONSOLE_NONE)
 				usage (stderr, 1, cmd);
@@ -316,6 +375,68 @@ void ConsoleView::initView(int argc, char **argv) const {
 			dcl->setForce(true);
 			break;
 		}
+		case 'm': {
+			memoryLimit = atoi (optarg);
+			if(memoryLimit <= 0) {
+				usage (stderr, 1, cmd);
+			}
+
+			dcl->setMemoryLimit(memoryLimit);
+			break;
+		}
+		case 'b': {
+			dcl->setBase(optarg);
+			break;
+		}
+		case 'p': {
+			dcl->setRepository(optarg);
+			break;
+		}
+		case 'y': {
+			dcl->setSync(true);
+			break;
+		}
+		case 't': {
+			target = optarg;
+			dcl->addTarget(target);
+			break;
+		}
+		case 'I': {
+			dcl->setRemoteImage(optarg);
+			break;
+		}
+		case 'w': {
+			dcl->setWriters(atoi(optarg));
+			break;
+		}
+		case 'q': {
+			dcl->setQuorum(atoi(optarg));
+			break;
+		}
+		case 'P': {
+			dcl->setStreams(atoi(optarg));
+			break;
+		}
+		case 'B': {
+			dcl->setSocketBuffer(atoi(optarg));
+			break;
+		}
+		case 'Z': {
+			dcl->setZeroCopy(true);
+			break;
+		}
+		case 'j': {
+			statsPath = optarg;
+			break;
+		}
+		case 'E': {
+			dcl->setEventRate(atoi(optarg));
+			break;
+		}
+		case 'T': {
+			dcl->setTrace(optarg);
+			break;
+		}
 		case -1:
 			break;
 		case '?':
@@ -327,9 +448,31 @@ void ConsoleView::initView(int argc, char **argv) const {
 	}
 	while (option != -1);
 
+	// The stats are written by another thread while the job runs
+	dcStatsEmitter emitter;
+	pthread_t emitterThread;
+	bool statsStarted = false;
+
+	if(!statsPath.empty()) {
+		emitter.file = statsPath == "-" ? stdout
+				: fopen(statsPath.c_str(), "w");
+		emitter.job = Doclone::Job::getCurrent();
+		emitter.stop = false;
+
+		if(emitter.file == 0) {
+			perror(statsPath.c_str());
+			exit(1);
+		}
+
+		pthread_mutex_init(&emitter.mutex, 0);
+		pthread_cond_init(&emitter.cond, 0);
+		statsStarted = (pthread_create(&emitterThread, 0,
+				ConsoleView::statsThread, &emitter) == 0);
+	}
+
 	try {
 		switch (function) {
-		/* local working functions - create/restore */
+		/* local working functions - create/restore/verify/clone */
 		case CONSOLE_CREATE: {
 			if(image.empty() || device.empty()) {
 				usage(stderr, 1, cmd);
@@ -350,6 +493,36 @@ void ConsoleView::initView(int argc, char **argv) const {
 
 			break;
 		}
+		case CONSOLE_VERIFY: {
+			if(image.empty() || device.empty()) {
+				usage(stderr, 1, cmd);
+				break;
+			}
+
+			dcl->verify();
+
+			break;
+		}
+		case CONSOLE_LOCAL_CLONE: {
+			if(device.empty() || target.empty()) {
+				usage(stderr, 1, cmd);
+				break;
+			}
+
+			dcl->localClone();
+
+			break;
+		}
+		case CONSOLE_DUPLICATE: {
+			if(image.empty() || target.empty()) {
+				usage(stderr, 1, cmd);
+				break;
+			}
+
+			dcl->duplicate();
+
+			break;
+		}
 		/* network functions - unicast/multicast */
 		case CONSOLE_SEND: {
 			if((image.empty() && device.empty())) {
@@ -371,6 +544,26 @@ void ConsoleView::initView(int argc, char **argv) const {
 
 			break;
 		}
+		case CONSOLE_SERVE: {
+			if(image.empty()) {
+				usage(stderr, 1, cmd);
+				break;
+			}
+
+			dcl->serve();
+
+			break;
+		}
+		case CONSOLE_COLLECT: {
+			if(image.empty()) {
+				usage(stderr, 1, cmd);
+				break;
+			}
+
+			dcl->collect();
+
+			break;
+		}
 		/* network functions - link mode */
 		case CONSOLE_LINK_SEND: {
 			if(image.empty() && device.empty()) {
@@ -397,13 +590,138 @@ void ConsoleView::initView(int argc, char **argv) const {
 			break;
 		}
 		}
+
+		if(memoryLimit > 0) {
+			// TO TRANSLATORS: looks like	Peak memory usage: 182 MiB
+			std::cout << _("Peak memory usage:") << " "
+					<< dcl->getPeakMemory() / Doclone::MIB << " MiB" << std::endl;
+		}
 	} catch(const Doclone::Exception &ex) {
 		ex.logMsg();
 	}
 
+	if(!statsPath.empty()) {
+		if(statsStarted) {
+			pthread_mutex_lock(&emitter.mutex);
+			emitter.stop = true;
+			pthread_cond_signal(&emitter.cond);
+			pthread_mutex_unlock(&emitter.mutex);
+
+			pthread_join(emitterThread, 0);
+		}
+
+		// The last line has the totals of the job
+		Doclone::dcStats stats;
+		emitter.job->getStats()->getSnapshot(stats);
+		writeStats(emitter.file, stats);
+
+		if(emitter.file != stdout) {
+			fclose(emitter.file);
+		}
+
+		pthread_cond_destroy(&emitter.cond);
+		pthread_mutex_destroy(&emitter.mutex);
+	}
+
 	return;
 }
 
+/**
+ * Writes the stats of the job every STATS_INTERVAL seconds, until it's
+ * stopped
+ *
+ * \param arg
+ * 		Pointer to the dcStatsEmitter
+ */
+void *ConsoleView::statsThread(void *arg) {
+	dcStatsEmitter *emitter = static_cast<dcStatsEmitter *>(arg);
+
+	pthread_mutex_lock(&emitter->mutex);
+
+	while(!emitter->stop) {
+		struct timeval now;
+		gettimeofday(&now, 0);
+
+		struct timespec timeout;
+		timeout.tv_sec = now.tv_sec + STATS_INTERVAL;
+		timeout.tv_nsec = now.tv_usec * 1000;
+
+		while(!emitter->stop && pthread_cond_timedwait(&emitter->cond,
+				&emitter->mutex, &timeout) == 0) {
+		}
+
+		if(emitter->stop) {
+			break;
+		}
+
+		pthread_mutex_unlock(&emitter->mutex);
+
+		Doclone::dcStats stats;
+		emitter->job->getStats()->getSnapshot(stats);
+		writeStats(emitter->file, stats);
+
+		pthread_mutex_lock(&emitter->mutex);
+	}
+
+	pthread_mutex_unlock(&emitter->mutex);
+
+	return 0;
+}
+
+/**
+ * Writes the stats of the job as a line of JSON
+ *
+ * \param file
+ * 		File the line is written to
+ * \param stats
+ * 		The stats
+ */
+void ConsoleView::writeStats(FILE *file, const Doclone::dcStats &stats) {
+	static const char *stageNames[Doclone::STATS_STAGES] = {
+		"walk", "read", "compress", "send", "receive", "extract", "fsync"
+	};
+
+	fprintf(file, "{\"elapsed\":%.3f,\"total_size\":%llu,"
+			"\"transferred_bytes\":%llu,\"rate\":%.0f,\"average_rate\":%.0f,",
+			stats.elapsed, static_cast<unsigned long long>(stats.totalSize),
+			static_cast<unsigned long long>(stats.transferredBytes),
+			stats.rate, stats.averageRate);
+
+	if(stats.eta < 0) {
+		fprintf(file, "\"eta\":null,");
+	} else {
+		fprintf(file, "\"eta\":%.1f,", stats.eta);
+	}
+
+	fprintf(file, "\"finished\":%s,\"stages\":{",
+			stats.finished ? "true" : "false");
+
+	for(unsigned int i = 0; i < Doclone::STATS_STAGES; i++) {
+		fprintf(file, "%s\"%s\":{\"bytes\":%llu,\"seconds\":%.3f,"
+				"\"calls\":%llu}", i > 0 ? "," : "", stageNames[i],
+				static_cast<unsigned long long>(stats.stages[i].bytes),
+				stats.stages[i].seconds,
+				static_cast<unsigned long long>(stats.stages[i].calls));
+	}
+
+	fprintf(file, "},\"receivers\":[");
+
+	for(unsigned int i = 0; i < stats.receivers.size(); i++) {
+		const Doclone::dcReceiverStats &receiver = stats.receivers[i];
+
+		// The addresses are numeric, they need no escaping
+		fprintf(file, "%s{\"address\":\"%s\",\"bytes\":%llu,\"rate\":%.0f,"
+				"\"average_rate\":%.0f,\"connected\":%s}", i > 0 ? "," : "",
+				receiver.address.c_str(),
+				static_cast<unsigned long long>(receiver.bytes),
+				receiver.rate, receiver.averageRate,
+				receiver.connected ? "true" : "false");
+	}
+
+	fprintf(file, "]}\n");
+	fflush(file);
+}
+
 /**
  * Shows the program help dialog
  *
@@ -420,24 +738,78 @@ void ConsoleView::usage (FILE * stream, int code, const char * cmd) const {
 			"\t[ -a, --address SERVER-IP-ADDRESS ]"
 			" [ -n, --nodes NUMBER ]\n"
 			"\t[ -i, --interface IP-OF-WORKING-INTERFACE]\n"
-			"\t[ -e, --empty ] [ -F, --force]\n "), cmd);
+			"\t[ -e, --empty ] [ -F, --force]\n"
+			"\t[ -m, --memory-limit MIB ] [ -b, --base FILE ]\n"
+			"\t[ -p, --repository DIR ] [ -y, --sync ]\n"
+			"\t[ -t, --target DEVICE ] [ -I, --remote-image NAME ]\n"
+			"\t[ -w, --writers NUMBER ] [ -q, --quorum NUMBER ]\n"
+			"\t[ -P, --streams NUMBER ] [ -B, --socket-buffer KIB ]\n"
+			"\t[ -Z, --zero-copy ] [ -j, --stats FILE ]\n"
+			"\t[ -E, --event-rate NUMBER ] [ -T, --trace FILE ]\n "), cmd);
 
 	fprintf (stream,
 			_("\nFUNCTION is made up of one of these specifications:\n"
 					"\tFor local work: (All these options imply -d and -f)\n"
 					"\t-c, --create\t\tCreates a doclone image.\n"
 					"\t-r, --restore\t\tRestores a doclone image.\n"
+					"\t-V, --verify\t\tVerifies a device against an image.\n"
+					"\t-b, --base\t\tFull image an incremental image is\n"
+					"\t\t\t\tcreated from or restored with.\n"
+					"\t-p, --repository\tDirectory where the data of the\n"
+					"\t\t\t\timages is deduplicated.\n"
+					"\t-y, --sync\t\tRestores only the changes into the\n"
+					"\t\t\t\tfilesystems of the device.\n"
+					"\n\tFor local clones: (These options imply -t)\n"
+					"\t-C, --clone\t\tClones the device in other ones.\n"
+					"\t\t\t\t(This function implies -d).\n"
+					"\t-D, --duplicate\t\tRestores an image in many devices\n"
+					"\t\t\t\tat once. (This function implies -f).\n"
+					"\t-t, --target\t\tDevice the device or image is\n"
+					"\t\t\t\tcloned to. Can be given many times.\n"
 					"\n\tFor work over the network: "
 					"(All these options imply -d or -f)\n"
 					"\tUnicast/Multicast:\n"
 					"\t-S, --send\t\tSends server's data to receivers.\n"
 					"\t\t\t\t(This function implies -n).\n"
+					"\t-q, --quorum\t\tReceivers -S waits for before\n"
+					"\t\t\t\tsending. The other ones join later.\n"
 					"\t-R, --receive\t\tReceives data from the server.\n"
 					"\t\t\t\t(This option implies -a).\n"
+					"\t-L, --serve\t\tServes the images of the directory\n"
+					"\t\t\t\tgiven with -f to any client.\n"
+					"\t-I, --remote-image\tImage requested to the server\n"
+					"\t\t\t\tof -L with -R, or name of the\n"
+					"\t\t\t\timage sent to -k.\n"
+					"\t-k, --collect\t\tReceives the images of many senders\n"
+					"\t\t\t\tin the directory given with -f.\n"
+					"\t\t\t\tThe senders use -S with -a.\n"
+					"\t-w, --writers\t\tImages written at the same time\n"
+					"\t\t\t\tby -k.\n"
 					"\n"
 					"\tLink mode:\n"
 					"\t-s, --link-send\t\tSends data to the network.\n"
-					"\t-l, --link-receive\tReceives data from the network.\n"));
+					"\t-l, --link-receive\tReceives data from the network.\n"
+					"\n"
+					"\tTCP:\n"
+					"\t-P, --streams\t\tConnections -S and -s send the data\n"
+					"\t\t\t\ton to each receiver.\n"
+					"\t-B, --socket-buffer\tSize of the buffers of the\n"
+					"\t\t\t\tsockets, in KiB.\n"
+					"\t-Z, --zero-copy\t\tSends the data of a device, or\n"
+					"\t\t\t\trelays it in the link mode, without\n"
+					"\t\t\t\tcopying it to the kernel.\n"));
+	fprintf (stream,
+			_("\n\tMemory:\n"
+					"\t-m, --memory-limit\tMemory budget of the job, in MiB.\n"));
+	fprintf (stream,
+			_("\n\tStatistics:\n"
+					"\t-j, --stats\t\tWrites the progress of the job every\n"
+					"\t\t\t\tsecond in FILE, as lines of JSON.\n"
+					"\t\t\t\t- is the standard output.\n"
+					"\t-E, --event-rate\tUpdates of the progress shown per\n"
+					"\t\t\t\tsecond, 0 for no limit.\n"
+					"\t-T, --trace\t\tWrites a timeline of the job in FILE,\n"
+					"\t\t\t\tfor chrome://tracing or Perfetto.\n"));
 	fprintf (stream,
 			_("\n\tOthers:\n" "\t-h, --help\t\tShow this help.\n"
 					"\t-v, --version\t\tShow doclone version.\n"));